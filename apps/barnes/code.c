@@ -19,6 +19,17 @@ Usage: BARNES <options> < inputfile
 Command line options:
 
     -h : Print out input file description
+    -s : Evaluate each interaction as the tree walk finds it, rather
+         than gathering them on lists for the vector force kernels
+    -g : Walk the tree once for the bodies of each leaf, opening cells
+         for the nearest point of a sphere around them, and evaluate
+         one shared interaction list for all of them (not with -s)
+    -l : Build the tree by inserting bodies one at a time under cell
+         locks, rather than from bodies sorted on their Morton keys
+    -c : Check the list forces against the scalar ones and print the
+         largest relative difference.  Use one processor: with more,
+         bodies that others have already advanced move between the two
+         evaluations.
 
     Input parameters should be placed in a file and redirected through
     standard input.  There are a total of twelve parameters, and all of
@@ -246,14 +257,26 @@ int main (int argc, char *argv[])
 {
    long c;
 
-   while ((c = getopt(argc, argv, "h")) != -1) {
+   while ((c = getopt(argc, argv, "hscgl")) != -1) {
      switch(c) {
       case 'h':
 	Help();
 	exit(-1);
 	break;
+      case 's':
+	scalarforce = TRUE;
+	break;
+      case 'c':
+	checkforce = TRUE;
+	break;
+      case 'g':
+	groupforce = TRUE;
+	break;
+      case 'l':
+	locktree = TRUE;
+	break;
       default:
-	fprintf(stderr, "Only valid option is \"-h\".\n");
+	fprintf(stderr, "Valid options are \"-h\", \"-s\", \"-g\", \"-l\" and \"-c\".\n");
 	exit(-1);
 	break;
      }
@@ -263,6 +286,15 @@ int main (int argc, char *argv[])
    initparam(defv);
    startrun();
    initoutput();
+   ForceInit();
+   if (scalarforce) {
+      groupforce = FALSE;
+   }
+   printf("Force evaluation: %s%s\n",
+	  scalarforce ? "scalar walk" : ForceKernelName(),
+	  groupforce ? ", one walk per leaf" : "");
+   printf("Tree build: %s\n\n",
+	  locktree ? "insertion under cell locks" : "sorted Morton keys");
    tab_init();
 
    Global->tracktime = 0;
@@ -358,6 +390,17 @@ int main (int argc, char *argv[])
 	  ((float)(Global->tracktime-Global->partitiontime-
 		   Global->treebuildtime-Global->forcecalctime))/
 	  Global->tracktime);
+   if (checkforce) {
+      real err = 0.0;
+      unsigned long i;
+
+      for (i = 0; i < NPROC; i++) {
+	 if (Local[i].myforceerr > err) {
+	    err = Local[i].myforceerr;
+	 }
+      }
+      printf("FORCEERROR    = %12.3e\n", err);
+   }
    {exit(0);};
 }
 
@@ -479,6 +522,7 @@ void tab_init()
    maxmyleaf = maxleaf / NPROC;
    Local[0].mycelltab = (cellptr*) valloc(NPROC*maxmycell*sizeof(cellptr));;
    Local[0].myleaftab = (leafptr*) valloc(NPROC*maxmyleaf*sizeof(leafptr));;
+   inittree();
 
    CellLock = (struct CellLockType *) valloc(sizeof(struct CellLockType));;
    {
@@ -879,7 +923,63 @@ void stepsystem(long ProcessId)
     Local[ProcessId].mynbody = 0;
     find_my_bodies(Global->G_root, 0, BRC_FUC, ProcessId );
 
-/*     B*RRIER(Global->Barcom,NPROC); */
+    /* bar needed to make sure that every process has read the costs of */
+    /* its bodies in find_my_bodies() before any of them computes new   */
+    /* ones in ComputeForces(), or a body on the boundary between two   */
+    /* processors' zones may be taken by both or by neither             */
+    {
+
+	unsigned long	Error, Cycle;
+
+	int		Cancel, Temp;
+
+
+
+	Error = pthread_mutex_lock(&(Global->Barrier).mutex);
+
+	if (Error != 0) {
+
+		printf("Error while trying to get lock in barrier.\n");
+
+		exit(-1);
+
+	}
+
+
+
+	Cycle = (Global->Barrier).cycle;
+
+	if (++(Global->Barrier).counter != (NPROC)) {
+
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &Cancel);
+
+		while (Cycle == (Global->Barrier).cycle) {
+
+			Error = pthread_cond_wait(&(Global->Barrier).cv, &(Global->Barrier).mutex);
+
+			if (Error != 0) {
+
+				break;
+
+			}
+
+		}
+
+		pthread_setcancelstate(Cancel, &Temp);
+
+	} else {
+
+		(Global->Barrier).cycle = !(Global->Barrier).cycle;
+
+		(Global->Barrier).counter = 0;
+
+		Error = pthread_cond_broadcast(&(Global->Barrier).cv);
+
+	}
+
+	pthread_mutex_unlock(&(Global->Barrier).mutex);
+
+};
     if ((ProcessId == 0) && (Local[ProcessId].nstep >= 2)) {
         {
 
@@ -1048,25 +1148,44 @@ void stepsystem(long ProcessId)
 
 void ComputeForces(long ProcessId)
 {
-   bodyptr p,*pp;
-   vector acc1, dacc, dvel;
-
-   for (pp = Local[ProcessId].mybodytab;
-	pp < Local[ProcessId].mybodytab+Local[ProcessId].mynbody;pp++) {
-      p = *pp;
-      SETV(acc1, Acc(p));
-      Cost(p)=0;
-      hackgrav(p,ProcessId);
-      Local[ProcessId].myn2bcalc += Local[ProcessId].myn2bterm;
-      Local[ProcessId].mynbccalc += Local[ProcessId].mynbcterm;
-      if (!Local[ProcessId].skipself) {       /*   did we miss self-int?  */
-	 Local[ProcessId].myselfint++;        /*   count another goofup   */
+   bodyptr p,*pp,*end;
+   vector acc1[MAX_BODIES_PER_LEAF], dacc, dvel;
+   long i, n;
+
+   end = Local[ProcessId].mybodytab + Local[ProcessId].mynbody;
+   for (pp = Local[ProcessId].mybodytab; pp < end; pp += n) {
+      /* with groupforce, my bodies of one leaf, which find_my_bodies()
+	 has put next to each other */
+      n = 1;
+      if (groupforce) {
+	 while (pp+n < end && Parent(pp[n]) == Parent(*pp)) {
+	    n++;
+	 }
+      }
+      for (i = 0; i < n; i++) {
+	 SETV(acc1[i], Acc(pp[i]));
+	 Cost(pp[i])=0;
+      }
+      if (groupforce) {
+	 hackgroup(pp, n, ProcessId);
+      }
+      else {
+	 p = *pp;
+	 hackgrav(p,ProcessId);
+	 Local[ProcessId].myn2bcalc += Local[ProcessId].myn2bterm;
+	 Local[ProcessId].mynbccalc += Local[ProcessId].mynbcterm;
+	 if (!Local[ProcessId].skipself) {       /*   did we miss self-int?  */
+	    Local[ProcessId].myselfint++;        /*   count another goofup   */
+	 }
       }
       if (Local[ProcessId].nstep > 0) {
 	 /*   use change in accel to make 2nd order correction to vel      */
-	 SUBV(dacc, Acc(p), acc1);
-	 MULVS(dvel, dacc, dthf);
-	 ADDV(Vel(p), Vel(p), dvel);
+	 for (i = 0; i < n; i++) {
+	    p = pp[i];
+	    SUBV(dacc, Acc(p), acc1[i]);
+	    MULVS(dvel, dacc, dthf);
+	    ADDV(Vel(p), Vel(p), dvel);
+	 }
       }
    }
 }
@@ -1229,6 +1348,12 @@ void setbound()
 
 void Help()
 {
+   printf("Options: -s evaluates each interaction as the tree walk finds it rather\n");
+   printf("than through the vector force kernels; -g walks the tree once per leaf\n");
+   printf("and shares one interaction list among its bodies; -c checks either\n");
+   printf("against the scalar walk; -l builds the tree by locked insertion\n");
+   printf("rather than from bodies sorted on their Morton keys.\n");
+   printf("\n");
    printf("There are a total of twelve parameters, and all of them have default values.\n");
    printf("\n");
    printf("1) infile (char*) : The name of an input file that contains particle data.  \n");
@@ -39,6 +39,10 @@ global real eps; 		/* potential softening parameter */
 global real epssq; 		/* square of previous */
 global real dthf; 		/* half time step */
 global unsigned long NPROC;		/* Number of Processors */
+global cbool scalarforce;	/* evaluate forces one interaction at a time */
+global cbool checkforce;	/* check list forces against scalar ones */
+global cbool groupforce;	/* one walk and list for the bodies of a leaf */
+global cbool locktree;		/* insert bodies into the tree under cell locks */
 
 global long maxcell;		/* max number of cells allocated */
 global long maxleaf;		/* max number of leaves allocated */
@@ -127,6 +131,13 @@ struct local_memory {
    vector dr;  		/* data to be shared */
    real drsq;      	/* between gravsub and subdivp */
    nodeptr pmem;	/* remember particle data */
+   ilist blist;		/* body-body interactions of a body */
+   ilist clist;		/* body-cell interactions of a body */
+   real myforceerr;	/* largest difference found by checkforce */
+   bodyptr *group;	/* bodies that share a walk */
+   long ngroup;		/* how many */
+   real grouprad;	/* radius of their sphere, centred at pos0 */
+   long groupself[MAX_BODIES_PER_LEAF];	/* where each is on blist, or -1 */
 
    nodeptr Current_Root;
    long Root_Coords[NDIM];
@@ -157,6 +157,23 @@ typedef struct _leaf {
 #endif
 #define Done(x) (((cellptr) (x))->done)
 
+/*
+ * ILIST: interactions gathered by the tree walk for one body, kept one
+ * array per component so that the force kernels can take several at a
+ * time.  Only lists of cells carry quadrupole moments.
+ */
+
+typedef struct _ilist {
+   long num;                   /* interactions on the list */
+   long max;                   /* room for this many */
+   real *x, *y, *z;            /* positions */
+   real *m;                    /* masses */
+#ifdef QUADPOLE
+   real *qxx, *qxy, *qxz;      /* quad. moments, upper triangle */
+   real *qyy, *qyz, *qzz;
+#endif
+} ilist;
+
 /*
  * Integerized coordinates: used to mantain body-tree.
  */
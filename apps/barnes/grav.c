@@ -29,7 +29,9 @@ extern pthread_t PThreadTable[];
 #include "stdinc.h"
 
 /*
- * HACKGRAV: evaluate grav field at a given particle.
+ * HACKGRAV: evaluate grav field at a given particle.  The walk gathers
+ * the interactions on lists for EvalList(), unless scalarforce asks for
+ * them one at a time as they are found.
  */
 
 void hackgrav(bodyptr p, long ProcessId)
@@ -41,7 +43,12 @@ void hackgrav(bodyptr p, long ProcessId)
    Local[ProcessId].myn2bterm = 0;
    Local[ProcessId].mynbcterm = 0;
    Local[ProcessId].skipself = FALSE;
-   hackwalk(ProcessId);
+   if (scalarforce) {
+      hackwalk(ProcessId);
+   }
+   else {
+      hacklist(ProcessId);
+   }
    Phi(p) = Local[ProcessId].phi0;
    SETV(Acc(p), Local[ProcessId].acc0);
 #ifdef QUADPOLE
@@ -49,9 +56,137 @@ void hackgrav(bodyptr p, long ProcessId)
 #else
    Cost(p) = Local[ProcessId].myn2bterm + Local[ProcessId].mynbcterm;
 #endif
+   if (checkforce && !scalarforce) {
+      checkgrav(p, Phi(p), Acc(p), ProcessId);
+   }
+}
+
+
+
+/*
+ * CHECKGRAV: compare phi and acc, found for p some other way, with the
+ * field the scalar walk gives, and keep the largest relative difference.
+ */
+
+void checkgrav(bodyptr p, real phi, vector acc, long ProcessId)
+{
+   real err, norm;
+   vector dacc;
+   long n2bterm, nbcterm;
+   cbool skipself;
+
+   n2bterm = Local[ProcessId].myn2bterm;
+   nbcterm = Local[ProcessId].mynbcterm;
+   skipself = Local[ProcessId].skipself;
+   Local[ProcessId].pskip = p;
+   SETV(Local[ProcessId].pos0, Pos(p));
+   Local[ProcessId].phi0 = 0.0;
+   CLRV(Local[ProcessId].acc0);
+   hackwalk(ProcessId);
+   SUBV(dacc, acc, Local[ProcessId].acc0);
+   ABSV(err, dacc);
+   ABSV(norm, Local[ProcessId].acc0);
+   err /= norm;
+   if (err > Local[ProcessId].myforceerr) {
+      Local[ProcessId].myforceerr = err;
+   }
+   err = ABS(phi - Local[ProcessId].phi0) / ABS(Local[ProcessId].phi0);
+   if (err > Local[ProcessId].myforceerr) {
+      Local[ProcessId].myforceerr = err;
+   }
+   Local[ProcessId].myn2bterm = n2bterm;
+   Local[ProcessId].mynbcterm = nbcterm;
+   Local[ProcessId].skipself = skipself;
 }
 
+/*
+ * HACKGROUP: evaluate grav field at the n bodies pp[0..n), all of one
+ * leaf, from a single walk and pair of lists.  Nodes are opened as
+ * subdivp() would open them for the nearest point of a sphere around
+ * the bodies, so each body gets at least the interactions its own walk
+ * would have opened.  The interactions are counted and the bodies'
+ * costs set per body, as hackgrav() and ComputeForces() would.
+ */
+
+void hackgroup(bodyptr *pp, long n, long ProcessId)
+{
+   long i, k, self, last;
+   real phi, drsq, rsq;
+   vector acc, min, max, dr;
+   bodyptr p;
+
+   SETV(min, Pos(pp[0]));
+   SETV(max, Pos(pp[0]));
+   for (i = 1; i < n; i++) {
+      for (k = 0; k < NDIM; k++) {
+	 if (Pos(pp[i])[k] < min[k]) {
+	    min[k] = Pos(pp[i])[k];
+	 }
+	 if (Pos(pp[i])[k] > max[k]) {
+	    max[k] = Pos(pp[i])[k];
+	 }
+      }
+   }
+   ADDV(Local[ProcessId].pos0, min, max);
+   DIVVS(Local[ProcessId].pos0, Local[ProcessId].pos0, 2.0);
+   rsq = 0.0;
+   for (i = 0; i < n; i++) {
+      SUBV(dr, Pos(pp[i]), Local[ProcessId].pos0);
+      DOTVP(drsq, dr, dr);
+      if (drsq > rsq) {
+	 rsq = drsq;
+      }
+      Local[ProcessId].groupself[i] = -1;
+   }
+   Local[ProcessId].grouprad = sqrt((double) rsq);
+   Local[ProcessId].group = pp;
+   Local[ProcessId].ngroup = n;
+
+   Local[ProcessId].blist.num = 0;
+   Local[ProcessId].clist.num = 0;
+   walkgroup(Global->G_root, Global->rsize * Global->rsize, ProcessId);
+
+   for (i = 0; i < n; i++) {
+      p = pp[i];
+      phi = 0.0;
+      CLRV(acc);
+
+      /* leave p itself off the body list */
+      self = Local[ProcessId].groupself[i];
+      last = Local[ProcessId].blist.num - 1;
+      if (self >= 0) {
+	 ListSwap(&Local[ProcessId].blist, self, last);
+	 Local[ProcessId].blist.num--;
+      }
+      EvalList(&Local[ProcessId].blist, FALSE, Pos(p), &phi, acc);
+      EvalList(&Local[ProcessId].clist, TRUE, Pos(p), &phi, acc);
+      if (self >= 0) {
+	 Local[ProcessId].blist.num++;
+	 ListSwap(&Local[ProcessId].blist, self, last);
+      }
 
+      Phi(p) = phi;
+      SETV(Acc(p), acc);
+      Local[ProcessId].myn2bterm = last + (self >= 0 ? 0 : 1);
+      Local[ProcessId].mynbcterm = Local[ProcessId].clist.num;
+#ifdef QUADPOLE
+      Cost(p) = Local[ProcessId].myn2bterm + NDIM * Local[ProcessId].mynbcterm;
+#else
+      Cost(p) = Local[ProcessId].myn2bterm + Local[ProcessId].mynbcterm;
+#endif
+      Local[ProcessId].myn2bcalc += Local[ProcessId].myn2bterm;
+      Local[ProcessId].mynbccalc += Local[ProcessId].mynbcterm;
+      if (self < 0) {
+	 Local[ProcessId].myselfint++;
+      }
+   }
+
+   if (checkforce) {
+      for (i = 0; i < n; i++) {
+	 checkgrav(pp[i], Phi(pp[i]), Acc(pp[i]), ProcessId);
+      }
+   }
+}
 
 /*
  * GRAVSUB: compute a single body-body or body-cell longeraction.
@@ -61,6 +196,10 @@ void gravsub(void *p, long ProcessId)
 {
     real drabs, phii, mor3;
     vector ai;
+#ifdef QUADPOLE
+    real dr5inv, drquaddr, phiquad;
+    vector quaddr;
+#endif
 
     if (p != Local[ProcessId].pmem) {
         SUBV(Local[ProcessId].dr, Pos(p), Local[ProcessId].pos0);
@@ -140,6 +279,119 @@ void walksub(void *n, real dsq, long ProcessId)
    }
 }
 
+/*
+ * HACKLIST: walk the tree as hackwalk() does, putting the interactions
+ * on the lists, then evaluate them.
+ */
+
+void hacklist(long ProcessId)
+{
+   Local[ProcessId].blist.num = 0;
+   Local[ProcessId].clist.num = 0;
+   walklist(Global->G_root, Global->rsize * Global->rsize, ProcessId);
+   Local[ProcessId].myn2bterm = Local[ProcessId].blist.num;
+   Local[ProcessId].mynbcterm = Local[ProcessId].clist.num;
+   EvalList(&Local[ProcessId].blist, FALSE, Local[ProcessId].pos0,
+	    &Local[ProcessId].phi0, Local[ProcessId].acc0);
+   EvalList(&Local[ProcessId].clist, TRUE, Local[ProcessId].pos0,
+	    &Local[ProcessId].phi0, Local[ProcessId].acc0);
+}
+
+/*
+ * WALKLIST: walksub() with the interactions put on the lists rather
+ * than evaluated.
+ */
+
+void walklist(void *n, real dsq, long ProcessId)
+{
+   nodeptr* nn;
+   leafptr l;
+   bodyptr p;
+   long i;
+
+   if (subdivp((nodeptr)n, dsq, ProcessId)) {
+      if (Type(n) == CELL) {
+	 for (nn = Subp(n); nn < Subp(n) + NSUB; nn++) {
+	    if (*nn != NULL) {
+	       walklist(*nn, dsq / 4.0, ProcessId);
+	    }
+	 }
+      }
+      else {
+	 l = (leafptr) n;
+	 for (i = 0; i < l->num_bodies; i++) {
+	    p = Bodyp(l)[i];
+	    if (p != Local[ProcessId].pskip) {
+	       ListAdd(&Local[ProcessId].blist, (nodeptr) p);
+	    }
+	    else {
+	       Local[ProcessId].skipself = TRUE;
+	    }
+	 }
+      }
+   }
+   else {
+      ListAdd(&Local[ProcessId].clist, (nodeptr) n);
+   }
+}
+
+/*
+ * WALKGROUP: walklist() for the group of bodies set up by hackgroup(),
+ * noting where each of them lands on the body list.
+ */
+
+void walkgroup(void *n, real dsq, long ProcessId)
+{
+   nodeptr* nn;
+   leafptr l;
+   bodyptr p;
+   long i, k;
+
+   if (subdivgroup((nodeptr)n, dsq, ProcessId)) {
+      if (Type(n) == CELL) {
+	 for (nn = Subp(n); nn < Subp(n) + NSUB; nn++) {
+	    if (*nn != NULL) {
+	       walkgroup(*nn, dsq / 4.0, ProcessId);
+	    }
+	 }
+      }
+      else {
+	 l = (leafptr) n;
+	 for (i = 0; i < l->num_bodies; i++) {
+	    p = Bodyp(l)[i];
+	    ListAdd(&Local[ProcessId].blist, (nodeptr) p);
+	    if ((nodeptr) l == Parent(Local[ProcessId].group[0])) {
+	       for (k = 0; k < Local[ProcessId].ngroup; k++) {
+		  if (Local[ProcessId].group[k] == p) {
+		     Local[ProcessId].groupself[k] =
+			Local[ProcessId].blist.num - 1;
+		  }
+	       }
+	    }
+	 }
+      }
+   }
+   else {
+      ListAdd(&Local[ProcessId].clist, (nodeptr) n);
+   }
+}
+
+/*
+ * SUBDIVGROUP: subdivp() for the point of the group's sphere nearest
+ * to node p.
+ */
+
+cbool subdivgroup(register nodeptr p, real dsq, long ProcessId)
+{
+   vector dr;
+   real drsq, d;
+
+   SUBV(dr, Pos(p), Local[ProcessId].pos0);
+   DOTVP(drsq, dr, dr);
+   d = sqrt((double) drsq) - Local[ProcessId].grouprad;
+   return (d <= 0.0 || tolsq * d * d < dsq);
+}
+
 /*
  * SUBDIVP: decide if a node should be opened.
  * Side effects: sets  pmem,dr, and drsq.
@@ -5,6 +5,12 @@ void hackgrav(bodyptr p, long ProcessId);
 void gravsub(void *p, long ProcessId);
 void hackwalk(long ProcessId);
 void walksub(void *n, real dsq, long ProcessId);
+void hacklist(long ProcessId);
+void walklist(void *n, real dsq, long ProcessId);
+void checkgrav(bodyptr p, real phi, vector acc, long ProcessId);
+void hackgroup(bodyptr *pp, long n, long ProcessId);
+void walkgroup(void *n, real dsq, long ProcessId);
+cbool subdivgroup(register nodeptr p, real dsq, long ProcessId);
 cbool subdivp(register nodeptr p, real dsq, long ProcessId);
 
 #endif
@@ -0,0 +1,383 @@
+/*************************************************************************/
+/*                                                                       */
+/*  Interaction lists and the force kernels that evaluate them.          */
+/*                                                                       */
+/*  The tree walk in grav.c puts the bodies and cells that act on a      */
+/*  body on two lists with ListAdd(), and EvalList() then sums their     */
+/*  potential and acceleration at the body.  The kernel is chosen at     */
+/*  run time from the instruction sets the processor supports: AVX-512   */
+/*  and AVX2 kernels take 8 or 4 interactions at a time and refine an    */
+/*  approximate reciprocal square root with two Newton steps, which      */
+/*  leaves it good to better than 1e-13.  Without either the scalar      */
+/*  kernel does what gravsub() does.                                     */
+/*                                                                       */
+/*************************************************************************/
+
+#include <pthread.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <stdlib.h>
+extern pthread_t PThreadTable[];
+
+#define global extern
+
+#include "stdinc.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FORCE_X86
+#include <immintrin.h>
+#endif
+
+#define LIST_START 1024        /* interactions a list first has room for */
+
+typedef void (*force_kernel_t)(ilist *l, long quad, vector pos0,
+			       real *phi, vector acc);
+
+local void EvalScalar(ilist *l, long quad, vector pos0, real *phi,
+		      vector acc);
+#ifdef FORCE_X86
+local void EvalAVX2(ilist *l, long quad, vector pos0, real *phi,
+		    vector acc);
+local void EvalAVX512(ilist *l, long quad, vector pos0, real *phi,
+		      vector acc);
+#endif
+
+local force_kernel_t force_kernel = EvalScalar;
+local const char *force_kernel_name = "scalar";
+
+/*
+ * FORCEINIT: select the widest force kernel the processor runs.  Must
+ * be called before any process evaluates forces.
+ */
+
+void ForceInit()
+{
+#ifdef FORCE_X86
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("avx512f")) {
+      force_kernel = EvalAVX512;
+      force_kernel_name = "AVX-512";
+   }
+   else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+      force_kernel = EvalAVX2;
+      force_kernel_name = "AVX2";
+   }
+#endif
+}
+
+const char *ForceKernelName()
+{
+   return (force_kernel_name);
+}
+
+local real *growarray(real *a, long num, long max)
+{
+   real *b;
+
+   b = (real *) malloc(max * sizeof(real));
+   if (b == NULL) {
+      error("growarray: no room for %ld interactions\n", max);
+      exit(-1);
+   }
+   if (a != NULL) {
+      memcpy(b, a, num * sizeof(real));
+      free(a);
+   }
+   return (b);
+}
+
+/*
+ * LISTGROW: double the room on a list, keeping what is on it.
+ */
+
+void ListGrow(ilist *l)
+{
+   l->max = (l->max == 0 ? LIST_START : 2 * l->max);
+   l->x = growarray(l->x, l->num, l->max);
+   l->y = growarray(l->y, l->num, l->max);
+   l->z = growarray(l->z, l->num, l->max);
+   l->m = growarray(l->m, l->num, l->max);
+#ifdef QUADPOLE
+   l->qxx = growarray(l->qxx, l->num, l->max);
+   l->qxy = growarray(l->qxy, l->num, l->max);
+   l->qxz = growarray(l->qxz, l->num, l->max);
+   l->qyy = growarray(l->qyy, l->num, l->max);
+   l->qyz = growarray(l->qyz, l->num, l->max);
+   l->qzz = growarray(l->qzz, l->num, l->max);
+#endif
+}
+
+/*
+ * LISTADD: put node n on list l.
+ */
+
+void ListAdd(ilist *l, nodeptr n)
+{
+   long i;
+
+   if (l->num == l->max) {
+      ListGrow(l);
+   }
+   i = l->num++;
+   l->x[i] = Pos(n)[0];
+   l->y[i] = Pos(n)[1];
+   l->z[i] = Pos(n)[2];
+   l->m[i] = Mass(n);
+#ifdef QUADPOLE
+   if (Type(n) != BODY) {
+      l->qxx[i] = Quad(n)[0][0];
+      l->qxy[i] = Quad(n)[0][1];
+      l->qxz[i] = Quad(n)[0][2];
+      l->qyy[i] = Quad(n)[1][1];
+      l->qyz[i] = Quad(n)[1][2];
+      l->qzz[i] = Quad(n)[2][2];
+   }
+#endif
+}
+
+/*
+ * LISTSWAP: exchange interactions i and j of a list of bodies.
+ */
+
+void ListSwap(ilist *l, long i, long j)
+{
+   real t;
+
+   t = l->x[i]; l->x[i] = l->x[j]; l->x[j] = t;
+   t = l->y[i]; l->y[i] = l->y[j]; l->y[j] = t;
+   t = l->z[i]; l->z[i] = l->z[j]; l->z[j] = t;
+   t = l->m[i]; l->m[i] = l->m[j]; l->m[j] = t;
+}
+
+/*
+ * EVALLIST: add the potential and acceleration at pos0 of everything
+ * on list l to phi and acc; with quad set (and QUADPOLE defined) the
+ * list holds cells and their quadrupole terms are added too.
+ */
+
+void EvalList(ilist *l, long quad, vector pos0, real *phi, vector acc)
+{
+   force_kernel(l, quad, pos0, phi, acc);
+}
+
+/*
+ * EVALFROM: EvalList() for interactions i0 and on, one at a time.
+ */
+
+local void evalfrom(ilist *l, long i0, long quad, vector pos0, real *phi,
+		    vector acc)
+{
+   long i;
+   real dx, dy, dz, drsq, drabs, phii, mor3;
+#ifdef QUADPOLE
+   real dr5inv, qdx, qdy, qdz, drqdr, phiquad;
+#endif
+
+   for (i = i0; i < l->num; i++) {
+      dx = l->x[i] - pos0[0];
+      dy = l->y[i] - pos0[1];
+      dz = l->z[i] - pos0[2];
+      drsq = dx * dx + dy * dy + dz * dz + epssq;
+      drabs = sqrt((double) drsq);
+      phii = l->m[i] / drabs;
+      *phi -= phii;
+      mor3 = phii / drsq;
+      acc[0] += dx * mor3;
+      acc[1] += dy * mor3;
+      acc[2] += dz * mor3;
+#ifdef QUADPOLE
+      if (quad) {
+	 dr5inv = 1.0 / (drsq * drsq * drabs);
+	 qdx = l->qxx[i] * dx + l->qxy[i] * dy + l->qxz[i] * dz;
+	 qdy = l->qxy[i] * dx + l->qyy[i] * dy + l->qyz[i] * dz;
+	 qdz = l->qxz[i] * dx + l->qyz[i] * dy + l->qzz[i] * dz;
+	 drqdr = dx * qdx + dy * qdy + dz * qdz;
+	 phiquad = -0.5 * dr5inv * drqdr;
+	 *phi += phiquad;
+	 phiquad = 5.0 * phiquad / drsq;
+	 acc[0] -= dx * phiquad + qdx * dr5inv;
+	 acc[1] -= dy * phiquad + qdy * dr5inv;
+	 acc[2] -= dz * phiquad + qdz * dr5inv;
+      }
+#endif
+   }
+}
+
+local void EvalScalar(ilist *l, long quad, vector pos0, real *phi,
+		      vector acc)
+{
+   evalfrom(l, 0, quad, pos0, phi, acc);
+}
+
+#ifdef FORCE_X86
+
+/*
+ * EVALAVX2: EvalList() four interactions at a time.  The reciprocal
+ * square root starts from the single precision estimate.
+ */
+
+__attribute__((target("avx2,fma")))
+local void EvalAVX2(ilist *l, long quad, vector pos0, real *phi,
+		    vector acc)
+{
+   __m256d px, py, pz, eps2, half, three, vphi, ax, ay, az;
+   __m256d dx, dy, dz, drsq, rinv, rinv2, phii, mor3;
+#ifdef QUADPOLE
+   __m256d dr5inv, qxx, qxy, qxz, qyy, qyz, qzz, qdx, qdy, qdz, phiquad;
+   __m256d mhalf = _mm256_set1_pd(-0.5), five = _mm256_set1_pd(5.0);
+#endif
+   double t[4];
+   long i, n;
+
+   px = _mm256_set1_pd(pos0[0]);
+   py = _mm256_set1_pd(pos0[1]);
+   pz = _mm256_set1_pd(pos0[2]);
+   eps2 = _mm256_set1_pd(epssq);
+   half = _mm256_set1_pd(0.5);
+   three = _mm256_set1_pd(3.0);
+   vphi = ax = ay = az = _mm256_setzero_pd();
+
+   n = l->num & ~3L;
+   for (i = 0; i < n; i += 4) {
+      dx = _mm256_sub_pd(_mm256_loadu_pd(&l->x[i]), px);
+      dy = _mm256_sub_pd(_mm256_loadu_pd(&l->y[i]), py);
+      dz = _mm256_sub_pd(_mm256_loadu_pd(&l->z[i]), pz);
+      drsq = _mm256_fmadd_pd(dx, dx, eps2);
+      drsq = _mm256_fmadd_pd(dy, dy, drsq);
+      drsq = _mm256_fmadd_pd(dz, dz, drsq);
+
+      /* y (3 - x y y) / 2, twice */
+      rinv = _mm256_cvtps_pd(_mm_rsqrt_ps(_mm256_cvtpd_ps(drsq)));
+      rinv = _mm256_mul_pd(_mm256_mul_pd(half, rinv),
+	  _mm256_fnmadd_pd(_mm256_mul_pd(drsq, rinv), rinv, three));
+      rinv = _mm256_mul_pd(_mm256_mul_pd(half, rinv),
+	  _mm256_fnmadd_pd(_mm256_mul_pd(drsq, rinv), rinv, three));
+      rinv2 = _mm256_mul_pd(rinv, rinv);
+
+      phii = _mm256_mul_pd(_mm256_loadu_pd(&l->m[i]), rinv);
+      vphi = _mm256_sub_pd(vphi, phii);
+      mor3 = _mm256_mul_pd(phii, rinv2);
+      ax = _mm256_fmadd_pd(dx, mor3, ax);
+      ay = _mm256_fmadd_pd(dy, mor3, ay);
+      az = _mm256_fmadd_pd(dz, mor3, az);
+#ifdef QUADPOLE
+      if (quad) {
+	 dr5inv = _mm256_mul_pd(_mm256_mul_pd(rinv2, rinv2), rinv);
+	 qxx = _mm256_loadu_pd(&l->qxx[i]);
+	 qxy = _mm256_loadu_pd(&l->qxy[i]);
+	 qxz = _mm256_loadu_pd(&l->qxz[i]);
+	 qyy = _mm256_loadu_pd(&l->qyy[i]);
+	 qyz = _mm256_loadu_pd(&l->qyz[i]);
+	 qzz = _mm256_loadu_pd(&l->qzz[i]);
+	 qdx = _mm256_fmadd_pd(qxz, dz,
+	       _mm256_fmadd_pd(qxy, dy, _mm256_mul_pd(qxx, dx)));
+	 qdy = _mm256_fmadd_pd(qyz, dz,
+	       _mm256_fmadd_pd(qyy, dy, _mm256_mul_pd(qxy, dx)));
+	 qdz = _mm256_fmadd_pd(qzz, dz,
+	       _mm256_fmadd_pd(qyz, dy, _mm256_mul_pd(qxz, dx)));
+	 phiquad = _mm256_fmadd_pd(dz, qdz,
+		   _mm256_fmadd_pd(dy, qdy, _mm256_mul_pd(dx, qdx)));
+	 phiquad = _mm256_mul_pd(_mm256_mul_pd(mhalf, dr5inv), phiquad);
+	 vphi = _mm256_add_pd(vphi, phiquad);
+	 phiquad = _mm256_mul_pd(_mm256_mul_pd(five, phiquad), rinv2);
+	 ax = _mm256_fnmadd_pd(dx, phiquad, _mm256_fnmadd_pd(qdx, dr5inv, ax));
+	 ay = _mm256_fnmadd_pd(dy, phiquad, _mm256_fnmadd_pd(qdy, dr5inv, ay));
+	 az = _mm256_fnmadd_pd(dz, phiquad, _mm256_fnmadd_pd(qdz, dr5inv, az));
+      }
+#endif
+   }
+
+   _mm256_storeu_pd(t, vphi);
+   *phi += (t[0] + t[1]) + (t[2] + t[3]);
+   _mm256_storeu_pd(t, ax);
+   acc[0] += (t[0] + t[1]) + (t[2] + t[3]);
+   _mm256_storeu_pd(t, ay);
+   acc[1] += (t[0] + t[1]) + (t[2] + t[3]);
+   _mm256_storeu_pd(t, az);
+   acc[2] += (t[0] + t[1]) + (t[2] + t[3]);
+
+   evalfrom(l, n, quad, pos0, phi, acc);
+}
+
+/*
+ * EVALAVX512: EvalList() eight interactions at a time.
+ */
+
+__attribute__((target("avx512f")))
+local void EvalAVX512(ilist *l, long quad, vector pos0, real *phi,
+		      vector acc)
+{
+   __m512d px, py, pz, eps2, half, three, vphi, ax, ay, az;
+   __m512d dx, dy, dz, drsq, rinv, rinv2, phii, mor3;
+#ifdef QUADPOLE
+   __m512d dr5inv, qxx, qxy, qxz, qyy, qyz, qzz, qdx, qdy, qdz, phiquad;
+   __m512d mhalf = _mm512_set1_pd(-0.5), five = _mm512_set1_pd(5.0);
+#endif
+   long i, n;
+
+   px = _mm512_set1_pd(pos0[0]);
+   py = _mm512_set1_pd(pos0[1]);
+   pz = _mm512_set1_pd(pos0[2]);
+   eps2 = _mm512_set1_pd(epssq);
+   half = _mm512_set1_pd(0.5);
+   three = _mm512_set1_pd(3.0);
+   vphi = ax = ay = az = _mm512_setzero_pd();
+
+   n = l->num & ~7L;
+   for (i = 0; i < n; i += 8) {
+      dx = _mm512_sub_pd(_mm512_loadu_pd(&l->x[i]), px);
+      dy = _mm512_sub_pd(_mm512_loadu_pd(&l->y[i]), py);
+      dz = _mm512_sub_pd(_mm512_loadu_pd(&l->z[i]), pz);
+      drsq = _mm512_fmadd_pd(dx, dx, eps2);
+      drsq = _mm512_fmadd_pd(dy, dy, drsq);
+      drsq = _mm512_fmadd_pd(dz, dz, drsq);
+
+      rinv = _mm512_rsqrt14_pd(drsq);
+      rinv = _mm512_mul_pd(_mm512_mul_pd(half, rinv),
+	  _mm512_fnmadd_pd(_mm512_mul_pd(drsq, rinv), rinv, three));
+      rinv = _mm512_mul_pd(_mm512_mul_pd(half, rinv),
+	  _mm512_fnmadd_pd(_mm512_mul_pd(drsq, rinv), rinv, three));
+      rinv2 = _mm512_mul_pd(rinv, rinv);
+
+      phii = _mm512_mul_pd(_mm512_loadu_pd(&l->m[i]), rinv);
+      vphi = _mm512_sub_pd(vphi, phii);
+      mor3 = _mm512_mul_pd(phii, rinv2);
+      ax = _mm512_fmadd_pd(dx, mor3, ax);
+      ay = _mm512_fmadd_pd(dy, mor3, ay);
+      az = _mm512_fmadd_pd(dz, mor3, az);
+#ifdef QUADPOLE
+      if (quad) {
+	 dr5inv = _mm512_mul_pd(_mm512_mul_pd(rinv2, rinv2), rinv);
+	 qxx = _mm512_loadu_pd(&l->qxx[i]);
+	 qxy = _mm512_loadu_pd(&l->qxy[i]);
+	 qxz = _mm512_loadu_pd(&l->qxz[i]);
+	 qyy = _mm512_loadu_pd(&l->qyy[i]);
+	 qyz = _mm512_loadu_pd(&l->qyz[i]);
+	 qzz = _mm512_loadu_pd(&l->qzz[i]);
+	 qdx = _mm512_fmadd_pd(qxz, dz,
+	       _mm512_fmadd_pd(qxy, dy, _mm512_mul_pd(qxx, dx)));
+	 qdy = _mm512_fmadd_pd(qyz, dz,
+	       _mm512_fmadd_pd(qyy, dy, _mm512_mul_pd(qxy, dx)));
+	 qdz = _mm512_fmadd_pd(qzz, dz,
+	       _mm512_fmadd_pd(qyz, dy, _mm512_mul_pd(qxz, dx)));
+	 phiquad = _mm512_fmadd_pd(dz, qdz,
+		   _mm512_fmadd_pd(dy, qdy, _mm512_mul_pd(dx, qdx)));
+	 phiquad = _mm512_mul_pd(_mm512_mul_pd(mhalf, dr5inv), phiquad);
+	 vphi = _mm512_add_pd(vphi, phiquad);
+	 phiquad = _mm512_mul_pd(_mm512_mul_pd(five, phiquad), rinv2);
+	 ax = _mm512_fnmadd_pd(dx, phiquad, _mm512_fnmadd_pd(qdx, dr5inv, ax));
+	 ay = _mm512_fnmadd_pd(dy, phiquad, _mm512_fnmadd_pd(qdy, dr5inv, ay));
+	 az = _mm512_fnmadd_pd(dz, phiquad, _mm512_fnmadd_pd(qdz, dr5inv, az));
+      }
+#endif
+   }
+
+   *phi += _mm512_reduce_add_pd(vphi);
+   acc[0] += _mm512_reduce_add_pd(ax);
+   acc[1] += _mm512_reduce_add_pd(ay);
+   acc[2] += _mm512_reduce_add_pd(az);
+
+   evalfrom(l, n, quad, pos0, phi, acc);
+}
+
+#endif
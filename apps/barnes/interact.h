@@ -0,0 +1,12 @@
+
+#ifndef _INTERACT_H_
+#define _INTERACT_H_
+
+void ForceInit(void);
+const char *ForceKernelName(void);
+void ListGrow(ilist *l);
+void ListAdd(ilist *l, nodeptr n);
+void ListSwap(ilist *l, long i, long j);
+void EvalList(ilist *l, long quad, vector pos0, real *phi, vector acc);
+
+#endif
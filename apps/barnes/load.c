@@ -24,6 +24,32 @@ extern pthread_t PThreadTable[];
 
 #include "stdinc.h"
 
+#define KEYLEVELS  21			/* levels of the tree in a key */
+#define RADIXBITS  8			/* key bits sorted in each pass */
+#define RADIX      (1L << RADIXBITS)
+#define NOMASS     (1UL << 63)		/* key of a body with no mass */
+
+/* the sorted bodies lo..hi-1 below the top cells, for one processor to
+   build as Subp(parent)[kid] */
+struct subtree {
+   long lo, hi;
+   long kid;
+   cellptr parent;
+};
+
+local unsigned long *keys[2];		/* Morton keys, and sort space */
+local bodyptr *sorted[2];		/* the bodies in key order */
+local long (*digits)[RADIX];		/* each processor's digit counts */
+local struct subtree *pending;		/* what is left below the top */
+local long npending, maxpending;
+local long ntopcell;			/* cells processor 0 made first */
+local long ntree;			/* bodies with mass */
+
+local void buildtree(long ProcessId);
+local void leafcofm(leafptr l);
+local void cellcofm(cellptr q);
+local void treebarrier(void);
+
 /*
  * MAKETREE: initialize tree structure for hack force calculation.
  */
@@ -37,22 +63,27 @@ void maketree(long ProcessId)
    if (ProcessId == 0) {
       Local[ProcessId].mycelltab[Local[ProcessId].myncell++] = Global->G_root;
    }
-   Local[ProcessId].Current_Root = (nodeptr) Global->G_root;
-   for (pp = Local[ProcessId].mybodytab;
-	pp < Local[ProcessId].mybodytab+Local[ProcessId].mynbody; pp++) {
-      p = *pp;
-      if (Mass(p) != 0.0) {
-	 Local[ProcessId].Current_Root
-	    = (nodeptr) loadtree(p, (cellptr) Local[ProcessId].Current_Root,
-				 ProcessId);
-      }
-      else {
-	 {pthread_mutex_lock(&(Global->io_lock));};
-	 fprintf(stderr, "Process %ld found body %ld to have zero mass\n",
-		 ProcessId, (long) p);
-	 {pthread_mutex_unlock(&(Global->io_lock));};
+   if (locktree) {
+      Local[ProcessId].Current_Root = (nodeptr) Global->G_root;
+      for (pp = Local[ProcessId].mybodytab;
+	   pp < Local[ProcessId].mybodytab+Local[ProcessId].mynbody; pp++) {
+	 p = *pp;
+	 if (Mass(p) != 0.0) {
+	    Local[ProcessId].Current_Root
+	       = (nodeptr) loadtree(p, (cellptr) Local[ProcessId].Current_Root,
+				    ProcessId);
+	 }
+	 else {
+	    {pthread_mutex_lock(&(Global->io_lock));};
+	    fprintf(stderr, "Process %ld found body %ld to have zero mass\n",
+		    ProcessId, (long) p);
+	    {pthread_mutex_unlock(&(Global->io_lock));};
+	 }
       }
    }
+   else {
+      buildtree(ProcessId);
+   }
    {
 	unsigned long	Error, Cycle;
 	int		Cancel, Temp;
@@ -118,6 +149,344 @@ void maketree(long ProcessId)
 
 
 
+	Cycle = (Global->Barrier).cycle;
+
+	if (++(Global->Barrier).counter != (NPROC)) {
+
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &Cancel);
+
+		while (Cycle == (Global->Barrier).cycle) {
+
+			Error = pthread_cond_wait(&(Global->Barrier).cv, &(Global->Barrier).mutex);
+
+			if (Error != 0) {
+
+				break;
+
+			}
+
+		}
+
+		pthread_setcancelstate(Cancel, &Temp);
+
+	} else {
+
+		(Global->Barrier).cycle = !(Global->Barrier).cycle;
+
+		(Global->Barrier).counter = 0;
+
+		Error = pthread_cond_broadcast(&(Global->Barrier).cv);
+
+	}
+
+	pthread_mutex_unlock(&(Global->Barrier).mutex);
+
+};
+}
+
+/*
+ * INITTREE: allocate the space buildtree() sorts the bodies in.
+ */
+
+void inittree()
+{
+   keys[0] = (unsigned long *) valloc(nbody * sizeof(unsigned long));
+   keys[1] = (unsigned long *) valloc(nbody * sizeof(unsigned long));
+   sorted[0] = (bodyptr *) valloc(nbody * sizeof(bodyptr));
+   sorted[1] = (bodyptr *) valloc(nbody * sizeof(bodyptr));
+   digits = (long (*)[RADIX]) valloc(NPROC * sizeof(*digits));
+   maxpending = 8 * NPROC;
+   pending = (struct subtree *) malloc(maxpending * sizeof(struct subtree));
+}
+
+/*
+ * SPREAD: the low KEYLEVELS bits of x, two zero bits after each.
+ */
+
+local unsigned long spread(unsigned long x)
+{
+   x &= 0x1fffffUL;
+   x = (x | x << 32) & 0x1f00000000ffffUL;
+   x = (x | x << 16) & 0x1f0000ff0000ffUL;
+   x = (x | x << 8) & 0x100f00f00f00f00fUL;
+   x = (x | x << 4) & 0x10c30c30c30c30c3UL;
+   x = (x | x << 2) & 0x1249249249249249UL;
+   return (x);
+}
+
+/*
+ * BODYKEY: Morton key of a body, the bits of its integer coordinates
+ * for the top KEYLEVELS levels of the tree, x before y before z at
+ * each level.  Sorting on it puts the bodies of every cell together.
+ */
+
+local unsigned long bodykey(bodyptr p)
+{
+   long xp[NDIM];
+
+   CLRV(xp);
+   intcoord(xp, Pos(p));
+   return (spread(xp[0] >> (MAXLEVEL - KEYLEVELS)) << 2
+	   | spread(xp[1] >> (MAXLEVEL - KEYLEVELS)) << 1
+	   | spread(xp[2] >> (MAXLEVEL - KEYLEVELS)));
+}
+
+/*
+ * SORTKEYS: sort keys[0], and sorted[0] with it, RADIXBITS at a time
+ * from the least significant.  Each processor counts the digits of its
+ * part lo..hi-1, then moves it to where the counts of all put it,
+ * after its digit's entries from the processors before it, so that
+ * every pass is stable.
+ */
+
+local void sortkeys(long lo, long hi, long ProcessId)
+{
+   long pass, shift, d, t, i, at[RADIX];
+   long *count;
+   unsigned long *src, *dst;
+   bodyptr *bsrc, *bdst;
+
+   count = digits[ProcessId];
+   for (pass = 0; pass * RADIXBITS < 64; pass++) {
+      shift = pass * RADIXBITS;
+      src = keys[pass & 1];
+      dst = keys[!(pass & 1)];
+      bsrc = sorted[pass & 1];
+      bdst = sorted[!(pass & 1)];
+      for (d = 0; d < RADIX; d++) {
+	 count[d] = 0;
+      }
+      for (i = lo; i < hi; i++) {
+	 count[(src[i] >> shift) & (RADIX - 1)]++;
+      }
+      treebarrier();
+      i = 0;
+      for (d = 0; d < RADIX; d++) {
+	 for (t = 0; t < NPROC; t++) {
+	    if (t == ProcessId) {
+	       at[d] = i;
+	    }
+	    i += digits[t][d];
+	 }
+      }
+      for (i = lo; i < hi; i++) {
+	 d = (src[i] >> shift) & (RADIX - 1);
+	 dst[at[d]] = src[i];
+	 bdst[at[d]++] = bsrc[i];
+      }
+      treebarrier();
+   }
+}
+
+/*
+ * SPLITCELL: divide the sorted bodies lo..hi-1 of cell c among its
+ * children.  Returns how many children have bodies; those of the k-th,
+ * Subp(c)[kid[k]], are start[k]..start[k+1]-1.
+ */
+
+local long splitcell(cellptr c, long lo, long hi, long start[NSUB+1],
+		     long kid[NSUB])
+{
+   long l, depth, shift, digit, i, k, n;
+   long xp[NDIM], count[NSUB], at[NSUB];
+
+   l = Level(c);
+   if ((l >> 1) == 0) {
+      error("not enough levels in tree\n");
+      exit(-1);
+   }
+   depth = MAXLEVEL - 1 - __builtin_ctzl(l);
+   n = 0;
+   if (depth < KEYLEVELS) {
+      /* each child's bodies are a run of one digit of their keys */
+      shift = NDIM * (KEYLEVELS - 1 - depth);
+      i = lo;
+      while (i < hi) {
+	 digit = (keys[0][i] >> shift) & (NSUB - 1);
+	 for (k = 0; k < NDIM; k++) {
+	    xp[k] = (digit >> (NDIM - 1 - k)) & 1;
+	 }
+	 start[n] = i;
+	 kid[n++] = subindex(xp, 1);
+	 while (i < hi && ((keys[0][i] >> shift) & (NSUB - 1)) == digit) {
+	    i++;
+	 }
+      }
+   }
+   else {
+      /* more than a leaf of bodies agree on every level of their keys;
+	 order them by child here, through sorted[1] */
+      for (k = 0; k < NSUB; k++) {
+	 count[k] = 0;
+      }
+      for (i = lo; i < hi; i++) {
+	 intcoord(xp, Pos(sorted[0][i]));
+	 count[subindex(xp, l)]++;
+      }
+      for (k = 0, i = lo; k < NSUB; i += count[k++]) {
+	 at[k] = i;
+	 if (count[k] > 0) {
+	    start[n] = i;
+	    kid[n++] = k;
+	 }
+      }
+      for (i = lo; i < hi; i++) {
+	 intcoord(xp, Pos(sorted[0][i]));
+	 sorted[1][at[subindex(xp, l)]++] = sorted[0][i];
+      }
+      for (i = lo; i < hi; i++) {
+	 sorted[0][i] = sorted[1][i];
+      }
+   }
+   start[n] = hi;
+   return (n);
+}
+
+/*
+ * BUILDTOP: make the cells below c, whose bodies are lo..hi-1, that
+ * hold more than topsize bodies, and leave the rest on pending for
+ * buildsub().  Only processor 0 runs it.
+ */
+
+local void buildtop(cellptr c, long lo, long hi, long topsize)
+{
+   long start[NSUB+1], kid[NSUB], k, n;
+   cellptr q;
+
+   n = splitcell(c, lo, hi, start, kid);
+   for (k = 0; k < n; k++) {
+      if (start[k+1] - start[k] > topsize) {
+	 q = InitCell(c, 0);
+	 ChildNum(q) = kid[k];
+	 Subp(c)[kid[k]] = (nodeptr) q;
+	 buildtop(q, start[k], start[k+1], topsize);
+      }
+      else {
+	 if (npending == maxpending) {
+	    maxpending *= 2;
+	    pending = (struct subtree *)
+	       realloc(pending, maxpending * sizeof(struct subtree));
+	 }
+	 pending[npending].lo = start[k];
+	 pending[npending].hi = start[k+1];
+	 pending[npending].kid = kid[k];
+	 pending[npending].parent = c;
+	 npending++;
+      }
+   }
+}
+
+/*
+ * BUILDSUB: make the node for the bodies lo..hi-1 in child kid of
+ * parent, and everything below it: a leaf if they fit in one, else a
+ * cell.  Its cells are created before their children, as hackcofm()
+ * needs.
+ */
+
+local nodeptr buildsub(cellptr parent, long kid, long lo, long hi,
+		       long ProcessId)
+{
+   long start[NSUB+1], kids[NSUB], i, k, n;
+   leafptr le;
+   cellptr c;
+   bodyptr p;
+
+   if (hi - lo <= MAX_BODIES_PER_LEAF) {
+      le = InitLeaf(parent, ProcessId);
+      ChildNum(le) = kid;
+      for (i = lo; i < hi; i++) {
+	 p = sorted[0][i];
+	 Parent(p) = (nodeptr) le;
+	 Level(p) = Level(le);
+	 ChildNum(p) = le->num_bodies;
+	 Bodyp(le)[le->num_bodies++] = p;
+      }
+      return ((nodeptr) le);
+   }
+   c = InitCell(parent, ProcessId);
+   ChildNum(c) = kid;
+   n = splitcell(c, lo, hi, start, kids);
+   for (k = 0; k < n; k++) {
+      Subp(c)[kids[k]] = buildsub(c, kids[k], start[k], start[k+1], ProcessId);
+   }
+   return ((nodeptr) c);
+}
+
+/*
+ * BUILDTREE: build the tree without locks.  The bodies are sorted on
+ * their Morton keys, which makes the bodies of every cell a run of the
+ * sorted array.  Processor 0 makes the cells with more than a share of
+ * them; each processor then builds the subtrees below those in its
+ * part of the sorted order, from its own cells and leaves.  The tree
+ * is the one loadtree() gives: a leaf wherever the bodies fit in one.
+ */
+
+local void buildtree(long ProcessId)
+{
+   long lo, hi, i, k, mid, topsize;
+   bodyptr p;
+
+   lo = nbody * ProcessId / NPROC;
+   hi = nbody * (ProcessId + 1) / NPROC;
+   for (i = lo; i < hi; i++) {
+      p = bodytab + i;
+      if (Mass(p) != 0.0) {
+	 keys[0][i] = bodykey(p);
+      }
+      else {
+	 keys[0][i] = NOMASS;
+	 {pthread_mutex_lock(&(Global->io_lock));};
+	 fprintf(stderr, "Process %ld found body %ld to have zero mass\n",
+		 ProcessId, (long) p);
+	 {pthread_mutex_unlock(&(Global->io_lock));};
+      }
+      sorted[0][i] = p;
+   }
+   sortkeys(lo, hi, ProcessId);
+
+   if (ProcessId == 0) {
+      for (ntree = nbody; ntree > 0 && keys[0][ntree-1] == NOMASS; ntree--)
+	 ;
+      topsize = ntree / (8 * NPROC);
+      if (topsize < MAX_BODIES_PER_LEAF) {
+	 topsize = MAX_BODIES_PER_LEAF;
+      }
+      npending = 0;
+      buildtop(Global->G_root, 0, ntree, topsize);
+      ntopcell = Local[0].myncell;
+   }
+   treebarrier();
+
+   /* a subtree goes to the processor whose share of the sorted bodies
+      holds its middle; with no bodies of mass there are none */
+   for (k = 0; ntree > 0 && k < npending; k++) {
+      mid = (pending[k].lo + pending[k].hi) / 2;
+      if (mid * (long) NPROC / ntree == ProcessId) {
+	 Subp(pending[k].parent)[pending[k].kid]
+	    = buildsub(pending[k].parent, pending[k].kid,
+		       pending[k].lo, pending[k].hi, ProcessId);
+      }
+   }
+}
+
+/*
+ * TREEBARRIER: wait for all processors, between the steps of the tree
+ * build and center-of-mass pass.
+ */
+
+local void treebarrier()
+{
+   {
+	unsigned long	Error, Cycle;
+	int		Cancel, Temp;
+
+	Error = pthread_mutex_lock(&(Global->Barrier).mutex);
+	if (Error != 0) {
+		printf("Error while trying to get lock in barrier.\n");
+		exit(-1);
+	}
+
+
 	Cycle = (Global->Barrier).cycle;
 
 	if (++(Global->Barrier).counter != (NPROC)) {
@@ -419,12 +788,9 @@ void hackcofm(long ProcessId)
 {
    long i;
    nodeptr r;
-   leafptr l;
-   leafptr* ll;
-   bodyptr p;
+   leafptr *ll;
    cellptr q;
-   cellptr *cc;
-   vector tmpv;
+   cellptr *cc, *first;
 
    /* get a cell using get*sub.  Cells are got in reverse of the order in */
    /* the cell array; i.e. reverse of the order in which they were created */
@@ -432,75 +798,138 @@ void hackcofm(long ProcessId)
 
    for (ll = Local[ProcessId].myleaftab + Local[ProcessId].mynleaf - 1;
 	ll >= Local[ProcessId].myleaftab; ll--) {
-      l = *ll;
-      Mass(l) = 0.0;
-      Cost(l) = 0;
-      CLRV(Pos(l));
-      for (i = 0; i < l->num_bodies; i++) {
-	 p = Bodyp(l)[i];
-	 Mass(l) += Mass(p);
-	 Cost(l) += Cost(p);
-	 MULVS(tmpv, Pos(p), Mass(p));
-	 ADDV(Pos(l), Pos(l), tmpv);
-      }
-      DIVVS(Pos(l), Pos(l), Mass(l));
+      leafcofm(*ll);
+      Done(*ll) = TRUE;
+   }
+   if (locktree) {
+      /* children may be other processors', so wait for them */
+      for (cc = Local[ProcessId].mycelltab+Local[ProcessId].myncell-1;
+	   cc >= Local[ProcessId].mycelltab; cc--) {
+	 q = *cc;
+	 for (i = 0; i < NSUB; i++) {
+	    r = Subp(q)[i];
+	    if (r != NULL) {
+	       while(!Done(r)) {
+		  /* wait */
+	       }
+	    }
+	 }
+	 cellcofm(q);
+	 for (i = 0; i < NSUB; i++) {
+	    r = Subp(q)[i];
+	    if (r != NULL) {
+	       Done(r) = FALSE;
+	    }
+	 }
+	 Done(q)=TRUE;
+      }
+   }
+   else {
+      /* buildtree() gave each subtree below the top cells to one
+	 processor, so there is nothing to wait for until the top */
+      first = Local[ProcessId].mycelltab + (ProcessId == 0 ? ntopcell : 0);
+      for (cc = Local[ProcessId].mycelltab+Local[ProcessId].myncell-1;
+	   cc >= first; cc--) {
+	 cellcofm(*cc);
+      }
+      treebarrier();
+      if (ProcessId == 0) {
+	 for (cc = first - 1; cc >= Local[ProcessId].mycelltab; cc--) {
+	    cellcofm(*cc);
+	 }
+      }
+   }
+}
+
+/*
+ * LEAFCOFM: center of mass, cost and quadrupole moment of a leaf.
+ */
+
+local void leafcofm(leafptr l)
+{
+   long i;
+   bodyptr p;
+   vector tmpv;
+#ifdef QUADPOLE
+   vector dr;
+   real drsq;
+   matrix drdr, Idrsq, tmpm;
+#endif
+
+   Mass(l) = 0.0;
+   Cost(l) = 0;
+   CLRV(Pos(l));
+   for (i = 0; i < l->num_bodies; i++) {
+      p = Bodyp(l)[i];
+      Mass(l) += Mass(p);
+      Cost(l) += Cost(p);
+      MULVS(tmpv, Pos(p), Mass(p));
+      ADDV(Pos(l), Pos(l), tmpv);
+   }
+   DIVVS(Pos(l), Pos(l), Mass(l));
 #ifdef QUADPOLE
-      CLRM(Quad(l));
-      for (i = 0; i < l->num_bodies; i++) {
-	 p = Bodyp(l)[i];
-	 SUBV(dr, Pos(p), Pos(l));
+   CLRM(Quad(l));
+   for (i = 0; i < l->num_bodies; i++) {
+      p = Bodyp(l)[i];
+      SUBV(dr, Pos(p), Pos(l));
+      OUTVP(drdr, dr, dr);
+      DOTVP(drsq, dr, dr);
+      SETMI(Idrsq);
+      MULMS(Idrsq, Idrsq, drsq);
+      MULMS(tmpm, drdr, 3.0);
+      SUBM(tmpm, tmpm, Idrsq);
+      MULMS(tmpm, tmpm, Mass(p));
+      ADDM(Quad(l), Quad(l), tmpm);
+   }
+#endif
+}
+
+/*
+ * CELLCOFM: the same for a cell whose children are done.
+ */
+
+local void cellcofm(cellptr q)
+{
+   long i;
+   nodeptr r;
+   vector tmpv;
+#ifdef QUADPOLE
+   vector dr;
+   real drsq;
+   matrix drdr, Idrsq, tmpm;
+#endif
+
+   Mass(q) = 0.0;
+   Cost(q) = 0;
+   CLRV(Pos(q));
+   for (i = 0; i < NSUB; i++) {
+      r = Subp(q)[i];
+      if (r != NULL) {
+	 Mass(q) += Mass(r);
+	 Cost(q) += Cost(r);
+	 MULVS(tmpv, Pos(r), Mass(r));
+	 ADDV(Pos(q), Pos(q), tmpv);
+      }
+   }
+   DIVVS(Pos(q), Pos(q), Mass(q));
+#ifdef QUADPOLE
+   CLRM(Quad(q));
+   for (i = 0; i < NSUB; i++) {
+      r = Subp(q)[i];
+      if (r != NULL) {
+	 SUBV(dr, Pos(r), Pos(q));
 	 OUTVP(drdr, dr, dr);
 	 DOTVP(drsq, dr, dr);
 	 SETMI(Idrsq);
 	 MULMS(Idrsq, Idrsq, drsq);
 	 MULMS(tmpm, drdr, 3.0);
 	 SUBM(tmpm, tmpm, Idrsq);
-	 MULMS(tmpm, tmpm, Mass(p));
-	 ADDM(Quad(l), Quad(l), tmpm);
-      }
-#endif
-      Done(l)=TRUE;
-   }
-   for (cc = Local[ProcessId].mycelltab+Local[ProcessId].myncell-1;
-	cc >= Local[ProcessId].mycelltab; cc--) {
-      q = *cc;
-      Mass(q) = 0.0;
-      Cost(q) = 0;
-      CLRV(Pos(q));
-      for (i = 0; i < NSUB; i++) {
-	 r = Subp(q)[i];
-	 if (r != NULL) {
-	    while(!Done(r)) {
-	       /* wait */
-	    }
-	    Mass(q) += Mass(r);
-	    Cost(q) += Cost(r);
-	    MULVS(tmpv, Pos(r), Mass(r));
-	    ADDV(Pos(q), Pos(q), tmpv);
-	    Done(r) = FALSE;
-	 }
+	 MULMS(tmpm, tmpm, Mass(r));
+	 ADDM(tmpm, tmpm, Quad(r));
+	 ADDM(Quad(q), Quad(q), tmpm);
       }
-      DIVVS(Pos(q), Pos(q), Mass(q));
-#ifdef QUADPOLE
-      CLRM(Quad(q));
-      for (i = 0; i < NSUB; i++) {
-	 r = Subp(q)[i];
-	 if (r != NULL) {
-	    SUBV(dr, Pos(r), Pos(q));
-	    OUTVP(drdr, dr, dr);
-	    DOTVP(drsq, dr, dr);
-	    SETMI(Idrsq);
-	    MULMS(Idrsq, Idrsq, drsq);
-	    MULMS(tmpm, drdr, 3.0);
-	    SUBM(tmpm, tmpm, Idrsq);
-	    MULMS(tmpm, tmpm, Mass(r));
-	    ADDM(tmpm, tmpm, Quad(r));
-	    ADDM(Quad(q), Quad(q), tmpm);
-	 }
-      }
-#endif
-      Done(q)=TRUE;
    }
+#endif
 }
 
 cellptr SubdivideLeaf(leafptr le, cellptr parent, long l, long ProcessId)
@@ -2,6 +2,7 @@
 #define _LOAD_H_
 
 void maketree(long ProcessId);
+void inittree(void);
 cellptr InitCell(cellptr parent, long ProcessId);
 leafptr InitLeaf(cellptr parent, long ProcessId);
 void printtree(nodeptr n);
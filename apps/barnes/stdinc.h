@@ -108,6 +108,7 @@ typedef real (*rproc)();
 #include "load.h"
 #include "code_io.h"
 #include "grav.h"
+#include "interact.h"
 #include "getparam.h"
 
 #endif
@@ -64,6 +64,7 @@ void Amalgamate2(long join, SMatrix M, long *T, long *nz, long *node, long *doma
 {
   long i, j;
   long counter, supers_before, supers_after;
+  long *first_perm;
   double g_ops_before;
   extern double *work_tree;
   extern long *PERM, *firstchild, *child;
@@ -112,12 +113,24 @@ void Amalgamate2(long join, SMatrix M, long *T, long *nz, long *node, long *doma
     i = tree_original_sibling[i];
   }
 
+  /* ReorderMatrix() numbers the columns as ordered so far, so keep
+     that ordering to compose with */
+  first_perm = (long *) malloc((M.n+1)*sizeof(long));
+  for (i=0; i<=M.n; i++)
+    first_perm[i] = PERM[i];
+
   counter = M.n;
   ReorderMatrix(M, M.n, node, &counter, PERM);
   InvertPerm(M.n, PERM, INVP);
 
   FixNodeNZAndT(M, PERM, node, nz, T);
 
+  ComposePerm(first_perm, PERM, M.n);
+  for (i=0; i<=M.n; i++)
+    PERM[i] = first_perm[i];
+  InvertPerm(M.n, PERM, INVP);
+  free(first_perm);
+
   free(tree_firstchild); free(tree_sibling);
   free(tree_original_firstchild); free(tree_original_sibling);
   free(next_in_super); free(member_of); free(super_parent);
@@ -34,11 +34,12 @@ extern pthread_t PThreadTable[];
 #define MISS_COST 4.74
 #define ALPHA 100
 #define BETA 10
-#define TIME(ops,misses) (ops+(misses)*MISS_COST)/(1.0+MISS_COST/BS)
+#define TIME(ops,misses) (ops+(misses)*miss_cost)/(1.0+miss_cost/BS)
 
 extern BMatrix LB;
 extern long P;
 extern long BS;
+double miss_cost = MISS_COST;  /* in ops; CalibrateModel() measures it */
 double *opStats = NULL;
 double seq_time, seq_ops, seq_misses;
 
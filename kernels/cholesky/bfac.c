@@ -50,6 +50,11 @@ void BFac(long diag, struct LocalCopies *lc)
   n = BLOCK(diag)->length;
   A = BLOCK(diag)->nz;
 
+  if (DenseWorth(n, n, n/2)) {
+    OneFac(A, n, n);
+    return;
+  }
+
   for (js=0; js<n; js+=BS) {
     jl = js+BS; if (jl > n) jl = n;
 
@@ -79,10 +84,21 @@ void BFac(long diag, struct LocalCopies *lc)
 }
 
 /* Factor A (dim n1 by n1), stride n2 */
+/* large blocks are split in half, recursively, so that most of the
+   work is done by the dense solve and update kernels */
 
 void OneFac(double *A, long n1, long n2)
 {
-  long i, j, k;
+  long i, j, k, h;
+
+  h = n1/2;
+  if (DenseWorth(n1-h, n1-h, h)) {
+    OneFac(A, h, n2);
+    DenseTrsm(h, n1-h, A, n2, &A[h], n2);
+    DenseGemm(n1-h, n1-h, h, &A[h], n2, &A[h], n2, &A[h+n2*h], n2, 1);
+    OneFac(&A[h+n2*h], n1-h, n2);
+    return;
+  }
 
   for (j=0; j<n1; j++) {
     for (k=0; k<j; k++)
@@ -105,7 +121,7 @@ void BDiv(long n1, long n3, double *diag_nz, double *below_nz, struct LocalCopie
 
   A = diag_nz; B = below_nz;
 
-  if (n1*n3 <= BS*BS) {
+  if (n1*n3 <= BS*BS || DenseWorth(n3, n1, n1)) {
     OneDiv(A, B, n1, n3, n1);
   }
   else {
@@ -145,6 +161,11 @@ void OneDiv(double *A, double *B, long n1, long n3, long n4)
   double *tmp;
   double t0, t1, tmp0, tmp1;
 
+  if (DenseWorth(n3, n1, n1)) {
+    DenseTrsm(n1, n3, A, n4, B, n3);
+    return;
+  }
+
   for (j=0; j<n1-1; j+=2) {
     for (k=0; k<j-3; k+=4) {
       tmp = &A[j+n4*k];
@@ -211,7 +232,7 @@ void BMod(long n1, long n2, long n3, double *top_nz, double *bend_nz, double *de
   B = bend_nz;
   C = dest_nz;
 
-  if (n2*n3 <= BS*BS) {
+  if (n2*n3 <= BS*BS || DenseWorth(n3, n1, n2)) {
     OneMatmat(B, A, C, n1, n2, n3, n3, n1);
   }
   else if (n3 < FitsInCache/16) {  /* 16 columns at a time are good enough */
@@ -272,6 +293,11 @@ void OneMatmat(double *B, double *A, double *C, long n1, long n2, long n3, long
   double *tmp;
   double t0, t1, tmp0, tmp1;
 
+  if (DenseWorth(n3, n1, n2)) {
+    DenseGemm(n3, n1, n2, B, n3, A, n5, C, n4, 0);
+    return;
+  }
+
   for (j=0; j<n1-1; j+=2) {
     k = 0;
     for (; k<n2-7; k+=8) {
@@ -376,7 +402,7 @@ void BLMod(long n1, long n2, double *left_nz, double *dest_nz, struct LocalCopie
   A = left_nz;
   C = dest_nz;
 
-  if (n1*n2 <= BS*BS) {
+  if (n1*n2 <= BS*BS || DenseWorth(n1, n1, n2)) {
     OneLower(A, C, n1, n2, n1);
   }
   else {
@@ -407,6 +433,11 @@ void OneLower(double *A, double *C, long n1, long n2, long n3)
   double t0, t1, tmp0, tmp1;
   double *dest0, *dest1, *last;
 
+  if (DenseWorth(n1, n1, n2)) {
+    DenseGemm(n1, n1, n2, A, n1, A, n1, C, n3, 1);
+    return;
+  }
+
   for (j=0; j<n1-1; j+=2) {
     for (k=0; k<n2-3; k+=4) {
       tmp = &A[j+n1*k];
@@ -31,108 +31,486 @@ extern pthread_t PThreadTable[];
 #include "matrix.h"
 #include <math.h>
 
-double *TriBSolve(BMatrix LB, double *b, long *PERM)
+extern BMatrix LB;
+
+/* The triangular solves with the factor run on P threads, which are
+   started by the first solve and then wait for later ones.  Each
+   processor first solves through its own domains, one supernode at
+   a time, gathering what they contribute to the rest of the matrix
+   in a dense vector per domain, as the factorization does.  The
+   partitions outside the domains are then taken from a queue as soon
+   as all updates into them are in (forward), or all the rows they
+   need are solved (backward).  All k right-hand sides are carried
+   together, one row of k after another, so that every supernode and
+   block is one dense update of all of them.  The workspace is kept
+   for the next solve. */
+
+struct SolveWork {
+	long *indices;          /* position of each row in acc */
+	double *acc;            /* updates from a domain to other rows */
+	};
+
+static long solveP = 0, solve_k = 0, max_k = 0, acc_rows;
+static double *X;               /* n rows of k, in factor order */
+static struct SolveWork *work;
+static long n_parts, *part, *partStart;  /* partition of each column */
+static long *fwdNeed, *bwdNeed, *need;   /* updates into / rows needed */
+static long *rowFirst, *rowBlocks;       /* blocks in each block row */
+static pthread_mutex_t *partLock;
+static pthread_mutex_t queueLock;
+static pthread_cond_t queueReady;
+static long *queue, queueHead, queueTail, partsDone;
+static pthread_barrier_t solveStart, solveDone, solvePhase;
+extern long P, *node, *firstchild, *child;
+
+
+/* First column of the domain rooted at root */
+
+static long DomainStart(long root)
 {
-  long i, j, i1, j1, bl, row;
-  double *y, *xp, *x, *bt;
+  long start;
 
-  x = (double *) malloc(LB.n*sizeof(double));
-  xp = (double *) malloc(LB.n*sizeof(double));
-  y = (double *) malloc(LB.n*sizeof(double));
-  bt = (double *) malloc(LB.n*sizeof(double));
+  start = root;
+  while (firstchild[start] != firstchild[start+1])
+    start = child[firstchild[start]];
+  return(start);
+}
 
-  for (j=0; j<LB.n; j++)
-    bt[j] = b[j];
 
-  /* forward solve */
+/* Column lengths and structure count updates, so that the number of
+   updates into each partition and the blocks in each block row are
+   found once, by the first solve */
 
-  for (j=0; j<LB.n; j+=LB.partition_size[j]) {
-    if (LB.domain[j]) {
-      y[j] = bt[PERM[j]]/LB.entry[LB.col[j]].nz;
-      for (i=LB.col[j]+1; i<LB.col[j+1]; i++)
-        bt[PERM[LB.row[i]]] -= LB.entry[i].nz*y[j];
+static void SetUpSolve()
+{
+  long i, j, d, bl, root, r, last, max_len;
+
+  part = (long *) MyMalloc(LB.n*sizeof(long), DISTRIBUTED);
+  partStart = (long *) MyMalloc(LB.n*sizeof(long), DISTRIBUTED);
+  n_parts = 0;
+  for (j=0; j<LB.n; j+=LB.partition_size[j])
+    if (!LB.domain[j]) {
+      for (i=j; i<j+LB.partition_size[j]; i++)
+	part[i] = n_parts;
+      partStart[n_parts++] = j;
     }
-    else {
-      /* diagonal block */
-      bl = LB.col[j];
-      for (j1=j; j1<j+LB.partition_size[j]; j1++) {
-	y[j1] = bt[PERM[j1]]/
-	        LB.entry[bl].block->nz[(j1-j)+(j1-j)*LB.entry[bl].block->length];
-        for (i1=j1-j+1; i1<LB.entry[bl].block->length; i1++) {
-	  if (LB.entry[bl].block->structure)
-	    row = LB.row[bl] + LB.entry[bl].block->structure[i1];
-	  else row = LB.row[bl] + i1;
-	  bt[PERM[row]] -= LB.entry[bl].block->nz[
-		i1+(j1-j)*LB.entry[bl].block->length] * y[j1];
-	}
-      }
-      /* blocks below diagonal */
-      for (bl=LB.col[j]+1; bl<LB.col[j+1]; bl++) {
-	for (i1=0; i1<LB.entry[bl].block->length; i1++) {
-	  if (LB.entry[bl].block->structure)
-	    row = LB.row[bl] + LB.entry[bl].block->structure[i1];
-	  else row = LB.row[bl] + i1;
-	  for (j1=j; j1<j+LB.partition_size[j]; j1++) {
-	    bt[PERM[row]] -= LB.entry[bl].block->nz[
-		i1+(j1-j)*LB.entry[bl].block->length] * y[j1];
-	  }
-	}
-      }
+
+  fwdNeed = (long *) MyMalloc((n_parts+1)*sizeof(long), DISTRIBUTED);
+  bwdNeed = (long *) MyMalloc((n_parts+1)*sizeof(long), DISTRIBUTED);
+  need = (long *) MyMalloc((n_parts+1)*sizeof(long), DISTRIBUTED);
+  rowFirst = (long *) MyMalloc((n_parts+1)*sizeof(long), DISTRIBUTED);
+  partLock = (pthread_mutex_t *) MyMalloc((n_parts+1)*sizeof(pthread_mutex_t),
+					  DISTRIBUTED);
+  queue = (long *) MyMalloc((n_parts+1)*sizeof(long), DISTRIBUTED);
+  for (i=0; i<=n_parts; i++) {
+    fwdNeed[i] = bwdNeed[i] = rowFirst[i] = 0;
+    {pthread_mutex_init(&(partLock[i]), NULL);}
+  }
+
+  for (i=0; i<n_parts; i++) {
+    j = partStart[i];
+    for (bl=LB.col[j]+1; bl<LB.col[j+1]; bl++) {
+      fwdNeed[part[LB.row[bl]]]++;
+      rowFirst[part[LB.row[bl]]+1]++;
+      bwdNeed[i]++;
+    }
+  }
+  for (i=0; i<n_parts; i++)
+    rowFirst[i+1] += rowFirst[i];
+  rowBlocks = (long *) MyMalloc((rowFirst[n_parts]+1)*sizeof(long),
+				DISTRIBUTED);
+  for (i=0; i<n_parts; i++) {
+    j = partStart[i];
+    for (bl=LB.col[j]+1; bl<LB.col[j+1]; bl++)
+      rowBlocks[rowFirst[part[LB.row[bl]]]++] = bl;
+  }
+  for (i=n_parts; i>0; i--)
+    rowFirst[i] = rowFirst[i-1];
+  rowFirst[0] = 0;
+
+  /* each domain updates every partition its root column reaches */
+  max_len = 0;
+  for (d=0; d<LB.n_domains; d++) {
+    root = LB.domains[d];
+    last = -1;
+    for (i=LB.col[root]+1; i<LB.col[root+1]; i++) {
+      r = part[LB.row[i]];
+      if (r != last)
+	fwdNeed[r]++;
+      last = r;
     }
+    if (LB.col[root+1]-LB.col[root] > max_len)
+      max_len = LB.col[root+1]-LB.col[root];
+  }
+
+  {pthread_mutex_init(&(queueLock), NULL);}
+  {pthread_cond_init(&(queueReady), NULL);}
+
+  acc_rows = max_len;
+  work = (struct SolveWork *) MyMalloc(P*sizeof(struct SolveWork),
+				       DISTRIBUTED);
+  for (i=0; i<P; i++) {
+    work[i].indices = (long *) MyMalloc(LB.n*sizeof(long), i);
+    work[i].acc = NULL;
+  }
+}
+
+
+static void Ready(long r)
+{
+  {pthread_mutex_lock(&(queueLock));}
+  queue[queueTail++] = r;
+  {pthread_cond_signal(&(queueReady));}
+  {pthread_mutex_unlock(&(queueLock));}
+}
+
+
+/* Next partition that is ready, or -1 once all are done */
+
+static long NextReady()
+{
+  long r;
+
+  {pthread_mutex_lock(&(queueLock));}
+  while (queueHead == queueTail && partsDone < n_parts)
+    {pthread_cond_wait(&(queueReady), &(queueLock));}
+  r = (queueHead < queueTail ? queue[queueHead++] : -1);
+  {pthread_mutex_unlock(&(queueLock));}
+  return(r);
+}
+
+
+static void PartDone()
+{
+  {pthread_mutex_lock(&(queueLock));}
+  if (++partsDone == n_parts)
+    {pthread_cond_broadcast(&(queueReady));}
+  {pthread_mutex_unlock(&(queueLock));}
+}
+
+
+/* Start a phase with need[] from count[], queueing what is ready */
+
+static void StartPhase(long *count)
+{
+  long i;
+
+  queueHead = queueTail = partsDone = 0;
+  for (i=0; i<n_parts; i++) {
+    need[i] = count[i];
+    if (need[i] == 0)
+      queue[queueTail++] = i;
   }
+}
+
 
-  /* back solve */
+static void Credit(long r)
+{
+  if (__atomic_sub_fetch(&need[r], 1, __ATOMIC_ACQ_REL) == 0)
+    Ready(r);
+}
+
+
+static void Axpy(double *y, double *x, double a, long k)
+{
+  long i;
+
+  for (i=0; i<k; i++)
+    y[i] += a*x[i];
+}
 
-  j = LB.n-1;
-  if (LB.partition_size[j] < 0)
-    j += LB.partition_size[j];
 
-  while (j >= 0) {
-    if (LB.domain[j]) {
-      for (i=LB.col[j]+1; i<LB.col[j+1]; i++)
-        y[j] -= LB.entry[i].nz*xp[LB.row[i]];
-      xp[j] = y[j]/LB.entry[LB.col[j]].nz;
+static void Scale(double *y, double a, long k)
+{
+  long i;
+
+  for (i=0; i<k; i++)
+    y[i] *= a;
+}
+
+
+/* Forward through domain d.  Rows outside the domain collect in acc
+   and are then added in under the lock of their partition. */
+
+static void ForwardDomain(long d, long MyNum)
+{
+  long i, j, p, q, s, w, len, rows, root, r, k;
+  long *indices, *row;
+  double *acc, *L, **a, **b, **c;
+
+  k = solve_k;
+  root = LB.domains[d];
+  indices = work[MyNum].indices;
+  acc = work[MyNum].acc;
+  len = LB.col[root+1]-LB.col[root]-1;
+  for (i=0; i<len; i++)
+    indices[LB.row[LB.col[root]+1+i]] = i;
+  for (i=0; i<len*k; i++)
+    acc[i] = 0.0;
+
+  for (s=DomainStart(root); s<=root; s+=node[s]) {
+    w = node[s];
+    len = LB.col[s+1]-LB.col[s];
+    row = &LB.row[LB.col[s]];
+
+    /* diagonal triangle */
+    for (p=0; p<w; p++) {
+      L = (double *) &LB.entry[LB.col[s+p]].nz;
+      Scale(&X[(s+p)*k], 1.0/L[0], k);
+      for (q=p+1; q<w; q++)
+	Axpy(&X[(s+q)*k], &X[(s+p)*k], -L[q-p], k);
     }
-    else {
-      /* blocks below diagonal */
-      for (bl=LB.col[j]+1; bl<LB.col[j+1]; bl++) {
-        for (i1=0; i1<LB.entry[bl].block->length; i1++) {
-	  if (LB.entry[bl].block->structure)
-	    row = LB.row[bl] + LB.entry[bl].block->structure[i1];
-	  else row = LB.row[bl] + i1;
-          for (j1=j; j1<j+LB.partition_size[j]; j1++) {
-	    y[j1] -= LB.entry[bl].block->nz[
-		i1+(j1-j)*LB.entry[bl].block->length] * xp[row];
-	  }
-	}
-      }
-      /* diagonal block */
-      bl = LB.col[j];
-      for (j1=j+LB.partition_size[j]-1; j1>=j; j1--) {
-        for (i1=j1-j+1; i1<LB.entry[bl].block->length; i1++) {
-	  if (LB.entry[bl].block->structure)
-	    row = LB.row[bl] + LB.entry[bl].block->structure[i1];
-	  else row = LB.row[bl] + i1;
-	  y[j1] -= LB.entry[bl].block->nz[
-		i1+(j1-j)*LB.entry[bl].block->length] * xp[row];
-	}
-	xp[j1] = y[j1]/
-	        LB.entry[bl].block->nz[(j1-j)+(j1-j)*LB.entry[bl].block->length];
-      }
+
+    /* rows below, within the domain or collected in acc */
+    rows = len-w;
+    a = DenseColumns(w+w+rows);
+    b = a+w; c = b+w;
+    for (p=0; p<w; p++) {
+      a[p] = &X[(s+p)*k];
+      b[p] = (double *) &LB.entry[LB.col[s+p]+w-p].nz;
     }
+    for (j=0; j<rows; j++)
+      if (row[w+j] <= root)
+	c[j] = &X[row[w+j]*k];
+      else
+	c[j] = &acc[indices[row[w+j]]*k];
+    DenseUpdate(k, rows, w, a, b, c, 0);
+  }
 
-    j--;
-    if (j>=0 && LB.partition_size[j] < 0)
-      j += LB.partition_size[j];
+  len = LB.col[root+1]-LB.col[root]-1;
+  row = &LB.row[LB.col[root]+1];
+  for (i=0; i<len; i=j) {
+    r = part[row[i]];
+    {pthread_mutex_lock(&(partLock[r]));}
+    for (j=i; j<len && part[row[j]] == r; j++)
+      Axpy(&X[row[j]*k], &acc[j*k], 1.0, k);
+    {pthread_mutex_unlock(&(partLock[r]));}
+    Credit(r);
   }
+}
+
 
+/* Back through domain d, last supernode first */
+
+static void BackDomain(long d)
+{
+  long j, p, q, s, w, len, rows, start, root, k;
+  long *row;
+  double *L, **a, **bt, **c;
+
+  k = solve_k;
+  root = LB.domains[d];
+  start = DomainStart(root);
+
+  for (j=root; j>=start; j=s-1) {
+    s = (node[j] < 0 ? j+node[j] : j);
+    w = node[s];
+    len = LB.col[s+1]-LB.col[s];
+    row = &LB.row[LB.col[s]];
+
+    rows = len-w;
+    a = DenseColumns(rows+w+w);
+    bt = a+rows; c = bt+w;
+    for (q=0; q<rows; q++)
+      a[q] = &X[row[w+q]*k];
+    for (p=0; p<w; p++) {
+      bt[p] = (double *) &LB.entry[LB.col[s+p]+w-p].nz;
+      c[p] = &X[(s+p)*k];
+    }
+    DenseUpdateT(k, w, rows, a, bt, c);
+
+    for (p=w-1; p>=0; p--) {
+      L = (double *) &LB.entry[LB.col[s+p]].nz;
+      for (q=p+1; q<w; q++)
+	Axpy(&X[(s+p)*k], &X[(s+q)*k], -L[q-p], k);
+      Scale(&X[(s+p)*k], 1.0/L[0], k);
+    }
+  }
+}
+
+
+/* Row of entry i of block bl */
+
+#define BLOCK_ROW(bl, i) (BLOCK(bl)->structure ? \
+			  LB.row[bl] + BLOCK(bl)->structure[i] : LB.row[bl] + (i))
+
+
+/* Forward through partition r, whose updates are all in */
+
+static void ForwardPartition(long r)
+{
+  long j, p, q, bl, w, len, k;
+  double *L, **a, **b, **c;
+
+  k = solve_k;
+  j = partStart[r];
+  w = LB.partition_size[j];
+
+  bl = LB.col[j];
+  len = BLOCK(bl)->length;
+  L = BLOCK(bl)->nz;
+  for (p=0; p<w; p++) {
+    Scale(&X[(j+p)*k], 1.0/L[p+p*len], k);
+    for (q=p+1; q<len; q++)
+      Axpy(&X[BLOCK_ROW(bl, q)*k], &X[(j+p)*k], -L[q+p*len], k);
+  }
+
+  for (bl=LB.col[j]+1; bl<LB.col[j+1]; bl++) {
+    len = BLOCK(bl)->length;
+    L = BLOCK(bl)->nz;
+    a = DenseColumns(w+w+len);
+    b = a+w; c = b+w;
+    for (p=0; p<w; p++) {
+      a[p] = &X[(j+p)*k];
+      b[p] = &L[p*len];
+    }
+    for (q=0; q<len; q++)
+      c[q] = &X[BLOCK_ROW(bl, q)*k];
+    {pthread_mutex_lock(&(partLock[part[LB.row[bl]]]));}
+    DenseUpdate(k, len, w, a, b, c, 0);
+    {pthread_mutex_unlock(&(partLock[part[LB.row[bl]]]));}
+    Credit(part[LB.row[bl]]);
+  }
+}
+
+
+/* Back through partition r, all of whose rows below are solved */
+
+static void BackPartition(long r)
+{
+  long i, j, p, q, bl, w, len, k;
+  double *L, **a, **bt, **c;
+
+  k = solve_k;
+  j = partStart[r];
+  w = LB.partition_size[j];
+
+  for (bl=LB.col[j]+1; bl<LB.col[j+1]; bl++) {
+    len = BLOCK(bl)->length;
+    L = BLOCK(bl)->nz;
+    a = DenseColumns(len+w+w);
+    bt = a+len; c = bt+w;
+    for (q=0; q<len; q++)
+      a[q] = &X[BLOCK_ROW(bl, q)*k];
+    for (p=0; p<w; p++) {
+      bt[p] = &L[p*len];
+      c[p] = &X[(j+p)*k];
+    }
+    DenseUpdateT(k, w, len, a, bt, c);
+  }
+
+  bl = LB.col[j];
+  len = BLOCK(bl)->length;
+  L = BLOCK(bl)->nz;
+  for (p=w-1; p>=0; p--) {
+    for (q=p+1; q<len; q++)
+      Axpy(&X[(j+p)*k], &X[BLOCK_ROW(bl, q)*k], -L[q+p*len], k);
+    Scale(&X[(j+p)*k], 1.0/L[p+p*len], k);
+  }
+
+  /* partitions with a block in this block row may now go */
+  for (i=rowFirst[r]; i<rowFirst[r+1]; i++)
+    Credit(part[BLOCKCOL(rowBlocks[i])]);
+}
+
+
+static void SolveWorker(long MyNum)
+{
+  long d, r;
+
+  for (d=LB.proc_domains[MyNum]; d<LB.proc_domains[MyNum+1]; d++)
+    ForwardDomain(d, MyNum);
+  while ((r = NextReady()) >= 0) {
+    ForwardPartition(r);
+    PartDone();
+  }
+
+  pthread_barrier_wait(&solvePhase);
+  if (MyNum == 0)
+    StartPhase(bwdNeed);
+  pthread_barrier_wait(&solvePhase);
+
+  while ((r = NextReady()) >= 0) {
+    BackPartition(r);
+    PartDone();
+  }
+  for (d=LB.proc_domains[MyNum+1]-1; d>=LB.proc_domains[MyNum]; d--)
+    BackDomain(d);
+}
+
+
+static void *SolveThread(void *arg)
+{
+  long MyNum = (long) arg;
+
+  for (;;) {
+    pthread_barrier_wait(&solveStart);
+    SolveWorker(MyNum);
+    pthread_barrier_wait(&solveDone);
+  }
+  return(NULL);
+}
+
+
+/* Overwrite x, n by k and column-major in the original order, with
+   the solution of A x = x.  Called by the master alone, after the
+   factorization. */
+
+void BlockSolve(double *x, long k, long *PERM)
+{
+  long i, j, c;
+
+  if (!work)
+    SetUpSolve();
+  if (k > max_k) {
+    if (X)
+      free(X);
+    X = (double *) malloc(LB.n*k*sizeof(double));
+    for (i=0; i<P; i++) {
+      if (work[i].acc)
+	MyFree(work[i].acc);
+      work[i].acc = (double *) MyMalloc((acc_rows*k+1)*sizeof(double), i);
+    }
+    max_k = k;
+  }
+  solve_k = k;
 
   for (j=0; j<LB.n; j++)
-    x[j] = xp[PERM[j]];
+    for (c=0; c<k; c++)
+      X[j*k+c] = x[PERM[j]+c*LB.n];
+
+  if (!solveP) {
+    pthread_barrier_init(&solveStart, NULL, P);
+    pthread_barrier_init(&solveDone, NULL, P);
+    pthread_barrier_init(&solvePhase, NULL, P);
+    for (i=1; i<P; i++)
+      if (pthread_create(&PThreadTable[i-1], NULL, SolveThread, (void *) i) != 0) {
+	printf("Error in pthread_create().\n");
+	exit(-1);
+      }
+    solveP = P;
+  }
+
+  StartPhase(fwdNeed);
+  pthread_barrier_wait(&solveStart);
+  SolveWorker(0);
+  pthread_barrier_wait(&solveDone);
 
-  free(xp);
-  free(y);
-  free(bt);
+  for (j=0; j<LB.n; j++)
+    for (c=0; c<k; c++)
+      x[PERM[j]+c*LB.n] = X[j*k+c];
+}
+
+
+double *TriBSolve(BMatrix LB, double *b, long *PERM)
+{
+  long j;
+  double *x;
+
+  x = (double *) malloc(LB.n*sizeof(double));
+  for (j=0; j<LB.n; j++)
+    x[j] = b[j];
+  BlockSolve(x, 1, PERM);
 
   return(x);
 }
@@ -269,71 +269,162 @@ void ComputeBlockParents(long *T)
 }
 
 
-/* find non-zero structure of individual blocks */
+/* find non-zero structure of individual blocks.  A supernode needs the
+   structure of its children, so each processor does its own subtrees
+   of the elimination tree, and the top of the tree is done after. */
 
-void FillInStructure(SMatrix M, long *firstchild, long *child, long *PERM, long *INVP)
+static SMatrix fill_M;
+static long *fill_PERM, *fill_INVP, *fill_firstchild, *fill_child;
+static struct Subtrees *fill_trees;
+static long *fill_owner;
+
+static void FillInSuper(long super, long *structure, long *nz)
 {
-  long i, j, col, super;
+  long j, n_nz;
+
+  FindSuperStructure(fill_M, super, fill_PERM, fill_INVP, fill_firstchild,
+		     fill_child, structure, nz, &n_nz);
+  if (!LB.domain[super])
+    for (j=super; j<super+node[super]; j+=LB.partition_size[j]) {
+      FindDetailedStructure(j, structure, nz, n_nz);
+    }
+}
+
+
+/* processor -1 does the top */
+
+static void FillInSubtrees(long MyNum)
+{
+  long i, j, s, col, super;
   long *structure, *nz, n_nz;
 
   /* all procedures get structure=0, and return structure=0 */
-  structure = (long *) malloc(M.n*sizeof(long));
-  nz = (long *) malloc(M.n*sizeof(long));
-  for (i=0; i<M.n; i++)
+  structure = (long *) malloc(LB.n*sizeof(long));
+  nz = (long *) malloc(LB.n*sizeof(long));
+  for (i=0; i<LB.n; i++)
     structure[i] = 0;
 
   /* find the structure of dummy domain blocks */
-  for (j=0; j<LB.n_domains; j++) {
-    col = LB.domains[j];
-    for (i=LB.col[col]+1; i<LB.col[col+1]; i++)
-      nz[i-LB.col[col]-1] = LB.row[i];
-    n_nz = LB.col[col+1]-LB.col[col]-1;
-    FindDetailedStructure(LB.n+j, structure, nz, n_nz);
-  }
+  if (MyNum >= 0)
+    for (j=LB.proc_domains[MyNum]; j<LB.proc_domains[MyNum+1]; j++) {
+      col = LB.domains[j];
+      for (i=LB.col[col]+1; i<LB.col[col+1]; i++)
+	nz[i-LB.col[col]-1] = LB.row[i];
+      n_nz = LB.col[col+1]-LB.col[col]-1;
+      FindDetailedStructure(LB.n+j, structure, nz, n_nz);
+    }
 
   /* find the structure of the individual blocks */
   for (super=0; super<LB.n; super+=node[super]) {
-    FindSuperStructure(M, super, PERM, INVP, firstchild, child,
-		       structure, nz, &n_nz);
-    if (!LB.domain[super])
-      for (j=super; j<super+node[super]; j+=LB.partition_size[j]) {
-	FindDetailedStructure(j, structure, nz, n_nz);
-      }
+    s = fill_trees->sub[super+node[super]-1];
+    if ((s == -1 && MyNum == -1) ||
+	(s != -1 && fill_trees->owner[s] == MyNum))
+      FillInSuper(super, structure, nz);
   }
 
   free(structure); free(nz);
+}
+
+
+void FillInStructure(SMatrix M, long *firstchild, long *child, long *PERM, long *INVP)
+{
+  long j;
+  double *weight;
+  extern long *nz, *T, P;
+
+  fill_M = M; fill_PERM = PERM; fill_INVP = INVP;
+  fill_firstchild = firstchild; fill_child = child;
+
+  weight = (double *) malloc(LB.n*sizeof(double));
+  for (j=0; j<LB.n; j++)
+    weight[j] = nz[j];
+  fill_trees = FindSubtrees(LB.n, T, weight, P);
+  free(weight);
 
+  SymbolicThreads(FillInSubtrees, P);
+  FillInSubtrees(-1);
+
+  FreeSubtrees(fill_trees);
 }
 
-/* put original non-zero values into blocks */
+/* put original non-zero values into blocks, each partition by the
+   processor that owns it */
 
-void FillInNZ(SMatrix M, long *PERM, long *INVP)
+static void FillInSome(long MyNum)
 {
   long j;
   double *scatter;
 
-  scatter = (double *) malloc(M.n*sizeof(double));
-  for (j=0; j<M.n; j++)
+  scatter = (double *) malloc(fill_M.n*sizeof(double));
+  for (j=0; j<fill_M.n; j++)
     scatter[j] = 0.0;
 
-  /* fill in non-zeroes */  
   for (j=0; j<LB.n; j+=LB.partition_size[j])
-    FillIn(M, j, PERM, INVP, scatter);
+    if (fill_owner[j] == MyNum)
+      FillIn(fill_M, j, fill_PERM, fill_INVP, scatter);
 
   free(scatter);
 }
 
 
+void FillInNZ(SMatrix M, long *PERM, long *INVP)
+{
+  long j, p, d, first, root;
+  extern long *firstchild, *child, P;
+
+  fill_M = M; fill_PERM = PERM; fill_INVP = INVP;
+
+  if (!fill_owner) {
+    fill_owner = (long *) malloc(LB.n*sizeof(long));
+    for (j=0; j<LB.n; j+=LB.partition_size[j])
+      fill_owner[j] = LB.domain[j] ? 0 : BLOCK(LB.col[j])->owner;
+    for (p=0; p<P; p++)
+      for (d=LB.proc_domains[p]; d<LB.proc_domains[p+1]; d++) {
+	root = LB.domains[d];
+	first = root;
+	while (firstchild[first] != firstchild[first+1])
+	  first = child[firstchild[first]];
+	for (j=first; j<=root; j++)
+	  fill_owner[j] = p;
+      }
+  }
+
+  SymbolicThreads(FillInSome, P);
+}
+
+
+/* Make room for n entries in LB.row and LB.entry, which were sized
+   from an estimate of the number of blocks before the structure was
+   known */
+
+void GrowEntries(long n)
+{
+  long old;
+
+  if (n <= LB.entries_allocated)
+    return;
+  old = LB.entries_allocated;
+  while (LB.entries_allocated < n)
+    LB.entries_allocated *= 2;
+  LB.entry = (Entry *) realloc(LB.entry, LB.entries_allocated*sizeof(Entry));
+  LB.row = (long *) realloc(LB.row, LB.entries_allocated*sizeof(long));
+  if (!LB.entry || !LB.row) {
+    printf("Out of memory for %ld block entries\n", LB.entries_allocated);
+    exit(-1);
+  }
+  memset(&LB.entry[old], 0x00, (LB.entries_allocated-old)*sizeof(Entry));
+  MigrateMem(LB.entry, LB.entries_allocated*sizeof(Entry), DISTRIBUTED);
+  MigrateMem(LB.row, LB.entries_allocated*sizeof(long), DISTRIBUTED);
+}
+
+
 void FindDomStructure(long super, long *nz, long n_nz)
 {
   long col, i;
 
   for (col=super; col<super+node[super]; col++) {
     LB.col[col+1] = LB.col[col] + n_nz - (col-super);
-    if (LB.col[col+1] > LB.entries_allocated) {
-      printf("Overflow\n");
-      exit(-1);
-    }
+    GrowEntries(LB.col[col+1]);
 
     for (i=col-super; i<n_nz; i++)
       LB.row[LB.col[col]+i-(col-super)] = nz[i];
@@ -349,8 +440,10 @@ void FindDummyDomainStructure(long which_domain)
   current_block = current_block_last = -1;
   row = LB.col[col]+1;
 
-  /* column starts out empty */
+  /* column starts out empty, and has at most a block per row below
+     the domain's root */
   LB.col[LB.n+which_domain+1] = LB.col[LB.n+which_domain];
+  GrowEntries(LB.col[LB.n+which_domain] + LB.col[col+1]-LB.col[col]);
 
   while (row < LB.col[col+1]) {
     current_block = LB.row[row];
@@ -364,11 +457,6 @@ void FindDummyDomainStructure(long which_domain)
 	   row < LB.col[col+1])
       row++;
   }
-
-  if (LB.col[LB.n+which_domain+1] > LB.entries_allocated) {
-    printf("Overflow!!\n");
-    exit(-1);
-  }
 }
 
 
@@ -420,10 +508,7 @@ void FindBlStructure(SMatrix M, long super, long *PERM, long *INVP, long *firstc
   InsSort(nz, n_nz);
 
   LB.col[super+1] = LB.col[super] + n_nz;
-  if (LB.col[super+1] > LB.entries_allocated) {
-    printf("Overflow\n");
-    exit(-1);
-  }
+  GrowEntries(LB.col[super+1]);
   for (i=0; i<n_nz; i++)
     LB.row[LB.col[super]+i] = nz[i];
 
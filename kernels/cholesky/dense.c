@@ -0,0 +1,458 @@
+/*************************************************************************/
+/*                                                                       */
+/*  Packed, register-tiled dense kernels for the block and supernode     */
+/*  updates.                                                             */
+/*                                                                       */
+/*  DenseUpdate() computes C -= A B^T, or only its lower triangle, for   */
+/*  matrices given as arrays of column pointers, so that the same code   */
+/*  serves dense blocks and the packed trapezoidal columns of a          */
+/*  supernode.  A and B are copied into MR-row and NR-column panels and  */
+/*  an MR x NR micro-kernel accumulates each tile of C in registers;     */
+/*  the micro-kernel is chosen at run time from the instruction sets     */
+/*  the processor supports, and without one that has vector FMA the      */
+/*  callers keep to their scalar loops.  Edge tiles of any shape go      */
+/*  through the same micro-kernel, and tiles cut by the diagonal are     */
+/*  formed aside and only their lower part subtracted.  DenseTrsm() is   */
+/*  blocked so that all but a narrow diagonal panel of a solve is a      */
+/*  DenseUpdate().                                                       */
+/*                                                                       */
+/*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "matrix.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DENSE_X86
+#include <immintrin.h>
+#endif
+
+#define NR                  6    /* columns of a micro-tile */
+#define MR_MAX             16    /* most rows of any micro-tile */
+#define KC                256    /* depth of a packed panel */
+#define MC                128    /* rows of packed A, a multiple of MR */
+#define NC                384    /* columns of packed B, a multiple of NR */
+#define TRSM_BLOCK         32    /* columns solved one by one in DenseTrsm */
+#define DENSE_MIN_WORK   4096    /* fewer multiply-adds stay scalar */
+#define PACK_ALIGN         64
+
+typedef void (*micro_kernel_t)(long k, double *a, double *b, double **c,
+			       long m, long n);
+
+#ifdef DENSE_X86
+static void Kernel8x6AVX2(long k, double *a, double *b, double **c,
+			  long m, long n);
+static void Kernel16x6AVX512(long k, double *a, double *b, double **c,
+			     long m, long n);
+#endif
+
+static micro_kernel_t micro_kernel = NULL;
+static long mr = 1;
+static char *kernel_name = "scalar";
+
+/* Per-thread packing buffers and column pointer lists, grown on demand */
+static __thread double *pack_a = NULL, *pack_b = NULL;
+static __thread long pack_a_size = 0, pack_b_size = 0;
+static __thread double **cols = NULL;
+static __thread long cols_size = 0;
+
+
+/* Select the widest micro-kernel the processor runs.  Must be called
+   before any thread uses the kernels. */
+
+void DenseInit()
+{
+#ifdef DENSE_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    micro_kernel = Kernel16x6AVX512;
+    mr = 16;
+    kernel_name = "AVX-512 16x6";
+  }
+  else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    micro_kernel = Kernel8x6AVX2;
+    mr = 8;
+    kernel_name = "AVX2 8x6";
+  }
+#endif
+}
+
+
+char *DenseKernelName()
+{
+  return(kernel_name);
+}
+
+
+/* Whether an m x n update of depth k is worth packing */
+
+long DenseWorth(long m, long n, long k)
+{
+  return(micro_kernel && k >= 4 && n >= 2 && m*n*k >= DENSE_MIN_WORK);
+}
+
+
+static void *GrowBuffer(void *buf, long *size, long want, long elem)
+{
+  void *p;
+
+  if (want <= *size)
+    return(buf);
+  free(buf);
+  if (posix_memalign(&p, PACK_ALIGN, want*elem) != 0) {
+    printf("Could not malloc memory for packing buffer\n");
+    exit(-1);
+  }
+  *size = want;
+  return(p);
+}
+
+
+/* Copy rows i0..i0+m of columns a[0..k) into panels of mr rows, each
+   stored column by column, padding the last panel with zeros */
+
+static void PackA(double **a, long i0, long m, long k, double *pa)
+{
+  long i, ir, p, rows;
+  double *col;
+
+  for (ir=0; ir<m; ir+=mr) {
+    rows = min(mr, m-ir);
+    for (p=0; p<k; p++) {
+      col = a[p] + i0 + ir;
+      for (i=0; i<rows; i++)
+	*pa++ = col[i];
+      for (; i<mr; i++)
+	*pa++ = 0.0;
+    }
+  }
+}
+
+
+/* Copy rows j0..j0+n, columns p0..p0+k of B into panels of NR rows,
+   each stored row by row, padding the last panel with zeros.  B(j,p)
+   is b[p][j], or b[j][p] if trans is set. */
+
+static void PackB(double **b, long trans, long j0, long p0, long n, long k,
+		  double *pb)
+{
+  long j, jr, p, rows;
+  double *col;
+
+  for (jr=0; jr<n; jr+=NR) {
+    rows = min(NR, n-jr);
+    for (p=0; p<k; p++) {
+      if (trans)
+	for (j=0; j<rows; j++)
+	  *pb++ = b[j0+jr+j][p0+p];
+      else {
+	col = b[p0+p] + j0 + jr;
+	for (j=0; j<rows; j++)
+	  *pb++ = col[j];
+      }
+      for (j=rows; j<NR; j++)
+	*pb++ = 0.0;
+    }
+  }
+}
+
+
+/* One tile of C at row i, column j.  A tile that the diagonal cuts is
+   formed in t and only its lower part is subtracted. */
+
+static void Tile(long kc, double *pa, double *pb, double **c, long i, long j,
+		 long m, long n, long lower)
+{
+  double t[MR_MAX*NR];
+  double *tc[NR];
+  long ii, jj;
+
+  if (lower && i+m-1 < j)
+    return;
+
+  if (!lower || i >= j+n-1) {
+    for (jj=0; jj<n; jj++)
+      tc[jj] = c[j+jj] + i;
+    micro_kernel(kc, pa, pb, tc, m, n);
+    return;
+  }
+
+  for (jj=0; jj<n; jj++) {
+    tc[jj] = &t[jj*MR_MAX];
+    for (ii=0; ii<m; ii++)
+      tc[jj][ii] = 0.0;
+  }
+  micro_kernel(kc, pa, pb, tc, m, n);
+  for (jj=0; jj<n; jj++)
+    for (ii=0; ii<m; ii++)
+      if (i+ii >= j+jj)
+	c[j+jj][i+ii] += tc[jj][ii];
+}
+
+
+/* C -= A B^T, where A is m by k with A(i,p) = a[p][i], B is n by k
+   with B(j,p) = b[p][j] (b[j][p] if trans), and C is m by n with
+   C(i,j) = c[j][i].  If lower is set only the entries with i >= j are
+   updated.  Updates too small to pack are done in place. */
+
+static void Update(long m, long n, long k, double **a, double **b, double **c,
+		   long lower, long trans)
+{
+  long i, j, p, ic, jc, pc, ir, jr;
+  long mc, nc, kc, i0;
+  double bjp, *ap, *cj;
+
+  if (m <= 0 || n <= 0 || k <= 0)
+    return;
+
+  if (!DenseWorth(m, n, k)) {
+    for (j=0; j<n; j++) {
+      cj = c[j];
+      for (p=0; p<k; p++) {
+	bjp = (trans ? b[j][p] : b[p][j]);
+	if (bjp == 0.0)
+	  continue;
+	ap = a[p];
+	for (i=(lower ? j : 0); i<m; i++)
+	  cj[i] -= ap[i]*bjp;
+      }
+    }
+    return;
+  }
+
+  pack_a = GrowBuffer(pack_a, &pack_a_size, MC*KC, sizeof(double));
+  pack_b = GrowBuffer(pack_b, &pack_b_size,
+		      ((min(n, NC)+NR-1)/NR)*NR*min(k, KC), sizeof(double));
+
+  for (jc=0; jc<n; jc+=NC) {
+    nc = min(NC, n-jc);
+    i0 = (lower ? jc : 0);
+    for (pc=0; pc<k; pc+=KC) {
+      kc = min(KC, k-pc);
+      PackB(b, trans, jc, pc, nc, kc, pack_b);
+      for (ic=i0; ic<m; ic+=MC) {
+	mc = min(MC, m-ic);
+	PackA(&a[pc], ic, mc, kc, pack_a);
+	for (jr=0; jr<nc; jr+=NR)
+	  for (ir=0; ir<mc; ir+=mr)
+	    Tile(kc, &pack_a[ir*kc], &pack_b[jr*kc], c, ic+ir, jc+jr,
+		 min(mr, mc-ir), min(NR, nc-jr), lower);
+      }
+    }
+  }
+}
+
+
+void DenseUpdate(long m, long n, long k, double **a, double **b, double **c,
+		 long lower)
+{
+  Update(m, n, k, a, b, c, lower, 0);
+}
+
+
+/* DenseUpdate() with B given by rows: B(j,p) = bt[j][p] */
+
+void DenseUpdateT(long m, long n, long k, double **a, double **bt, double **c)
+{
+  Update(m, n, k, a, bt, c, 0, 1);
+}
+
+
+/* A list of n column pointers for DenseUpdate(), private to the
+   calling thread and good until its next call here */
+
+double **DenseColumns(long n)
+{
+  cols = (double **) GrowBuffer(cols, &cols_size, n, sizeof(double *));
+  return(cols);
+}
+
+
+/* Column pointers for the n columns of x, stride ld, from 'at' on in
+   the calling thread's list */
+
+static double **Columns(double *x, long ld, long n, long at)
+{
+  long j;
+
+  for (j=0; j<n; j++)
+    cols[at+j] = x + j*ld;
+  return(&cols[at]);
+}
+
+
+/* DenseUpdate() for column-major blocks: C (m by n, stride ldc) -= A
+   (m by k, stride lda) times the transpose of B (n by k, stride ldb) */
+
+void DenseGemm(long m, long n, long k, double *a, long lda, double *b,
+	       long ldb, double *c, long ldc, long lower)
+{
+  DenseColumns(2*k+n);
+  DenseUpdate(m, n, k, Columns(a, lda, k, 0), Columns(b, ldb, k, k),
+	      Columns(c, ldc, n, 2*k), lower);
+}
+
+
+/* B (m by n, stride ldb) := B L^-T, for the lower triangle L of the
+   n by n block at l, stride ldl */
+
+void DenseTrsm(long n, long m, double *l, long ldl, double *b, long ldb)
+{
+  long i, j, k, kk, nb;
+  double ljk, *bj, *bk;
+
+  for (kk=0; kk<n; kk+=TRSM_BLOCK) {
+    nb = min(TRSM_BLOCK, n-kk);
+    for (j=kk; j<kk+nb; j++) {
+      bj = &b[j*ldb];
+      for (k=kk; k<j; k++) {
+	ljk = l[j+k*ldl];
+	bk = &b[k*ldb];
+	for (i=0; i<m; i++)
+	  bj[i] -= ljk*bk[i];
+      }
+      ljk = 1.0/l[j+j*ldl];
+      for (i=0; i<m; i++)
+	bj[i] *= ljk;
+    }
+    DenseGemm(m, n-kk-nb, nb, &b[kk*ldb], ldb, &l[kk+nb+kk*ldl], ldl,
+	      &b[(kk+nb)*ldb], ldb, 0);
+  }
+}
+
+
+#ifdef DENSE_X86
+
+__attribute__((target("avx2,fma")))
+static void Kernel8x6AVX2(long k, double *a, double *b, double **c,
+			  long m, long n)
+{
+  __m256d c00, c01, c10, c11, c20, c21, c30, c31, c40, c41, c50, c51;
+  __m256d a0, a1, bj;
+  double t[NR*8];
+  long i, j, p;
+
+  c00 = c01 = c10 = c11 = c20 = c21 = _mm256_setzero_pd();
+  c30 = c31 = c40 = c41 = c50 = c51 = _mm256_setzero_pd();
+  for (p=0; p<k; p++) {
+    a0 = _mm256_load_pd(a);
+    a1 = _mm256_load_pd(a+4);
+    bj = _mm256_broadcast_sd(b);
+    c00 = _mm256_fmadd_pd(a0, bj, c00);
+    c01 = _mm256_fmadd_pd(a1, bj, c01);
+    bj = _mm256_broadcast_sd(b+1);
+    c10 = _mm256_fmadd_pd(a0, bj, c10);
+    c11 = _mm256_fmadd_pd(a1, bj, c11);
+    bj = _mm256_broadcast_sd(b+2);
+    c20 = _mm256_fmadd_pd(a0, bj, c20);
+    c21 = _mm256_fmadd_pd(a1, bj, c21);
+    bj = _mm256_broadcast_sd(b+3);
+    c30 = _mm256_fmadd_pd(a0, bj, c30);
+    c31 = _mm256_fmadd_pd(a1, bj, c31);
+    bj = _mm256_broadcast_sd(b+4);
+    c40 = _mm256_fmadd_pd(a0, bj, c40);
+    c41 = _mm256_fmadd_pd(a1, bj, c41);
+    bj = _mm256_broadcast_sd(b+5);
+    c50 = _mm256_fmadd_pd(a0, bj, c50);
+    c51 = _mm256_fmadd_pd(a1, bj, c51);
+    a += 8;
+    b += NR;
+  }
+  if (m == 8 && n == NR) {
+#define UPDATE_COLUMN(j, lo, hi) \
+    _mm256_storeu_pd(c[j], _mm256_sub_pd(_mm256_loadu_pd(c[j]), lo)); \
+    _mm256_storeu_pd(c[j]+4, _mm256_sub_pd(_mm256_loadu_pd(c[j]+4), hi));
+    UPDATE_COLUMN(0, c00, c01)
+    UPDATE_COLUMN(1, c10, c11)
+    UPDATE_COLUMN(2, c20, c21)
+    UPDATE_COLUMN(3, c30, c31)
+    UPDATE_COLUMN(4, c40, c41)
+    UPDATE_COLUMN(5, c50, c51)
+#undef UPDATE_COLUMN
+    return;
+  }
+  _mm256_storeu_pd(&t[0], c00);
+  _mm256_storeu_pd(&t[4], c01);
+  _mm256_storeu_pd(&t[8], c10);
+  _mm256_storeu_pd(&t[12], c11);
+  _mm256_storeu_pd(&t[16], c20);
+  _mm256_storeu_pd(&t[20], c21);
+  _mm256_storeu_pd(&t[24], c30);
+  _mm256_storeu_pd(&t[28], c31);
+  _mm256_storeu_pd(&t[32], c40);
+  _mm256_storeu_pd(&t[36], c41);
+  _mm256_storeu_pd(&t[40], c50);
+  _mm256_storeu_pd(&t[44], c51);
+  for (j=0; j<n; j++)
+    for (i=0; i<m; i++)
+      c[j][i] -= t[i+j*8];
+}
+
+
+__attribute__((target("avx512f")))
+static void Kernel16x6AVX512(long k, double *a, double *b, double **c,
+			     long m, long n)
+{
+  __m512d c00, c01, c10, c11, c20, c21, c30, c31, c40, c41, c50, c51;
+  __m512d a0, a1, bj;
+  double t[NR*16];
+  long i, j, p;
+
+  c00 = c01 = c10 = c11 = c20 = c21 = _mm512_setzero_pd();
+  c30 = c31 = c40 = c41 = c50 = c51 = _mm512_setzero_pd();
+  for (p=0; p<k; p++) {
+    a0 = _mm512_load_pd(a);
+    a1 = _mm512_load_pd(a+8);
+    bj = _mm512_set1_pd(b[0]);
+    c00 = _mm512_fmadd_pd(a0, bj, c00);
+    c01 = _mm512_fmadd_pd(a1, bj, c01);
+    bj = _mm512_set1_pd(b[1]);
+    c10 = _mm512_fmadd_pd(a0, bj, c10);
+    c11 = _mm512_fmadd_pd(a1, bj, c11);
+    bj = _mm512_set1_pd(b[2]);
+    c20 = _mm512_fmadd_pd(a0, bj, c20);
+    c21 = _mm512_fmadd_pd(a1, bj, c21);
+    bj = _mm512_set1_pd(b[3]);
+    c30 = _mm512_fmadd_pd(a0, bj, c30);
+    c31 = _mm512_fmadd_pd(a1, bj, c31);
+    bj = _mm512_set1_pd(b[4]);
+    c40 = _mm512_fmadd_pd(a0, bj, c40);
+    c41 = _mm512_fmadd_pd(a1, bj, c41);
+    bj = _mm512_set1_pd(b[5]);
+    c50 = _mm512_fmadd_pd(a0, bj, c50);
+    c51 = _mm512_fmadd_pd(a1, bj, c51);
+    a += 16;
+    b += NR;
+  }
+  if (m == 16 && n == NR) {
+#define UPDATE_COLUMN(j, lo, hi) \
+    _mm512_storeu_pd(c[j], _mm512_sub_pd(_mm512_loadu_pd(c[j]), lo)); \
+    _mm512_storeu_pd(c[j]+8, _mm512_sub_pd(_mm512_loadu_pd(c[j]+8), hi));
+    UPDATE_COLUMN(0, c00, c01)
+    UPDATE_COLUMN(1, c10, c11)
+    UPDATE_COLUMN(2, c20, c21)
+    UPDATE_COLUMN(3, c30, c31)
+    UPDATE_COLUMN(4, c40, c41)
+    UPDATE_COLUMN(5, c50, c51)
+#undef UPDATE_COLUMN
+    return;
+  }
+  _mm512_storeu_pd(&t[0], c00);
+  _mm512_storeu_pd(&t[8], c01);
+  _mm512_storeu_pd(&t[16], c10);
+  _mm512_storeu_pd(&t[24], c11);
+  _mm512_storeu_pd(&t[32], c20);
+  _mm512_storeu_pd(&t[40], c21);
+  _mm512_storeu_pd(&t[48], c30);
+  _mm512_storeu_pd(&t[56], c31);
+  _mm512_storeu_pd(&t[64], c40);
+  _mm512_storeu_pd(&t[72], c41);
+  _mm512_storeu_pd(&t[80], c50);
+  _mm512_storeu_pd(&t[88], c51);
+  for (j=0; j<n; j++)
+    for (i=0; i<m; i++)
+      c[j][i] -= t[i+j*16];
+}
+
+#endif
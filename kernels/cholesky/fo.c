@@ -37,8 +37,10 @@ extern long P;
 extern long BS;
 extern long *node;  /* global */
 extern long scatter_decomposition, P_dimi, P_dimj;
+extern long steal;
 struct BlockList ***AllBlocks, ***DiagBlock;
 long **ToReceive, **NReceived;
+long *NLeft;   /* blocks still to arrive at each processor */
 
 
 void PreProcessFO(long MyNum)
@@ -57,6 +59,7 @@ void PreAllocate1FO()
 					       DISTRIBUTED);
   ToReceive = (long **) MyMalloc(P*sizeof(long *), DISTRIBUTED);
   NReceived = (long **) MyMalloc(P*sizeof(long *), DISTRIBUTED);
+  NLeft = (long *) MyMalloc(P*sizeof(long), DISTRIBUTED);
   for (i=0; i<P; i++) {
     ToReceive[i] = (long *) MyMalloc(LB.n_partitions*sizeof(long), i);
     NReceived[i] = (long *) MyMalloc(LB.n_partitions*sizeof(long), i);
@@ -145,20 +148,20 @@ void BNumericSolveFO(long MyNum, struct LocalCopies *lc)
 
 void DriveParallelFO(long MyNum, struct LocalCopies *lc)
 {
-  long some, j;
+  long j;
 
-  some = 0;
   for (j=0; j<LB.n; j+=node[j])
     if (!LB.domain[j]) {
-      some = 1;
       if (BLOCK(LB.col[j])->owner == MyNum &&
 	  BLOCK(LB.col[j])->remaining == 0)
 	BlockReadyFO(LB.col[j], MyNum, lc);
     }
 
-  if (some) 
-    while (HandleTaskFO(MyNum, lc))
-      ;
+  /* finished once every block sent here has arrived: the blocks this
+     processor owns are among them, and every other task sent to it
+     comes before one of those is done */
+  while (NLeft[MyNum] > 0)
+    HandleTaskFO(MyNum, lc);
 
   if (TaskWaiting(MyNum))
     printf("**** Termination error ***\n");
@@ -171,10 +174,10 @@ long HandleTaskFO(long MyNum, struct LocalCopies *lc)
   struct Update *update;
 
   GetBlock(&desti, &destj, &src, &update, MyNum, lc);
-  if (desti == -1) /* terminate */
-    return(0);
-  else if (update == (struct Update *) -19)
+  if (update == (struct Update *) -19)
     HandleUpdate2FO(src, desti, destj, MyNum, lc);
+  else if (update == (struct Update *) -20) /* my block, updated by a thief */
+    DecrementRemaining(src, MyNum, lc);
   else if (update != NULL) {
   }
   else {
@@ -183,6 +186,7 @@ long HandleTaskFO(long MyNum, struct LocalCopies *lc)
     else
       BlockReceived(src, MyNum, lc);
 
+    NLeft[MyNum]--;
     NReceived[MyNum][LB.renumbering[BLOCKCOL(src)]]--;
     if (NReceived[MyNum][LB.renumbering[BLOCKCOL(src)]] == 0)
       FreeColumnListFO(MyNum, LB.renumbering[BLOCKCOL(src)]);
@@ -211,12 +215,6 @@ void DiagReceived(long diag, long MyNum, struct LocalCopies *lc)
       BDiv(diagbl->length, BLOCK(i)->length, diagbl->nz, BLOCK(i)->nz, lc);
       BlockDoneFO(i, MyNum, lc);
     }
-
-  /* terminate */
-  if (BLOCKCOL(diag)+LB.partition_size[BLOCKCOL(diag)] == LB.n &&
-      OWNER(diag) == MyNum)
-    for (i=0; i<P; i++)
-      Send(-1, -1, -1, -1, (struct Update *) NULL, i, MyNum, lc);
 }
 
 
@@ -319,6 +317,8 @@ void PerformUpdate(struct BlockList *above_bl, struct BlockList *below_bl, long
   else if (BLOCK(dest_block)->owner != MyNum)
     return; /* not my block */
 
+  LockBlock(dest_block);
+
   if (is_diag) {
 
     if (!below_bl->structure)
@@ -371,6 +371,7 @@ void PerformUpdate(struct BlockList *above_bl, struct BlockList *below_bl, long
 
     }
   }
+  UnlockBlock(dest_block);
   DecrementRemaining(dest_block, MyNum, lc);
 }
 
@@ -378,7 +379,7 @@ void PerformUpdate(struct BlockList *above_bl, struct BlockList *below_bl, long
 
 void DistributeUpdateFO(long which_domain, long MyNum, struct LocalCopies *lc)
 {
-  long bi, bj, desti, destj, dest_block;
+  long bi, bj, desti, destj, dest_block, p;
 
   for (bi=LB.col[LB.n+which_domain]; bi<LB.col[LB.n+which_domain+1]; bi++) {
     for (bj=LB.col[LB.n+which_domain]; bj<=bi; bj++) {
@@ -386,10 +387,12 @@ void DistributeUpdateFO(long which_domain, long MyNum, struct LocalCopies *lc)
       destj = BLOCKROW(bj);
 
       dest_block = FindBlock(desti, destj);
-      Send(which_domain, dest_block, bi, bj, (struct Update *) -19,
+      Post(which_domain, dest_block, bi, bj, (struct Update *) -19,
 	   OWNER(dest_block), MyNum, lc);
     }
   }
+  for (p=0; p<P; p++)
+    Notify(p);
 }
 
 
@@ -405,7 +408,7 @@ void HandleUpdate2FO(long which_domain, long bli, long blj, long MyNum, struct L
 
   if (dest_block == -1)
     printf("Couldn't find %ld,%ld\n", desti, destj);
-  else if (BLOCK(dest_block)->owner != MyNum)
+  else if (BLOCK(dest_block)->owner != MyNum && !steal)
     printf("Sent to wrong PE\n");
 
   FindBlockUpdate(which_domain, bli, blj, &update, &stride);
@@ -428,12 +431,20 @@ void HandleUpdate2FO(long which_domain, long bli, long blj, long MyNum, struct L
   else
     relative_j = NULL;
 
+  LockBlock(dest_block);
   ScatterUpdateFO2(BLOCK(bli)->length, relative_i,
 		  BLOCK(blj)->length, relative_j,
 		  stride, BLOCK(dest_block)->length,
 		  update, BLOCK(dest_block)->nz);
+  UnlockBlock(dest_block);
 
-  DecrementRemaining(dest_block, MyNum, lc);
+  /* only the owner counts updates down, so that it alone sees the
+     block become ready */
+  if (BLOCK(dest_block)->owner == MyNum)
+    DecrementRemaining(dest_block, MyNum, lc);
+  else
+    Send(dest_block, dest_block, 0, 0, (struct Update *) -20,
+	 OWNER(dest_block), MyNum, lc);
 }
 
 
@@ -491,16 +502,25 @@ void BlockDoneFO(long block, long MyNum, struct LocalCopies *lc)
 
     /* send to row */
     for (i=0; i<P_dimj; i++)
-      Send(block, block, 0, 0, (struct Update *) NULL, P_row + i*P_dimi, MyNum, lc);
+      Post(block, block, 0, 0, (struct Update *) NULL, P_row + i*P_dimi, MyNum, lc);
 
     /* send to column */
     for (i=0; i<P_dimi; i++)
       if (i != P_row)
-	Send(block, block, 0, 0, (struct Update *) NULL, i + P_col*P_dimi, MyNum, lc);
+	Post(block, block, 0, 0, (struct Update *) NULL, i + P_col*P_dimi, MyNum, lc);
+
+    /* wake them once all of it is queued */
+    for (i=0; i<P_dimj; i++)
+      Notify(P_row + i*P_dimi);
+    for (i=0; i<P_dimi; i++)
+      if (i != P_row)
+	Notify(i + P_col*P_dimi);
   }
   else {
     for (i=0; i<P; i++)
-      Send(block, block, 0, 0, (struct Update *) NULL, i, MyNum, lc);
+      Post(block, block, 0, 0, (struct Update *) NULL, i, MyNum, lc);
+    for (i=0; i<P; i++)
+      Notify(i);
   }
 }
 
@@ -644,8 +664,11 @@ void InitReceivedFO(long MyNum)
 {
   long i;
 
-  for (i=0; i<LB.n_partitions; i++)
+  NLeft[MyNum] = 0;
+  for (i=0; i<LB.n_partitions; i++) {
     NReceived[MyNum][i] = ToReceive[MyNum][i];
+    NLeft[MyNum] += ToReceive[MyNum][i];
+  }
 }
 
 
@@ -0,0 +1,419 @@
+/*************************************************************************/
+/*                                                                       */
+/*  Matrix Market and binary CSC input for ReadSparse().                 */
+/*                                                                       */
+/*  ReadMatrixMarket() reads the structure of a square coordinate        */
+/*  matrix, symmetrizing it if the file holds a general one.  The file   */
+/*  is mapped, cut into P pieces at line boundaries, and the entries     */
+/*  are counted and then parsed by P threads at once.                    */
+/*                                                                       */
+/*  The binary CSC format is the full symmetric structure exactly as     */
+/*  an SMatrix holds it:  a CSCHeader, then col[n+1], row[m] and,        */
+/*  if has_nz, nz[m].  ReadBinaryCSC() maps the file and points the      */
+/*  SMatrix straight at those arrays, so nothing is parsed or copied.    */
+/*  WriteBinaryCSC() writes one, with the values Value() gives, so a     */
+/*  matrix need only be parsed once.                                     */
+/*                                                                       */
+/*************************************************************************/
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "matrix.h"
+
+#define MM_BANNER       "%%MatrixMarket"
+#define CSC_MAGIC       "SPLSHCSC"
+
+struct CSCHeader {
+  char magic[8];
+  long long_size;       /* sizeof(long) where the file was written */
+  long n, m;            /* columns, entries */
+  long has_nz;
+  char name[88];
+};
+
+struct MMPiece {
+  const char *start, *end;
+  long count;
+  long *rows, *cols;    /* where this piece's entries go */
+  long bad;
+};
+
+extern long maxm;
+
+/* Map name read-write and private, so that the mapping can stand in
+   for memory of our own */
+static char *MapFile(char *name, long *size)
+{
+  struct stat st;
+  char *base;
+  int fd;
+
+  fd = open(name, O_RDONLY);
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    fprintf(stderr, "Could not open %s\n", name);
+    exit(-1);
+  }
+  *size = st.st_size;
+  base = (char *) mmap(NULL, st.st_size > 0 ? st.st_size : 1,
+		       PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    fprintf(stderr, "Could not map %s\n", name);
+    exit(-1);
+  }
+  return(base);
+}
+
+static const char *NextLine(const char *p, const char *end)
+{
+  while (p < end && *p != '\n')
+    p++;
+  return(p < end ? p+1 : end);
+}
+
+static const char *SkipBlanks(const char *p, const char *end)
+{
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+    p++;
+  return(p);
+}
+
+/* Parse an unsigned integer at *p, or return -1 */
+static long ParseIndex(const char **p, const char *end)
+{
+  const char *q = SkipBlanks(*p, end);
+  long v = 0;
+
+  if (q == end || *q < '0' || *q > '9')
+    return(-1);
+  while (q < end && *q >= '0' && *q <= '9')
+    v = 10*v + (*q++ - '0');
+  *p = q;
+  return(v);
+}
+
+static void *CountEntries(void *arg)
+{
+  struct MMPiece *piece = (struct MMPiece *) arg;
+  const char *p;
+
+  piece->count = 0;
+  for (p=piece->start; p<piece->end; p=NextLine(p, piece->end)) {
+    p = SkipBlanks(p, piece->end);
+    if (p < piece->end && *p != '\n' && *p != '%')
+      piece->count++;
+  }
+  return(NULL);
+}
+
+static void *ParseEntries(void *arg)
+{
+  struct MMPiece *piece = (struct MMPiece *) arg;
+  const char *p;
+  long k = 0;
+
+  piece->bad = 0;
+  for (p=piece->start; p<piece->end; p=NextLine(p, piece->end)) {
+    p = SkipBlanks(p, piece->end);
+    if (p == piece->end || *p == '\n' || *p == '%')
+      continue;
+    piece->rows[k] = ParseIndex(&p, piece->end);
+    piece->cols[k] = ParseIndex(&p, piece->end);
+    if (piece->rows[k] < 1 || piece->cols[k] < 1)
+      piece->bad++;
+    k++;
+  }
+  return(NULL);
+}
+
+/* Run f over all pieces, one thread each */
+static void RunPieces(void *(*f)(void *), struct MMPiece *pieces, long T)
+{
+  pthread_t *threads;
+  long t;
+
+  threads = (pthread_t *) malloc(T*sizeof(pthread_t));
+  for (t=1; t<T; t++) {
+    if (pthread_create(&threads[t], NULL, f, &pieces[t]) != 0) {
+      printf("Error in pthread_create().\n");
+      exit(-1);
+    }
+  }
+  f(&pieces[0]);
+  for (t=1; t<T; t++)
+    pthread_join(threads[t], NULL);
+  free(threads);
+}
+
+/*
+ * Lower triangle, diagonal included, of the structure of the entries
+ * rows[k],cols[k] (1-based), in the sorted form LowerToFull() wants.
+ */
+static SMatrix LowerFromEntries(long n, long nnz, long *rows, long *cols)
+{
+  SMatrix L;
+  long *count, *by_row, *by_col;
+  long i, j, k, tmp, total;
+
+  /* each entry as (max, min), plus the whole diagonal */
+  total = nnz + n;
+  by_row = (long *) malloc(total*sizeof(long));
+  by_col = (long *) malloc(total*sizeof(long));
+  count = (long *) malloc((n+1)*sizeof(long));
+  if (!by_row || !by_col || !count) {
+    printf("ReadMatrixMarket: Out of memory\n");
+    exit(0);
+  }
+
+  /* sort by row, then stably by column */
+  for (i=0; i<=n; i++)
+    count[i] = 0;
+  for (k=0; k<nnz; k++)
+    count[max(rows[k], cols[k])]++;
+  for (i=0; i<n; i++)
+    count[i+1]++;
+  for (i=1; i<=n; i++)
+    count[i] += count[i-1];
+  for (i=n-1; i>=0; i--)
+    by_row[--count[i+1]] = i + i*n;
+  for (k=nnz-1; k>=0; k--) {
+    i = max(rows[k], cols[k]);
+    by_row[--count[i]] = (i-1) + (min(rows[k], cols[k])-1)*n;
+  }
+
+  for (j=0; j<=n; j++)
+    count[j] = 0;
+  for (k=0; k<total; k++)
+    count[by_row[k]/n + 1]++;
+  for (j=1; j<=n; j++)
+    count[j] += count[j-1];
+  for (k=0; k<total; k++)
+    by_col[count[by_row[k]/n]++] = by_row[k];
+
+  /* drop duplicates */
+  L = NewMatrix(n, total, 0);
+  k = 0;
+  for (i=0; i<total; i++) {
+    if (i == 0 || by_col[i] != by_col[i-1])
+      by_col[k++] = by_col[i];
+  }
+  L.m = k;
+  for (j=0; j<=n; j++)
+    L.col[j] = 0;
+  for (i=0; i<k; i++) {
+    tmp = by_col[i];
+    L.row[i] = tmp % n;
+    L.col[tmp/n + 1]++;
+  }
+  for (j=1; j<=n; j++)
+    L.col[j] += L.col[j-1];
+  for (j=0; j<=n; j++)
+    L.startrow[j] = L.col[j];
+
+  free(by_row); free(by_col); free(count);
+
+  return(L);
+}
+
+SMatrix ReadMatrixMarket(char *name, char *probName, long P)
+{
+  struct MMPiece *pieces;
+  const char *p, *q, *end, *data;
+  char *base, *slash, banner[128], format[32], field[32];
+  long size, n_rows, n, nnz, total, bad, t;
+  long *rows, *cols;
+  SMatrix L, F;
+
+  base = MapFile(name, &size);
+  end = base + size;
+
+  /* the mapping need not end in a NUL, so scan a copy of the banner */
+  for (t=0; t<(long) sizeof(banner)-1 && t<size && base[t] != '\n'; t++)
+    banner[t] = base[t];
+  banner[t] = 0;
+  if (!IsMatrixMarket(banner, t) ||
+      sscanf(banner + strlen(MM_BANNER), " matrix %31s %31s", format,
+	     field) != 2 ||
+      strcmp(format, "coordinate") != 0 || strcmp(field, "complex") == 0) {
+    fprintf(stderr, "%s: only real, integer or pattern coordinate "
+	    "matrices can be read\n", name);
+    exit(0);
+  }
+
+  /* comments and blank lines, then the size line */
+  p = base;
+  for (;;) {
+    q = SkipBlanks(p, end);
+    if (q == end || (*q != '%' && *q != '\n'))
+      break;
+    p = NextLine(p, end);
+  }
+  n_rows = ParseIndex(&p, end);
+  n = ParseIndex(&p, end);
+  nnz = ParseIndex(&p, end);
+  if (n_rows < 1 || n_rows != n || nnz < 0) {
+    fprintf(stderr, "%s: matrix must be square\n", name);
+    exit(0);
+  }
+  data = NextLine(p, end);
+
+  slash = strrchr(name, '/');
+  strncpy(probName, slash ? slash+1 : name, 79);
+  probName[79] = 0;
+
+  if (P < 1)
+    P = 1;
+  pieces = (struct MMPiece *) malloc(P*sizeof(struct MMPiece));
+  for (t=0; t<P; t++) {
+    p = data + (end-data)*t/P;
+    pieces[t].start = (t == 0) ? p : NextLine(p-1, end);
+  }
+  for (t=0; t<P; t++)
+    pieces[t].end = (t == P-1) ? end : pieces[t+1].start;
+
+  RunPieces(CountEntries, pieces, P);
+
+  total = 0;
+  for (t=0; t<P; t++)
+    total += pieces[t].count;
+  if (total != nnz) {
+    fprintf(stderr, "%s: %ld entries, but %ld expected\n", name, total, nnz);
+    exit(0);
+  }
+
+  rows = (long *) malloc((nnz+1)*sizeof(long));
+  cols = (long *) malloc((nnz+1)*sizeof(long));
+  total = 0;
+  for (t=0; t<P; t++) {
+    pieces[t].rows = &rows[total];
+    pieces[t].cols = &cols[total];
+    total += pieces[t].count;
+  }
+
+  RunPieces(ParseEntries, pieces, P);
+
+  bad = 0;
+  for (t=0; t<P; t++)
+    bad += pieces[t].bad;
+  for (t=0; t<nnz && !bad; t++)
+    if (rows[t] > n || cols[t] > n)
+      bad++;
+  if (bad) {
+    fprintf(stderr, "%s: %ld bad entries\n", name, bad);
+    exit(0);
+  }
+
+  free(pieces);
+  munmap(base, size);
+
+  L = LowerFromEntries(n, nnz, rows, cols);
+  free(rows); free(cols);
+
+  F = LowerToFull(L);
+  FreeMatrix(L);
+
+  maxm = 0;
+  for (t=0; t<n; t++)
+    if (F.col[t+1]-F.col[t] > maxm)
+      maxm = F.col[t+1]-F.col[t];
+
+  return(F);
+}
+
+
+/* Does the file start with the binary CSC magic? */
+long IsBinaryCSC(char *first, long length)
+{
+  return(length >= 8 && strncmp(first, CSC_MAGIC, 8) == 0);
+}
+
+/* Does the file start with the Matrix Market banner? */
+long IsMatrixMarket(char *first, long length)
+{
+  return(length >= (long) strlen(MM_BANNER) &&
+	 strncmp(first, MM_BANNER, strlen(MM_BANNER)) == 0);
+}
+
+SMatrix ReadBinaryCSC(char *name, char *probName)
+{
+  struct CSCHeader *h;
+  char *base;
+  long size, i, expect;
+  SMatrix M;
+
+  base = MapFile(name, &size);
+  h = (struct CSCHeader *) base;
+
+  if (size < (long) sizeof(struct CSCHeader) || !IsBinaryCSC(h->magic, 8) ||
+      h->long_size != sizeof(long)) {
+    fprintf(stderr, "%s: not a binary CSC file for this machine\n", name);
+    exit(0);
+  }
+  expect = sizeof(struct CSCHeader) +
+    (h->n+1 + h->m + (h->has_nz ? h->m : 0))*sizeof(long);
+  if (size != expect) {
+    fprintf(stderr, "%s: %ld bytes, but %ld expected\n", name, size, expect);
+    exit(0);
+  }
+
+  memcpy(probName, h->name, sizeof(h->name));
+  probName[sizeof(h->name)-1] = 0;
+
+  M.n = h->n;
+  M.m = h->m;
+  M.col = (long *) (base + sizeof(struct CSCHeader));
+  M.startrow = M.col;
+  M.row = M.col + M.n+1;
+  M.nz = h->has_nz ? (double *) (M.row + M.m) : NULL;
+  M.map = base;
+  M.map_size = size;
+
+  maxm = 0;
+  for (i=0; i<M.n; i++)
+    if (M.col[i+1]-M.col[i] > maxm)
+      maxm = M.col[i+1]-M.col[i];
+
+  return(M);
+}
+
+void WriteBinaryCSC(SMatrix M, char *name, char *probName)
+{
+  struct CSCHeader h;
+  FILE *fp;
+  long i, j;
+  double v;
+
+  fp = fopen(name, "w");
+  if (!fp) {
+    fprintf(stderr, "Could not open %s\n", name);
+    exit(-1);
+  }
+
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, CSC_MAGIC, 8);
+  h.long_size = sizeof(long);
+  h.n = M.n;
+  h.m = M.col[M.n];
+  h.has_nz = 1;
+  strncpy(h.name, probName, sizeof(h.name)-1);
+
+  fwrite(&h, sizeof(h), 1, fp);
+  fwrite(M.col, sizeof(long), M.n+1, fp);
+  fwrite(M.row, sizeof(long), h.m, fp);
+  for (j=0; j<M.n; j++) {
+    for (i=M.col[j]; i<M.col[j+1]; i++) {
+      v = M.nz ? M.nz[i] : Value(M.row[i], j);
+      fwrite(&v, sizeof(double), 1, fp);
+    }
+  }
+
+  if (fclose(fp) != 0) {
+    fprintf(stderr, "Error writing %s\n", name);
+    exit(-1);
+  }
+}
@@ -0,0 +1,294 @@
+/*************************************************************************/
+/*                                                                       */
+/*  Generated test matrices for ReadSparse().                            */
+/*                                                                       */
+/*  Naming one of these in place of an input file builds its structure   */
+/*  directly as an SMatrix; the values are those Value() gives.          */
+/*                                                                       */
+/*     lap2d:K[xL]     5-point Laplacian on a K by L grid                */
+/*     lap3d:K[xLxM]   7-point Laplacian on a K by L by M grid           */
+/*     lap27:K[xLxM]   27-point Laplacian on a K by L by M grid          */
+/*     rgg:N[:D]       graph Laplacian of N random points in the unit    */
+/*                     square, joined when closer than the radius that   */
+/*                     gives about D neighbours each (default 8)         */
+/*     fe:K[:B]        bilinear elements on a K by K grid of nodes with  */
+/*                     B unknowns per node (default 3), so that every    */
+/*                     node couples its 3 by 3 neighbourhood in dense    */
+/*                     B by B blocks                                     */
+/*                                                                       */
+/*  The columns are split among P threads, which count the entries of    */
+/*  their columns and then, once the arrays are allocated, fill them.    */
+/*                                                                       */
+/*************************************************************************/
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "matrix.h"
+
+#define LAP2D   1
+#define LAP3D   2
+#define LAP27   3
+#define RGG     4
+#define FE      5
+
+extern long maxm;
+extern long P;
+
+static char *gen_names[] = { "", "lap2d", "lap3d", "lap27", "rgg", "fe" };
+
+static long kind;
+static long nx, ny, nz_, dof;   /* grid dimensions, unknowns per node */
+static double *px, *py;         /* rgg points, in cell order */
+static long cells, *cell_start; /* rgg cells per side, first point of each */
+static double radius;
+static SMatrix G;
+static long *range_count, *range_max;
+
+/* A uniform number in [0,1) that depends only on i */
+static double Uniform(unsigned long i)
+{
+  unsigned long z = i + 0x9e3779b97f4a7c15UL;
+
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9UL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebUL;
+  z = z ^ (z >> 31);
+  return((z >> 11) * (1.0/9007199254740992.0));
+}
+
+static long Cell(double x)
+{
+  long c = (long) (x*cells);
+
+  return(c < cells ? c : cells-1);
+}
+
+/* The rows of column j in increasing order, into rows if it is not NULL;
+   returns how many there are */
+static long Column(long j, long *rows)
+{
+  long x, y, z, dx, dy, dz, c, cx, cy, i, node, n;
+  double ddx, ddy;
+
+  n = 0;
+  switch (kind) {
+  case LAP2D:
+  case LAP3D:
+  case LAP27:
+    x = j%nx;
+    y = (j/nx)%ny;
+    z = j/(nx*ny);
+    for (dz=-1; dz<=1; dz++)
+      for (dy=-1; dy<=1; dy++)
+	for (dx=-1; dx<=1; dx++) {
+	  if (x+dx < 0 || x+dx >= nx || y+dy < 0 || y+dy >= ny ||
+	      z+dz < 0 || z+dz >= nz_)
+	    continue;
+	  if (kind != LAP27 && labs(dx)+labs(dy)+labs(dz) > 1)
+	    continue;
+	  if (rows)
+	    rows[n] = j + dx + nx*(dy + ny*dz);
+	  n++;
+	}
+    break;
+
+  case FE:
+    node = j/dof;
+    x = node%nx;
+    y = node/nx;
+    for (dy=-1; dy<=1; dy++)
+      for (dx=-1; dx<=1; dx++) {
+	if (x+dx < 0 || x+dx >= nx || y+dy < 0 || y+dy >= ny)
+	  continue;
+	for (c=0; c<dof; c++) {
+	  if (rows)
+	    rows[n] = (node + dx + nx*dy)*dof + c;
+	  n++;
+	}
+      }
+    break;
+
+  case RGG:
+    cx = Cell(px[j]);
+    cy = Cell(py[j]);
+    for (dy=-1; dy<=1; dy++)
+      for (dx=-1; dx<=1; dx++) {
+	if (cx+dx < 0 || cx+dx >= cells || cy+dy < 0 || cy+dy >= cells)
+	  continue;
+	c = cx+dx + cells*(cy+dy);
+	for (i=cell_start[c]; i<cell_start[c+1]; i++) {
+	  ddx = px[i]-px[j];
+	  ddy = py[i]-py[j];
+	  if (i == j || ddx*ddx + ddy*ddy < radius*radius) {
+	    if (rows)
+	      rows[n] = i;
+	    n++;
+	  }
+	}
+      }
+    break;
+  }
+
+  return(n);
+}
+
+
+static void CountColumns(long MyNum)
+{
+  long j, len, hi;
+
+  range_count[MyNum] = range_max[MyNum] = 0;
+  hi = G.n*(MyNum+1)/P;
+  for (j=G.n*MyNum/P; j<hi; j++) {
+    len = Column(j, NULL);
+    range_count[MyNum] += len;
+    if (len > range_max[MyNum])
+      range_max[MyNum] = len;
+  }
+}
+
+
+static void FillColumns(long MyNum)
+{
+  long j, at, hi;
+
+  at = range_count[MyNum];
+  hi = G.n*(MyNum+1)/P;
+  for (j=G.n*MyNum/P; j<hi; j++) {
+    G.col[j] = G.startrow[j] = at;
+    at += Column(j, &G.row[at]);
+  }
+}
+
+
+/* Scatter n random points into cells of side at least radius, numbering
+   them cell by cell */
+static void PlacePoints(long n, double degree)
+{
+  long i, c, *where;
+  double x, y;
+
+  radius = sqrt(degree/(M_PI*n));
+  cells = (long) (1.0/radius);
+  if (cells < 1)
+    cells = 1;
+
+  cell_start = (long *) malloc((cells*cells+1)*sizeof(long));
+  where = (long *) malloc(n*sizeof(long));
+  px = (double *) malloc(n*sizeof(double));
+  py = (double *) malloc(n*sizeof(double));
+  if (!cell_start || !where || !px || !py) {
+    printf("rgg: Out of memory\n");
+    exit(0);
+  }
+
+  for (c=0; c<=cells*cells; c++)
+    cell_start[c] = 0;
+  for (i=0; i<n; i++) {
+    where[i] = Cell(Uniform(2*i)) + cells*Cell(Uniform(2*i+1));
+    cell_start[where[i]+1]++;
+  }
+  for (c=0; c<cells*cells; c++)
+    cell_start[c+1] += cell_start[c];
+  for (i=0; i<n; i++) {
+    x = Uniform(2*i);
+    y = Uniform(2*i+1);
+    c = cell_start[where[i]]++;
+    px[c] = x;
+    py[c] = y;
+  }
+  for (c=cells*cells; c>0; c--)
+    cell_start[c] = cell_start[c-1];
+  cell_start[0] = 0;
+
+  free(where);
+}
+
+
+/* Is name one of the generated matrices? */
+long IsGenerated(char *name)
+{
+  long k, len;
+
+  if (!name)
+    return(0);
+  for (k=LAP2D; k<=FE; k++) {
+    len = strlen(gen_names[k]);
+    if (strncmp(name, gen_names[k], len) == 0 && name[len] == ':')
+      return(k);
+  }
+  return(0);
+}
+
+
+SMatrix GenerateMatrix(char *name, char *probName)
+{
+  long n, t, total, count;
+  double degree;
+  char *args;
+
+  kind = IsGenerated(name);
+  args = name + strlen(gen_names[kind]) + 1;
+  nx = ny = nz_ = dof = 1;
+  degree = 8.0;
+
+  switch (kind) {
+  case LAP2D:
+    if (sscanf(args, "%ldx%ld", &nx, &ny) < 2)
+      ny = nx;
+    break;
+  case LAP3D:
+  case LAP27:
+    if (sscanf(args, "%ldx%ldx%ld", &nx, &ny, &nz_) < 3)
+      ny = nz_ = nx;
+    break;
+  case RGG:
+    sscanf(args, "%ld:%lf", &nx, &degree);
+    break;
+  case FE:
+    dof = 3;
+    sscanf(args, "%ld:%ld", &nx, &dof);
+    ny = nx;
+    break;
+  }
+  if (nx < 1 || ny < 1 || nz_ < 1 || dof < 1 || degree <= 0.0) {
+    fprintf(stderr, "%s: bad size\n", name);
+    exit(0);
+  }
+
+  n = nx*ny*nz_*dof;
+  if (kind == RGG)
+    PlacePoints(n, degree);
+
+  strncpy(probName, name, 79);
+  probName[79] = 0;
+
+  G.n = n;
+  range_count = (long *) malloc(P*sizeof(long));
+  range_max = (long *) malloc(P*sizeof(long));
+  SymbolicThreads(CountColumns, P);
+
+  total = 0;
+  maxm = 0;
+  for (t=0; t<P; t++) {
+    count = range_count[t];
+    range_count[t] = total;
+    total += count;
+    if (range_max[t] > maxm)
+      maxm = range_max[t];
+  }
+
+  G = NewMatrix(n, total, 0);
+  SymbolicThreads(FillColumns, P);
+  G.col[n] = G.startrow[n] = total;
+
+  free(range_count); free(range_max);
+  if (kind == RGG) {
+    free(px); free(py); free(cell_start);
+  }
+
+  printf("Generated %s: %ld unknowns, %ld nonzeroes\n", probName, n, total);
+
+  return(G);
+}
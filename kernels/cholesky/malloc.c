@@ -33,6 +33,10 @@ extern pthread_t PThreadTable[];
 
 #include "matrix.h"
 #include <string.h>
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#endif
 
 #define ALIGN 8
 #define MAXFAST 16
@@ -41,6 +45,8 @@ extern pthread_t PThreadTable[];
 #define SIZE(block) (block[-1]) /* in all blocks */
 #define HOME(block) (block[-2]) /* in all blocks */
 #define NEXTFREE(block) (*((long **) block)) /* in free blocks */
+#define CACHE_BATCH 32  /* blocks moved between a cache and its pool at once */
+#define CACHE_MAX (2*CACHE_BATCH)
 
 struct MemPool {
 	pthread_mutex_t (memoryLock);
@@ -48,7 +54,28 @@ struct MemPool {
 	long tally, touched, maxm;
 	} *mem_pool;
 
+/* Each processor keeps the small blocks of its own home that it has
+   freed in a private cache, one list per bucket, and takes them from
+   there without locking.  The cache trades with the home pool
+   CACHE_BATCH blocks at a time.  Blocks freed into another home are
+   held until CACHE_BATCH of them have gathered for that home, and
+   then returned under one acquisition of its lock. */
+
+struct MallocCache {
+	long *freeBlock[MAXFAST];
+	long count[MAXFAST];
+	long **remote;          /* held frees, by home+1 */
+	long *remoteCount;
+	long hits, refills, spills, remoteFrees, remoteBatches;
+	} **caches;
+
+static __thread struct MallocCache *myCache = NULL;
+static __thread long myHome = -2;
+
 long mallocP = 1, machineP = 1;
+#ifdef __linux__
+unsigned long nodeMask = 0;     /* memory nodes we may place pages on */
+#endif
 
 extern struct GlobalMemory *Global;
 
@@ -59,6 +86,8 @@ void MallocInit(long P)
   
   mallocP = P;
 
+  FindMemoryNodes();
+
   mem_pool = (struct MemPool *)
     malloc((mallocP+1)*sizeof(struct MemPool));
   memset(mem_pool, 0x00, (mallocP+1)*sizeof(struct MemPool));
@@ -67,6 +96,84 @@ void MallocInit(long P)
 
   for (p = -1; p<mallocP; p++)
     InitOneFreeList(p);
+
+  caches = (struct MallocCache **)
+    malloc(mallocP*sizeof(struct MallocCache *));
+  for (p = 0; p<mallocP; p++)
+    caches[p] = NULL;
+}
+
+
+/* Count the memory nodes this process may use, into machineP */
+
+void FindMemoryNodes()
+{
+#ifdef __linux__
+  unsigned long mask;
+  long i;
+
+  if (syscall(SYS_get_mempolicy, NULL, &mask, 8*sizeof(mask), NULL,
+	      MPOL_F_MEMS_ALLOWED) != 0)
+    return;
+  nodeMask = mask;
+  machineP = 0;
+  for (i=0; i<8*(long)sizeof(mask); i++)
+    if (mask & (1UL<<i))
+      machineP++;
+#endif
+}
+
+
+/* Make the calling thread processor p, whose blocks it will cache */
+
+void MallocBind(long p)
+{
+  struct MallocCache *c;
+
+  if (!caches[p]) {
+    c = (struct MallocCache *) malloc(sizeof(struct MallocCache));
+    memset(c, 0x00, sizeof(struct MallocCache));
+    c->remote = (long **) malloc((mallocP+1)*sizeof(long *));
+    memset(c->remote, 0x00, (mallocP+1)*sizeof(long *));
+    c->remoteCount = (long *) malloc((mallocP+1)*sizeof(long));
+    memset(c->remoteCount, 0x00, (mallocP+1)*sizeof(long));
+    MigrateMem(c, sizeof(struct MallocCache), p);
+    caches[p] = c;
+  }
+  myCache = caches[p];
+  myHome = p;
+}
+
+
+/* Return the held frees for 'home' to their pool */
+
+static void FlushRemote(struct MallocCache *c, long home)
+{
+  long *block, *next;
+
+  {pthread_mutex_lock(&(mem_pool[home].memoryLock));}
+  for (block = c->remote[home+1]; block; block = next) {
+    next = NEXTFREE(block);
+    MyFreeNow(block);
+  }
+  {pthread_mutex_unlock(&(mem_pool[home].memoryLock));}
+  c->remote[home+1] = NULL;
+  c->remoteCount[home+1] = 0;
+  c->remoteBatches++;
+}
+
+
+/* Return all frees the calling thread holds for other homes */
+
+void MallocFlush()
+{
+  long home;
+
+  if (!myCache)
+    return;
+  for (home = -1; home<mallocP; home++)
+    if (myCache->remote[home+1])
+      FlushRemote(myCache, home);
 }
 
 
@@ -108,6 +215,24 @@ void MallocStats()
       printf("%ld ", mem_pool[i].maxm);
   printf("\n");
 
+  if (!caches)
+    return;
+  printf("Malloc cache hits/refills/spills: ");
+  for (i=0; i<mallocP; i++)
+    if (caches[i])
+      printf("%ld/%ld/%ld ", caches[i]->hits, caches[i]->refills,
+	     caches[i]->spills);
+  printf("\n");
+  printf("Malloc remote frees/batches: ");
+  for (i=0; i<mallocP; i++)
+    if (caches[i])
+      printf("%ld/%ld ", caches[i]->remoteFrees, caches[i]->remoteBatches);
+  printf("\n");
+  printf("Malloc system allocations: ");
+  for (i=-1; i<mallocP; i++)
+    printf("%ld ", mem_pool[i].touched);
+  printf("\n");
+  printf("Memory nodes: %ld\n", machineP);
 }
 
 
@@ -135,6 +260,7 @@ char *MyMalloc(long size, long home)
 {
   long bucket, leftover, alloc_size, block_size;
   long *d, *result, *prev, *freespace;
+  struct MallocCache *c;
 
   if (size < ALIGN)
     size = ALIGN;
@@ -151,7 +277,30 @@ char *MyMalloc(long size, long home)
 
   result = NULL;
 
-  if (bucket < MAXFAST) {
+  c = myCache;
+  if (home == myHome && bucket < MAXFAST) {
+    if (!c->freeBlock[bucket] && mem_pool[home].freeBlock[bucket]) {
+      /* refill the cache from the pool */
+      {pthread_mutex_lock(&(mem_pool[home].memoryLock));}
+      while (c->count[bucket] < CACHE_BATCH &&
+	     (d = mem_pool[home].freeBlock[bucket])) {
+	mem_pool[home].freeBlock[bucket] = NEXTFREE(d);
+	NEXTFREE(d) = c->freeBlock[bucket];
+	c->freeBlock[bucket] = d;
+	c->count[bucket]++;
+      }
+      {pthread_mutex_unlock(&(mem_pool[home].memoryLock));}
+      c->refills++;
+    }
+    else if (c->freeBlock[bucket])
+      c->hits++;
+    result = c->freeBlock[bucket];
+    if (result) {
+      c->freeBlock[bucket] = NEXTFREE(result);
+      c->count[bucket]--;
+    }
+  }
+  else if (bucket < MAXFAST) {
     if (mem_pool[home].freeBlock[bucket]) {
       {pthread_mutex_lock(&(mem_pool[home].memoryLock));}
       result = mem_pool[home].freeBlock[bucket];
@@ -171,6 +320,10 @@ char *MyMalloc(long size, long home)
 
       if (block_size >= alloc_size) {  /* Found one! */
 
+	/* too little over to hold a header: hand out all of it */
+	if (block_size < alloc_size + 2*(long)sizeof(long))
+	  alloc_size = block_size;
+
 	leftover = block_size - alloc_size - 2*sizeof(long);
         result = d + (leftover/sizeof(long)) + 2;
 	SIZE(result) = alloc_size;
@@ -212,8 +365,8 @@ char *MyMalloc(long size, long home)
     block_size = max(alloc_size, 4*(1<<MAXFAST));
     {pthread_mutex_lock(&(Global->memLock));};
     freespace = (long *) malloc(block_size+2*sizeof(long));
-    memset(freespace, home, (block_size+2*sizeof(long)));
     MigrateMem(freespace, block_size+2*sizeof(long), home);
+    memset(freespace, home, (block_size+2*sizeof(long)));
 
     mem_pool[home].touched++;
     {pthread_mutex_unlock(&(Global->memLock));};
@@ -247,46 +400,89 @@ char *MyMalloc(long size, long home)
 }
 
 
+/* Place the whole pages of [start, start+length) on home's memory node,
+   or spread them over all nodes if home is DISTRIBUTED.  Homes share
+   the nodes round robin.  Pages already touched are moved. */
+
 void MigrateMem(void *start, long length, long home)
 {
-/*  unsigned long *finish;
-  unsigned long currpage, endpage;
-  long i;
-  long j;*/
-
-/* POSSIBLE ENHANCEMENT:  Here is where one might distribute the memory
-   pages across physically distributed memories as desired.
+#ifdef __linux__
+  unsigned long first, last, mask;
+  long mode, node, i;
 
-   One way to do this is as follows:
-
-   finish = (unsigned long *) (((char *) start) + length);
+  if (machineP <= 1)
+    return;
 
-   currpage = (unsigned long) start;
-   endpage = (unsigned long) finish;
-   if ((home == DISTRIBUTED) || (home < 0) || (home >= mallocP)) {
-     j = 0;
-     while (currpage < endpage) {
+  first = ((unsigned long) start + PAGE_SIZE-1) & ~((unsigned long) PAGE_SIZE-1);
+  last = ((unsigned long) start + length) & ~((unsigned long) PAGE_SIZE-1);
+  if (last <= first)
+    return;
 
-       Place all addresses x such that
-         (currpage <= x < currpage + PAGE_SIZE) on node j
+  if ((home == DISTRIBUTED) || (home < 0) || (home >= mallocP)) {
+    mode = MPOL_INTERLEAVE;
+    mask = nodeMask;
+  }
+  else {
+    /* the (home mod machineP)th allowed node */
+    node = home % machineP;
+    for (i=0; node > 0 || !(nodeMask & (1UL<<i)); i++)
+      if (nodeMask & (1UL<<i))
+	node--;
+    mode = MPOL_PREFERRED;
+    mask = 1UL<<i;
+  }
 
-       j++;
-       currpage += PAGE_SIZE;
-     }
-   } else {
-     Place all addresses x such that
-       (currpage <= x < endpage) on node home
-   }  
-*/
+  syscall(SYS_mbind, first, last-first, mode, &mask, 8*sizeof(mask),
+	  MPOL_MF_MOVE);
+#endif
 }
     
 
 void MyFree(void *block)
 {
-  long home;
+  long home, size, bucket;
   long *lblock = (long*) block;
+  struct MallocCache *c;
 
   home = HOME(lblock);
+  size = SIZE(lblock);
+  c = myCache;
+
+  if (c && size <= MAXFASTBL && size > 0) {
+    if (home == myHome) {
+      bucket = FindBucket(size);
+      if (size < 1<<bucket)
+	bucket--;
+      if (bucket == 0)
+	return;
+      NEXTFREE(lblock) = c->freeBlock[bucket];
+      c->freeBlock[bucket] = lblock;
+      mem_pool[home].tally -= size;
+      if (++c->count[bucket] > CACHE_MAX) {
+	/* spill a batch back to the pool */
+	{pthread_mutex_lock(&(mem_pool[home].memoryLock));}
+	while (c->count[bucket] > CACHE_MAX-CACHE_BATCH) {
+	  lblock = c->freeBlock[bucket];
+	  c->freeBlock[bucket] = NEXTFREE(lblock);
+	  NEXTFREE(lblock) = mem_pool[home].freeBlock[bucket];
+	  mem_pool[home].freeBlock[bucket] = lblock;
+	  c->count[bucket]--;
+	}
+	{pthread_mutex_unlock(&(mem_pool[home].memoryLock));}
+	c->spills++;
+      }
+      return;
+    }
+    if (home >= -1 && home < mallocP) {
+      NEXTFREE(lblock) = c->remote[home+1];
+      c->remote[home+1] = lblock;
+      c->remoteFrees++;
+      if (++c->remoteCount[home+1] == CACHE_BATCH)
+	FlushRemote(c, home);
+      return;
+    }
+  }
+
   {pthread_mutex_lock(&(mem_pool[home].memoryLock));}
   MyFreeNow(block);
   {pthread_mutex_unlock(&(mem_pool[home].memoryLock));}
@@ -25,6 +25,8 @@
 typedef struct {
 	long n, m, *col, *startrow, *row;
 	double *nz;
+	char *map;		/* file the arrays are mapped from, if any */
+	long map_size;
 	} SMatrix;
 
 struct Pair {
@@ -123,6 +125,25 @@ struct LocalCopies {
        unsigned long runs;
        };
 
+/* Independent subtrees of an elimination tree, for the parallel
+   symbolic analysis */
+struct Subtrees {
+	long n_sub;
+	long *sub;	/* subtree of each node, or -1 for the top */
+	long *root;	/* root of each subtree */
+	long *owner;	/* processor that analyzes each subtree */
+	};
+
+/* The symbolic analysis of one sparsity pattern: everything up to the
+   numeric values is left in LB and the task setup, so that Factor()
+   can be repeated for every matrix with the same pattern. */
+struct Symbolic {
+	long n, *col, *row;	/* the pattern analyzed, input numbering */
+	unsigned long order_time, tree_time, block_time, task_time;
+	unsigned long scatter_time, numeric_time;	/* last Factor() */
+	long factorizations;
+	};
+
 #define DISTRIBUTED 888
 
 #define max(a, b) ((a) > (b) ? (a) : (b))
@@ -133,6 +154,8 @@ struct LocalCopies {
 #define EMBED 1
 
 #define NO_PERM 1
+#define AMD_PERM 2
+#define ND_PERM 3
 
 #define FAN_OUT 2
 
@@ -173,9 +196,22 @@ void BLMod(long n1, long n2, double *left_nz, double *dest_nz, struct LocalCopie
 void OneLower(double *A, double *C, long n1, long n2, long n3);
 void FindBlockUpdate(long domain, long blj, long bli, double **update, long *stride);
 
+/*
+ * dense.c
+ */
+void DenseInit(void);
+char *DenseKernelName(void);
+long DenseWorth(long m, long n, long k);
+void DenseUpdate(long m, long n, long k, double **a, double **b, double **c, long lower);
+void DenseUpdateT(long m, long n, long k, double **a, double **bt, double **c);
+double **DenseColumns(long n);
+void DenseGemm(long m, long n, long k, double *a, long lda, double *b, long ldb, double *c, long ldc, long lower);
+void DenseTrsm(long n, long m, double *l, long ldl, double *b, long ldb);
+
 /*
  * bksolve.c
  */
+void BlockSolve(double *x, long k, long *PERM);
 double *TriBSolve(BMatrix LB, double *b, long *PERM);
 double ComputeNorm(double *x, long n);
 double *CreateVector(SMatrix M);
@@ -188,6 +224,7 @@ long FindNumPartitions(long set_size, long piece_size);
 void ComputeBlockParents(long *T);
 void FillInStructure(SMatrix M, long *firstchild, long *child, long *PERM, long *INVP);
 void FillInNZ(SMatrix M, long *PERM, long *INVP);
+void GrowEntries(long n);
 void FindDomStructure(long super, long *nz, long n_nz);
 void FindDummyDomainStructure(long which_domain);
 void CheckColLength(long col, long n_nz);
@@ -233,11 +270,29 @@ void InitReceivedFO(long MyNum);
 void ScatterUpdateFO(long dimi, long *structi, long dimj, long *structj, long destdim, double *oldupdate, double *newupdate);
 void ScatterUpdateFO2(long dimi, long *structi, long dimj, long *structj, long stride, long destdim, double *oldupdate, double *newupdate);
 
+/*
+ * formats.c
+ */
+SMatrix ReadMatrixMarket(char *name, char *probName, long P);
+long IsBinaryCSC(char *first, long length);
+long IsMatrixMarket(char *first, long length);
+SMatrix ReadBinaryCSC(char *name, char *probName);
+void WriteBinaryCSC(SMatrix M, char *name, char *probName);
+
+/*
+ * gen.c
+ */
+long IsGenerated(char *name);
+SMatrix GenerateMatrix(char *name, char *probName);
+
 /*
  * malloc.c
  */
 void MallocInit(long P);
 void InitOneFreeList(long p);
+void FindMemoryNodes(void);
+void MallocBind(long p);
+void MallocFlush(void);
 void MallocStats(void);
 long FindBucket(long size);
 char *MyMalloc(long size, long home);
@@ -249,9 +304,18 @@ void MyFreeNow(void *block);
  * mf.c
  */
 void InitTaskQueues(long P);
+void LockBlock(long block);
+void UnlockBlock(long block);
+long TasksStolen(void);
 long FindBlock(long i, long j);
+void WakeUp(long p);
+void Post(long src_block, long dest_block, long desti, long destj, struct Update *update, long p, long MyNum, struct LocalCopies *lc);
+void Notify(long p);
 void Send(long src_block, long dest_block, long desti, long destj, struct Update *update, long p, long MyNum, struct LocalCopies *lc);
 long TaskWaiting(long MyNum);
+struct Task *TakeStealable(long p, long wait);
+struct Task *TakeTask(long MyNum);
+void WaitForTask(long MyNum);
 void GetBlock(long *desti, long *destj, long *src, struct Update **update, long MyNum, struct LocalCopies *lc);
 
 /*
@@ -266,9 +330,16 @@ void ModifySuperByColumn(double *src_nz, long cols_in_update, long rows_in_updat
 void SetDestIndices(long super, long *indices);
 void SetDomainIndices(long super, long *indices);
 void ModifySuperBySuper(long src, long theFirst, long theLast, long length, double *dest);
+void ModifyByPanel(long first, long last, long theFirst, long m, long n, double *dest);
 void ModifyTwoBySupernodeB(long super, long lastcol, long theFirst, double *destination0, double *destination1);
 void ModifyBySupernodeB(long super, long lastcol, long theFirst, double *destination);
 
+/*
+ * order.c
+ */
+void AMDOrder(SMatrix M, long *PERM);
+void NDOrder(SMatrix M, long *PERM, long P);
+
 /*
  * parts.c
  */
@@ -286,15 +357,24 @@ struct Chunk *GetChunk(void);
 void ComputeTargetBlockSize(SMatrix M, long P);
 void FindMaxHeight(SMatrix L, long root, long height, long *maxm);
 void NoSegments(SMatrix M);
-void CreatePermutation(long n, long *PERM, long permutation_method);
+void CreatePermutation(SMatrix M, long *PERM, long permutation_method);
+void OrderingCost(SMatrix M, long *PERM, long *fill, double *ops);
 
 /*
  * solve.c
  */
 void Go(void);
+struct Symbolic *Analyze(SMatrix M);
+void Factor(struct Symbolic *S, SMatrix M);
 void PlaceDomains(long P);
 void ComposePerm(long *PERM1, long *PERM2, long n);
 
+/*
+ * tune.c
+ */
+void CalibrateModel(void);
+long TunePartitionSize(SMatrix M, long *T, long *nz, long *node, long *domain);
+
 /*
  * tree.c
  */
@@ -303,6 +383,9 @@ void ParentToChild(long *T, long n, long *firstchild, long *child);
 void ComputeNZ(SMatrix A, long *T, long *nz, long *PERM, long *INVP);
 void FindSupernodes(SMatrix A, long *T, long *nz, long *node);
 void ComputeWorkTree(SMatrix A, long *nz, double *work_tree);
+struct Subtrees *FindSubtrees(long n, long *T, double *weight, long parts);
+void FreeSubtrees(struct Subtrees *S);
+void SymbolicThreads(void (*work)(long MyNum), long parts);
 
 /*
  * util.c
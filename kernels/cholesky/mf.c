@@ -29,21 +29,39 @@ extern pthread_t PThreadTable[];
 
 
 #include "matrix.h"
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#else
+#include <sched.h>
+#endif
 #define HashNum 1024
 #define Bucket(desti, destj, src) ((desti+destj+src)%HashNum)
+#define SPIN_TRIES 1000   /* polls of an empty inbox before sleeping */
 
 long uMiss = 0;
 extern struct GlobalMemory *Global;
+extern long steal, P;
 struct Update **updateHash;
 
+/* Each processor's inbox is a lock-free stack that any processor pushes
+   onto and only its owner takes from, all at once, reversing it into
+   the local list so that tasks are handled in the order sent.  With
+   stealing, domain updates go instead to stealQ, where any idle
+   processor may take them. */
+
 struct taskQ {
-	pthread_mutex_t (taskLock);
-	struct Task *volatile taskQ; 
-	struct Task *volatile taskQlast;
-	struct Task *volatile probeQ; 
-	struct Task *volatile probeQlast;
+	struct Task *inbox;
+	struct Task *local;
+	int waiting;
+	pthread_mutex_t (stealLock);
+	struct Task *stealQ;
+	struct Task *stealQlast;
+	long stolen;
 	} *tasks;
 
+pthread_mutex_t *blockLock;
+
 extern BMatrix LB;
 
 void InitTaskQueues(long P)
@@ -52,13 +70,49 @@ void InitTaskQueues(long P)
 
   tasks = (struct taskQ *) MyMalloc(P*sizeof(struct taskQ), DISTRIBUTED);
   for (i=0; i<P; i++) {
-    {pthread_mutex_init(&(tasks[i].taskLock), NULL);}
-
-    tasks[i].taskQ = (struct Task *) NULL;
-    tasks[i].taskQlast = (struct Task *) NULL;
-    tasks[i].probeQ = (struct Task *) NULL;
-    tasks[i].probeQlast = (struct Task *) NULL;
+    {pthread_mutex_init(&(tasks[i].stealLock), NULL);}
+
+    tasks[i].inbox = (struct Task *) NULL;
+    tasks[i].local = (struct Task *) NULL;
+    tasks[i].waiting = 0;
+    tasks[i].stealQ = (struct Task *) NULL;
+    tasks[i].stealQlast = (struct Task *) NULL;
+    tasks[i].stolen = 0;
     }
+
+  if (steal) {
+    blockLock = (pthread_mutex_t *) MyMalloc(LB.n_entries*sizeof(pthread_mutex_t),
+					     DISTRIBUTED);
+    for (i=0; i<LB.n_entries; i++)
+      {pthread_mutex_init(&(blockLock[i]), NULL);}
+  }
+}
+
+
+/* With stealing, a block may be updated by a processor that does not
+   own it, so every update to a block holds its lock */
+
+void LockBlock(long block)
+{
+  if (steal)
+    {pthread_mutex_lock(&(blockLock[block]));}
+}
+
+
+void UnlockBlock(long block)
+{
+  if (steal)
+    {pthread_mutex_unlock(&(blockLock[block]));}
+}
+
+
+long TasksStolen()
+{
+  long i, total = 0;
+
+  for (i=0; i<P; i++)
+    total += tasks[i].stolen;
+  return(total);
 }
 
 
@@ -88,17 +142,29 @@ long FindBlock(long i, long j)
 }
 
 
-/* p is processor no if block_num = -1, ignored otherwise */
+/* Wake processor p if it is asleep waiting for a task */
 
-void Send(long src_block, long dest_block, long desti, long destj, struct Update *update, long p, long MyNum, struct LocalCopies *lc)
+void WakeUp(long p)
 {
-  long procnum, is_probe;
+  if (__atomic_exchange_n(&tasks[p].waiting, 0, __ATOMIC_SEQ_CST)) {
+#ifdef __linux__
+    syscall(SYS_futex, &tasks[p].waiting, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+#endif
+  }
+}
+
+
+/* Queue a task for processor p without waking it.  Senders of several
+   tasks at once Post() them all and then Notify() each processor, so
+   that no receiver is woken to find only part of them. */
+
+void Post(long src_block, long dest_block, long desti, long destj, struct Update *update, long p, long MyNum, struct LocalCopies *lc)
+{
+  long procnum;
   struct Task *t;
 
   procnum = p;
 
-  is_probe = (dest_block == -2);
-
   if (lc->freeTask) {
     t = lc->freeTask;
     lc->freeTask = t->next;
@@ -111,61 +177,145 @@ void Send(long src_block, long dest_block, long desti, long destj, struct Update
   t->desti = desti; t->destj = destj; t->src = src_block; t->update = update;
   t->next = NULL;
 
-  {pthread_mutex_lock(&(tasks[procnum].taskLock));}
-
-  if (is_probe) {
-    if (tasks[procnum].probeQlast)
-      tasks[procnum].probeQlast->next = t;
+  if (steal && update == (struct Update *) -19) {
+    {pthread_mutex_lock(&(tasks[procnum].stealLock));}
+    if (tasks[procnum].stealQlast)
+      tasks[procnum].stealQlast->next = t;
     else
-      tasks[procnum].probeQ = t;
-    tasks[procnum].probeQlast = t;
+      __atomic_store_n(&tasks[procnum].stealQ, t, __ATOMIC_SEQ_CST);
+    tasks[procnum].stealQlast = t;
+    {pthread_mutex_unlock(&(tasks[procnum].stealLock));}
   }
   else {
-    if (tasks[procnum].taskQlast)
-      tasks[procnum].taskQlast->next = t;
-    else
-      tasks[procnum].taskQ = t;
-    tasks[procnum].taskQlast = t;
+    t->next = __atomic_load_n(&tasks[procnum].inbox, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&tasks[procnum].inbox, &t->next, t, 0,
+					__ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+      ;
   }
 
-  {pthread_mutex_unlock(&(tasks[procnum].taskLock));}
+}
+
+
+/* Wake processor p if it went to sleep before the tasks just posted */
+
+void Notify(long p)
+{
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&tasks[p].waiting, __ATOMIC_SEQ_CST))
+    WakeUp(p);
+}
+
+
+void Send(long src_block, long dest_block, long desti, long destj, struct Update *update, long p, long MyNum, struct LocalCopies *lc)
+{
+  Post(src_block, dest_block, desti, destj, update, p, MyNum, lc);
+  Notify(p);
 }
 
 
 long TaskWaiting(long MyNum)
 {
-  return(tasks[MyNum].taskQ != NULL);
+  return(tasks[MyNum].local != NULL ||
+	 __atomic_load_n(&tasks[MyNum].inbox, __ATOMIC_SEQ_CST) != NULL ||
+	 __atomic_load_n(&tasks[MyNum].stealQ, __ATOMIC_SEQ_CST) != NULL);
 }
 
 
-void GetBlock(long *desti, long *destj, long *src, struct Update **update, long MyNum, struct LocalCopies *lc)
+/* Take the first task from the steal queue of processor p, or NULL */
+
+struct Task *TakeStealable(long p, long wait)
 {
   struct Task *t;
 
-  for (;;) {
+  if (!__atomic_load_n(&tasks[p].stealQ, __ATOMIC_SEQ_CST))
+    return(NULL);
+  if (wait)
+    {pthread_mutex_lock(&(tasks[p].stealLock));}
+  else if (pthread_mutex_trylock(&(tasks[p].stealLock)) != 0)
+    return(NULL);
+  t = tasks[p].stealQ;
+  if (t) {
+    __atomic_store_n(&tasks[p].stealQ, t->next, __ATOMIC_SEQ_CST);
+    if (!t->next)
+      tasks[p].stealQlast = NULL;
+  }
+  {pthread_mutex_unlock(&(tasks[p].stealLock));}
+  return(t);
+}
+
+
+/* Next task for MyNum: its own first, then, with stealing, any other
+   processor's domain updates */
 
-    if (tasks[MyNum].taskQ || tasks[MyNum].probeQ) {
-      {pthread_mutex_lock(&(tasks[MyNum].taskLock));}
-      t = NULL;
-      if (tasks[MyNum].probeQ) {
-        t = (struct Task *) tasks[MyNum].probeQ;
-        tasks[MyNum].probeQ = t->next;
-	if (!t->next)
-	  tasks[MyNum].probeQlast = NULL;
-      }
-      else if (tasks[MyNum].taskQ) {
-        t = (struct Task *) tasks[MyNum].taskQ;
-        tasks[MyNum].taskQ = t->next;
-	if (!t->next)
-	  tasks[MyNum].taskQlast = NULL;
-      }
-      {pthread_mutex_unlock(&(tasks[MyNum].taskLock));}
-      if (t)
-        break;
+struct Task *TakeTask(long MyNum)
+{
+  struct Task *t, *batch, *next;
+  long i;
+
+  if (!tasks[MyNum].local &&
+      __atomic_load_n(&tasks[MyNum].inbox, __ATOMIC_RELAXED)) {
+    batch = __atomic_exchange_n(&tasks[MyNum].inbox, NULL, __ATOMIC_SEQ_CST);
+    while (batch) {
+      next = batch->next;
+      batch->next = tasks[MyNum].local;
+      tasks[MyNum].local = batch;
+      batch = next;
     }
-    else {
-    while (!tasks[MyNum].taskQ && !tasks[MyNum].probeQ)
-      ;
+  }
+
+  t = tasks[MyNum].local;
+  if (t) {
+    tasks[MyNum].local = t->next;
+    return(t);
+  }
+
+  if (!steal)
+    return(NULL);
+
+  t = TakeStealable(MyNum, 1);
+  if (t)
+    return(t);
+
+  for (i=1; i<P; i++) {
+    t = TakeStealable((MyNum+i)%P, 0);
+    if (t) {
+      tasks[MyNum].stolen++;
+      return(t);
+    }
+  }
+
+  return(NULL);
+}
+
+
+/* Sleep until a task is sent to MyNum; may return early */
+
+void WaitForTask(long MyNum)
+{
+  __atomic_store_n(&tasks[MyNum].waiting, 1, __ATOMIC_SEQ_CST);
+  if (!TaskWaiting(MyNum)) {
+#ifdef __linux__
+    syscall(SYS_futex, &tasks[MyNum].waiting, FUTEX_WAIT_PRIVATE, 1, NULL, NULL, 0);
+#else
+    sched_yield();
+#endif
+  }
+  __atomic_store_n(&tasks[MyNum].waiting, 0, __ATOMIC_SEQ_CST);
+}
+
+
+void GetBlock(long *desti, long *destj, long *src, struct Update **update, long MyNum, struct LocalCopies *lc)
+{
+  struct Task *t;
+  long spins = 0;
+
+  for (;;) {
+    t = TakeTask(MyNum);
+    if (t)
+      break;
+    if (++spins == SPIN_TRIES) {
+      WaitForTask(MyNum);
+      spins = 0;
     }
   }
 
@@ -177,5 +327,3 @@ void GetBlock(long *desti, long *destj, long *src, struct Update **update, long
 
   /* straight through is 32 cycles */
 }
-
-
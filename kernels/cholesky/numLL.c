@@ -31,6 +31,7 @@ extern pthread_t PThreadTable[];
 #include "matrix.h"
 #include <math.h>
 
+#define SUPER_PANEL 16   /* columns per dense panel of a supernode */
 #define AddMember(set, new) { long s, n; s = set; n = new; \
 			       lc->link[n] = lc->link[s]; lc->link[s] = n; }
 
@@ -184,7 +185,7 @@ void FactorLLDomain(long which_domain, long MyNum, struct LocalCopies *lc)
 
 void CompleteSupernodeB(long super)
 {
-  long i, length, fits, first, last;
+  long i, length, fits, first, last, rest;
 
   if (node[super] == 1) {
     CompleteColumnB(super);
@@ -197,6 +198,9 @@ void CompleteSupernodeB(long super)
     fits &= 0xfffffffc;
   else if (fits < 2)
     fits = node[super];
+  /* narrow panels, each updating the rest of the supernode at once */
+  if (DenseWorth(length, node[super]-SUPER_PANEL, SUPER_PANEL))
+    fits = SUPER_PANEL;
 
   first = super;
 
@@ -221,6 +225,13 @@ void CompleteSupernodeB(long super)
     }
 
     i = last;
+    rest = super+node[super]-last;
+    if (rest > 0 &&
+	DenseWorth(LB.col[last+1]-LB.col[last], rest, last-first)) {
+      ModifyByPanel(first, last, last-first, LB.col[last+1]-LB.col[last],
+		    rest, (double *) &LB.entry[LB.col[last]].nz);
+      i += rest;
+    }
     for (; i<super+node[super]-1; i+=2)
       ModifyTwoBySupernodeB(first, last, i-first,
 			 (double *) &LB.entry[LB.col[i]].nz,
@@ -354,6 +365,12 @@ void ModifySuperBySuper(long src, long theFirst, long theLast, long length, doub
   long this_length;
   double *destination;
 
+  if (DenseWorth(length-theFirst, theLast-theFirst, node[src])) {
+    ModifyByPanel(src, src+node[src], theFirst, length-theFirst,
+		  theLast-theFirst, dest);
+    return;
+  }
+
   fits = FitsInCache/length;
   if (fits > 4)
     fits &= 0xfffffffc;
@@ -386,6 +403,29 @@ void ModifySuperBySuper(long src, long theFirst, long theLast, long length, doub
 }
 
 
+/* Subtract from dest, n packed columns of m, m-1, ... entries, each
+   from its diagonal down, the product of columns first..last of a
+   supernode, rows theFirst on (counted from the diagonal of first), by
+   the transpose of their first n such rows */
+
+void ModifyByPanel(long first, long last, long theFirst, long m, long n, double *dest)
+{
+  long j, p, k;
+  double **a, **c;
+
+  k = last-first;
+  a = DenseColumns(k+n);
+  c = a+k;
+  for (p=0; p<k; p++)
+    a[p] = (double *) &LB.entry[LB.col[first+p] - p + theFirst].nz;
+  for (j=0; j<n; j++) {
+    c[j] = dest - j;
+    dest += m-j;
+  }
+  DenseUpdate(m, n, k, a, a, c, 1);
+}
+
+
 void ModifyTwoBySupernodeB(long super, long lastcol, long theFirst, double *destination0, double *destination1)
 {
   long col, increment;
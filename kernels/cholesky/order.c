@@ -0,0 +1,635 @@
+/*************************************************************************/
+/*                                                                       */
+/*  Fill-reducing orderings for CreatePermutation().                     */
+/*                                                                       */
+/*  AMDOrder() is approximate minimum degree on the quotient graph:      */
+/*  each pivot becomes an element, the elements it touches are           */
+/*  absorbed into it, indistinguishable variables are merged into        */
+/*  supervariables, and degrees are the Amestoy-Davis-Duff upper         */
+/*  bound rather than exact.                                             */
+/*                                                                       */
+/*  NDOrder() is nested dissection: each piece of the graph is split     */
+/*  by the smallest balanced level of a breadth-first level structure,   */
+/*  the two halves are ordered first and the separator last.  Pieces     */
+/*  of no more than ND_LEAF vertices, and pieces whose separator would   */
+/*  hold more than 1/ND_SEPARATOR of them, are ordered by minimum        */
+/*  degree instead.  The two halves of the top levels are ordered by     */
+/*  separate threads.  The depth of the separator holding each vertex    */
+/*  is left in separator_level[] for Partition().                        */
+/*                                                                       */
+/*************************************************************************/
+
+#include <pthread.h>
+#include <stdlib.h>
+#include "matrix.h"
+
+#define ND_LEAF            128
+#define ND_PERIPHERAL        5
+#define ND_SEPARATOR        10
+
+#define VARIABLE             0
+#define MERGED               1
+#define ELEMENT              2
+#define ABSORBED             3
+
+long *separator_level = NULL;
+
+struct List {
+  long *e, len, max;
+};
+
+struct Piece {
+  long *verts, count, lo, depth;
+};
+
+static SMatrix G;               /* the graph being dissected */
+static long *dissection;        /* dissection[k] is the vertex ordered k-th */
+static long *piece_of;          /* lowest position of a vertex's piece */
+static long *level;             /* breadth-first level within its piece */
+static long *local;             /* index within a leaf piece */
+static long thread_levels;
+
+static void Append(struct List *l, long v)
+{
+  if (l->len == l->max) {
+    l->max = 2*l->max + 4;
+    l->e = (long *) realloc(l->e, l->max*sizeof(long));
+    if (l->e == NULL) {
+      printf("Out of memory in AMDOrder\n");
+      exit(-1);
+    }
+  }
+  l->e[l->len++] = v;
+}
+
+static void Unlink(long i, long *head, long *next, long *prev, long *deg)
+{
+  if (prev[i] != -1)
+    next[prev[i]] = next[i];
+  else
+    head[deg[i]] = next[i];
+  if (next[i] != -1)
+    prev[next[i]] = prev[i];
+}
+
+static void Link(long i, long *head, long *next, long *prev, long *deg)
+{
+  prev[i] = -1;
+  next[i] = head[deg[i]];
+  if (next[i] != -1)
+    prev[next[i]] = i;
+  head[deg[i]] = i;
+}
+
+/*
+ * Approximate minimum degree ordering of the n vertex graph whose
+ * adjacency lists are row[col[i]..col[i+1]-1] (the diagonal, if
+ * present, is ignored).  order[k] is set to the vertex eliminated k-th.
+ */
+static void MinimumDegree(long n, long *col, long *row, long *order)
+{
+  struct List *var, *elt;
+  long *nv, *status, *deg, *esize, *w, *wstamp, *mark, *hash;
+  long *head, *next, *prev, *first_member, *next_member, *last_member;
+  long *Lp;
+  long i, j, k, e, p, v, q, stamp, mindeg, remaining, lp_len, lp_weight;
+  long d, ext, count, ordered, t;
+
+  var = (struct List *) calloc(n, sizeof(struct List));
+  elt = (struct List *) calloc(n, sizeof(struct List));
+  nv = (long *) malloc(n*sizeof(long));
+  status = (long *) malloc(n*sizeof(long));
+  deg = (long *) malloc(n*sizeof(long));
+  esize = (long *) malloc(n*sizeof(long));
+  w = (long *) malloc(n*sizeof(long));
+  wstamp = (long *) malloc(n*sizeof(long));
+  mark = (long *) malloc(n*sizeof(long));
+  hash = (long *) malloc(n*sizeof(long));
+  head = (long *) malloc((n+1)*sizeof(long));
+  next = (long *) malloc(n*sizeof(long));
+  prev = (long *) malloc(n*sizeof(long));
+  first_member = (long *) malloc(n*sizeof(long));
+  next_member = (long *) malloc(n*sizeof(long));
+  last_member = (long *) malloc(n*sizeof(long));
+  if (!var || !elt || !nv || !status || !deg || !esize || !w || !wstamp ||
+      !mark || !hash || !head || !next || !prev || !first_member ||
+      !next_member || !last_member) {
+    printf("Out of memory in AMDOrder\n");
+    exit(-1);
+  }
+
+  for (i=0; i<=n; i++)
+    head[i] = -1;
+  for (i=0; i<n; i++) {
+    for (j=col[i]; j<col[i+1]; j++)
+      if (row[j] != i)
+	Append(&var[i], row[j]);
+    nv[i] = 1;
+    status[i] = VARIABLE;
+    deg[i] = var[i].len;
+    wstamp[i] = mark[i] = -1;
+    first_member[i] = last_member[i] = i;
+    next_member[i] = -1;
+    Link(i, head, next, prev, deg);
+  }
+
+  mindeg = 0;
+  remaining = n;
+  ordered = 0;
+  stamp = 0;
+
+  while (remaining > 0) {
+
+    /* pick the pivot supervariable of least approximate degree */
+    while (head[mindeg] == -1)
+      mindeg++;
+    p = head[mindeg];
+    Unlink(p, head, next, prev, deg);
+
+    for (v=first_member[p]; v!=-1; v=next_member[v])
+      order[ordered++] = v;
+    remaining -= nv[p];
+
+    /* Lp: the variables adjacent to p, directly or through elements,
+       which are absorbed into the new element p */
+    stamp++;
+    mark[p] = stamp;
+    Lp = NULL;
+    lp_len = lp_weight = 0;
+    {
+      struct List l = { NULL, 0, 0 };
+
+      for (k=0; k<var[p].len; k++) {
+	v = var[p].e[k];
+	if (status[v] == VARIABLE && mark[v] != stamp) {
+	  mark[v] = stamp;
+	  Append(&l, v);
+	  lp_weight += nv[v];
+	}
+      }
+      for (k=0; k<elt[p].len; k++) {
+	e = elt[p].e[k];
+	if (status[e] != ELEMENT)
+	  continue;
+	for (j=0; j<var[e].len; j++) {
+	  v = var[e].e[j];
+	  if (status[v] == VARIABLE && mark[v] != stamp) {
+	    mark[v] = stamp;
+	    Append(&l, v);
+	    lp_weight += nv[v];
+	  }
+	}
+	status[e] = ABSORBED;
+	free(var[e].e);
+	var[e].e = NULL;
+	var[e].len = 0;
+      }
+      free(var[p].e);
+      free(elt[p].e);
+      elt[p].e = NULL;
+      elt[p].len = 0;
+      var[p] = l;
+      Lp = l.e;
+      lp_len = l.len;
+    }
+    status[p] = ELEMENT;
+    esize[p] = lp_weight;
+
+    /* prune the lists of Lp: p replaces the elements and variables
+       it now covers */
+    for (k=0; k<lp_len; k++) {
+      i = Lp[k];
+      Unlink(i, head, next, prev, deg);
+      count = 0;
+      for (j=0; j<elt[i].len; j++) {
+	e = elt[i].e[j];
+	if (status[e] == ELEMENT)
+	  elt[i].e[count++] = e;
+      }
+      elt[i].len = count;
+      Append(&elt[i], p);
+      count = 0;
+      for (j=0; j<var[i].len; j++) {
+	v = var[i].e[j];
+	if (status[v] == VARIABLE && mark[v] != stamp)
+	  var[i].e[count++] = v;
+      }
+      var[i].len = count;
+    }
+
+    /* w[e] = |Le \ Lp| for every other element e next to Lp */
+    for (k=0; k<lp_len; k++) {
+      i = Lp[k];
+      for (j=0; j<elt[i].len; j++) {
+	e = elt[i].e[j];
+	if (e == p)
+	  continue;
+	if (wstamp[e] != stamp) {
+	  wstamp[e] = stamp;
+	  w[e] = esize[e];
+	}
+	w[e] -= nv[i];
+      }
+    }
+
+    /* approximate degrees; elements inside Lp are absorbed into p */
+    for (k=0; k<lp_len; k++) {
+      i = Lp[k];
+      ext = 0;
+      count = 0;
+      hash[i] = 0;
+      for (j=0; j<elt[i].len; j++) {
+	e = elt[i].e[j];
+	if (e != p && w[e] == 0)
+	  status[e] = ABSORBED;
+	if (status[e] != ELEMENT)
+	  continue;
+	elt[i].e[count++] = e;
+	hash[i] += e;
+	if (e != p)
+	  ext += w[e];
+      }
+      elt[i].len = count;
+      for (j=0; j<var[i].len; j++) {
+	ext += nv[var[i].e[j]];
+	hash[i] += var[i].e[j];
+      }
+      d = ext + lp_weight - nv[i];
+      if (d > deg[i] + lp_weight - nv[i])
+	d = deg[i] + lp_weight - nv[i];
+      if (d > remaining - nv[i])
+	d = remaining - nv[i];
+      deg[i] = d;
+    }
+
+    /* merge indistinguishable variables of Lp into supervariables */
+    for (k=0; k<lp_len; k++) {
+      i = Lp[k];
+      if (status[i] != VARIABLE)
+	continue;
+      for (q=k+1; q<lp_len; q++) {
+	j = Lp[q];
+	if (status[j] != VARIABLE || hash[j] != hash[i] ||
+	    var[j].len != var[i].len || elt[j].len != elt[i].len)
+	  continue;
+	stamp++;
+	for (t=0; t<var[i].len; t++)
+	  mark[var[i].e[t]] = stamp;
+	for (t=0; t<elt[i].len; t++)
+	  mark[elt[i].e[t]] = stamp;
+	for (t=0; t<var[j].len; t++)
+	  if (mark[var[j].e[t]] != stamp)
+	    break;
+	if (t < var[j].len)
+	  continue;
+	for (t=0; t<elt[j].len; t++)
+	  if (mark[elt[j].e[t]] != stamp)
+	    break;
+	if (t < elt[j].len)
+	  continue;
+
+	deg[i] -= nv[j];
+	nv[i] += nv[j];
+	nv[j] = 0;
+	status[j] = MERGED;
+	next_member[last_member[i]] = first_member[j];
+	last_member[i] = last_member[j];
+	free(var[j].e); free(elt[j].e);
+	var[j].e = elt[j].e = NULL;
+	var[j].len = elt[j].len = 0;
+      }
+    }
+
+    for (k=0; k<lp_len; k++) {
+      i = Lp[k];
+      if (status[i] == VARIABLE) {
+	if (deg[i] < 0)
+	  deg[i] = 0;
+	Link(i, head, next, prev, deg);
+	if (deg[i] < mindeg)
+	  mindeg = deg[i];
+      }
+    }
+  }
+
+  for (i=0; i<n; i++) {
+    free(var[i].e);
+    free(elt[i].e);
+  }
+  free(var); free(elt); free(nv); free(status); free(deg); free(esize);
+  free(w); free(wstamp); free(mark); free(hash); free(head); free(next);
+  free(prev); free(first_member); free(next_member); free(last_member);
+}
+
+
+void AMDOrder(SMatrix M, long *PERM)
+{
+  MinimumDegree(M.n, M.col, M.row, PERM);
+}
+
+
+/* Order a small piece, or one without a small separator, by minimum degree */
+static void OrderLeaf(struct Piece *s)
+{
+  long *col, *row, *order;
+  long i, j, v, u, m;
+
+  col = (long *) malloc((s->count+1)*sizeof(long));
+  order = (long *) malloc(s->count*sizeof(long));
+  m = 0;
+  for (i=0; i<s->count; i++) {
+    v = s->verts[i];
+    local[v] = i;
+    m += G.col[v+1]-G.col[v];
+  }
+  row = (long *) malloc((m+1)*sizeof(long));
+
+  m = 0;
+  for (i=0; i<s->count; i++) {
+    v = s->verts[i];
+    col[i] = m;
+    for (j=G.col[v]; j<G.col[v+1]; j++) {
+      u = G.row[j];
+      if (piece_of[u] == s->lo)
+	row[m++] = local[u];
+    }
+  }
+  col[s->count] = m;
+
+  MinimumDegree(s->count, col, row, order);
+  for (i=0; i<s->count; i++)
+    dissection[s->lo+i] = s->verts[order[i]];
+
+  free(col); free(row); free(order);
+}
+
+
+/*
+ * Breadth-first search from start over the vertices of piece s.  The
+ * vertices reached are left in queue in level order; returns how many.
+ */
+static long LevelStructure(struct Piece *s, long start, long *queue,
+			   long *levels)
+{
+  long qhead, qtail, v, u, j;
+
+  for (j=0; j<s->count; j++)
+    level[s->verts[j]] = -1;
+  level[start] = 0;
+  queue[0] = start;
+  qhead = 0; qtail = 1;
+  while (qhead < qtail) {
+    v = queue[qhead++];
+    for (j=G.col[v]; j<G.col[v+1]; j++) {
+      u = G.row[j];
+      if (piece_of[u] == s->lo && level[u] == -1) {
+	level[u] = level[v]+1;
+	queue[qtail++] = u;
+      }
+    }
+  }
+  *levels = level[queue[qtail-1]]+1;
+  return(qtail);
+}
+
+
+static void Dissect(struct Piece *s);
+
+static void *DissectThread(void *arg)
+{
+  Dissect((struct Piece *) arg);
+  return(NULL);
+}
+
+/* Give the vertices of list a piece of their own at position lo */
+static void NewPiece(struct Piece *t, long *list, long count, long lo,
+		     long depth)
+{
+  long i;
+
+  t->verts = (long *) malloc((count+1)*sizeof(long));
+  t->count = count;
+  t->lo = lo;
+  t->depth = depth;
+  for (i=0; i<count; i++) {
+    t->verts[i] = list[i];
+    piece_of[list[i]] = lo;
+  }
+}
+
+/*
+ * Order piece s into positions s->lo .. s->lo+s->count-1.  Its
+ * vertices are adjacent only to each other and to separators already
+ * ordered, so pieces are independent of each other.
+ */
+static void Dissect(struct Piece *s)
+{
+  struct Piece a, b;
+  pthread_t thread;
+  long *queue, *side, *size;
+  long i, j, l, v, u, start, reached, levels, last_levels, mid, sum, before, n_sep;
+  long n_a, n_b, iter, best, deg, first, big;
+
+  if (s->count <= ND_LEAF) {
+    OrderLeaf(s);
+    free(s->verts);
+    return;
+  }
+
+  queue = (long *) malloc(s->count*sizeof(long));
+  side = (long *) malloc(s->count*sizeof(long));
+
+  /* pseudo-peripheral vertex: restart from the far end while the
+     level structure keeps getting deeper */
+  start = s->verts[0];
+  reached = LevelStructure(s, start, queue, &levels);
+  last_levels = 0;
+  for (iter=0; iter<ND_PERIPHERAL && levels > last_levels; iter++) {
+    last_levels = levels;
+    best = -1;
+    for (i=reached-1; i>=0 && level[queue[i]] == levels-1; i--) {
+      v = queue[i];
+      deg = G.col[v+1]-G.col[v];
+      if (best == -1 || deg < G.col[best+1]-G.col[best])
+	best = v;
+    }
+    start = best;
+    reached = LevelStructure(s, start, queue, &levels);
+  }
+
+  if (reached < s->count) {
+    /* disconnected: order the other components first and the largest
+       last, so that the last columns are its top separator rather
+       than a small component that may become a domain */
+    for (i=0; i<s->count; i++)
+      level[s->verts[i]] = -1;
+    reached = 0;
+    first = big = n_b = 0;
+    for (i=0; i<s->count; i++) {
+      if (level[s->verts[i]] != -1)
+	continue;
+      start = reached;
+      level[s->verts[i]] = 0;
+      queue[reached++] = s->verts[i];
+      for (l=start; l<reached; l++) {
+	v = queue[l];
+	for (j=G.col[v]; j<G.col[v+1]; j++) {
+	  u = G.row[j];
+	  if (piece_of[u] == s->lo && level[u] == -1) {
+	    level[u] = 0;
+	    queue[reached++] = u;
+	  }
+	}
+      }
+      if (reached-start > n_b) {
+	first = start;
+	n_b = reached-start;
+      }
+    }
+    big = first+n_b;
+    n_a = 0;
+    for (i=0; i<s->count; i++)
+      if (i < first || i >= big)
+	side[n_a++] = queue[i];
+    NewPiece(&a, side, n_a, s->lo, s->depth);
+    NewPiece(&b, &queue[first], n_b, s->lo+n_a, s->depth);
+    free(queue); free(side); free(s->verts);
+    Dissect(&a);
+    Dissect(&b);
+    return;
+  }
+
+  if (levels < 3) {
+    free(queue); free(side);
+    OrderLeaf(s);
+    free(s->verts);
+    return;
+  }
+
+  /* separator: the smallest level that leaves at least a quarter of
+     the piece on either side, or failing that the middle one, less
+     the vertices with no neighbour in the level after it */
+  size = (long *) calloc(levels, sizeof(long));
+  for (i=0; i<s->count; i++)
+    size[level[queue[i]]]++;
+  mid = -1;
+  before = size[0];
+  for (l=1; l<levels-1; l++) {
+    if (4*before >= s->count && 4*(s->count-before-size[l]) >= s->count &&
+	(mid == -1 || size[l] < size[mid]))
+      mid = l;
+    before += size[l];
+  }
+  if (mid == -1) {
+    for (i=0; i<s->count; i++) {
+      if (level[queue[i]] > 0 && 2*(i+1) >= s->count)
+	break;
+    }
+    mid = level[queue[i]];
+    if (mid >= levels-1)
+      mid = levels-2;
+  }
+  free(size);
+
+  n_a = n_b = n_sep = 0;
+  for (i=0; i<s->count; i++) {
+    v = queue[i];
+    if (level[v] < mid) {
+      side[i] = 0;
+    } else if (level[v] > mid) {
+      side[i] = 1;
+    } else {
+      side[i] = 0;
+      for (j=G.col[v]; j<G.col[v+1]; j++) {
+	u = G.row[j];
+	if (piece_of[u] == s->lo && level[u] == mid+1) {
+	  side[i] = 2;
+	  n_sep++;
+	  break;
+	}
+      }
+    }
+  }
+  /* a piece with no small separator is ordered better by AMD */
+  if (n_sep*ND_SEPARATOR > s->count) {
+    free(queue); free(side);
+    OrderLeaf(s);
+    free(s->verts);
+    return;
+  }
+
+  /* stable partition of queue into A, B and the separator */
+  sum = 0;
+  for (i=0; i<s->count; i++) {
+    if (side[i] == 0)
+      s->verts[n_a++] = queue[i];
+  }
+  for (i=0; i<s->count; i++) {
+    if (side[i] == 1)
+      s->verts[n_a + n_b++] = queue[i];
+  }
+  for (i=0; i<s->count; i++) {
+    if (side[i] == 2) {
+      v = queue[i];
+      dissection[s->lo+s->count-1-sum] = v;
+      piece_of[v] = -1;
+      separator_level[v] = s->depth;
+      sum++;
+    }
+  }
+
+  NewPiece(&a, s->verts, n_a, s->lo, s->depth+1);
+  NewPiece(&b, &s->verts[n_a], n_b, s->lo+n_a, s->depth+1);
+  free(queue); free(side); free(s->verts);
+
+  if (s->depth < thread_levels &&
+      pthread_create(&thread, NULL, DissectThread, &a) == 0) {
+    Dissect(&b);
+    pthread_join(thread, NULL);
+  } else {
+    Dissect(&a);
+    Dissect(&b);
+  }
+}
+
+
+/*
+ * Nested dissection ordering of M, with the halves split by the top
+ * levels of the dissection ordered in parallel by up to P threads.
+ */
+void NDOrder(SMatrix M, long *PERM, long P)
+{
+  struct Piece s;
+  long i;
+
+  G = M;
+  dissection = PERM;
+  piece_of = (long *) malloc(M.n*sizeof(long));
+  level = (long *) malloc(M.n*sizeof(long));
+  local = (long *) malloc(M.n*sizeof(long));
+  if (separator_level)
+    free(separator_level);
+  separator_level = (long *) malloc(M.n*sizeof(long));
+  if (!piece_of || !level || !local || !separator_level) {
+    printf("Out of memory in NDOrder\n");
+    exit(-1);
+  }
+
+  for (thread_levels=0; (1L << thread_levels) < P; thread_levels++)
+    ;
+
+  s.verts = (long *) malloc((M.n+1)*sizeof(long));
+  for (i=0; i<M.n; i++) {
+    s.verts[i] = i;
+    separator_level[i] = M.n;
+  }
+  s.count = M.n;
+  s.depth = 0;
+  s.lo = 0;
+  for (i=0; i<M.n; i++)
+    piece_of[i] = 0;
+
+  Dissect(&s);
+
+  free(piece_of); free(level); free(local);
+}
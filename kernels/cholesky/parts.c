@@ -45,13 +45,15 @@ double *divide_lo=NULL, *divide_hi;
 
 extern double *work_tree;
 extern long *firstchild, *child;
+extern long *separator_level, *PERM;
 
 long Divide(struct Chunk *root);
 void AddInOrder(struct Chunk *t);
+struct Chunk *SeparatorChunk(long levels);
 
 void Partition(SMatrix M, long parts, long *T, long *assigned_ops, long *domain, long *domains, long *proc_domains)
 {
-  long i, p, start, minm, maxm, ops, change;
+  long i, p, start, minm, maxm, ops, change, levels;
   long which=0;
   long *depth;
   double ave, maxo=0.0, maxd;
@@ -66,6 +68,16 @@ void Partition(SMatrix M, long parts, long *T, long *assigned_ops, long *domain,
       start = i+1;
     }
 
+  /* After nested dissection, the separators of the top log P levels
+     of the dissection stay out of the domains, so that the domains
+     are the pieces the dissection cut apart */
+  if (separator_level) {
+    for (levels=0; (1L << levels) < parts; levels++)
+      ;
+    while ((t = SeparatorChunk(levels)))
+      Divide(t);
+  }
+
     NumberPartition(parts, assigned_ops, 0);
 
     for (;;) {
@@ -277,6 +289,30 @@ void AddInOrder(struct Chunk *t)
 }
 
 
+/* Remove and return a chunk rooted in a separator above depth levels */
+
+struct Chunk *SeparatorChunk(long levels)
+{
+	struct Chunk *t, *prev;
+
+	prev = NULL;
+	for (t=chunks_head; t; t=t->next) {
+		if (separator_level[PERM[t->last-1]] < levels) {
+			if (prev)
+				prev->next = t->next;
+			else
+				chunks_head = t->next;
+			if (t == chunks_tail)
+				chunks_tail = prev;
+			return(t);
+			}
+		prev = t;
+		}
+
+	return(NULL);
+}
+
+
 struct Chunk *GetChunk()
 {
 	struct Chunk *t;
@@ -78,14 +78,52 @@ void NoSegments(SMatrix M)
 }
 
 
-void CreatePermutation(long n, long *PERM, long permutation_method)
+void CreatePermutation(SMatrix M, long *PERM, long permutation_method)
 {
   long j;
+  extern long P, *separator_level;
 
-  PERM[n] = n;
+  /* only nested dissection leaves a separator tree */
+  if (permutation_method != ND_PERM && separator_level) {
+    free(separator_level);
+    separator_level = NULL;
+  }
+
+  PERM[M.n] = M.n;
   if (permutation_method == NO_PERM) {
-    for (j=0; j<n; j++)
+    for (j=0; j<M.n; j++)
       PERM[j] = j;
   }
+  else if (permutation_method == AMD_PERM) {
+    AMDOrder(M, PERM);
+  }
+  else if (permutation_method == ND_PERM) {
+    NDOrder(M, PERM, P);
+  }
 }
 
+
+/* Number of nonzeroes in L, and operations to factor, under PERM */
+
+void OrderingCost(SMatrix M, long *PERM, long *fill, double *ops)
+{
+  long j;
+  long *INVP, *T, *nz;
+
+  INVP = (long *) malloc((M.n+1)*sizeof(long));
+  T = (long *) malloc((M.n+1)*sizeof(long));
+  nz = (long *) malloc((M.n+1)*sizeof(long));
+
+  InvertPerm(M.n, PERM, INVP);
+  EliminationTreeFromA(M, T, PERM, INVP);
+  ComputeNZ(M, T, nz, PERM, INVP);
+
+  *fill = 0;
+  *ops = 0;
+  for (j=0; j<M.n; j++) {
+    *fill += nz[j];
+    *ops += nz[j]+nz[j]*(nz[j]-1);
+  }
+
+  free(INVP); free(T); free(nz);
+}
@@ -23,10 +23,29 @@
 /*  -pP : P = number of processors.                                      */
 /*  -Bb : Use a postpass partition size of b.                            */
 /*  -Cc : Cache size in bytes.                                           */
-/*  -s  : Print individual processor timing statistics.                  */
+/*  -a  : Autotune: calibrate the cost model on this machine, then choose*/
+/*        for each matrix the postpass partition size (overrides -B)     */
+/*        and, without packed kernels, which do not use it, the block    */
+/*        size (overrides -C).                                           */
+/*  -Oo : Order the matrix with o: natural (as read, the default), amd   */
+/*        (approximate minimum degree) or nd (nested dissection).        */
+/*  -s  : Print individual processor timing and allocator statistics.    */
+/*  -S  : Let idle processors steal updates from domains to blocks       */
+/*        they do not own.                                               */
 /*  -t  : Test output.                                                   */
+/*  -kK : With -t, solve K right-hand sides at once (default 1).         */
+/*  -rR : Refactor R more matrices with the same pattern and new values, */
+/*        reusing the symbolic analysis.                                 */
+/*  -wf : Write the matrix to f in binary CSC form and exit.             */
 /*  -h  : Print out command line options.                                */
 /*                                                                       */
+/*  The input file may be Harwell-Boeing, Matrix Market coordinate, or   */
+/*  binary CSC as written by -w, which is mapped rather than read.       */
+/*  In place of a file, one of the matrices in gen.c may be named:       */
+/*  lap2d:K, lap3d:K, lap27:K (grid Laplacians), rgg:N[:D] (random       */
+/*  geometric graph) or fe:K[:B] (B unknowns per node of a K by K        */
+/*  finite element grid).                                                */
+/*                                                                       */
 /*  Note: This version works under both the FORK and SPROC models        */
 /*                                                                       */
 /*************************************************************************/
@@ -69,9 +88,10 @@ long distribute = -1;
 
 long target_partition_size = 0;
 long postpass_partition_size = DEFAULT_PPS;
-long permutation_method = 1;
+long permutation_method = NO_PERM;
 long join = 1; /* attempt to amalgamate supernodes */
 long scatter_decomposition = 0;
+long steal = 0; /* idle processors take other processors' domain updates */
 
 long P=DEFAULT_P;
 long iters = 1;
@@ -79,11 +99,14 @@ SMatrix M;      /* input matrix */
 
 char probname[80];
 
+char *ordering_names[] = { "", "Natural", "AMD", "Nested dissection" };
+
 extern struct Update *freeUpdate[MAX_PROC];
 extern struct Task *freeTask[MAX_PROC];
 extern long *firstchild, *child;
 extern BMatrix LB;
 extern char *optarg;
+extern int optind;
 
 struct gpid {
   long pid;
@@ -92,18 +115,26 @@ struct gpid {
 } *gp;
 
 long do_test = 0;
+long nrhs = 1;
 long do_stats = 0;
+long refactor = 0;
+long autotune = 0;
+extern long tuned_bs;
+struct LocalCopies *localCopies[MAX_PROC];
+char *write_name = NULL;
+
+static void TestSolve(double *b);
+static SMatrix NewValues(SMatrix M, long step);
+static unsigned long WallTime(void);
 
 int main(int argc, char *argv[])
 {
-  double *b, *x;
-  double norm;
-  long i;
+  double *b;
+  long i, r;
   long c;
-  long *assigned_ops, num_nz, num_domain, num_alloc, ps;
-  long *PERM2;
   extern double *work_tree;
-  extern long *partition;
+  struct Symbolic *S;
+  SMatrix A;
   unsigned long start;
   double mint, maxt, avgt;
 
@@ -119,22 +150,46 @@ int main(int argc, char *argv[])
 
 }
 
-  while ((c = getopt(argc, argv, "B:C:p:D:sth")) != -1) {
+  while ((c = getopt(argc, argv, "aB:C:O:p:D:k:r:sStw:h")) != -1) {
     switch(c) {
+    case 'a': autotune = 1; break;
     case 'B': postpass_partition_size = atoi(optarg); break;  
     case 'C': CacheSize = (double) atoi(optarg); break;  
+    case 'O': if (strcmp(optarg, "natural") == 0) {
+                permutation_method = NO_PERM;
+              } else if (strcmp(optarg, "amd") == 0) {
+                permutation_method = AMD_PERM;
+              } else if (strcmp(optarg, "nd") == 0) {
+                permutation_method = ND_PERM;
+              } else {
+                fprintf(stderr, "Unknown ordering %s\n", optarg);
+                exit(-1);
+              }
+              break;
     case 'p': P = atol(optarg); break;  
     case 's': do_stats = 1; break;  
+    case 'S': steal = 1; break;
     case 't': do_test = 1; break;  
+    case 'k': nrhs = atol(optarg); break;
+    case 'r': refactor = atol(optarg); break;
+    case 'w': write_name = optarg; break;
     case 'h': printf("Usage: CHOLESKY <options> file\n\n");
               printf("options:\n");
               printf("  -Bb : Use a postpass partition size of b.\n");
               printf("  -Cc : Cache size in bytes.\n");
+              printf("  -a  : Autotune partition size and, without packed kernels, block size.\n");
+              printf("  -Oo : Order the matrix with o: natural, amd or nd.\n");
               printf("  -pP : P = number of processors.\n");
-              printf("  -s  : Print individual processor timing statistics.\n");
+              printf("  -s  : Print individual processor timing and allocator statistics.\n");
+              printf("  -S  : Let idle processors steal domain updates.\n");
               printf("  -t  : Test output.\n");
+              printf("  -kK : With -t, solve K right-hand sides at once.\n");
+              printf("  -rR : Refactor R more matrices with the same pattern.\n");
+              printf("  -wf : Write the matrix to f in binary CSC form and exit.\n");
               printf("  -h  : Print out command line options.\n\n");
-              printf("Default: CHOLESKY -p%1d -B%1d -C%1d\n",
+              printf("file may also be a generated matrix: lap2d:K[xL], lap3d:K[xLxM],\n");
+              printf("lap27:K[xLxM], rgg:N[:D] or fe:K[:B].\n\n");
+              printf("Default: CHOLESKY -p%1d -B%1d -C%1d -Onatural\n",
                      DEFAULT_P,DEFAULT_PPS,DEFAULT_CS);
               exit(0);
               break;
@@ -194,11 +249,18 @@ int main(int argc, char *argv[])
   {pthread_mutex_init(&(Global->memLock), NULL);}
 
   MallocInit(P);  
+  DenseInit();
+  if (autotune)
+    CalibrateModel();
 
-  i = 0;
-  while (++i < argc && argv[i][0] == '-')
-    ;
-  M = ReadSparse(argv[i], probname);
+  M = ReadSparse(argv[optind], probname);
+
+  if (write_name) {
+    WriteBinaryCSC(M, write_name, probname);
+    printf("Wrote %s: %ld columns, %ld nonzeroes\n", write_name, M.n,
+           M.col[M.n]);
+    exit(0);
+  }
 
   distribute = LB_DOMAINS*10 + EMBED;
 
@@ -206,8 +268,15 @@ int main(int argc, char *argv[])
   printf("Sparse Cholesky Factorization\n");
   printf("     Problem: %s\n",probname);
   printf("     %ld Processors\n",P);
-  printf("     Postpass partition size: %ld\n",postpass_partition_size);
-  printf("     %0.0f byte cache\n",CacheSize);
+  if (autotune) {
+    printf("     Postpass partition size: autotuned\n");
+    printf("     Block size %ld, %s\n",BS,
+	   tuned_bs ? "calibrated" : "not tuned with packed kernels");
+  }
+  else {
+    printf("     Postpass partition size: %ld\n",postpass_partition_size);
+    printf("     %0.0f byte cache\n",CacheSize);
+  }
   printf("\n");
   printf("\n");
 
@@ -220,15 +289,227 @@ int main(int argc, char *argv[])
   printf("embedded ");
   printf("distribution\n");
 
-  printf("No ordering\n");
-
   PERM = (long *) MyMalloc((M.n+1)*sizeof(long), DISTRIBUTED);
   INVP = (long *) MyMalloc((M.n+1)*sizeof(long), DISTRIBUTED);
 
-  CreatePermutation(M.n, PERM, NO_PERM);
+  /* fill and work of every ordering, the chosen one marked */
+  {
+    long m, fill;
+    double ops;
+    unsigned long t0, t1;
+    struct timeval now;
+
+    printf("\n");
+    printf("  Ordering           Nonzeros in L     Factor ops    Time (ms)\n");
+    for (m=NO_PERM; m<=ND_PERM; m++) {
+      gettimeofday(&now, NULL);
+      t0 = (unsigned long)(now.tv_usec + now.tv_sec * 1000000);
+      CreatePermutation(M, PERM, m);
+      gettimeofday(&now, NULL);
+      t1 = (unsigned long)(now.tv_usec + now.tv_sec * 1000000);
+      OrderingCost(M, PERM, &fill, &ops);
+      printf("%c %-18s %14ld %14.0f %12.1f\n",
+             (m == permutation_method) ? '*' : ' ', ordering_names[m],
+             fill, ops, (t1-t0)/1000.0);
+    }
+    printf("\n");
+  }
+
+  printf("%s ordering\n", ordering_names[permutation_method]);
+  printf("%s dense kernels\n", DenseKernelName());
+
+  S = Analyze(M);
+
+  b = CreateVector(M);
+
+  Factor(S, M);
+  if (refactor == 0) {
+    FreeMatrix(M);
+  }
+
+  printf("%.0f operations for factorization\n", work_tree[M.n]);
+  if (steal)
+    printf("%ld domain updates stolen\n", TasksStolen());
+
+  printf("\n");
+  printf("                            PROCESS STATISTICS\n");
+  printf("              Total\n");
+  printf(" Proc         Time \n");
+  printf("    0    %10.0ld\n", Global->runtime[0]);
+  if (do_stats) {
+    maxt = avgt = mint = Global->runtime[0];
+    for (i=1; i<P; i++) {
+      if (Global->runtime[i] > maxt) {
+        maxt = Global->runtime[i];
+      }
+      if (Global->runtime[i] < mint) {
+        mint = Global->runtime[i];
+      }
+      avgt += Global->runtime[i];
+    }
+    avgt = avgt / P;
+    for (i=1; i<P; i++) {
+      printf("  %3ld    %10ld\n",i,Global->runtime[i]);
+    }
+    printf("  Avg    %10.0f\n",avgt);
+    printf("  Min    %10.0f\n",mint);
+    printf("  Max    %10.0f\n",maxt);
+    printf("\n");
+    MallocStats();
+    printf("\n");
+  }
+
+  printf("                            TIMING INFORMATION\n");
+  printf("Start time                        : %16lu\n",
+          start);
+  printf("Initialization finish time        : %16lu\n",
+          gp->initdone);
+  printf("Overall finish time               : %16lu\n",
+          gp->finish);
+  printf("Total time with initialization    : %16lu\n",
+          gp->finish-start);
+  printf("Total time without initialization : %16lu\n",
+          gp->finish-gp->initdone);
+  printf("\n");
+
+  printf("Symbolic analysis time            : %16lu\n",
+          S->order_time+S->tree_time+S->block_time+S->task_time);
+  printf("  ordering                        : %16lu\n", S->order_time);
+  printf("  elimination tree, supernodes    : %16lu\n", S->tree_time);
+  printf("  partitions and blocks           : %16lu\n", S->block_time);
+  printf("  task setup                      : %16lu\n", S->task_time);
+  printf("Value scatter time                : %16lu\n", S->scatter_time);
+  printf("Numeric factorization time        : %16lu\n", S->numeric_time);
+  printf("\n");
+
+  if (do_test) {
+    printf("                             TESTING RESULTS\n");
+    TestSolve(b);
+  }
+
+  /* new values in the same pattern reuse the analysis */
+  for (r=1; r<=refactor; r++) {
+    A = NewValues(M, r);
+    Factor(S, A);
+    printf("Refactorization %ld: scatter %lu, numeric %lu\n", r,
+           S->scatter_time, S->numeric_time);
+    if (do_test) {
+      MyFree(b);
+      b = CreateVector(A);
+      TestSolve(b);
+    }
+    free(A.nz);
+  }
+
+  {exit(0);}
+}
+
+
+/* Solve A x = b for nrhs multiples of b, whose solutions are multiples
+   of the all-ones vector, and report the largest error */
+
+static void TestSolve(double *b)
+{
+  double *x;
+  double norm;
+  long i, c;
+  unsigned long t0;
+
+  if (nrhs < 1) {
+    nrhs = 1;
+  }
+  x = (double *) malloc(LB.n*nrhs*sizeof(double));
+  for (c=0; c<nrhs; c++) {
+    for (i=0; i<LB.n; i++) {
+      x[c*LB.n+i] = (c+1)*b[i];
+    }
+  }
+  t0 = WallTime();
+  BlockSolve(x, nrhs, PERM);
+  printf("Solve time for %4ld right-hand sides: %16lu\n", nrhs,
+         WallTime() - t0);
+  norm = 0.0;
+  for (c=0; c<nrhs; c++) {
+    for (i=0; i<LB.n; i++) {
+      if (fabs(x[c*LB.n+i]/(c+1) - 1.0) > norm) {
+        norm = fabs(x[c*LB.n+i]/(c+1) - 1.0);
+      }
+    }
+  }
+  if (norm >= 0.0001) {
+    printf("Max error is %10.9f\n", norm);
+  } else {
+    printf("PASSED\n");
+  }
+  free(x);
+}
+
+
+/* A matrix with the pattern of M whose diagonal is scaled by
+   1 + step/10, which keeps it positive definite.  Only nz is new. */
+
+static SMatrix NewValues(SMatrix M, long step)
+{
+  SMatrix A;
+  long i, j;
+
+  A = M;
+  A.map = NULL;
+  A.nz = (double *) malloc(M.col[M.n]*sizeof(double));
+  for (j=0; j<M.n; j++)
+    for (i=M.col[j]; i<M.col[j+1]; i++) {
+      if (M.nz)
+	A.nz[i] = M.nz[i];
+      else
+	A.nz[i] = Value(M.row[i], j);
+      if (M.row[i] == j)
+	A.nz[i] *= 1.0 + step/10.0;
+    }
+
+  return(A);
+}
+
+
+static unsigned long WallTime()
+{
+  struct timeval now;
+
+  gettimeofday(&now, NULL);
+  return((unsigned long)(now.tv_usec + now.tv_sec * 1000000));
+}
+
+
+/* Everything from the ordering through the task setup depends only on
+   the sparsity pattern of M, so it is done once here.  The numeric
+   values are scattered by Factor(). */
+
+struct Symbolic *Analyze(SMatrix M)
+{
+  long i;
+  long *assigned_ops, num_nz, num_domain, num_alloc, ps;
+  long *PERM2;
+  extern double *work_tree;
+  extern long *partition;
+  struct Symbolic *S;
+  unsigned long t0;
+
+  S = (struct Symbolic *) malloc(sizeof(struct Symbolic));
+  S->n = M.n;
+  S->col = (long *) malloc((M.n+1)*sizeof(long));
+  S->row = (long *) malloc(M.col[M.n]*sizeof(long));
+  memcpy(S->col, M.col, (M.n+1)*sizeof(long));
+  memcpy(S->row, M.row, M.col[M.n]*sizeof(long));
+  S->factorizations = 0;
+
+  t0 = WallTime();
+
+  CreatePermutation(M, PERM, permutation_method);
 
   InvertPerm(M.n, PERM, INVP);
 
+  S->order_time = WallTime() - t0;
+  t0 = WallTime();
+
   T = (long *) MyMalloc((M.n+1)*sizeof(long), DISTRIBUTED);
   EliminationTreeFromA(M, T, PERM, INVP);
 
@@ -247,6 +528,8 @@ int main(int argc, char *argv[])
 
   Amalgamate2(1, M, T, nz, node, (long *) NULL, 1);
 
+  S->tree_time = WallTime() - t0;
+  t0 = WallTime();
 
   assigned_ops = (long *) malloc(P*sizeof(long));
   domain = (long *) MyMalloc(M.n*sizeof(long), DISTRIBUTED);
@@ -257,6 +540,9 @@ int main(int argc, char *argv[])
   Partition(M, P, T, assigned_ops, domain, domains, proc_domains);
   free(assigned_ops);
 
+  if (autotune)
+    postpass_partition_size = TunePartitionSize(M, T, nz, node, domain);
+
   {
     long i, tot_domain_updates, tail_length;
 
@@ -283,16 +569,20 @@ int main(int argc, char *argv[])
   NoSegments(M);
 
   PERM2 = (long *) malloc((M.n+1)*sizeof(long));
-  CreatePermutation(M.n, PERM2, permutation_method);
+  CreatePermutation(M, PERM2, NO_PERM);
   ComposePerm(PERM, PERM2, M.n);
   free(PERM2);
 
   InvertPerm(M.n, PERM, INVP);
 
-  b = CreateVector(M);
 
+  /* a guess at the number of blocks, which CreateBlockedMatrix2() grows
+     if it is short: the domains' columns, the rest in blocks of ps,
+     and a dummy column of blocks for each domain */
   ps = postpass_partition_size;
   num_alloc = num_domain + (num_nz-num_domain)*10/ps/ps;
+  for (i=0; i<proc_domains[P]; i++)
+    num_alloc += nz[domains[i]]-1;
   CreateBlockedMatrix2(M, num_alloc, T, firstchild, child, PERM, INVP,
 		       domain, partition);
 
@@ -302,8 +592,8 @@ int main(int argc, char *argv[])
 
   AllocateNZ();
 
-  FillInNZ(M, PERM, INVP);
-  FreeMatrix(M);
+  S->block_time = WallTime() - t0;
+  t0 = WallTime();
 
   InitTaskQueues(P);
 
@@ -311,6 +601,34 @@ int main(int argc, char *argv[])
   ComputeRemainingFO();
   ComputeReceivedFO();
 
+  S->task_time = WallTime() - t0;
+
+  return(S);
+}
+
+
+
+/* Factor a matrix with the pattern S was computed for: scatter its
+   values into LB and run the numeric factorization. */
+
+void Factor(struct Symbolic *S, SMatrix M)
+{
+  unsigned long t0;
+
+  if (M.n != S->n ||
+      memcmp(M.col, S->col, (M.n+1)*sizeof(long)) != 0 ||
+      memcmp(M.row, S->row, M.col[M.n]*sizeof(long)) != 0) {
+    printf("Matrix does not have the analyzed sparsity pattern\n");
+    exit(-1);
+  }
+
+  t0 = WallTime();
+  FillInNZ(M, PERM, INVP);
+  S->scatter_time = WallTime() - t0;
+
+  t0 = WallTime();
+  gp->pid = 0;
+
   {
 
 	long i;
@@ -357,62 +675,10 @@ int main(int argc, char *argv[])
 
 };
 
-  printf("%.0f operations for factorization\n", work_tree[M.n]);
-
-  printf("\n");
-  printf("                            PROCESS STATISTICS\n");
-  printf("              Total\n");
-  printf(" Proc         Time \n");
-  printf("    0    %10.0ld\n", Global->runtime[0]);
-  if (do_stats) {
-    maxt = avgt = mint = Global->runtime[0];
-    for (i=1; i<P; i++) {
-      if (Global->runtime[i] > maxt) {
-        maxt = Global->runtime[i];
-      }
-      if (Global->runtime[i] < mint) {
-        mint = Global->runtime[i];
-      }
-      avgt += Global->runtime[i];
-    }
-    avgt = avgt / P;
-    for (i=1; i<P; i++) {
-      printf("  %3ld    %10ld\n",i,Global->runtime[i]);
-    }
-    printf("  Avg    %10.0f\n",avgt);
-    printf("  Min    %10.0f\n",mint);
-    printf("  Max    %10.0f\n",maxt);
-    printf("\n");
-  }
-
-  printf("                            TIMING INFORMATION\n");
-  printf("Start time                        : %16lu\n",
-          start);
-  printf("Initialization finish time        : %16lu\n",
-          gp->initdone);
-  printf("Overall finish time               : %16lu\n",
-          gp->finish);
-  printf("Total time with initialization    : %16lu\n",
-          gp->finish-start);
-  printf("Total time without initialization : %16lu\n",
-          gp->finish-gp->initdone);
-  printf("\n");
-
-  if (do_test) {
-    printf("                             TESTING RESULTS\n");
-    x = TriBSolve(LB, b, PERM);
-    norm = ComputeNorm(x, LB.n);
-    if (norm >= 0.0001) {
-      printf("Max error is %10.9f\n", norm);
-    } else {
-      printf("PASSED\n");
-    }
-  }
-
-  {exit(0);}
+  S->numeric_time = WallTime() - t0;
+  S->factorizations++;
 }
 
-
 void Go()
 {
   long MyNum;
@@ -423,18 +689,26 @@ void Go()
     gp->pid++;
   {pthread_mutex_unlock(&(Global->waitLock));}
 
+  MallocBind(MyNum);
+
   {;};
 /* POSSIBLE ENHANCEMENT:  Here is where one might pin processes to
    processors to avoid migration */
 
-  lc =(struct LocalCopies *) malloc(sizeof(struct LocalCopies)+2*PAGE_SIZE);
-  memset(lc, MyNum, sizeof(struct LocalCopies)+2*PAGE_SIZE);
-  lc->freeUpdate = NULL;
-  lc->freeTask = NULL;
+  /* the local copies outlive the thread, so a refactorization reuses
+     them along with their domain update storage */
+  lc = localCopies[MyNum];
+  if (lc == NULL) {
+    lc =(struct LocalCopies *) malloc(sizeof(struct LocalCopies)+2*PAGE_SIZE);
+    memset(lc, MyNum, sizeof(struct LocalCopies)+2*PAGE_SIZE);
+    lc->freeUpdate = NULL;
+    lc->freeTask = NULL;
+
+    PreAllocateFO(MyNum,lc);
+    localCopies[MyNum] = lc;
+  }
   lc->runtime = 0;
 
-  PreAllocateFO(MyNum,lc);
-
     /* initialize - put original non-zeroes in L */
 
   PreProcessFO(MyNum);
@@ -511,6 +785,7 @@ void Go()
   }
 
   BNumericSolveFO(MyNum,lc);
+  MallocFlush();
 
   {
 
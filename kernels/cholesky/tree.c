@@ -105,74 +105,450 @@ void ParentToChild(long *T, long n, long *firstchild, long *child)
 }
 
 
-void ComputeNZ(SMatrix A, long *T, long *nz, long *PERM, long *INVP)
+/* Independent subtrees of an elimination tree.  Every node whose
+   subtree weighs at most 1/(SUBTREES*parts) of the whole belongs to the
+   highest such subtree; the nodes above them all are the top.  The
+   subtrees are dealt to processors heaviest first, each to the least
+   loaded. */
+
+#define SUBTREES 4
+
+static double *subtree_weight;
+
+static int HeavierSubtree(const void *a, const void *b)
 {
-  long i, j, nd, nabor, k;
-  long *marker;
+  double wa = subtree_weight[*(long *) a], wb = subtree_weight[*(long *) b];
 
-  marker = (long *) malloc(A.n*sizeof(long));
-  for (i=0; i<A.n; i++)
-    nz[i] = 1;
-  nz[A.n] = 0;
+  return((wa < wb) - (wa > wb));
+}
 
-  for (i=0; i<A.n; i++) {
-    nd = PERM[i];
-    marker[i] = -1;
-    for (j=A.col[nd]; j<A.col[nd+1]; j++) {
-      nabor = INVP[A.row[j]];
-      k = nabor;
-      while (marker[k] != i && k < i) {
-        nz[k]++;
-	marker[k] = i;
-	k = T[k];
-      }
+struct Subtrees *FindSubtrees(long n, long *T, double *weight, long parts)
+{
+  struct Subtrees *S;
+  double *w, *load, threshold;
+  long i, j, p, best;
+
+  S = (struct Subtrees *) malloc(sizeof(struct Subtrees));
+  S->sub = (long *) malloc((n+1)*sizeof(long));
+  S->root = (long *) malloc((n+1)*sizeof(long));
+  S->owner = (long *) malloc((n+1)*sizeof(long));
+
+  w = (double *) malloc((n+1)*sizeof(double));
+  for (j=0; j<=n; j++)
+    w[j] = 0.0;
+  for (j=0; j<n; j++) {
+    w[j] += weight[j];
+    w[T[j]] += w[j];
+  }
+  threshold = w[n]/(SUBTREES*parts);
+
+  /* parents are numbered after their children */
+  S->n_sub = 0;
+  for (j=n-1; j>=0; j--) {
+    if (w[j] > threshold)
+      S->sub[j] = -1;
+    else if (T[j] == n || w[T[j]] > threshold) {
+      S->sub[j] = S->n_sub;
+      S->root[S->n_sub++] = j;
     }
+    else
+      S->sub[j] = S->sub[T[j]];
+  }
+
+  load = (double *) malloc(parts*sizeof(double));
+  for (p=0; p<parts; p++)
+    load[p] = 0.0;
+  subtree_weight = w;
+  qsort(S->root, S->n_sub, sizeof(long), HeavierSubtree);
+  for (i=0; i<S->n_sub; i++) {
+    best = 0;
+    for (p=1; p<parts; p++)
+      if (load[p] < load[best])
+	best = p;
+    S->sub[S->root[i]] = i;
+    S->owner[i] = best;
+    load[best] += w[S->root[i]];
   }
+  for (j=n-1; j>=0; j--)
+    if (S->sub[j] != -1 && T[j] != n && S->sub[T[j]] != -1)
+      S->sub[j] = S->sub[T[j]];
+
+  free(load);
+  free(w);
 
-  free(marker);
+  return(S);
 }
 
 
-void FindSupernodes(SMatrix A, long *T, long *nz, long *node)
+void FreeSubtrees(struct Subtrees *S)
 {
+  free(S->sub);
+  free(S->root);
+  free(S->owner);
+  free(S);
+}
+
+
+/* Run work(p) on processors p = 0..parts-1 and wait for all of them */
+
+void SymbolicThreads(void (*work)(long MyNum), long parts)
+{
+  pthread_t *threads;
   long i;
-  long *nchild;
-  long supers, current, size, max_super = 0;
 
-  nchild = (long *) malloc((A.n+1)*sizeof(long));
-  for (i=0; i<=A.n; i++)
-    nchild[i] = 0;
+  threads = (pthread_t *) malloc(parts*sizeof(pthread_t));
+  for (i=1; i<parts; i++) {
+    if (pthread_create(&threads[i], NULL, (void * (*)(void *)) work,
+		       (void *) i) != 0) {
+      printf("Error in pthread_create().\n");
+      exit(-1);
+    }
+  }
+  work(0);
+  for (i=1; i<parts; i++)
+    pthread_join(threads[i], NULL);
+  free(threads);
+}
+
+
+/* Column counts of the factor by the Gilbert-Ng-Peyton method: in a
+   postorder of the tree, each nonzero a(i,j) that makes j a leaf of
+   the row subtree of i adds one at j and takes one away at the least
+   common ancestor with the previous leaf, and every column takes one
+   away at its parent.  nz[j] is then the sum over the subtree of j.
+
+   The subtrees found by FindSubtrees() are done in parallel.  Rows
+   inside a subtree have all their leaves in it.  For rows in the top,
+   each subtree records the first and last leaf it saw, and the serial
+   pass over the top joins these up in postorder. */
+
+static SMatrix cnt_A;
+static long *cnt_T, *cnt_nz, *cnt_PERM, *cnt_INVP;
+static long *post, *postpos, *first, *ancestor, *maxfirst, *prevleaf;
+static long *top_index, n_top, **leaves, *n_leaves;
+static struct Subtrees *cnt_trees;
+
+static long FindAncestor(long j)
+{
+  long q, s, next;
+
+  for (q=j; ancestor[q] != q; q=ancestor[q])
+    ;
+  for (s=j; s != q; s=next) {
+    next = ancestor[s];
+    ancestor[s] = q;
+  }
+  return(q);
+}
+
+
+static void CountSubtrees(long MyNum)
+{
+  long s, k, j, p, i, t, root, n_touched, size;
+  long *tmax, *tfirst, *tlast, *touched, *list;
+  long *nz = cnt_nz;
+
+  tmax = (long *) malloc((n_top+1)*sizeof(long));
+  tfirst = (long *) malloc((n_top+1)*sizeof(long));
+  tlast = (long *) malloc((n_top+1)*sizeof(long));
+  touched = (long *) malloc((n_top+1)*sizeof(long));
+  for (t=0; t<n_top; t++)
+    tmax[t] = tlast[t] = -1;
+
+  size = 1024;
+  list = (long *) malloc(size*sizeof(long));
+  n_leaves[MyNum] = 0;
+
+  for (s=0; s<cnt_trees->n_sub; s++) {
+    if (cnt_trees->owner[s] != MyNum)
+      continue;
+    root = cnt_trees->root[s];
+    n_touched = 0;
+
+    for (k=first[root]; k<=postpos[root]; k++) {
+      j = post[k];
+      if (j != root)
+	nz[cnt_T[j]]--;
+      for (p=cnt_A.col[cnt_PERM[j]]; p<cnt_A.col[cnt_PERM[j]+1]; p++) {
+	i = cnt_INVP[cnt_A.row[p]];
+	if (i <= j)
+	  continue;
+	if (cnt_trees->sub[i] == s) {
+	  if (first[j] > maxfirst[i]) {
+	    maxfirst[i] = first[j];
+	    nz[j]++;
+	    if (prevleaf[i] != -1)
+	      nz[FindAncestor(prevleaf[i])]--;
+	    prevleaf[i] = j;
+	  }
+	}
+	else {
+	  t = top_index[i];
+	  if (first[j] > tmax[t]) {
+	    tmax[t] = first[j];
+	    nz[j]++;
+	    if (tlast[t] == -1) {
+	      tfirst[t] = j;
+	      touched[n_touched++] = t;
+	    }
+	    else
+	      nz[FindAncestor(tlast[t])]--;
+	    tlast[t] = j;
+	  }
+	}
+      }
+      if (j != root)
+	ancestor[j] = cnt_T[j];
+    }
+
+    /* the top rows seen here, for the serial pass: s, count, then
+       (row, first leaf, last leaf) for each */
+    if (n_leaves[MyNum] + 3*n_touched + 2 > size) {
+      size = 2*(n_leaves[MyNum] + 3*n_touched + 2);
+      list = (long *) realloc(list, size*sizeof(long));
+    }
+    list[n_leaves[MyNum]++] = s;
+    list[n_leaves[MyNum]++] = n_touched;
+    for (i=0; i<n_touched; i++) {
+      t = touched[i];
+      list[n_leaves[MyNum]++] = t;
+      list[n_leaves[MyNum]++] = tfirst[t];
+      list[n_leaves[MyNum]++] = tlast[t];
+      tmax[t] = tlast[t] = -1;
+    }
+
+    /* sum up the subtree below its root */
+    for (k=first[root]; k<postpos[root]; k++) {
+      j = post[k];
+      nz[cnt_T[j]] += nz[j];
+    }
+  }
+
+  leaves[MyNum] = list;
+  free(tmax); free(tfirst); free(tlast); free(touched);
+}
 
-  for (i=0; i<A.n; i++)
-    nchild[T[i]]++;
 
-  current = 0;
-  supers = 1;
-  size = 1;
-  for (i=1; i<A.n; i++) {
-    if (nz[i] == nz[i-1]-1 && T[i-1] == i && nchild[i] == 1) {
-      node[i] = current-i;
-      size++;
+void ComputeNZ(SMatrix A, long *T, long *nz, long *PERM, long *INVP)
+{
+  long i, j, k, p, s, t, q, root, n_touched;
+  long *head, *next, *stack, *list, *at_p, *at_i, *top_row;
+  long top;
+  double *weight;
+  extern long P;
+
+  cnt_A = A; cnt_T = T; cnt_nz = nz; cnt_PERM = PERM; cnt_INVP = INVP;
+
+  post = (long *) malloc((A.n+1)*sizeof(long));
+  postpos = (long *) malloc((A.n+1)*sizeof(long));
+  first = (long *) malloc((A.n+1)*sizeof(long));
+  ancestor = (long *) malloc((A.n+1)*sizeof(long));
+  maxfirst = (long *) malloc((A.n+1)*sizeof(long));
+  prevleaf = (long *) malloc((A.n+1)*sizeof(long));
+  top_index = (long *) malloc((A.n+1)*sizeof(long));
+
+  /* postorder the tree */
+  head = (long *) malloc((A.n+1)*sizeof(long));
+  next = (long *) malloc((A.n+1)*sizeof(long));
+  stack = (long *) malloc((A.n+1)*sizeof(long));
+  for (j=0; j<=A.n; j++)
+    head[j] = -1;
+  for (j=A.n-1; j>=0; j--) {
+    next[j] = head[T[j]];
+    head[T[j]] = j;
+  }
+  k = 0;
+  top = 0;
+  stack[top++] = A.n;
+  while (top) {
+    j = stack[top-1];
+    if (head[j] == -1) {
+      top--;
+      if (j != A.n) {
+	postpos[j] = k;
+	post[k++] = j;
+      }
     }
     else {
-      node[current] = size;
-      if (size > max_super)
-	max_super = size;
-      supers++;
+      stack[top++] = head[j];
+      head[j] = next[head[j]];
+    }
+  }
+  free(head); free(next); free(stack);
+
+  /* first descendant of every node; the leaves start with one */
+  for (j=0; j<A.n; j++)
+    first[j] = -1;
+  for (k=0; k<A.n; k++) {
+    j = post[k];
+    nz[j] = (first[j] == -1);
+    for (; j != A.n && first[j] == -1; j = T[j])
+      first[j] = k;
+  }
+  nz[A.n] = 0;
+
+  for (j=0; j<A.n; j++) {
+    ancestor[j] = j;
+    maxfirst[j] = prevleaf[j] = -1;
+  }
+
+  weight = (double *) malloc(A.n*sizeof(double));
+  for (j=0; j<A.n; j++)
+    weight[j] = 1 + A.col[PERM[j]+1] - A.col[PERM[j]];
+  cnt_trees = FindSubtrees(A.n, T, weight, P);
+  free(weight);
+
+  n_top = 0;
+  for (j=0; j<A.n; j++)
+    if (cnt_trees->sub[j] == -1)
+      top_index[j] = n_top++;
+  top_row = (long *) malloc((n_top+1)*sizeof(long));
+  for (j=0; j<A.n; j++)
+    if (cnt_trees->sub[j] == -1)
+      top_row[top_index[j]] = j;
+
+  leaves = (long **) malloc(P*sizeof(long *));
+  n_leaves = (long *) malloc(P*sizeof(long));
+  SymbolicThreads(CountSubtrees, P);
+
+  /* where each subtree left its top rows */
+  at_p = (long *) malloc((cnt_trees->n_sub+1)*sizeof(long));
+  at_i = (long *) malloc((cnt_trees->n_sub+1)*sizeof(long));
+  for (p=0; p<P; p++)
+    for (i=0; i<n_leaves[p]; i+=3*leaves[p][i+1]+2) {
+      at_p[leaves[p][i]] = p;
+      at_i[leaves[p][i]] = i;
+    }
+
+  /* the top, in postorder, a whole subtree at a time */
+  for (k=0; k<A.n; k++) {
+    j = post[k];
+    s = cnt_trees->sub[j];
+    if (s != -1) {
+      root = cnt_trees->root[s];
+      list = &leaves[at_p[s]][at_i[s]];
+      n_touched = list[1];
+      for (i=0; i<n_touched; i++) {
+	t = list[3*i+2];
+	q = top_row[t];
+	if (prevleaf[q] != -1)
+	  nz[FindAncestor(prevleaf[q])]--;
+	prevleaf[q] = list[3*i+4];
+	maxfirst[q] = first[list[3*i+4]];
+      }
+      if (T[root] != A.n) {
+	nz[T[root]]--;
+	ancestor[root] = T[root];
+      }
+      k = postpos[root];
+      continue;
+    }
+
+    if (T[j] != A.n)
+      nz[T[j]]--;
+    for (p=A.col[PERM[j]]; p<A.col[PERM[j]+1]; p++) {
+      i = INVP[A.row[p]];
+      if (i > j && first[j] > maxfirst[i]) {
+	maxfirst[i] = first[j];
+	nz[j]++;
+	if (prevleaf[i] != -1)
+	  nz[FindAncestor(prevleaf[i])]--;
+	prevleaf[i] = j;
+      }
+    }
+    if (T[j] != A.n)
+      ancestor[j] = T[j];
+  }
+
+  /* add the subtree sums into the top */
+  for (j=0; j<A.n; j++)
+    if (T[j] != A.n && (cnt_trees->sub[j] == -1 ||
+			cnt_trees->root[cnt_trees->sub[j]] == j))
+      nz[T[j]] += nz[j];
+
+  for (p=0; p<P; p++)
+    free(leaves[p]);
+  free(leaves); free(n_leaves); free(at_p); free(at_i); free(top_row);
+  FreeSubtrees(cnt_trees);
+  free(post); free(postpos); free(first); free(ancestor);
+  free(maxfirst); free(prevleaf); free(top_index);
+}
+
+
+/* A column starts a new supernode unless it is the only child's parent
+   and its column is the child's less the diagonal.  Each processor
+   takes a range of columns, first marking the heads and then, once
+   all heads are known, sizing the supernodes that start in its range. */
+
+static long sn_n, *sn_T, *sn_nz, *sn_node, *sn_supers, *sn_max;
+static char *sn_head;
+
+static void MarkSupernodes(long MyNum)
+{
+  long i, lo, hi;
+  extern long P;
+
+  lo = sn_n*MyNum/P;
+  hi = sn_n*(MyNum+1)/P;
+  for (i=lo; i<hi; i++)
+    sn_head[i] = (i == 0 || sn_nz[i] != sn_nz[i-1]-1 || sn_T[i-1] != i ||
+		  firstchild[i+1]-firstchild[i] != 1);
+}
+
+
+static void SizeSupernodes(long MyNum)
+{
+  long i, k, lo, hi, current;
+  extern long P;
+
+  lo = sn_n*MyNum/P;
+  hi = sn_n*(MyNum+1)/P;
+  sn_supers[MyNum] = sn_max[MyNum] = 0;
+  if (lo == hi)
+    return;
+  for (current=lo; !sn_head[current]; current--)
+    ;
+  for (i=lo; i<hi; i++) {
+    if (sn_head[i]) {
       current = i;
-      size = 1;
+      for (k=i+1; k<sn_n && !sn_head[k]; k++)
+	;
+      sn_node[i] = k-i;
+      sn_supers[MyNum]++;
+      if (k-i > sn_max[MyNum])
+	sn_max[MyNum] = k-i;
     }
+    else
+      sn_node[i] = current-i;
   }
+}
+
 
-  node[current] = size;
-  if (size > max_super)
-    max_super = size;
+void FindSupernodes(SMatrix A, long *T, long *nz, long *node)
+{
+  long p, supers, max_super;
+  extern long P;
+
+  sn_n = A.n; sn_T = T; sn_nz = nz; sn_node = node;
+  sn_head = (char *) malloc(A.n+1);
+  sn_supers = (long *) malloc(P*sizeof(long));
+  sn_max = (long *) malloc(P*sizeof(long));
+
+  SymbolicThreads(MarkSupernodes, P);
+  SymbolicThreads(SizeSupernodes, P);
   node[A.n] = 0;
 
+  supers = max_super = 0;
+  for (p=0; p<P; p++) {
+    supers += sn_supers[p];
+    if (sn_max[p] > max_super)
+      max_super = sn_max[p];
+  }
+
   printf("%ld supers, %4.2f nodes/super, %ld max super\n",
 	 supers, A.n/(double) supers, max_super);  
 
-  free(nchild);
+  free(sn_head); free(sn_supers); free(sn_max);
 }
 
 
@@ -0,0 +1,277 @@
+/*************************************************************************/
+/*                                                                       */
+/*  Autotuning of the dense block size and the postpass partition size   */
+/*  (-a).                                                                */
+/*                                                                       */
+/*  CalibrateModel() times the block kernels on this machine once: the   */
+/*  time of an op, the cost of a miss in ops (which PDIV(), PMOD() and   */
+/*  PADD() use, and so amalgamation too), a lower bound on the cost of   */
+/*  a task, and, where the scalar kernels run, the fastest block size    */
+/*  BS.  With a packed micro-kernel BS is left as -C gives it: every     */
+/*  block large enough to be tiled by BS goes through the packed path,   */
+/*  which does not use it.                                               */
+/*                                                                       */
+/*  TunePartitionSize() then prices the factorization of each matrix     */
+/*  for a range of partition sizes with the same model, as the work      */
+/*  over P plus the critical path of the block tasks, and returns the    */
+/*  cheapest.                                                            */
+/*                                                                       */
+/*************************************************************************/
+
+#include <pthread.h>
+#include <sys/time.h>
+#include <stdlib.h>
+#include <string.h>
+#include "matrix.h"
+
+#define TUNE_N        192       /* order of the blocks BS is timed on */
+#define TUNE_MS        10       /* time each candidate for this long */
+#define STREAM_LEN  (1<<22)     /* doubles, well beyond the caches */
+
+extern long BS;
+extern long P;
+extern long postpass_partition_size;
+extern double miss_cost;
+
+static long bs_sizes[] = { 16, 24, 32, 45, 64, 96, 128 };
+static long ps_sizes[] = { 8, 12, 16, 24, 32, 48, 64, 96, 128 };
+
+static double op_time = 0.0;    /* seconds per op */
+long tuned_bs = 0;              /* whether CalibrateModel() chose BS */
+static double task_time = 0.0;  /* seconds per block task */
+
+static double *ta, *tb, *tc, *td;
+static struct LocalCopies tune_lc;
+
+
+static double Seconds()
+{
+  struct timeval now;
+
+  gettimeofday(&now, NULL);
+  return(now.tv_sec + now.tv_usec*1.0e-6);
+}
+
+
+/* One block update and one block division of order TUNE_N */
+static void DenseStep(long n)
+{
+  memcpy(tb, td, n*n*sizeof(double));
+  BDiv(n, n, ta, tb, &tune_lc);
+  BMod(n, n, n, tb, tb, tc, &tune_lc);
+}
+
+
+/* One n by n by n block update */
+static void UpdateStep(long n)
+{
+  BMod(n, n, n, ta, tb, tc, &tune_lc);
+}
+
+
+/* One task's worth of bookkeeping: a lock and a 1 by 1 update */
+static pthread_mutex_t tune_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void TaskStep(long n)
+{
+  pthread_mutex_lock(&tune_lock);
+  BMod(1, 1, 1, ta, tb, tc, &tune_lc);
+  pthread_mutex_unlock(&tune_lock);
+}
+
+
+/* Seconds per call of step(n): the best of three runs, each calling it
+   until TUNE_MS have passed */
+static double TimeStep(void (*step)(long), long n)
+{
+  long reps, i, run;
+  double start, elapsed, best;
+
+  step(n);
+  reps = 1;
+  for (;;) {
+    start = Seconds();
+    for (i=0; i<reps; i++)
+      step(n);
+    elapsed = Seconds() - start;
+    if (elapsed*1000 >= TUNE_MS)
+      break;
+    reps *= 2;
+  }
+
+  best = elapsed;
+  for (run=1; run<3; run++) {
+    start = Seconds();
+    for (i=0; i<reps; i++)
+      step(n);
+    elapsed = Seconds() - start;
+    if (elapsed < best)
+      best = elapsed;
+  }
+  return(best/reps);
+}
+
+
+void CalibrateModel()
+{
+  long i, j, k, best_bs;
+  double t, best, stream, *x, *y;
+
+  ta = (double *) malloc(TUNE_N*TUNE_N*sizeof(double));
+  tb = (double *) malloc(TUNE_N*TUNE_N*sizeof(double));
+  tc = (double *) malloc(TUNE_N*TUNE_N*sizeof(double));
+  td = (double *) malloc(TUNE_N*TUNE_N*sizeof(double));
+  tune_lc.blktmp = (double *) malloc(128*128*sizeof(double));
+  if (!ta || !tb || !tc || !td || !tune_lc.blktmp) {
+    printf("Could not malloc memory for tuning\n");
+    exit(-1);
+  }
+
+  /* a well conditioned lower triangle in ta; nothing in the blocks may
+     be zero, or the scalar kernels skip work */
+  for (j=0; j<TUNE_N; j++)
+    for (i=0; i<TUNE_N; i++) {
+      ta[i+TUNE_N*j] = (i == j ? 1.0 : 1.0e-3);
+      tb[i+TUNE_N*j] = td[i+TUNE_N*j] = 1.0/(i+j+1);
+      tc[i+TUNE_N*j] = 0.0;
+    }
+
+  /* the time of an op, from a 64 by 64 by 64 update in the cache */
+  op_time = TimeStep(UpdateStep, 64)/(2.0*64*64*64);
+
+  /* the time of a miss, from a stream through memory, which PADD()
+     counts as two misses an element */
+  x = (double *) malloc(STREAM_LEN*sizeof(double));
+  y = (double *) malloc(STREAM_LEN*sizeof(double));
+  if (!x || !y) {
+    printf("Could not malloc memory for tuning\n");
+    exit(-1);
+  }
+  for (i=0; i<STREAM_LEN; i++)
+    x[i] = y[i] = 1.0;
+  stream = Seconds();
+  for (k=0; k<4; k++)
+    for (i=0; i<STREAM_LEN; i++)
+      y[i] += x[i];
+  stream = (Seconds() - stream)/(4.0*2*STREAM_LEN);
+  miss_cost = stream/op_time;
+  if (miss_cost < 1.0)
+    miss_cost = 1.0;
+  if (y[STREAM_LEN/2] < 0.0)    /* so that the stream is not dropped */
+    printf("\n");
+  free(x); free(y);
+
+  task_time = TimeStep(TaskStep, 1);
+
+  /* the fastest block size, the one -C gives unless another is clearly
+     better; only the scalar tiled loops of BDiv() and BMod() use it, so
+     it is timed only when those are what DenseStep() runs */
+  tuned_bs = !DenseWorth(TUNE_N, TUNE_N, TUNE_N);
+  if (tuned_bs) {
+    best_bs = BS;
+    best = TimeStep(DenseStep, TUNE_N);
+    for (k=0; k<sizeof(bs_sizes)/sizeof(long); k++) {
+      BS = bs_sizes[k];
+      t = TimeStep(DenseStep, TUNE_N);
+      if (t < 0.95*best) {
+	best = t;
+	best_bs = BS;
+      }
+    }
+    BS = best_bs;
+  }
+
+  free(ta); free(tb); free(tc); free(td); free(tune_lc.blktmp);
+
+  printf("Calibrated: %.3f ns per op, miss %.2f ops, task %.0f ops, block size %ld%s\n",
+	 op_time*1.0e9, miss_cost, task_time/op_time, BS,
+	 tuned_bs ? "" : " (packed kernels, not tuned)");
+}
+
+
+/* Model time of the factorization with partitions of size ps: the
+   block tasks' work over P plus their critical path.  Domains are
+   factored the same way whatever ps is, so they are left out. */
+static double EstimateTime(SMatrix M, long *T, long *nz, long *node,
+			   long *domain, long ps, long *blocks)
+{
+  long i, j, k, piece, first, w, below, h, nb, parent, *super;
+  double work, crit, path, chain, runtime, dummy, *longest;
+
+  longest = (double *) malloc((M.n+1)*sizeof(double));
+  super = (long *) malloc((M.n+1)*sizeof(long));
+  for (j=0; j<=M.n; j++)
+    longest[j] = 0.0;
+  for (j=0; j<M.n; j+=node[j])
+    for (i=j; i<j+node[j]; i++)
+      super[i] = j;
+  super[M.n] = M.n;
+
+  work = crit = 0.0;
+  *blocks = 0;
+  for (j=0; j<M.n; j+=node[j]) {
+    path = longest[j];
+    if (!domain[j]) {
+      k = FindNumPartitions(node[j], ps);
+      first = j;
+      for (piece=0; piece<k; piece++) {
+	w = node[j]*(piece+1)/k - node[j]*piece/k;
+	below = nz[j] - (first-j) - w;
+	nb = (below+ps-1)/ps;
+
+	runtime = 0.0;
+	PDIV(w, w+below, &dummy, &dummy, &runtime);
+	PMOD(w, below, below, &dummy, &dummy, &runtime);
+	PADD(below, below, &dummy, &runtime);
+	work += runtime*op_time + (1+nb+nb*(nb+1)/2)*task_time;
+	*blocks += 1+nb;
+
+	/* the piece's diagonal block, then one division and one update
+	   before the next piece can start */
+	h = (below < ps ? below : ps);
+	chain = 0.0;
+	PDIV(w, w+h, &dummy, &dummy, &chain);
+	PMOD(w, h, h, &dummy, &dummy, &chain);
+	path += chain*op_time + 3*task_time;
+
+	first += w;
+      }
+    }
+    if (path > crit)
+      crit = path;
+    parent = super[T[j+node[j]-1]];
+    if (path > longest[parent])
+      longest[parent] = path;
+  }
+
+  free(longest); free(super);
+
+  return(work/P + crit*(P-1)/P);
+}
+
+
+long TunePartitionSize(SMatrix M, long *T, long *nz, long *node, long *domain)
+{
+  long k, best, best_blocks, blocks[sizeof(ps_sizes)/sizeof(long)];
+  double best_est, est[sizeof(ps_sizes)/sizeof(long)];
+
+  /* keep the size we have unless another is clearly cheaper */
+  best = postpass_partition_size;
+  best_est = EstimateTime(M, T, nz, node, domain, best, &best_blocks);
+  for (k=0; k<sizeof(ps_sizes)/sizeof(long); k++) {
+    est[k] = EstimateTime(M, T, nz, node, domain, ps_sizes[k], &blocks[k]);
+    if (est[k] < 0.99*best_est) {
+      best = ps_sizes[k];
+      best_est = est[k];
+    }
+  }
+
+  printf("\n");
+  printf("  Partition size       Blocks    Model time (ms)\n");
+  for (k=0; k<sizeof(ps_sizes)/sizeof(long); k++)
+    printf("%c %14ld %12ld %18.2f\n", (ps_sizes[k] == best) ? '*' : ' ',
+	   ps_sizes[k], blocks[k], est[k]*1000);
+  printf("\n");
+
+  return(best);
+}
@@ -22,6 +22,7 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include <string.h>
+#include <sys/mman.h>
 
 extern pthread_t PThreadTable[];
 
@@ -84,6 +85,8 @@ SMatrix NewMatrix(long n, long m, long nz)
   } else {
 	M.nz = NULL;
   }
+  M.map = NULL;
+  M.map_size = 0;
 
   if (!M.col || !M.row || (nz && !M.nz)) {
     printf("NewMatrix %ld %ld: Out of memory\n", n, m);
@@ -96,6 +99,10 @@ SMatrix NewMatrix(long n, long m, long nz)
 
 void FreeMatrix(SMatrix M)
 {
+  if (M.map) {
+    munmap(M.map, M.map_size);
+    return;
+  }
   MyFree(M.col);
   MyFree(M.startrow);
   MyFree(M.row);
@@ -131,6 +138,7 @@ double Value(long i, long j)
 
 SMatrix ReadSparseStr(const char *text, char *probName);
 extern const char *lshp;
+extern long P;
 
 SMatrix ReadSparse(char *name, char *probName)
 {
@@ -142,6 +150,9 @@ SMatrix ReadSparse(char *name, char *probName)
 	char buf[100], type[4];
 	SMatrix M, F;
 
+	if (IsGenerated(name))
+		return(GenerateMatrix(name, probName));
+
 	if (!name || name[0] == 0) {
 		fp = stdin;
 	} else {
@@ -153,6 +164,20 @@ SMatrix ReadSparse(char *name, char *probName)
 		Error("Error opening file\n");
 	}
 
+	/* Matrix Market and binary CSC files announce themselves */
+	if (fp != stdin) {
+	  n = fread(buf, 1, 16, fp);
+	  if (IsBinaryCSC(buf, n)) {
+	    fclose(fp);
+	    return(ReadBinaryCSC(name, probName));
+	  }
+	  if (IsMatrixMarket(buf, n)) {
+	    fclose(fp);
+	    return(ReadMatrixMarket(name, probName, P));
+	  }
+	  rewind(fp);
+	}
+
 	fscanf(fp, "%72c", buf);
 
 	fscanf(fp, "%8c", probName);
@@ -0,0 +1,1773 @@
+/*************************************************************************/
+/*                                                                       */
+/*  Copyright (c) 1994 Stanford University                               */
+/*                                                                       */
+/*  All rights reserved.                                                 */
+/*                                                                       */
+/*  Permission is given to use, copy, and modify this software for any   */
+/*  non-commercial purpose as long as this copyright notice is not       */
+/*  removed.  All other uses, including redistribution in whole or in    */
+/*  part, are forbidden without prior written permission.                */
+/*                                                                       */
+/*  This software is provided with absolutely no warranty and no         */
+/*  support.                                                             */
+/*                                                                       */
+/*************************************************************************/
+
+/*************************************************************************/
+/*                                                                       */
+/*  Parallel dense blocked LU factorization (no pivoting)                */
+/*                                                                       */
+/*  The factorization reaches the matrix only through the blocks of      */
+/*  lu_storage.c, so one binary can factor it in any of three layouts:   */
+/*  column-major, contiguous blocks in their owner's memory or           */
+/*  contiguous blocks in Morton order.                                   */
+/*                                                                       */
+/*  Command line options:                                                */
+/*                                                                       */
+/*  -nN : Decompose NxN matrix.                                          */
+/*  -pP : P = number of processors.                                      */
+/*  -bB : Use a block size of B. BxB elements should fit in cache for    */
+/*        good performance. Small block sizes (B=8, B=16) work well.     */
+/*  -d  : Dataflow execution: per-block dependency counters replace the  */
+/*        global barriers of each step (see lu_dataflow.c).              */
+/*  -lL : Let dataflow execution run L steps ahead of the oldest         */
+/*        unfinished step (lookahead depth, default 1).                  */
+/*  -f  : Mixed precision: factor in single precision, then refine the   */
+/*        solution against the double-precision matrix, factoring        */
+/*        again in double if refinement does not converge.               */
+/*  -mM : Assign blocks to processors with mapping M: diagonal           */
+/*        (default), cyclic, 2d or tiled (see lu_mapping.c).             */
+/*  -r  : Factor each diagonal block with all processors, which are      */
+/*        otherwise idle at that point (not with -d).                    */
+/*  -LL : Store the matrix in layout L: column, tiles or morton (see     */
+/*        lu_storage.c).                                                 */
+/*  -kK : After factoring, solve for K right-hand sides at once with     */
+/*        parallel blocked triangular solves (not with -f or -B).        */
+/*  -BN : Factor a batch of N independent matrices of the -n size        */
+/*        instead of one large matrix (see lu_batch.c).                  */
+/*  -s  : Print individual processor timing and mapping statistics.      */
+/*  -t  : Test output.                                                   */
+/*  -o  : Print out matrix values.                                       */
+/*  -h  : Print out command line options.                                */
+/*                                                                       */
+/*  The block updates use the packed kernels in lu_kernels.c, the -d     */
+/*  scheduler is in lu_dataflow.c, the -m mappings are in lu_mapping.c,  */
+/*  the -B batches are in lu_batch.c, the -L layouts are in              */
+/*  lu_storage.c and the -k solves are in lu_solve.c.                    */
+/*                                                                       */
+/*  There is one LU program.  contiguous_blocks/lu.c and                 */
+/*  non_contiguous_blocks/lu.c only set DEFAULT_LAYOUT (tiles and        */
+/*  column) and include this file; build either and link all six with    */
+/*  it.                                                                  */
+/*                                                                       */
+/*  Note: This version works under both the FORK and SPROC models        */
+/*                                                                       */
+/*************************************************************************/
+
+#include <stdio.h>
+#include <math.h>
+#include <float.h>
+#include <stdlib.h>
+
+
+#include <pthread.h>
+
+#include <sys/time.h>
+
+#include <unistd.h>
+
+#include <stdlib.h>
+
+#include "lu_kernels.h"
+#include "lu_dataflow.h"
+#include "lu_mapping.h"
+#include "lu_batch.h"
+#include "lu_storage.h"
+#include "lu_solve.h"
+
+#define MAX_THREADS 32
+
+pthread_t PThreadTable[MAX_THREADS];
+
+
+
+#define MAXRAND                         32767.0
+#define DEFAULT_N                         512
+#define DEFAULT_P                           1
+#define DEFAULT_B                          16
+#define MAX_REFINE                         30
+#ifndef DEFAULT_LAYOUT
+#define DEFAULT_LAYOUT                  "tiles"
+#endif
+#define min(a,b) ((a) < (b) ? (a) : (b))
+
+struct GlobalMemory {
+  double *t_in_fac;   
+  double *t_in_solve;
+  double *t_in_mod; 
+  double *t_in_bar;
+  double *completion;
+  unsigned long starttime; 
+  unsigned long rf; 
+  unsigned long rs; 
+  unsigned long done;
+  long id;
+  
+
+struct {
+
+	pthread_mutex_t	mutex;
+
+	pthread_cond_t	cv;
+
+	unsigned long	counter;
+
+	unsigned long	cycle;
+
+} (start);
+
+
+  pthread_mutex_t (idlock);
+} *Global;
+
+struct LocalCopies {
+  double t_in_fac;
+  double t_in_solve;
+  double t_in_mod;
+  double t_in_bar;
+};
+
+long n = DEFAULT_N;          /* The size of the matrix */
+long P = DEFAULT_P;          /* Number of processors */
+long block_size = DEFAULT_B; /* Block dimension */
+long nblocks;                /* Number of blocks in each dimension */
+double *rhs;
+long layout;                 /* Block storage layout of the matrix */
+
+long test_result = 0;        /* Test result of factorization? */
+long doprint = 0;            /* Print out matrix values? */
+long dostats = 0;            /* Print out individual processor statistics? */
+long dataflow = 0;           /* Use dataflow execution? */
+long lookahead = DEFAULT_LOOKAHEAD; /* Steps dataflow may run ahead */
+struct lu_tasks tasks;       /* Block operations for dataflow execution */
+long mapping = MAP_DIAGONAL; /* Block-to-processor mapping */
+long mixed = 0;              /* Factor in single precision and refine? */
+long single = 0;             /* Factoring the single-precision copy? */
+double *x;                   /* Solution found by refinement */
+long refined = 0;            /* Did refinement converge? */
+long refine_steps = 0;       /* Refinement steps taken */
+double refine_residual;      /* Scaled residual after refinement */
+unsigned long refine_time;   /* Time spent refining */
+long team = 0;               /* Factor diagonal blocks with all processors? */
+long nrhs = 0;               /* Right-hand sides for -k, or 0 */
+unsigned long solve_time;    /* Time spent in the -k solves */
+long batch_count = 0;        /* Matrices in a -B batch, or 0 */
+struct lu_batch batch;       /* Batch of small matrices for -B */
+
+void SlaveStart(void);
+void OneSolve(long n, long block_size, long MyNum, long dostats);
+void lu0(double *a, long n, long stride);
+void bdiv(double *a, double *diag, long stride_a, long stride_diag, long dimi, long dimk);
+void bmodd(double *a, double *c, long dimi, long dimj, long stride_a, long stride_c);
+void bmod(double *a, double *b, double *c, long dimi, long dimj, long dimk, long stridea, long strideb, long stridec);
+long BlockOwner(long I, long J);
+long BlockOwnerColumn(long I, long J);
+long BlockOwnerRow(long I, long J);
+void lu(long n, long bs, long MyNum, struct LocalCopies *lc, long dostats);
+long BlockDim(long I);
+void TaskFactor(long K);
+void TaskFactorTeam(long K, long MyNum);
+void TaskColumn(long I, long K);
+void TaskRow(long K, long J);
+void TaskUpdate(long I, long J, long K);
+void Factor(long MyNum, struct LocalCopies *lc);
+void Barrier(void);
+void ConvertA(long MyNum);
+long Refine(void);
+void SolveSingle(double *y);
+void Residual(double *x, double *r);
+double NormA(void);
+double CheckResidual(double *y);
+void InitA(double *rhs);
+double TouchA(long bs, long MyNum);
+void PrintA(void);
+void CheckResult(long n, double *rhs);
+void CheckSolve(void);
+void printerr(const char *s);
+
+int main(int argc, char *argv[])
+{
+  long i, j;
+  long ch;
+  extern char *optarg;
+  double mint, maxt, avgt;
+  double min_fac, min_solve, min_mod, min_bar;
+  double max_fac, max_solve, max_mod, max_bar;
+  double avg_fac, avg_solve, avg_mod, avg_bar;
+  unsigned long start;
+  char desc[128];
+
+  {
+
+	struct timeval	FullTime;
+
+
+
+	gettimeofday(&FullTime, NULL);
+
+	(start) = (unsigned long)(FullTime.tv_usec + FullTime.tv_sec * 1000000);
+
+}
+
+  P=1;
+  layout = lu_storage_parse(DEFAULT_LAYOUT);
+  while ((ch = getopt(argc, argv, "n:p:b:cdfl:m:rL:k:B:stoh")) != -1) {
+    switch(ch) {
+    case 'n': n = atoi(optarg); break;
+    case 'p': P = atoi(optarg); break;
+    case 'b': block_size = atoi(optarg); break;
+    case 'd': dataflow = 1; break;
+    case 'f': mixed = 1; break;
+    case 'l': lookahead = atoi(optarg); break;
+    case 'm': mapping = lu_mapping_parse(optarg);
+              if (mapping < 0) {
+                printerr("Mapping must be diagonal, cyclic, 2d or tiled\n");
+                exit(-1);
+              }
+              break;
+    case 'r': team = 1; break;
+    case 'L': layout = lu_storage_parse(optarg);
+              if (layout < 0) {
+                printerr("Layout must be column, tiles or morton\n");
+                exit(-1);
+              }
+              break;
+    case 'k': nrhs = atol(optarg); break;
+    case 'B': batch_count = atol(optarg); break;
+    case 's': dostats = 1; break;
+    case 't': test_result = !test_result; break;
+    case 'o': doprint = !doprint; break;
+    case 'h': printf("Usage: LU <options>\n\n");
+	      printf("options:\n");
+              printf("  -nN : Decompose NxN matrix.\n");
+              printf("  -pP : P = number of processors.\n");
+              printf("  -bB : Use a block size of B. BxB elements should fit in cache for \n");
+              printf("        good performance. Small block sizes (B=8, B=16) work well.\n");
+              printf("  -c  : Copy non-locally allocated blocks to local memory before use.\n");
+              printf("  -d  : Dataflow execution: per-block dependency counters replace the\n");
+              printf("        global barriers of each step.\n");
+              printf("  -lL : Let dataflow execution run L steps ahead of the oldest\n");
+              printf("        unfinished step (lookahead depth, default %1d).\n", DEFAULT_LOOKAHEAD);
+              printf("  -f  : Mixed precision: factor in single precision, then refine the\n");
+              printf("        solution against the double-precision matrix, factoring\n");
+              printf("        again in double if refinement does not converge.\n");
+              printf("  -mM : Assign blocks to processors with mapping M: diagonal\n");
+              printf("        (default), cyclic, 2d or tiled.\n");
+              printf("  -r  : Factor each diagonal block with all processors, which are\n");
+              printf("        otherwise idle at that point (not with -d).\n");
+              printf("  -LL : Store the matrix in layout L: column, tiles or morton\n");
+              printf("        (default %s).\n", DEFAULT_LAYOUT);
+              printf("  -kK : After factoring, solve for K right-hand sides at once with\n");
+              printf("        parallel blocked triangular solves (not with -f or -B).\n");
+              printf("  -BN : Factor a batch of N independent matrices of the -n size\n");
+              printf("        instead of one large matrix.\n");
+              printf("  -s  : Print individual processor timing and mapping statistics.\n");
+              printf("  -t  : Test output.\n");
+              printf("  -o  : Print out matrix values.\n");
+              printf("  -h  : Print out command line options.\n\n");
+              printf("Default: LU -n%1d -p%1d -b%1d\n",
+		     DEFAULT_N,DEFAULT_P,DEFAULT_B);
+              exit(0);
+              break;
+    }
+  }
+
+  {;}
+
+  if (lookahead < 0) {
+    printerr("Lookahead depth must be non-negative\n");
+    exit(-1);
+  }
+  if (team && dataflow) {
+    printerr("-r cannot be combined with -d\n");
+    exit(-1);
+  }
+  if ((nrhs < 0) || (nrhs && (mixed || batch_count))) {
+    printerr("Right-hand sides must be positive and cannot be combined with -f or -B\n");
+    exit(-1);
+  }
+  if ((batch_count < 0) || (batch_count && (dataflow || mixed))) {
+    printerr("Batch size must be positive and cannot be combined with -d or -f\n");
+    exit(-1);
+  }
+
+  nblocks = n/block_size;
+  if (block_size * nblocks != n) {
+    nblocks++;
+  }
+  lu_mapping_init(mapping, P, nblocks);
+  lu_mapping_describe(desc, sizeof(desc));
+  lu_storage_init(layout, n, block_size, P, BlockOwner);
+
+  printf("\n");
+  lu_kernel_init();
+  printf("Blocked Dense LU Factorization\n");
+  printf("     %ld by %ld Matrix\n",n,n);
+  printf("     %ld Processors\n",P);
+  printf("     %ld by %ld Element Blocks\n",block_size,block_size);
+  printf("     %s block kernel\n",lu_kernel_name());
+  printf("     %s mapping\n",desc);
+  lu_storage_describe(desc, sizeof(desc));
+  printf("     %s layout\n",desc);
+  if (dataflow) {
+    printf("     Dataflow execution, lookahead %ld\n",lookahead);
+  }
+  if (mixed) {
+    printf("     Single-precision factorization, double-precision refinement\n");
+  }
+  if (team) {
+    printf("     Diagonal blocks factored by all processors\n");
+  }
+  if (nrhs) {
+    printf("     Solve for %ld right-hand sides\n",nrhs);
+  }
+  if (batch_count) {
+    printf("     Batch of %ld matrices, %d factored in lockstep\n",
+           batch_count,LU_BATCH_LANES);
+  }
+  printf("\n");
+  printf("\n");
+
+
+  if (mixed) {
+    lu_storage_single();
+    x = (double *) malloc(n*sizeof(double));
+    if (x == NULL) {
+      printerr("Could not malloc memory for x\n");
+      exit(-1);
+    }
+    single = 1;
+  }
+
+  rhs = (double *) malloc(n*sizeof(double));
+  if (rhs == NULL) {
+    printerr("Could not malloc memory for rhs\n");
+    exit(-1);
+  } 
+
+  Global = (struct GlobalMemory *) malloc(sizeof(struct GlobalMemory));
+  Global->t_in_fac = (double *) malloc(P*sizeof(double));
+  Global->t_in_mod = (double *) malloc(P*sizeof(double));
+  Global->t_in_solve = (double *) malloc(P*sizeof(double));
+  Global->t_in_bar = (double *) malloc(P*sizeof(double));
+  Global->completion = (double *) malloc(P*sizeof(double));
+
+  if (Global == NULL) {
+    printerr("Could not malloc memory for Global\n");
+    exit(-1);
+  } else if (Global->t_in_fac == NULL) {
+    printerr("Could not malloc memory for Global->t_in_fac\n");
+    exit(-1);
+  } else if (Global->t_in_mod == NULL) {
+    printerr("Could not malloc memory for Global->t_in_mod\n");
+    exit(-1);
+  } else if (Global->t_in_solve == NULL) {
+    printerr("Could not malloc memory for Global->t_in_solve\n");
+    exit(-1);
+  } else if (Global->t_in_bar == NULL) {
+    printerr("Could not malloc memory for Global->t_in_bar\n");
+    exit(-1);
+  } else if (Global->completion == NULL) {
+    printerr("Could not malloc memory for Global->completion\n");
+    exit(-1);
+  }
+
+  {
+
+	unsigned long	Error;
+
+
+
+	Error = pthread_mutex_init(&(Global->start).mutex, NULL);
+
+	if (Error != 0) {
+
+		printf("Error while initializing barrier.\n");
+
+		exit(-1);
+
+	}
+
+
+
+	Error = pthread_cond_init(&(Global->start).cv, NULL);
+
+	if (Error != 0) {
+
+		printf("Error while initializing barrier.\n");
+
+		pthread_mutex_destroy(&(Global->start).mutex);
+
+		exit(-1);
+
+	}
+
+
+
+	(Global->start).counter = 0;
+
+	(Global->start).cycle = 0;
+
+};
+  {pthread_mutex_init(&(Global->idlock), NULL);};
+  Global->id = 0;
+
+  if (dataflow) {
+    tasks.nblocks = nblocks;
+    tasks.depth = lookahead;
+    tasks.owner = BlockOwner;
+    tasks.factor = TaskFactor;
+    tasks.column = TaskColumn;
+    tasks.row = TaskRow;
+    tasks.update = TaskUpdate;
+    lu_dataflow_init(&tasks);
+  }
+
+  if (batch_count) {
+    lu_batch_init(&batch, n, batch_count);
+  } else {
+    InitA(rhs);
+    if (doprint) {
+      printf("Matrix before decomposition:\n");
+      PrintA();
+    }
+  }
+
+  /* right-hand side j is (j+1) rhs, for the solution (j+1) (1 ... 1) */
+  if (nrhs) {
+    double *b;
+
+    lu_solve_init(n, block_size, nrhs, BlockOwner);
+    b = lu_solve_rhs();
+    for (j=0; j<nrhs; j++) {
+      for (i=0; i<n; i++) {
+        b[i+j*n] = (j+1)*rhs[i];
+      }
+    }
+  }
+
+  {
+
+	long	i, Error;
+
+
+
+	for (i = 0; i < (P) - 1; i++) {
+
+		Error = pthread_create(&PThreadTable[i], NULL, (void * (*)(void *))(SlaveStart), NULL);
+
+		if (Error != 0) {
+
+			printf("Error in pthread_create().\n");
+
+			exit(-1);
+
+		}
+
+	}
+
+
+
+	SlaveStart();
+
+};
+  {
+
+	unsigned long	i, Error;
+
+	for (i = 0; i < (P) - 1; i++) {
+
+		Error = pthread_join(PThreadTable[i], NULL);
+
+		if (Error != 0) {
+
+			printf("Error in pthread_join().\n");
+
+			exit(-1);
+
+		}
+
+	}
+
+};
+
+  if (doprint && !batch_count) {
+    printf("\nMatrix after decomposition:\n");
+    PrintA();
+  }
+
+  if (dostats) {
+    maxt = avgt = mint = Global->completion[0];
+    for (i=1; i<P; i++) {
+      if (Global->completion[i] > maxt) {
+        maxt = Global->completion[i];
+      }
+      if (Global->completion[i] < mint) {
+        mint = Global->completion[i];
+      }
+      avgt += Global->completion[i];
+    }
+    avgt = avgt / P;
+  
+    min_fac = max_fac = avg_fac = Global->t_in_fac[0];
+    min_solve = max_solve = avg_solve = Global->t_in_solve[0];
+    min_mod = max_mod = avg_mod = Global->t_in_mod[0];
+    min_bar = max_bar = avg_bar = Global->t_in_bar[0];
+  
+    for (i=1; i<P; i++) {
+      if (Global->t_in_fac[i] > max_fac) {
+        max_fac = Global->t_in_fac[i];
+      }
+      if (Global->t_in_fac[i] < min_fac) {
+        min_fac = Global->t_in_fac[i];
+      }
+      if (Global->t_in_solve[i] > max_solve) {
+        max_solve = Global->t_in_solve[i];
+      }
+      if (Global->t_in_solve[i] < min_solve) {
+        min_solve = Global->t_in_solve[i];
+      }
+      if (Global->t_in_mod[i] > max_mod) {
+        max_mod = Global->t_in_mod[i];
+      }
+      if (Global->t_in_mod[i] < min_mod) {
+        min_mod = Global->t_in_mod[i];
+      }
+      if (Global->t_in_bar[i] > max_bar) {
+        max_bar = Global->t_in_bar[i];
+      }
+      if (Global->t_in_bar[i] < min_bar) {
+        min_bar = Global->t_in_bar[i];
+      }
+      avg_fac += Global->t_in_fac[i];
+      avg_solve += Global->t_in_solve[i];
+      avg_mod += Global->t_in_mod[i];
+      avg_bar += Global->t_in_bar[i];
+    }
+    avg_fac = avg_fac/P;
+    avg_solve = avg_solve/P;
+    avg_mod = avg_mod/P;
+    avg_bar = avg_bar/P;
+  }
+  printf("                            PROCESS STATISTICS\n");
+  printf("              Total      Diagonal     Perimeter      Interior       Barrier\n");
+  printf(" Proc         Time         Time         Time           Time          Time\n");
+  printf("    0    %10.0f    %10.0f    %10.0f    %10.0f    %10.0f\n",
+          Global->completion[0],Global->t_in_fac[0],
+          Global->t_in_solve[0],Global->t_in_mod[0],
+          Global->t_in_bar[0]);
+  if (dostats) {
+    for (i=1; i<P; i++) {
+      printf("  %3ld    %10.0f    %10.0f    %10.0f    %10.0f    %10.0f\n",
+              i,Global->completion[i],Global->t_in_fac[i],
+	      Global->t_in_solve[i],Global->t_in_mod[i],
+	      Global->t_in_bar[i]);
+    }
+    printf("  Avg    %10.0f    %10.0f    %10.0f    %10.0f    %10.0f\n",
+           avgt,avg_fac,avg_solve,avg_mod,avg_bar);
+    printf("  Min    %10.0f    %10.0f    %10.0f    %10.0f    %10.0f\n",
+           mint,min_fac,min_solve,min_mod,min_bar);
+    printf("  Max    %10.0f    %10.0f    %10.0f    %10.0f    %10.0f\n",
+           maxt,max_fac,max_solve,max_mod,max_bar);
+  }
+  printf("\n");
+  Global->starttime = start;
+  printf("                            TIMING INFORMATION\n");
+  printf("Start time                        : %16lu\n", Global->starttime);
+  printf("Initialization finish time        : %16lu\n", Global->rs);
+  printf("Overall finish time               : %16lu\n", Global->rf);
+  printf("Total time with initialization    : %16lu\n", Global->rf-Global->starttime);
+  printf("Total time without initialization : %16lu\n", Global->rf-Global->rs);
+  printf("\n");
+
+  if (batch_count) {
+    printf("                            BATCH THROUGHPUT\n");
+    printf("Matrices per second               : %16.0f\n",
+           batch_count*1e6/(Global->rf-Global->rs));
+    printf("Mflop/s                           : %16.1f\n",
+           batch_count*(2.0*n*n*n/3.0)/(Global->rf-Global->rs));
+    printf("\n");
+    if (test_result) {
+      double max_diff = lu_batch_check(&batch);
+
+      printf("                             TESTING RESULTS\n");
+      if (max_diff > 0.00001) {
+        printf("TEST FAILED: (%.5f diff)\n", max_diff);
+      } else {
+        printf("TEST PASSED\n");
+      }
+    }
+    {exit(0);};
+  }
+
+  if (nrhs) {
+    printf("                            SOLVE\n");
+    printf("Right-hand sides                  : %16ld\n", nrhs);
+    printf("Solve time                        : %16lu\n", solve_time);
+    printf("Right-hand sides per second       : %16.0f\n",
+           nrhs*1e6/solve_time);
+    printf("Solve Mflop/s                     : %16.1f\n",
+           2.0*n*n*nrhs/solve_time);
+    printf("\n");
+  }
+
+  if (mixed) {
+    printf("                            MIXED PRECISION\n");
+    printf("Refinement steps                  : %16ld\n", refine_steps);
+    printf("Refinement time                   : %16lu\n", refine_time);
+    printf("Scaled residual                   : %16.3e\n", refine_residual);
+    if (!refined) {
+      printf("Refinement did not converge; factored again in double precision\n");
+    }
+    printf("\n");
+  }
+
+  if (dataflow) {
+    lu_mapping_report(n, block_size, BlockOwner, BlockOwner, BlockOwner,
+                      BlockOwner, dostats);
+  } else {
+    lu_mapping_report(n, block_size, BlockOwner, BlockOwnerColumn,
+                      BlockOwnerRow, BlockOwner, dostats);
+  }
+
+  if (test_result) {
+    printf("                             TESTING RESULTS\n");
+    CheckResult(n, rhs);
+    if (nrhs) {
+      CheckSolve();
+    }
+  }
+
+  {exit(0);};
+}
+
+
+void SlaveStart()
+{
+  long MyNum;
+
+  {pthread_mutex_lock(&(Global->idlock));}
+    MyNum = Global->id;
+    Global->id ++;
+  {pthread_mutex_unlock(&(Global->idlock));}
+
+/* POSSIBLE ENHANCEMENT:  Here is where one might pin processes to
+   processors to avoid migration */
+
+  {;};
+  OneSolve(n, block_size, MyNum, dostats);
+}
+
+
+void OneSolve(long n, long block_size, long MyNum, long dostats)
+{
+  unsigned long myrs; 
+  unsigned long myrf; 
+  unsigned long mydone;
+  struct LocalCopies *lc;
+
+  lc = (struct LocalCopies *) malloc(sizeof(struct LocalCopies));
+  if (lc == NULL) {
+    fprintf(stderr,"Proc %ld could not malloc memory for lc\n",MyNum);
+    exit(-1);
+  }
+  lc->t_in_fac = 0.0;
+  lc->t_in_solve = 0.0;
+  lc->t_in_mod = 0.0;
+  lc->t_in_bar = 0.0;
+
+  /* barrier to ensure all initialization is done */
+  {
+
+	unsigned long	Error, Cycle;
+
+	int		Cancel, Temp;
+
+
+
+	Error = pthread_mutex_lock(&(Global->start).mutex);
+
+	if (Error != 0) {
+
+		printf("Error while trying to get lock in barrier.\n");
+
+		exit(-1);
+
+	}
+
+
+
+	Cycle = (Global->start).cycle;
+
+	if (++(Global->start).counter != (P)) {
+
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &Cancel);
+
+		while (Cycle == (Global->start).cycle) {
+
+			Error = pthread_cond_wait(&(Global->start).cv, &(Global->start).mutex);
+
+			if (Error != 0) {
+
+				break;
+
+			}
+
+		}
+
+		pthread_setcancelstate(Cancel, &Temp);
+
+	} else {
+
+		(Global->start).cycle = !(Global->start).cycle;
+
+		(Global->start).counter = 0;
+
+		Error = pthread_cond_broadcast(&(Global->start).cv);
+
+	}
+
+	pthread_mutex_unlock(&(Global->start).mutex);
+
+};
+
+  /* to remove cold-start misses, all processors touch their own data */
+  if (batch_count) {
+    lu_batch_generate(&batch, MyNum, P);
+  } else {
+    TouchA(block_size, MyNum);
+  }
+
+  {
+
+	unsigned long	Error, Cycle;
+
+	int		Cancel, Temp;
+
+
+
+	Error = pthread_mutex_lock(&(Global->start).mutex);
+
+	if (Error != 0) {
+
+		printf("Error while trying to get lock in barrier.\n");
+
+		exit(-1);
+
+	}
+
+
+
+	Cycle = (Global->start).cycle;
+
+	if (++(Global->start).counter != (P)) {
+
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &Cancel);
+
+		while (Cycle == (Global->start).cycle) {
+
+			Error = pthread_cond_wait(&(Global->start).cv, &(Global->start).mutex);
+
+			if (Error != 0) {
+
+				break;
+
+			}
+
+		}
+
+		pthread_setcancelstate(Cancel, &Temp);
+
+	} else {
+
+		(Global->start).cycle = !(Global->start).cycle;
+
+		(Global->start).counter = 0;
+
+		Error = pthread_cond_broadcast(&(Global->start).cv);
+
+	}
+
+	pthread_mutex_unlock(&(Global->start).mutex);
+
+};
+
+/* POSSIBLE ENHANCEMENT:  Here is where one might reset the
+   statistics that one is measuring about the parallel execution */
+
+  if ((MyNum == 0) || (dostats)) {
+    {
+
+	struct timeval	FullTime;
+
+
+
+	gettimeofday(&FullTime, NULL);
+
+	(myrs) = (unsigned long)(FullTime.tv_usec + FullTime.tv_sec * 1000000);
+
+};
+  }
+
+  if (batch_count) {
+    lu_batch_factor(&batch, MyNum, P);
+  } else if (mixed) {
+    ConvertA(MyNum);
+    Barrier();
+    Factor(MyNum, lc);
+  } else {
+    Factor(MyNum, lc);
+  }
+
+  if (mixed) {
+    Barrier();
+    if (MyNum == 0) {
+      refined = Refine();
+      if (!refined) {
+        single = 0;
+        if (dataflow) {
+          lu_dataflow_reset();
+        }
+      }
+    }
+    Barrier();
+    if (!refined) {
+      Factor(MyNum, lc);
+    }
+  }
+
+  if ((MyNum == 0) || (dostats)) {
+    {
+
+	struct timeval	FullTime;
+
+
+
+	gettimeofday(&FullTime, NULL);
+
+	(mydone) = (unsigned long)(FullTime.tv_usec + FullTime.tv_sec * 1000000);
+
+};
+  }
+
+  {
+
+	unsigned long	Error, Cycle;
+
+	int		Cancel, Temp;
+
+
+
+	Error = pthread_mutex_lock(&(Global->start).mutex);
+
+	if (Error != 0) {
+
+		printf("Error while trying to get lock in barrier.\n");
+
+		exit(-1);
+
+	}
+
+
+
+	Cycle = (Global->start).cycle;
+
+	if (++(Global->start).counter != (P)) {
+
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &Cancel);
+
+		while (Cycle == (Global->start).cycle) {
+
+			Error = pthread_cond_wait(&(Global->start).cv, &(Global->start).mutex);
+
+			if (Error != 0) {
+
+				break;
+
+			}
+
+		}
+
+		pthread_setcancelstate(Cancel, &Temp);
+
+	} else {
+
+		(Global->start).cycle = !(Global->start).cycle;
+
+		(Global->start).counter = 0;
+
+		Error = pthread_cond_broadcast(&(Global->start).cv);
+
+	}
+
+	pthread_mutex_unlock(&(Global->start).mutex);
+
+};
+
+  if ((MyNum == 0) || (dostats)) {
+    Global->t_in_fac[MyNum] = lc->t_in_fac;
+    Global->t_in_solve[MyNum] = lc->t_in_solve;
+    Global->t_in_mod[MyNum] = lc->t_in_mod;
+    Global->t_in_bar[MyNum] = lc->t_in_bar;
+    Global->completion[MyNum] = mydone-myrs;
+  }
+  if (MyNum == 0) {
+    {
+
+	struct timeval	FullTime;
+
+
+
+	gettimeofday(&FullTime, NULL);
+
+	(myrf) = (unsigned long)(FullTime.tv_usec + FullTime.tv_sec * 1000000);
+
+};
+    Global->rs = myrs;
+    Global->done = mydone;
+    Global->rf = myrf;
+  }
+
+  /* the -k solves, timed apart from the factorization */
+  if (nrhs) {
+    unsigned long t1, t2;
+
+    Barrier();
+    {
+	struct timeval	FullTime;
+
+	gettimeofday(&FullTime, NULL);
+	(t1) = (unsigned long)(FullTime.tv_usec + FullTime.tv_sec * 1000000);
+    }
+    lu_solve(MyNum, P, Barrier);
+    {
+	struct timeval	FullTime;
+
+	gettimeofday(&FullTime, NULL);
+	(t2) = (unsigned long)(FullTime.tv_usec + FullTime.tv_sec * 1000000);
+    }
+    if (MyNum == 0) {
+      solve_time = t2 - t1;
+    }
+  }
+}
+
+
+/* Factor the matrix, or its single-precision copy when single is set,
+   with the selected schedule */
+void Factor(long MyNum, struct LocalCopies *lc)
+{
+  if (dataflow) {
+    struct lu_task_times times;
+
+    lu_dataflow(&tasks, MyNum, &times);
+    lc->t_in_fac += times.fac;
+    lc->t_in_solve += times.solve;
+    lc->t_in_mod += times.mod;
+    lc->t_in_bar += times.wait;
+  } else {
+    lu(n, block_size, MyNum, lc, dostats);
+  }
+}
+
+
+void Barrier()
+{
+  unsigned long	Error, Cycle;
+  int		Cancel, Temp;
+
+  Error = pthread_mutex_lock(&(Global->start).mutex);
+  if (Error != 0) {
+    printf("Error while trying to get lock in barrier.\n");
+    exit(-1);
+  }
+  Cycle = (Global->start).cycle;
+  if (++(Global->start).counter != (P)) {
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &Cancel);
+    while (Cycle == (Global->start).cycle) {
+      Error = pthread_cond_wait(&(Global->start).cv, &(Global->start).mutex);
+      if (Error != 0) {
+        break;
+      }
+    }
+    pthread_setcancelstate(Cancel, &Temp);
+  } else {
+    (Global->start).cycle = !(Global->start).cycle;
+    (Global->start).counter = 0;
+    Error = pthread_cond_broadcast(&(Global->start).cv);
+  }
+  pthread_mutex_unlock(&(Global->start).mutex);
+}
+
+
+/* lu0 factors the diagonal block recursively; see lu_kernels.c */
+
+void lu0(double *a, long n, long stride)
+{
+  lu_getrf(a, n, stride);
+}
+
+
+/* bdiv, bmodd and bmod are blocked triangular solves and a packed
+   matrix multiply; see lu_kernels.c */
+
+void bdiv(double *a, double *diag, long stride_a, long stride_diag, long dimi, long dimk)
+{
+  lu_trsm_right_upper(a, diag, stride_a, stride_diag, dimi, dimk);
+}
+
+
+void bmodd(double *a, double *c, long dimi, long dimj, long stride_a, long stride_c)
+{
+  lu_trsm_left_lower(a, c, stride_a, stride_c, dimi, dimj);
+}
+
+
+void bmod(double *a, double *b, double *c, long dimi, long dimj, long dimk, long stridea, long strideb, long stridec)
+{
+  lu_gemm(dimi, dimj, dimk, a, stridea, b, strideb, c, stridec);
+}
+
+
+long BlockOwner(long I, long J)
+{
+	return(lu_mapping_owner(I, J));
+}
+
+/* The original mapping parcels out panel blocks separately; the others
+   leave each panel block with its owner */
+
+long BlockOwnerColumn(long I, long J)
+{
+	if (mapping != MAP_DIAGONAL) {
+		return(BlockOwner(I, J));
+	}
+	return(I % P);
+}
+
+long BlockOwnerRow(long I, long J)
+{
+	if (mapping != MAP_DIAGONAL) {
+		return(BlockOwner(I, J));
+	}
+	return(((J % P) + (P / 2)) % P);
+}
+
+void lu(long n, long bs, long MyNum, struct LocalCopies *lc, long dostats)
+{
+  long I, J, K;
+  unsigned long t1, t2, t3, t4, t11, t22;
+
+  for (K=0; K<nblocks; K++) {
+
+    if ((MyNum == 0) || (dostats)) {
+      {
+
+	struct timeval	FullTime;
+
+
+
+	gettimeofday(&FullTime, NULL);
+
+	(t1) = (unsigned long)(FullTime.tv_usec + FullTime.tv_sec * 1000000);
+
+};
+    }
+
+    /* factor diagonal block */
+    if (team) {
+      TaskFactorTeam(K, MyNum);
+    } else if (BlockOwner(K, K) == MyNum) {
+      TaskFactor(K);
+    }
+
+    if ((MyNum == 0) || (dostats)) {
+      {
+
+	struct timeval	FullTime;
+
+
+
+	gettimeofday(&FullTime, NULL);
+
+	(t11) = (unsigned long)(FullTime.tv_usec + FullTime.tv_sec * 1000000);
+
+};
+    }
+
+    {
+
+	unsigned long	Error, Cycle;
+
+	int		Cancel, Temp;
+
+
+
+	Error = pthread_mutex_lock(&(Global->start).mutex);
+
+	if (Error != 0) {
+
+		printf("Error while trying to get lock in barrier.\n");
+
+		exit(-1);
+
+	}
+
+
+
+	Cycle = (Global->start).cycle;
+
+	if (++(Global->start).counter != (P)) {
+
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &Cancel);
+
+		while (Cycle == (Global->start).cycle) {
+
+			Error = pthread_cond_wait(&(Global->start).cv, &(Global->start).mutex);
+
+			if (Error != 0) {
+
+				break;
+
+			}
+
+		}
+
+		pthread_setcancelstate(Cancel, &Temp);
+
+	} else {
+
+		(Global->start).cycle = !(Global->start).cycle;
+
+		(Global->start).counter = 0;
+
+		Error = pthread_cond_broadcast(&(Global->start).cv);
+
+	}
+
+	pthread_mutex_unlock(&(Global->start).mutex);
+
+};
+
+    if ((MyNum == 0) || (dostats)) {
+      {
+
+	struct timeval	FullTime;
+
+
+
+	gettimeofday(&FullTime, NULL);
+
+	(t2) = (unsigned long)(FullTime.tv_usec + FullTime.tv_sec * 1000000);
+
+};
+    }
+
+    /* divide column k by diagonal block */
+    for (I=K+1; I<nblocks; I++) {
+      if (BlockOwnerColumn(I, K) == MyNum) {  /* parcel out blocks */
+        TaskColumn(I, K);
+      }
+    }
+    /* modify row k by diagonal block */
+    for (J=K+1; J<nblocks; J++) {
+      if (BlockOwnerRow(K, J) == MyNum) {  /* parcel out blocks */
+        TaskRow(K, J);
+      }
+    }
+
+    if ((MyNum == 0) || (dostats)) {
+      {
+
+	struct timeval	FullTime;
+
+
+
+	gettimeofday(&FullTime, NULL);
+
+	(t22) = (unsigned long)(FullTime.tv_usec + FullTime.tv_sec * 1000000);
+
+};
+    }   
+
+    {
+
+	unsigned long	Error, Cycle;
+
+	int		Cancel, Temp;
+
+
+
+	Error = pthread_mutex_lock(&(Global->start).mutex);
+
+	if (Error != 0) {
+
+		printf("Error while trying to get lock in barrier.\n");
+
+		exit(-1);
+
+	}
+
+
+
+	Cycle = (Global->start).cycle;
+
+	if (++(Global->start).counter != (P)) {
+
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &Cancel);
+
+		while (Cycle == (Global->start).cycle) {
+
+			Error = pthread_cond_wait(&(Global->start).cv, &(Global->start).mutex);
+
+			if (Error != 0) {
+
+				break;
+
+			}
+
+		}
+
+		pthread_setcancelstate(Cancel, &Temp);
+
+	} else {
+
+		(Global->start).cycle = !(Global->start).cycle;
+
+		(Global->start).counter = 0;
+
+		Error = pthread_cond_broadcast(&(Global->start).cv);
+
+	}
+
+	pthread_mutex_unlock(&(Global->start).mutex);
+
+};
+
+    if ((MyNum == 0) || (dostats)) {
+      {
+
+	struct timeval	FullTime;
+
+
+
+	gettimeofday(&FullTime, NULL);
+
+	(t3) = (unsigned long)(FullTime.tv_usec + FullTime.tv_sec * 1000000);
+
+};
+    }
+
+    /* modify subsequent block columns */
+    for (I=K+1; I<nblocks; I++) {
+      for (J=K+1; J<nblocks; J++) {
+        if (BlockOwner(I, J) == MyNum) {  /* parcel out blocks */
+          TaskUpdate(I, J, K);
+        }
+      }
+    }
+
+    if ((MyNum == 0) || (dostats)) {
+      {
+
+	struct timeval	FullTime;
+
+
+
+	gettimeofday(&FullTime, NULL);
+
+	(t4) = (unsigned long)(FullTime.tv_usec + FullTime.tv_sec * 1000000);
+
+};
+      lc->t_in_fac += (t11-t1);
+      lc->t_in_solve += (t22-t2);
+      lc->t_in_mod += (t4-t3);
+      lc->t_in_bar += (t2-t11) + (t3-t22);
+    }
+  }
+}
+
+
+/* Dimension of block row or column I */
+long BlockDim(long I)
+{
+  if (I == nblocks-1) {
+    return(n - I*block_size);
+  }
+  return(block_size);
+}
+
+
+/* The block operations of lu() and lu_dataflow(), on the
+   single-precision copy when single is set */
+
+void TaskFactor(long K)
+{
+  if (single) {
+    lu_sgetrf(lu_sblock(K, K), BlockDim(K), lu_block_ld(K));
+  } else {
+    lu0(lu_block(K, K), BlockDim(K), lu_block_ld(K));
+  }
+}
+
+
+/* TaskFactor() by all processors together, the block's owner leading */
+
+void TaskFactorTeam(long K, long MyNum)
+{
+  long me = (MyNum - BlockOwner(K, K) + P) % P;
+
+  if (single) {
+    lu_sgetrf_team(lu_sblock(K, K), BlockDim(K), lu_block_ld(K), me, P,
+                   Barrier);
+  } else {
+    lu_getrf_team(lu_block(K, K), BlockDim(K), lu_block_ld(K), me, P,
+                  Barrier);
+  }
+}
+
+
+void TaskColumn(long I, long K)
+{
+  if (single) {
+    lu_strsm_right_upper(lu_sblock(I, K), lu_sblock(K, K), lu_block_ld(I),
+                         lu_block_ld(K), BlockDim(I), BlockDim(K));
+  } else {
+    bdiv(lu_block(I, K), lu_block(K, K), lu_block_ld(I), lu_block_ld(K),
+         BlockDim(I), BlockDim(K));
+  }
+}
+
+
+void TaskRow(long K, long J)
+{
+  if (single) {
+    lu_strsm_left_lower(lu_sblock(K, K), lu_sblock(K, J), lu_block_ld(K),
+                        lu_block_ld(K), BlockDim(K), BlockDim(J));
+  } else {
+    bmodd(lu_block(K, K), lu_block(K, J), BlockDim(K), BlockDim(J),
+          lu_block_ld(K), lu_block_ld(K));
+  }
+}
+
+
+void TaskUpdate(long I, long J, long K)
+{
+  if (single) {
+    lu_sgemm(BlockDim(I), BlockDim(J), BlockDim(K), lu_sblock(I, K),
+             lu_block_ld(I), lu_sblock(K, J), lu_block_ld(K),
+             lu_sblock(I, J), lu_block_ld(I));
+  } else {
+    bmod(lu_block(I, K), lu_block(K, J), lu_block(I, J), BlockDim(I),
+         BlockDim(J), BlockDim(K), lu_block_ld(I), lu_block_ld(K),
+         lu_block_ld(I));
+  }
+}
+
+
+/* Copy my blocks of the matrix into its single-precision copy */
+void ConvertA(long MyNum)
+{
+  long I, J, i, j, ld;
+  double *blk;
+  float *sblk;
+
+  for (J=0; J<nblocks; J++) {
+    for (I=0; I<nblocks; I++) {
+      if (BlockOwner(I, J) == MyNum) {
+        blk = lu_block(I, J);
+        sblk = lu_sblock(I, J);
+        ld = lu_block_ld(I);
+        for (j=0; j<BlockDim(J); j++) {
+          for (i=0; i<BlockDim(I); i++) {
+            sblk[i+j*ld] = (float) blk[i+j*ld];
+          }
+        }
+      }
+    }
+  }
+}
+
+
+/* Overwrite y with the solution of LU y = y, using the single-precision
+   factors */
+void SolveSingle(double *y)
+{
+  long I, J, i, j, di, dj, ld;
+  float *blk;
+  double *yi, yj;
+
+  for (J=0; J<nblocks; J++) {
+    dj = BlockDim(J);
+    for (j=0; j<dj; j++) {
+      blk = lu_sblock(J, J);
+      ld = lu_block_ld(J);
+      yi = &y[J*block_size];
+      yi[j] /= blk[j+j*ld];
+      yj = yi[j];
+      for (i=j+1; i<dj; i++) {
+        yi[i] -= blk[i+j*ld]*yj;
+      }
+      for (I=J+1; I<nblocks; I++) {
+        blk = lu_sblock(I, J);
+        ld = lu_block_ld(I);
+        di = BlockDim(I);
+        yi = &y[I*block_size];
+        for (i=0; i<di; i++) {
+          yi[i] -= blk[i+j*ld]*yj;
+        }
+      }
+    }
+  }
+  for (J=nblocks-1; J>=0; J--) {
+    dj = BlockDim(J);
+    for (j=dj-1; j>=0; j--) {
+      blk = lu_sblock(J, J);
+      ld = lu_block_ld(J);
+      yi = &y[J*block_size];
+      yj = yi[j];
+      for (i=0; i<j; i++) {
+        yi[i] -= blk[i+j*ld]*yj;
+      }
+      for (I=0; I<J; I++) {
+        blk = lu_sblock(I, J);
+        ld = lu_block_ld(I);
+        yi = &y[I*block_size];
+        for (i=0; i<block_size; i++) {
+          yi[i] -= blk[i+j*ld]*yj;
+        }
+      }
+    }
+  }
+}
+
+
+/* r = rhs - a x */
+void Residual(double *x, double *r)
+{
+  long I, J, i, j, di, dj, ld;
+  double *blk, *ri, xj;
+
+  for (i=0; i<n; i++) {
+    r[i] = rhs[i];
+  }
+  for (J=0; J<nblocks; J++) {
+    dj = BlockDim(J);
+    for (I=0; I<nblocks; I++) {
+      blk = lu_block(I, J);
+      ld = lu_block_ld(I);
+      di = BlockDim(I);
+      ri = &r[I*block_size];
+      for (j=0; j<dj; j++) {
+        xj = x[J*block_size+j];
+        for (i=0; i<di; i++) {
+          ri[i] -= blk[i+j*ld]*xj;
+        }
+      }
+    }
+  }
+}
+
+
+/* Infinity norm of a */
+double NormA()
+{
+  long I, J, i, j, di, dj, ld;
+  double *rowsum, *blk, norm;
+
+  rowsum = (double *) calloc(n, sizeof(double));
+  if (rowsum == NULL) {
+    printerr("Could not malloc memory for rowsum\n");
+    exit(-1);
+  }
+  for (J=0; J<nblocks; J++) {
+    dj = BlockDim(J);
+    for (I=0; I<nblocks; I++) {
+      blk = lu_block(I, J);
+      ld = lu_block_ld(I);
+      di = BlockDim(I);
+      for (j=0; j<dj; j++) {
+        for (i=0; i<di; i++) {
+          rowsum[I*block_size+i] += fabs(blk[i+j*ld]);
+        }
+      }
+    }
+  }
+  norm = 0.0;
+  for (i=0; i<n; i++) {
+    norm = fmax(norm, rowsum[i]);
+  }
+  free(rowsum);
+  return(norm);
+}
+
+
+/*
+ * Refine() solves with the single-precision factors in af and corrects
+ * the solution x with residuals computed against the original matrix,
+ * still in a.  It stops when the residual reaches double-precision
+ * accuracy, or fails when a step no longer reduces the residual.
+ */
+long Refine()
+{
+  double *r, *d;
+  double anorm, xnorm, rnorm, last;
+  long i, converged;
+  unsigned long t1, t2;
+
+  {
+	struct timeval	FullTime;
+
+	gettimeofday(&FullTime, NULL);
+	(t1) = (unsigned long)(FullTime.tv_usec + FullTime.tv_sec * 1000000);
+  }
+  r = (double *) malloc(n*sizeof(double));
+  d = (double *) malloc(n*sizeof(double));
+  if ((r == NULL) || (d == NULL)) {
+    printerr("Could not malloc memory for refinement\n");
+    exit(-1);
+  }
+  anorm = NormA();
+  for (i=0; i<n; i++) {
+    x[i] = 0.0;
+    r[i] = rhs[i];
+  }
+  converged = 0;
+  last = 0.0;
+  for (refine_steps=1; refine_steps<=MAX_REFINE; refine_steps++) {
+    for (i=0; i<n; i++) {
+      d[i] = r[i];
+    }
+    SolveSingle(d);
+    for (i=0; i<n; i++) {
+      x[i] += d[i];
+    }
+    Residual(x, r);
+    rnorm = xnorm = 0.0;
+    for (i=0; i<n; i++) {
+      rnorm = fmax(rnorm, fabs(r[i]));
+      xnorm = fmax(xnorm, fabs(x[i]));
+    }
+    refine_residual = rnorm/(anorm*xnorm);
+    if (rnorm <= xnorm*anorm*DBL_EPSILON*sqrt((double) n)) {
+      converged = 1;
+      break;
+    }
+    if ((refine_steps > 1) && (rnorm >= last)) {
+      break;
+    }
+    last = rnorm;
+  }
+  refine_steps = min(refine_steps, MAX_REFINE);
+  free(r);
+  free(d);
+  {
+	struct timeval	FullTime;
+
+	gettimeofday(&FullTime, NULL);
+	(t2) = (unsigned long)(FullTime.tv_usec + FullTime.tv_sec * 1000000);
+  }
+  refine_time = t2 - t1;
+  return(converged);
+}
+
+
+void InitA(double *rhs)
+{
+  long i, j;
+
+  srand48((long) 1);
+  for (j=0; j<n; j++) {
+    for (i=0; i<n; i++) {
+      *lu_elem(i, j) = ((double) lrand48())/MAXRAND;
+      if (i == j) {
+	*lu_elem(i, j) *= 10;
+      }
+    }
+  }
+
+  for (j=0; j<n; j++) {
+    rhs[j] = 0.0;
+  }
+  for (j=0; j<n; j++) {
+    for (i=0; i<n; i++) {
+      rhs[i] += *lu_elem(i, j);
+    }
+  }
+}
+
+
+double TouchA(long bs, long MyNum)
+{
+  long i, j, I, J, ld;
+  double tot = 0.0;
+  double *blk;
+
+  /* touch my portion of A[] */
+
+  for (J=0; J<nblocks; J++) {
+    for (I=0; I<nblocks; I++) {
+      if (BlockOwner(I, J) == MyNum) {
+	blk = lu_block(I, J);
+	ld = lu_block_ld(I);
+	for (j=0; j<BlockDim(J); j++) {
+	  for (i=0; i<BlockDim(I); i++) {
+	    tot += blk[i+j*ld];
+          }
+	}
+      }
+    }
+  } 
+  return(tot);
+}
+
+
+void PrintA()
+{
+  long i, j;
+
+  for (i=0; i<n; i++) {
+    for (j=0; j<n; j++) {
+      printf("%8.1f ", *lu_elem(i, j));
+    }
+    printf("\n");
+  }
+  fflush(stdout);
+}
+
+
+void CheckResult(long n, double *rhs)
+{
+  long i, j, bogus = 0;
+  double *y, diff, max_diff;
+
+  y = (double *) malloc(n*sizeof(double));  
+  if (y == NULL) {
+    printerr("Could not malloc memory for y\n");
+    exit(-1);
+  }
+  if (mixed && refined) {
+    /* a still holds the original matrix; use the refined solution */
+    for (j=0; j<n; j++) {
+      y[j] = x[j];
+    }
+  } else {
+    for (j=0; j<n; j++) {
+      y[j] = rhs[j];
+    }
+    for (j=0; j<n; j++) {
+      y[j] = y[j]/(*lu_elem(j, j));
+      for (i=j+1; i<n; i++) {
+        y[i] -= (*lu_elem(i, j))*y[j];
+      }
+    }
+
+    for (j=n-1; j>=0; j--) {
+      for (i=0; i<j; i++) {
+        y[i] -= (*lu_elem(i, j))*y[j];
+      }
+    }
+  }
+
+  printf("Scaled residual ||b-Ax||/(||A|| ||x||): %.3e\n", CheckResidual(y));
+  max_diff = 0.0;
+  for (j=0; j<n; j++) {
+    diff = y[j] - 1.0;
+    if (fabs(diff) > 0.00001) {
+      bogus = 1;
+      max_diff = diff;
+    }
+  }
+  if (bogus) {
+    printf("TEST FAILED: (%.5f diff)\n", max_diff);
+  } else {
+    printf("TEST PASSED\n");
+  }
+  free(y);
+}
+
+
+/* Check the -k solutions, right-hand side j against (j+1) (1 ... 1) */
+void CheckSolve()
+{
+  long i, j;
+  double *b, diff, max_diff;
+
+  b = lu_solve_rhs();
+  max_diff = 0.0;
+  for (j=0; j<nrhs; j++) {
+    for (i=0; i<n; i++) {
+      diff = fabs(b[i+j*n]/(j+1) - 1.0);
+      if (diff > max_diff) {
+        max_diff = diff;
+      }
+    }
+  }
+  if (max_diff > 0.00001) {
+    printf("Solve with %ld right-hand sides: TEST FAILED: (%.5f diff)\n",
+           nrhs, max_diff);
+  } else {
+    printf("Solve with %ld right-hand sides: TEST PASSED\n", nrhs);
+  }
+}
+
+
+/*
+ * CheckResidual() returns ||rhs - A y|| / (||A|| ||y||), in the infinity
+ * norm, regenerating A as InitA() does since a may hold its factors.
+ */
+double CheckResidual(double *y)
+{
+  long i, j;
+  double *r, *rowsum, aij;
+  double rnorm, anorm, ynorm;
+
+  r = (double *) malloc(n*sizeof(double));
+  rowsum = (double *) malloc(n*sizeof(double));
+  if ((r == NULL) || (rowsum == NULL)) {
+    printerr("Could not malloc memory for residual\n");
+    exit(-1);
+  }
+  for (i=0; i<n; i++) {
+    r[i] = rhs[i];
+    rowsum[i] = 0.0;
+  }
+  srand48((long) 1);
+  for (j=0; j<n; j++) {
+    for (i=0; i<n; i++) {
+      aij = ((double) lrand48())/MAXRAND;
+      if (i == j) {
+        aij *= 10;
+      }
+      r[i] -= aij*y[j];
+      rowsum[i] += fabs(aij);
+    }
+  }
+  rnorm = anorm = ynorm = 0.0;
+  for (i=0; i<n; i++) {
+    rnorm = fmax(rnorm, fabs(r[i]));
+    anorm = fmax(anorm, rowsum[i]);
+    ynorm = fmax(ynorm, fabs(y[i]));
+  }
+  free(r);
+  free(rowsum);
+  return(rnorm/(anorm*ynorm));
+}
+
+
+void printerr(const char *s)
+{
+  fprintf(stderr,"ERROR: %s\n",s);
+}
+
@@ -0,0 +1,252 @@
+/*************************************************************************/
+/*                                                                       */
+/*  Batched factorization of many small matrices for the LU engine in    */
+/*  lu.c (-B).                                                           */
+/*                                                                       */
+/*  Small matrices leave the blocked machinery nothing to block, so a    */
+/*  batch is instead factored LU_BATCH_LANES matrices at a time: the     */
+/*  matrices of a group are interleaved element by element, and every    */
+/*  step of lu0 is applied to all of them at once with one vector        */
+/*  operation.  Each processor factors a contiguous range of groups.     */
+/*  As in lu0 there is no pivoting; the factors are L (with diagonal)    */
+/*  and unit upper triangular U.                                         */
+/*                                                                       */
+/*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "lu_batch.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LU_X86
+#endif
+
+#define MAXRAND             32767.0
+#define BATCH_ALIGN         64
+
+typedef double lanes_t __attribute__((vector_size(LU_BATCH_LANES*sizeof(double))));
+
+static void factor_group_generic(long n, double *g);
+#ifdef LU_X86
+static void factor_group_avx2(long n, double *g);
+static void factor_group_avx512(long n, double *g);
+#endif
+
+static void (*factor_group)(long n, double *g) = factor_group_generic;
+
+/*
+ * lu_batch_init() allocates a batch of count n x n matrices and selects
+ * the widest vector unit for the group factorization.  The matrices are
+ * filled by lu_batch_generate() or lu_batch_pack().
+ */
+void lu_batch_init(struct lu_batch *batch, long n, long count)
+{
+  void *p;
+  long size;
+
+  batch->n = n;
+  batch->count = count;
+  batch->groups = (count+LU_BATCH_LANES-1)/LU_BATCH_LANES;
+  size = batch->groups*n*n*LU_BATCH_LANES;
+  if (posix_memalign(&p, BATCH_ALIGN, size*sizeof(double)) != 0) {
+    fprintf(stderr,"Could not malloc memory for batch.\n");
+    exit(-1);
+  }
+  batch->data = (double *) p;
+  if (posix_memalign(&p, BATCH_ALIGN,
+                     batch->groups*n*LU_BATCH_LANES*sizeof(double)) != 0) {
+    fprintf(stderr,"Could not malloc memory for batch rhs.\n");
+    exit(-1);
+  }
+  batch->rhs = (double *) p;
+
+#ifdef LU_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    factor_group = factor_group_avx512;
+  } else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    factor_group = factor_group_avx2;
+  }
+#endif
+}
+
+/* Copy the column-major matrix a into matrix l of the batch */
+void lu_batch_pack(struct lu_batch *batch, long l, double *a, long lda)
+{
+  long i, j, n = batch->n;
+  double *base;
+
+  base = &batch->data[(l/LU_BATCH_LANES)*n*n*LU_BATCH_LANES + l%LU_BATCH_LANES];
+  for (j=0; j<n; j++) {
+    for (i=0; i<n; i++) {
+      base[(i+j*n)*LU_BATCH_LANES] = a[i+j*lda];
+    }
+  }
+}
+
+/* Copy matrix l of the batch out to the column-major matrix a */
+void lu_batch_unpack(struct lu_batch *batch, long l, double *a, long lda)
+{
+  long i, j, n = batch->n;
+  double *base;
+
+  base = &batch->data[(l/LU_BATCH_LANES)*n*n*LU_BATCH_LANES + l%LU_BATCH_LANES];
+  for (j=0; j<n; j++) {
+    for (i=0; i<n; i++) {
+      a[i+j*lda] = base[(i+j*n)*LU_BATCH_LANES];
+    }
+  }
+}
+
+/*
+ * lu_batch_generate() fills this processor's groups with matrices made
+ * as InitA() makes its matrix, from a random stream seeded by the
+ * matrix number, and sets each right-hand side to the row sums so that
+ * the solution is all ones.  Lanes past the end of the batch get the
+ * identity.
+ */
+void lu_batch_generate(struct lu_batch *batch, long MyNum, long P)
+{
+  long g, l, m, i, j, n = batch->n;
+  unsigned short seed[3];
+  double *a, *rhs;
+
+  for (g=MyNum*batch->groups/P; g<(MyNum+1)*batch->groups/P; g++) {
+    a = &batch->data[g*n*n*LU_BATCH_LANES];
+    rhs = &batch->rhs[g*n*LU_BATCH_LANES];
+    for (m=0; m<LU_BATCH_LANES; m++) {
+      l = g*LU_BATCH_LANES + m;
+      if (l >= batch->count) {
+        for (j=0; j<n; j++) {
+          for (i=0; i<n; i++) {
+            a[(i+j*n)*LU_BATCH_LANES+m] = (i == j) ? 1.0 : 0.0;
+          }
+          rhs[j*LU_BATCH_LANES+m] = 1.0;
+        }
+        continue;
+      }
+      seed[0] = 0x330E;
+      seed[1] = (unsigned short) l;
+      seed[2] = (unsigned short) (l >> 16);
+      for (i=0; i<n; i++) {
+        rhs[i*LU_BATCH_LANES+m] = 0.0;
+      }
+      for (j=0; j<n; j++) {
+        for (i=0; i<n; i++) {
+          a[(i+j*n)*LU_BATCH_LANES+m] = ((double) nrand48(seed))/MAXRAND;
+          if (i == j) {
+            a[(i+j*n)*LU_BATCH_LANES+m] *= 10;
+          }
+          rhs[i*LU_BATCH_LANES+m] += a[(i+j*n)*LU_BATCH_LANES+m];
+        }
+      }
+    }
+  }
+}
+
+/* lu0 applied to all matrices of one group at once */
+static inline __attribute__((always_inline))
+void factor_group_body(long n, double *g)
+{
+  lanes_t *a = (lanes_t *) g;
+  lanes_t alpha;
+  long i, j, k;
+
+  for (k=0; k<n; k++) {
+    for (j=k+1; j<n; j++) {
+      a[k+j*n] /= a[k+k*n];
+      alpha = a[k+j*n];
+      for (i=k+1; i<n; i++) {
+        a[i+j*n] -= alpha*a[i+k*n];
+      }
+    }
+  }
+}
+
+static void factor_group_generic(long n, double *g)
+{
+  factor_group_body(n, g);
+}
+
+#ifdef LU_X86
+
+__attribute__((target("avx2,fma")))
+static void factor_group_avx2(long n, double *g)
+{
+  factor_group_body(n, g);
+}
+
+__attribute__((target("avx512f")))
+static void factor_group_avx512(long n, double *g)
+{
+  factor_group_body(n, g);
+}
+
+#endif
+
+/* Factor this processor's groups of the batch */
+void lu_batch_factor(struct lu_batch *batch, long MyNum, long P)
+{
+  long g, n = batch->n;
+
+  for (g=MyNum*batch->groups/P; g<(MyNum+1)*batch->groups/P; g++) {
+    factor_group(n, &batch->data[g*n*n*LU_BATCH_LANES]);
+  }
+}
+
+/*
+ * lu_batch_solve() overwrites x, n interleaved right-hand sides for the
+ * matrices of group g, with the solutions from the factors of group g.
+ */
+void lu_batch_solve(struct lu_batch *batch, long g, double *x)
+{
+  lanes_t *a = (lanes_t *) &batch->data[g*batch->n*batch->n*LU_BATCH_LANES];
+  lanes_t *y = (lanes_t *) x;
+  long i, j, n = batch->n;
+
+  for (j=0; j<n; j++) {
+    y[j] /= a[j+j*n];
+    for (i=j+1; i<n; i++) {
+      y[i] -= a[i+j*n]*y[j];
+    }
+  }
+  for (j=n-1; j>=0; j--) {
+    for (i=0; i<j; i++) {
+      y[i] -= a[i+j*n]*y[j];
+    }
+  }
+}
+
+/*
+ * lu_batch_check() solves every matrix of the factored batch against
+ * its right-hand side and returns the largest error in the solution,
+ * which should be all ones.
+ */
+double lu_batch_check(struct lu_batch *batch)
+{
+  void *p;
+  double *x, diff, max_diff;
+  long g, i, n = batch->n;
+
+  if (posix_memalign(&p, BATCH_ALIGN, n*LU_BATCH_LANES*sizeof(double)) != 0) {
+    fprintf(stderr,"Could not malloc memory for batch check.\n");
+    exit(-1);
+  }
+  x = (double *) p;
+  max_diff = 0.0;
+  for (g=0; g<batch->groups; g++) {
+    for (i=0; i<n*LU_BATCH_LANES; i++) {
+      x[i] = batch->rhs[g*n*LU_BATCH_LANES+i];
+    }
+    lu_batch_solve(batch, g, x);
+    for (i=0; i<n*LU_BATCH_LANES; i++) {
+      diff = fabs(x[i] - 1.0);
+      if (diff > max_diff) {
+        max_diff = diff;
+      }
+    }
+  }
+  free(x);
+  return(max_diff);
+}
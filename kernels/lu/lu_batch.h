@@ -0,0 +1,36 @@
+/*************************************************************************/
+/*                                                                       */
+/*  Batched factorization of many small matrices for the LU engine in    */
+/*  lu.c (-B).                                                           */
+/*                                                                       */
+/*************************************************************************/
+
+#ifndef LU_BATCH_H
+#define LU_BATCH_H
+
+#define LU_BATCH_LANES      8    /* matrices factored in lockstep */
+
+/*
+ * A batch of count n x n matrices, stored in groups of LU_BATCH_LANES
+ * matrices interleaved element by element: element i,j of matrix l is
+ * data[(g*n*n + i + j*n)*LU_BATCH_LANES + m] with g = l/LU_BATCH_LANES
+ * and m = l%LU_BATCH_LANES.  The last group is padded with identity
+ * matrices.
+ */
+struct lu_batch {
+  long n;
+  long count;
+  long groups;
+  double *data;
+  double *rhs;                   /* row sums of each matrix, interleaved */
+};
+
+void lu_batch_init(struct lu_batch *batch, long n, long count);
+void lu_batch_pack(struct lu_batch *batch, long l, double *a, long lda);
+void lu_batch_unpack(struct lu_batch *batch, long l, double *a, long lda);
+void lu_batch_generate(struct lu_batch *batch, long MyNum, long P);
+void lu_batch_factor(struct lu_batch *batch, long MyNum, long P);
+void lu_batch_solve(struct lu_batch *batch, long g, double *x);
+double lu_batch_check(struct lu_batch *batch);
+
+#endif
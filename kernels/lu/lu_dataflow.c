@@ -0,0 +1,202 @@
+/*************************************************************************/
+/*                                                                       */
+/*  Dataflow execution of blocked LU for the LU engine in lu.c (-d).     */
+/*                                                                       */
+/*  Instead of three global barriers per step, every block I,J keeps a   */
+/*  count of the operations already applied to it: the updates of steps  */
+/*  0..min(I,J)-1 and then its own factorization or panel solve.  An     */
+/*  operation runs as soon as the blocks it reads are final, so the      */
+/*  update of a block at step K waits only for its two panel blocks of   */
+/*  step K.  Each processor performs every operation on the blocks it    */
+/*  owns, choosing among its ready operations the one on the block       */
+/*  nearest the diagonal, so the panels of step K+1 are finished first   */
+/*  and factored while the rest of step K's updates are still running.   */
+/*  No operation of step K+depth+1 starts before step K is complete.     */
+/*                                                                       */
+/*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "lu_dataflow.h"
+
+#define min(a,b) ((a) < (b) ? (a) : (b))
+
+static long nb;                 /* blocks in each dimension */
+static long *progress;          /* operations applied to block I+J*nb */
+static long *remaining;         /* operations of each step not yet done */
+static unsigned long generation; /* bumped after every operation */
+static long waiting;            /* processors sleeping on progress_cv */
+static pthread_mutex_t progress_lock;
+static pthread_cond_t progress_cv;
+
+static unsigned long now()
+{
+  struct timeval FullTime;
+
+  gettimeofday(&FullTime, NULL);
+  return((unsigned long)(FullTime.tv_usec + FullTime.tv_sec * 1000000));
+}
+
+/*
+ * lu_dataflow_init() sets up the block and step counters.  It must be
+ * called once, before the processors start.
+ */
+void lu_dataflow_init(struct lu_tasks *tasks)
+{
+  nb = tasks->nblocks;
+  progress = (long *) malloc(nb*nb*sizeof(long));
+  remaining = (long *) malloc(nb*sizeof(long));
+  if ((progress == NULL) || (remaining == NULL)) {
+    fprintf(stderr,"Could not malloc memory for dataflow counters.\n");
+    exit(-1);
+  }
+  pthread_mutex_init(&progress_lock, NULL);
+  pthread_cond_init(&progress_cv, NULL);
+  lu_dataflow_reset();
+}
+
+/*
+ * lu_dataflow_reset() prepares the counters for another factorization.
+ * No processor may be inside lu_dataflow() while it runs.
+ */
+void lu_dataflow_reset()
+{
+  long i, k;
+
+  for (i=0; i<nb*nb; i++) {
+    progress[i] = 0;
+  }
+  /* step k factors one block, solves 2(nb-k-1) and updates (nb-k-1)^2 */
+  for (k=0; k<nb; k++) {
+    remaining[k] = (nb-k)*(nb-k);
+  }
+  generation = 0;
+  waiting = 0;
+}
+
+/* Can the next operation, at step s, on block I,J run now? */
+static long ready(long I, long J, long s)
+{
+  long m = min(I, J);
+
+  if (s < m) {
+    return((__atomic_load_n(&progress[I+s*nb], __ATOMIC_ACQUIRE) > s) &&
+           (__atomic_load_n(&progress[s+J*nb], __ATOMIC_ACQUIRE) > s));
+  } else if (I == J) {
+    return(1);
+  } else {
+    return(__atomic_load_n(&progress[m+m*nb], __ATOMIC_ACQUIRE) > m);
+  }
+}
+
+void lu_dataflow(struct lu_tasks *tasks, long MyNum, struct lu_task_times *times)
+{
+  long *own_i, *own_j;
+  long count, first, x, found;
+  long I, J, K, m, s, oldest;
+  unsigned long seen, t1, t2;
+
+  /* my blocks, ordered by distance from the top left of the matrix */
+  own_i = (long *) malloc(nb*nb*sizeof(long));
+  own_j = (long *) malloc(nb*nb*sizeof(long));
+  if ((own_i == NULL) || (own_j == NULL)) {
+    fprintf(stderr,"Proc %ld could not malloc memory for its block list\n",MyNum);
+    exit(-1);
+  }
+  count = 0;
+  for (K=0; K<nb; K++) {
+    for (I=K; I<nb; I++) {
+      if (tasks->owner(I, K) == MyNum) {
+        own_i[count] = I;
+        own_j[count] = K;
+        count++;
+      }
+      if ((I != K) && (tasks->owner(K, I) == MyNum)) {
+        own_i[count] = K;
+        own_j[count] = I;
+        count++;
+      }
+    }
+  }
+
+  times->fac = times->solve = times->mod = times->wait = 0.0;
+  oldest = 0;
+  first = 0;
+  while (first < count) {
+    seen = __atomic_load_n(&generation, __ATOMIC_SEQ_CST);
+    while ((oldest < nb) &&
+           (__atomic_load_n(&remaining[oldest], __ATOMIC_ACQUIRE) == 0)) {
+      oldest++;
+    }
+
+    found = -1;
+    for (x=first; x<count; x++) {
+      I = own_i[x];
+      J = own_j[x];
+      s = progress[I+J*nb];
+      if (s > min(I, J)) {
+        if (x == first) {
+          first++;
+        }
+        continue;
+      }
+      if (s > oldest + tasks->depth) {
+        continue;
+      }
+      if (ready(I, J, s)) {
+        found = x;
+        break;
+      }
+    }
+
+    if (first == count) {
+      break;
+    }
+    if (found < 0) {
+      t1 = now();
+      pthread_mutex_lock(&progress_lock);
+      __atomic_add_fetch(&waiting, 1, __ATOMIC_SEQ_CST);
+      while (__atomic_load_n(&generation, __ATOMIC_SEQ_CST) == seen) {
+        pthread_cond_wait(&progress_cv, &progress_lock);
+      }
+      __atomic_sub_fetch(&waiting, 1, __ATOMIC_SEQ_CST);
+      pthread_mutex_unlock(&progress_lock);
+      times->wait += now() - t1;
+      continue;
+    }
+
+    m = min(I, J);
+    t1 = now();
+    if (s < m) {
+      tasks->update(I, J, s);
+    } else if (I == J) {
+      tasks->factor(I);
+    } else if (I > J) {
+      tasks->column(I, J);
+    } else {
+      tasks->row(I, J);
+    }
+    t2 = now();
+    if (s < m) {
+      times->mod += t2 - t1;
+    } else if (I == J) {
+      times->fac += t2 - t1;
+    } else {
+      times->solve += t2 - t1;
+    }
+
+    __atomic_store_n(&progress[I+J*nb], s+1, __ATOMIC_RELEASE);
+    __atomic_sub_fetch(&remaining[s], 1, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&generation, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&waiting, __ATOMIC_SEQ_CST) != 0) {
+      pthread_mutex_lock(&progress_lock);
+      pthread_cond_broadcast(&progress_cv);
+      pthread_mutex_unlock(&progress_lock);
+    }
+  }
+
+  free(own_i);
+  free(own_j);
+}
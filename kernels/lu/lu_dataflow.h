@@ -0,0 +1,35 @@
+/*************************************************************************/
+/*                                                                       */
+/*  Dataflow execution of blocked LU for the LU engine in lu.c (-d).     */
+/*                                                                       */
+/*************************************************************************/
+
+#ifndef LU_DATAFLOW_H
+#define LU_DATAFLOW_H
+
+#define DEFAULT_LOOKAHEAD   1
+
+/* The block operations of one LU program, and who performs them. */
+struct lu_tasks {
+  long nblocks;                             /* blocks in each dimension */
+  long depth;                               /* lookahead depth */
+  long (*owner)(long I, long J);            /* processor owning block I,J */
+  void (*factor)(long K);                   /* lu0 on block K,K */
+  void (*column)(long I, long K);           /* bdiv on block I,K */
+  void (*row)(long K, long J);              /* bmodd on block K,J */
+  void (*update)(long I, long J, long K);   /* bmod of block I,J at step K */
+};
+
+/* Time, in microseconds, one processor spent in each kind of work. */
+struct lu_task_times {
+  double fac;
+  double solve;
+  double mod;
+  double wait;
+};
+
+void lu_dataflow_init(struct lu_tasks *tasks);
+void lu_dataflow_reset(void);
+void lu_dataflow(struct lu_tasks *tasks, long MyNum, struct lu_task_times *times);
+
+#endif
@@ -0,0 +1,819 @@
+/*************************************************************************/
+/*                                                                       */
+/*  Dense block kernels of the LU engine in lu.c.                        */
+/*                                                                       */
+/*  lu_gemm() is a packed, register-blocked matrix multiply: A and B     */
+/*  are copied into MR-row and NR-column panels and an MR x NR           */
+/*  micro-kernel accumulates each tile of C in registers.  The           */
+/*  micro-kernel is chosen at run time from the instruction sets the     */
+/*  processor supports.  The triangular solves are blocked so that all   */
+/*  but a narrow diagonal panel of their work goes through lu_gemm().    */
+/*  lu_getrf() factors a diagonal block recursively (Toledo): it splits  */
+/*  the block in half, factors the left half, solves for the top right   */
+/*  quarter, updates the bottom right quarter with one lu_gemm() and     */
+/*  recurses on it, so only blocks of LU_RECURSE_MIN columns or less     */
+/*  are factored element by element.  lu_getrf_team() does the same      */
+/*  with a team of processors sharing the solves and updates.            */
+/*  The lu_s*() routines repeat all of this in single precision, with    */
+/*  micro-tiles twice as tall.                                           */
+/*                                                                       */
+/*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "lu_kernels.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LU_X86
+#include <immintrin.h>
+#endif
+
+#define NR                  6    /* columns of a micro-tile */
+#define MR_MAX             16    /* most rows of any micro-tile */
+#define KC                256    /* depth of a packed panel */
+#define MC                128    /* rows of packed A, a multiple of MR */
+#define NC               1536    /* columns of packed B, a multiple of NR */
+#define PACK_ALIGN         64
+#define min(a,b) ((a) < (b) ? (a) : (b))
+
+typedef void (*micro_kernel_t)(long k, double *a, double *b, double *c,
+                               long ldc, long m, long n);
+
+typedef void (*smicro_kernel_t)(long k, float *a, float *b, float *c,
+                                long ldc, long m, long n);
+
+static void kernel_4x6(long k, double *a, double *b, double *c, long ldc,
+                       long m, long n);
+static void skernel_8x6(long k, float *a, float *b, float *c, long ldc,
+                        long m, long n);
+#ifdef LU_X86
+static void kernel_8x6_avx2(long k, double *a, double *b, double *c,
+                            long ldc, long m, long n);
+static void kernel_16x6_avx512(long k, double *a, double *b, double *c,
+                               long ldc, long m, long n);
+static void skernel_16x6_avx2(long k, float *a, float *b, float *c,
+                              long ldc, long m, long n);
+static void skernel_32x6_avx512(long k, float *a, float *b, float *c,
+                                long ldc, long m, long n);
+#endif
+
+static micro_kernel_t micro_kernel = kernel_4x6;
+static smicro_kernel_t smicro_kernel = skernel_8x6;
+static long mr = 4;
+static long smr = 8;
+static const char *kernel_name = "generic 4x6";
+
+/* Per-thread packing buffers, grown on demand. */
+static __thread double *pack_a = NULL;
+static __thread double *pack_b = NULL;
+static __thread long pack_a_size = 0;
+static __thread long pack_b_size = 0;
+static __thread float *spack_a = NULL;
+static __thread float *spack_b = NULL;
+static __thread long spack_a_size = 0;
+static __thread long spack_b_size = 0;
+
+/*
+ * lu_kernel_init() selects the widest micro-kernel the processor runs.
+ * It must be called before any thread uses the kernels.
+ */
+void lu_kernel_init()
+{
+#ifdef LU_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    micro_kernel = kernel_16x6_avx512;
+    smicro_kernel = skernel_32x6_avx512;
+    mr = 16;
+    smr = 32;
+    kernel_name = "AVX-512 16x6";
+  } else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    micro_kernel = kernel_8x6_avx2;
+    smicro_kernel = skernel_16x6_avx2;
+    mr = 8;
+    smr = 16;
+    kernel_name = "AVX2 8x6";
+  }
+#endif
+}
+
+const char *lu_kernel_name()
+{
+  return(kernel_name);
+}
+
+static void *grow_buffer(void *buf, long *size, long want, long elem)
+{
+  void *p;
+
+  if (want <= *size) {
+    return(buf);
+  }
+  free(buf);
+  if (posix_memalign(&p, PACK_ALIGN, want*elem) != 0) {
+    fprintf(stderr,"ERROR: Could not malloc memory for packing buffer\n");
+    exit(-1);
+  }
+  *size = want;
+  return(p);
+}
+
+/*
+ * pack_panel_a() copies the m x k block of A into panels of mr rows,
+ * each stored column by column, padding the last panel with zeros.
+ */
+static void pack_panel_a(double *a, long lda, long m, long k, double *pa)
+{
+  long i, ir, p;
+
+  for (ir=0; ir<m; ir+=mr) {
+    for (p=0; p<k; p++) {
+      for (i=0; i<mr; i++) {
+        *pa++ = (ir+i < m) ? a[ir+i+p*lda] : 0.0;
+      }
+    }
+  }
+}
+
+/*
+ * pack_panel_b() copies the k x n block of B into panels of NR columns,
+ * each stored row by row, padding the last panel with zeros.
+ */
+static void pack_panel_b(double *b, long ldb, long k, long n, double *pb)
+{
+  long j, jr, p;
+
+  for (jr=0; jr<n; jr+=NR) {
+    for (p=0; p<k; p++) {
+      for (j=0; j<NR; j++) {
+        *pb++ = (jr+j < n) ? b[p+(jr+j)*ldb] : 0.0;
+      }
+    }
+  }
+}
+
+/*
+ * lu_gemm() computes C -= A*B, with A m x k, B k x n and C m x n.
+ */
+void lu_gemm(long m, long n, long k, double *a, long lda, double *b,
+             long ldb, double *c, long ldc)
+{
+  long ic, jc, pc, ir, jr;
+  long mc, nc, kc;
+
+  if ((m <= 0) || (n <= 0) || (k <= 0)) {
+    return;
+  }
+  pack_a = grow_buffer(pack_a, &pack_a_size, MC*KC, sizeof(double));
+  pack_b = grow_buffer(pack_b, &pack_b_size,
+                       ((min(n, NC)+NR-1)/NR)*NR*min(k, KC), sizeof(double));
+  for (jc=0; jc<n; jc+=NC) {
+    nc = min(NC, n-jc);
+    for (pc=0; pc<k; pc+=KC) {
+      kc = min(KC, k-pc);
+      pack_panel_b(&b[pc+jc*ldb], ldb, kc, nc, pack_b);
+      for (ic=0; ic<m; ic+=MC) {
+        mc = min(MC, m-ic);
+        pack_panel_a(&a[ic+pc*lda], lda, mc, kc, pack_a);
+        for (jr=0; jr<nc; jr+=NR) {
+          for (ir=0; ir<mc; ir+=mr) {
+            micro_kernel(kc, &pack_a[ir*kc], &pack_b[jr*kc],
+                         &c[ic+ir+(jc+jr)*ldc], ldc,
+                         min(mr, mc-ir), min(NR, nc-jr));
+          }
+        }
+      }
+    }
+  }
+}
+
+static void axpy(double *a, double *b, long n, double alpha)
+{
+  long i;
+
+  for (i=0; i<n; i++) {
+    a[i] += alpha*b[i];
+  }
+}
+
+/*
+ * lu_trsm_right_upper() computes A := A * U^-1 for the m x n block A
+ * and the unit upper triangle U of an n x n diagonal block (bdiv).
+ */
+void lu_trsm_right_upper(double *a, double *u, long lda, long ldu,
+                         long m, long n)
+{
+  long j, k, kk, nb;
+
+  for (kk=0; kk<n; kk+=LU_TRSM_BLOCK) {
+    nb = min(LU_TRSM_BLOCK, n-kk);
+    for (k=kk; k<kk+nb; k++) {
+      for (j=k+1; j<kk+nb; j++) {
+        axpy(&a[j*lda], &a[k*lda], m, -u[k+j*ldu]);
+      }
+    }
+    lu_gemm(m, n-kk-nb, nb, &a[kk*lda], lda, &u[kk+(kk+nb)*ldu], ldu,
+            &a[(kk+nb)*lda], lda);
+  }
+}
+
+/*
+ * lu_trsm_left_lower() computes C := L^-1 * C for the m x n block C and
+ * the lower triangle L, diagonal included, of an m x m diagonal block
+ * (bmodd).
+ */
+void lu_trsm_left_lower(double *l, double *c, long ldl, long ldc,
+                        long m, long n)
+{
+  long j, k, kk, nb;
+
+  for (kk=0; kk<m; kk+=LU_TRSM_BLOCK) {
+    nb = min(LU_TRSM_BLOCK, m-kk);
+    for (j=0; j<n; j++) {
+      for (k=kk; k<kk+nb; k++) {
+        c[k+j*ldc] /= l[k+k*ldl];
+        axpy(&c[k+1+j*ldc], &l[k+1+k*ldl], kk+nb-k-1, -c[k+j*ldc]);
+      }
+    }
+    lu_gemm(m-kk-nb, n, nb, &l[kk+nb+kk*ldl], ldl, &c[kk], ldc,
+            &c[kk+nb], ldc);
+  }
+}
+
+/*
+ * lu_trsm_left_upper() computes C := U^-1 * C for the m x n block C and
+ * the unit upper triangle U of an m x m diagonal block, working up from
+ * the bottom panel.
+ */
+void lu_trsm_left_upper(double *u, double *c, long ldu, long ldc,
+                        long m, long n)
+{
+  long j, k, kk, nb;
+
+  for (kk=((m-1)/LU_TRSM_BLOCK)*LU_TRSM_BLOCK; kk>=0; kk-=LU_TRSM_BLOCK) {
+    nb = min(LU_TRSM_BLOCK, m-kk);
+    for (j=0; j<n; j++) {
+      for (k=kk+nb-1; k>kk; k--) {
+        axpy(&c[kk+j*ldc], &u[kk+k*ldu], k-kk, -c[k+j*ldc]);
+      }
+    }
+    lu_gemm(kk, n, nb, &u[kk*ldu], ldu, &c[kk], ldc, c, ldc);
+  }
+}
+
+/* lu0 proper, for blocks of at most LU_RECURSE_MIN columns */
+static void getrf_base(double *a, long n, long lda)
+{
+  long j, k;
+
+  for (k=0; k<n; k++) {
+    for (j=k+1; j<n; j++) {
+      a[k+j*lda] /= a[k+k*lda];
+      axpy(&a[k+1+j*lda], &a[k+1+k*lda], n-k-1, -a[k+j*lda]);
+    }
+  }
+}
+
+/*
+ * lu_getrf() factors the n x n block A into L (with diagonal) and unit
+ * upper triangular U, without pivoting (lu0).
+ */
+void lu_getrf(double *a, long n, long lda)
+{
+  long n1, n2;
+
+  if (n <= LU_RECURSE_MIN) {
+    getrf_base(a, n, lda);
+    return;
+  }
+  n1 = n/2;
+  n2 = n-n1;
+  lu_getrf(a, n1, lda);
+  lu_trsm_right_upper(&a[n1], a, lda, lda, n2, n1);
+  lu_trsm_left_lower(a, &a[n1*lda], lda, lda, n1, n2);
+  lu_gemm(n2, n2, n1, &a[n1], lda, &a[n1*lda], lda, &a[n1+n1*lda], lda);
+  lu_getrf(&a[n1+n1*lda], n2, lda);
+}
+
+/*
+ * lu_getrf_team() is lu_getrf() run by team processors together, each
+ * calling it with its own rank me.  Rank 0 factors the blocks too small
+ * to share; the solves are split by rows and columns and the update by
+ * columns, with barrier() called by all of them between the phases.
+ * The factors are complete in every processor's view on return.
+ */
+void lu_getrf_team(double *a, long n, long lda, long me, long team,
+                   void (*barrier)(void))
+{
+  long n1, n2, lo, hi;
+
+  if ((team == 1) || (n < 2*LU_TEAM_MIN)) {
+    if (me == 0) {
+      lu_getrf(a, n, lda);
+    }
+    barrier();
+    return;
+  }
+  n1 = n/2;
+  n2 = n-n1;
+  lu_getrf_team(a, n1, lda, me, team, barrier);
+  lo = me*n2/team;
+  hi = (me+1)*n2/team;
+  lu_trsm_right_upper(&a[n1+lo], a, lda, lda, hi-lo, n1);
+  lu_trsm_left_lower(a, &a[(n1+lo)*lda], lda, lda, n1, hi-lo);
+  barrier();
+  lu_gemm(n2, hi-lo, n1, &a[n1], lda, &a[(n1+lo)*lda], lda,
+          &a[n1+(n1+lo)*lda], lda);
+  barrier();
+  lu_getrf_team(&a[n1+n1*lda], n2, lda, me, team, barrier);
+}
+
+/* Single precision */
+
+static void spack_panel_a(float *a, long lda, long m, long k, float *pa)
+{
+  long i, ir, p;
+
+  for (ir=0; ir<m; ir+=smr) {
+    for (p=0; p<k; p++) {
+      for (i=0; i<smr; i++) {
+        *pa++ = (ir+i < m) ? a[ir+i+p*lda] : 0.0f;
+      }
+    }
+  }
+}
+
+static void spack_panel_b(float *b, long ldb, long k, long n, float *pb)
+{
+  long j, jr, p;
+
+  for (jr=0; jr<n; jr+=NR) {
+    for (p=0; p<k; p++) {
+      for (j=0; j<NR; j++) {
+        *pb++ = (jr+j < n) ? b[p+(jr+j)*ldb] : 0.0f;
+      }
+    }
+  }
+}
+
+void lu_sgemm(long m, long n, long k, float *a, long lda, float *b,
+              long ldb, float *c, long ldc)
+{
+  long ic, jc, pc, ir, jr;
+  long mc, nc, kc;
+
+  if ((m <= 0) || (n <= 0) || (k <= 0)) {
+    return;
+  }
+  spack_a = grow_buffer(spack_a, &spack_a_size, MC*KC, sizeof(float));
+  spack_b = grow_buffer(spack_b, &spack_b_size,
+                        ((min(n, NC)+NR-1)/NR)*NR*min(k, KC), sizeof(float));
+  for (jc=0; jc<n; jc+=NC) {
+    nc = min(NC, n-jc);
+    for (pc=0; pc<k; pc+=KC) {
+      kc = min(KC, k-pc);
+      spack_panel_b(&b[pc+jc*ldb], ldb, kc, nc, spack_b);
+      for (ic=0; ic<m; ic+=MC) {
+        mc = min(MC, m-ic);
+        spack_panel_a(&a[ic+pc*lda], lda, mc, kc, spack_a);
+        for (jr=0; jr<nc; jr+=NR) {
+          for (ir=0; ir<mc; ir+=smr) {
+            smicro_kernel(kc, &spack_a[ir*kc], &spack_b[jr*kc],
+                          &c[ic+ir+(jc+jr)*ldc], ldc,
+                          min(smr, mc-ir), min(NR, nc-jr));
+          }
+        }
+      }
+    }
+  }
+}
+
+static void saxpy(float *a, float *b, long n, float alpha)
+{
+  long i;
+
+  for (i=0; i<n; i++) {
+    a[i] += alpha*b[i];
+  }
+}
+
+void lu_strsm_right_upper(float *a, float *u, long lda, long ldu,
+                          long m, long n)
+{
+  long j, k, kk, nb;
+
+  for (kk=0; kk<n; kk+=LU_TRSM_BLOCK) {
+    nb = min(LU_TRSM_BLOCK, n-kk);
+    for (k=kk; k<kk+nb; k++) {
+      for (j=k+1; j<kk+nb; j++) {
+        saxpy(&a[j*lda], &a[k*lda], m, -u[k+j*ldu]);
+      }
+    }
+    lu_sgemm(m, n-kk-nb, nb, &a[kk*lda], lda, &u[kk+(kk+nb)*ldu], ldu,
+             &a[(kk+nb)*lda], lda);
+  }
+}
+
+void lu_strsm_left_lower(float *l, float *c, long ldl, long ldc,
+                         long m, long n)
+{
+  long j, k, kk, nb;
+
+  for (kk=0; kk<m; kk+=LU_TRSM_BLOCK) {
+    nb = min(LU_TRSM_BLOCK, m-kk);
+    for (j=0; j<n; j++) {
+      for (k=kk; k<kk+nb; k++) {
+        c[k+j*ldc] /= l[k+k*ldl];
+        saxpy(&c[k+1+j*ldc], &l[k+1+k*ldl], kk+nb-k-1, -c[k+j*ldc]);
+      }
+    }
+    lu_sgemm(m-kk-nb, n, nb, &l[kk+nb+kk*ldl], ldl, &c[kk], ldc,
+             &c[kk+nb], ldc);
+  }
+}
+
+static void sgetrf_base(float *a, long n, long lda)
+{
+  long j, k;
+
+  for (k=0; k<n; k++) {
+    for (j=k+1; j<n; j++) {
+      a[k+j*lda] /= a[k+k*lda];
+      saxpy(&a[k+1+j*lda], &a[k+1+k*lda], n-k-1, -a[k+j*lda]);
+    }
+  }
+}
+
+void lu_sgetrf(float *a, long n, long lda)
+{
+  long n1, n2;
+
+  if (n <= LU_RECURSE_MIN) {
+    sgetrf_base(a, n, lda);
+    return;
+  }
+  n1 = n/2;
+  n2 = n-n1;
+  lu_sgetrf(a, n1, lda);
+  lu_strsm_right_upper(&a[n1], a, lda, lda, n2, n1);
+  lu_strsm_left_lower(a, &a[n1*lda], lda, lda, n1, n2);
+  lu_sgemm(n2, n2, n1, &a[n1], lda, &a[n1*lda], lda, &a[n1+n1*lda], lda);
+  lu_sgetrf(&a[n1+n1*lda], n2, lda);
+}
+
+void lu_sgetrf_team(float *a, long n, long lda, long me, long team,
+                    void (*barrier)(void))
+{
+  long n1, n2, lo, hi;
+
+  if ((team == 1) || (n < 2*LU_TEAM_MIN)) {
+    if (me == 0) {
+      lu_sgetrf(a, n, lda);
+    }
+    barrier();
+    return;
+  }
+  n1 = n/2;
+  n2 = n-n1;
+  lu_sgetrf_team(a, n1, lda, me, team, barrier);
+  lo = me*n2/team;
+  hi = (me+1)*n2/team;
+  lu_strsm_right_upper(&a[n1+lo], a, lda, lda, hi-lo, n1);
+  lu_strsm_left_lower(a, &a[(n1+lo)*lda], lda, lda, n1, hi-lo);
+  barrier();
+  lu_sgemm(n2, hi-lo, n1, &a[n1], lda, &a[(n1+lo)*lda], lda,
+           &a[n1+(n1+lo)*lda], lda);
+  barrier();
+  lu_sgetrf_team(&a[n1+n1*lda], n2, lda, me, team, barrier);
+}
+
+/*
+ * The micro-kernels compute C -= A*B for one tile, from an A panel of
+ * mr x k and a B panel of k x NR.  Only the m x n corner of the tile is
+ * stored back, for tiles at the edge of C.
+ */
+static void kernel_4x6(long k, double *a, double *b, double *c, long ldc,
+                       long m, long n)
+{
+  double t[NR][4];
+  long i, j, p;
+
+  for (j=0; j<NR; j++) {
+    for (i=0; i<4; i++) {
+      t[j][i] = 0.0;
+    }
+  }
+  for (p=0; p<k; p++) {
+    for (j=0; j<NR; j++) {
+      for (i=0; i<4; i++) {
+        t[j][i] += a[i]*b[j];
+      }
+    }
+    a += 4;
+    b += NR;
+  }
+  for (j=0; j<n; j++) {
+    for (i=0; i<m; i++) {
+      c[i+j*ldc] -= t[j][i];
+    }
+  }
+}
+
+static void skernel_8x6(long k, float *a, float *b, float *c, long ldc,
+                        long m, long n)
+{
+  float t[NR][8];
+  long i, j, p;
+
+  for (j=0; j<NR; j++) {
+    for (i=0; i<8; i++) {
+      t[j][i] = 0.0f;
+    }
+  }
+  for (p=0; p<k; p++) {
+    for (j=0; j<NR; j++) {
+      for (i=0; i<8; i++) {
+        t[j][i] += a[i]*b[j];
+      }
+    }
+    a += 8;
+    b += NR;
+  }
+  for (j=0; j<n; j++) {
+    for (i=0; i<m; i++) {
+      c[i+j*ldc] -= t[j][i];
+    }
+  }
+}
+
+#ifdef LU_X86
+
+__attribute__((target("avx2,fma")))
+static void kernel_8x6_avx2(long k, double *a, double *b, double *c,
+                            long ldc, long m, long n)
+{
+  __m256d c00, c01, c10, c11, c20, c21, c30, c31, c40, c41, c50, c51;
+  __m256d a0, a1, bj;
+  double t[NR*8];
+  long i, j, p;
+
+  c00 = c01 = c10 = c11 = c20 = c21 = _mm256_setzero_pd();
+  c30 = c31 = c40 = c41 = c50 = c51 = _mm256_setzero_pd();
+  for (p=0; p<k; p++) {
+    a0 = _mm256_load_pd(a);
+    a1 = _mm256_load_pd(a+4);
+    bj = _mm256_broadcast_sd(b);
+    c00 = _mm256_fmadd_pd(a0, bj, c00);
+    c01 = _mm256_fmadd_pd(a1, bj, c01);
+    bj = _mm256_broadcast_sd(b+1);
+    c10 = _mm256_fmadd_pd(a0, bj, c10);
+    c11 = _mm256_fmadd_pd(a1, bj, c11);
+    bj = _mm256_broadcast_sd(b+2);
+    c20 = _mm256_fmadd_pd(a0, bj, c20);
+    c21 = _mm256_fmadd_pd(a1, bj, c21);
+    bj = _mm256_broadcast_sd(b+3);
+    c30 = _mm256_fmadd_pd(a0, bj, c30);
+    c31 = _mm256_fmadd_pd(a1, bj, c31);
+    bj = _mm256_broadcast_sd(b+4);
+    c40 = _mm256_fmadd_pd(a0, bj, c40);
+    c41 = _mm256_fmadd_pd(a1, bj, c41);
+    bj = _mm256_broadcast_sd(b+5);
+    c50 = _mm256_fmadd_pd(a0, bj, c50);
+    c51 = _mm256_fmadd_pd(a1, bj, c51);
+    a += 8;
+    b += NR;
+  }
+  if ((m == 8) && (n == NR)) {
+#define UPDATE_COLUMN(j, lo, hi) \
+    _mm256_storeu_pd(&c[(j)*ldc], _mm256_sub_pd(_mm256_loadu_pd(&c[(j)*ldc]), lo)); \
+    _mm256_storeu_pd(&c[(j)*ldc+4], _mm256_sub_pd(_mm256_loadu_pd(&c[(j)*ldc+4]), hi));
+    UPDATE_COLUMN(0, c00, c01)
+    UPDATE_COLUMN(1, c10, c11)
+    UPDATE_COLUMN(2, c20, c21)
+    UPDATE_COLUMN(3, c30, c31)
+    UPDATE_COLUMN(4, c40, c41)
+    UPDATE_COLUMN(5, c50, c51)
+#undef UPDATE_COLUMN
+    return;
+  }
+  _mm256_storeu_pd(&t[0], c00);
+  _mm256_storeu_pd(&t[4], c01);
+  _mm256_storeu_pd(&t[8], c10);
+  _mm256_storeu_pd(&t[12], c11);
+  _mm256_storeu_pd(&t[16], c20);
+  _mm256_storeu_pd(&t[20], c21);
+  _mm256_storeu_pd(&t[24], c30);
+  _mm256_storeu_pd(&t[28], c31);
+  _mm256_storeu_pd(&t[32], c40);
+  _mm256_storeu_pd(&t[36], c41);
+  _mm256_storeu_pd(&t[40], c50);
+  _mm256_storeu_pd(&t[44], c51);
+  for (j=0; j<n; j++) {
+    for (i=0; i<m; i++) {
+      c[i+j*ldc] -= t[i+j*8];
+    }
+  }
+}
+
+__attribute__((target("avx512f")))
+static void kernel_16x6_avx512(long k, double *a, double *b, double *c,
+                               long ldc, long m, long n)
+{
+  __m512d c00, c01, c10, c11, c20, c21, c30, c31, c40, c41, c50, c51;
+  __m512d a0, a1, bj;
+  double t[NR*16];
+  long i, j, p;
+
+  c00 = c01 = c10 = c11 = c20 = c21 = _mm512_setzero_pd();
+  c30 = c31 = c40 = c41 = c50 = c51 = _mm512_setzero_pd();
+  for (p=0; p<k; p++) {
+    a0 = _mm512_load_pd(a);
+    a1 = _mm512_load_pd(a+8);
+    bj = _mm512_set1_pd(b[0]);
+    c00 = _mm512_fmadd_pd(a0, bj, c00);
+    c01 = _mm512_fmadd_pd(a1, bj, c01);
+    bj = _mm512_set1_pd(b[1]);
+    c10 = _mm512_fmadd_pd(a0, bj, c10);
+    c11 = _mm512_fmadd_pd(a1, bj, c11);
+    bj = _mm512_set1_pd(b[2]);
+    c20 = _mm512_fmadd_pd(a0, bj, c20);
+    c21 = _mm512_fmadd_pd(a1, bj, c21);
+    bj = _mm512_set1_pd(b[3]);
+    c30 = _mm512_fmadd_pd(a0, bj, c30);
+    c31 = _mm512_fmadd_pd(a1, bj, c31);
+    bj = _mm512_set1_pd(b[4]);
+    c40 = _mm512_fmadd_pd(a0, bj, c40);
+    c41 = _mm512_fmadd_pd(a1, bj, c41);
+    bj = _mm512_set1_pd(b[5]);
+    c50 = _mm512_fmadd_pd(a0, bj, c50);
+    c51 = _mm512_fmadd_pd(a1, bj, c51);
+    a += 16;
+    b += NR;
+  }
+  if ((m == 16) && (n == NR)) {
+#define UPDATE_COLUMN(j, lo, hi) \
+    _mm512_storeu_pd(&c[(j)*ldc], _mm512_sub_pd(_mm512_loadu_pd(&c[(j)*ldc]), lo)); \
+    _mm512_storeu_pd(&c[(j)*ldc+8], _mm512_sub_pd(_mm512_loadu_pd(&c[(j)*ldc+8]), hi));
+    UPDATE_COLUMN(0, c00, c01)
+    UPDATE_COLUMN(1, c10, c11)
+    UPDATE_COLUMN(2, c20, c21)
+    UPDATE_COLUMN(3, c30, c31)
+    UPDATE_COLUMN(4, c40, c41)
+    UPDATE_COLUMN(5, c50, c51)
+#undef UPDATE_COLUMN
+    return;
+  }
+  _mm512_storeu_pd(&t[0], c00);
+  _mm512_storeu_pd(&t[8], c01);
+  _mm512_storeu_pd(&t[16], c10);
+  _mm512_storeu_pd(&t[24], c11);
+  _mm512_storeu_pd(&t[32], c20);
+  _mm512_storeu_pd(&t[40], c21);
+  _mm512_storeu_pd(&t[48], c30);
+  _mm512_storeu_pd(&t[56], c31);
+  _mm512_storeu_pd(&t[64], c40);
+  _mm512_storeu_pd(&t[72], c41);
+  _mm512_storeu_pd(&t[80], c50);
+  _mm512_storeu_pd(&t[88], c51);
+  for (j=0; j<n; j++) {
+    for (i=0; i<m; i++) {
+      c[i+j*ldc] -= t[i+j*16];
+    }
+  }
+}
+
+__attribute__((target("avx2,fma")))
+static void skernel_16x6_avx2(long k, float *a, float *b, float *c,
+                              long ldc, long m, long n)
+{
+  __m256 c00, c01, c10, c11, c20, c21, c30, c31, c40, c41, c50, c51;
+  __m256 a0, a1, bj;
+  float t[NR*16];
+  long i, j, p;
+
+  c00 = c01 = c10 = c11 = c20 = c21 = _mm256_setzero_ps();
+  c30 = c31 = c40 = c41 = c50 = c51 = _mm256_setzero_ps();
+  for (p=0; p<k; p++) {
+    a0 = _mm256_load_ps(a);
+    a1 = _mm256_load_ps(a+8);
+    bj = _mm256_broadcast_ss(b);
+    c00 = _mm256_fmadd_ps(a0, bj, c00);
+    c01 = _mm256_fmadd_ps(a1, bj, c01);
+    bj = _mm256_broadcast_ss(b+1);
+    c10 = _mm256_fmadd_ps(a0, bj, c10);
+    c11 = _mm256_fmadd_ps(a1, bj, c11);
+    bj = _mm256_broadcast_ss(b+2);
+    c20 = _mm256_fmadd_ps(a0, bj, c20);
+    c21 = _mm256_fmadd_ps(a1, bj, c21);
+    bj = _mm256_broadcast_ss(b+3);
+    c30 = _mm256_fmadd_ps(a0, bj, c30);
+    c31 = _mm256_fmadd_ps(a1, bj, c31);
+    bj = _mm256_broadcast_ss(b+4);
+    c40 = _mm256_fmadd_ps(a0, bj, c40);
+    c41 = _mm256_fmadd_ps(a1, bj, c41);
+    bj = _mm256_broadcast_ss(b+5);
+    c50 = _mm256_fmadd_ps(a0, bj, c50);
+    c51 = _mm256_fmadd_ps(a1, bj, c51);
+    a += 16;
+    b += NR;
+  }
+  if ((m == 16) && (n == NR)) {
+#define UPDATE_COLUMN(j, lo, hi) \
+    _mm256_storeu_ps(&c[(j)*ldc], _mm256_sub_ps(_mm256_loadu_ps(&c[(j)*ldc]), lo)); \
+    _mm256_storeu_ps(&c[(j)*ldc+8], _mm256_sub_ps(_mm256_loadu_ps(&c[(j)*ldc+8]), hi));
+    UPDATE_COLUMN(0, c00, c01)
+    UPDATE_COLUMN(1, c10, c11)
+    UPDATE_COLUMN(2, c20, c21)
+    UPDATE_COLUMN(3, c30, c31)
+    UPDATE_COLUMN(4, c40, c41)
+    UPDATE_COLUMN(5, c50, c51)
+#undef UPDATE_COLUMN
+    return;
+  }
+  _mm256_storeu_ps(&t[0], c00);
+  _mm256_storeu_ps(&t[8], c01);
+  _mm256_storeu_ps(&t[16], c10);
+  _mm256_storeu_ps(&t[24], c11);
+  _mm256_storeu_ps(&t[32], c20);
+  _mm256_storeu_ps(&t[40], c21);
+  _mm256_storeu_ps(&t[48], c30);
+  _mm256_storeu_ps(&t[56], c31);
+  _mm256_storeu_ps(&t[64], c40);
+  _mm256_storeu_ps(&t[72], c41);
+  _mm256_storeu_ps(&t[80], c50);
+  _mm256_storeu_ps(&t[88], c51);
+  for (j=0; j<n; j++) {
+    for (i=0; i<m; i++) {
+      c[i+j*ldc] -= t[i+j*16];
+    }
+  }
+}
+
+__attribute__((target("avx512f")))
+static void skernel_32x6_avx512(long k, float *a, float *b, float *c,
+                                long ldc, long m, long n)
+{
+  __m512 c00, c01, c10, c11, c20, c21, c30, c31, c40, c41, c50, c51;
+  __m512 a0, a1, bj;
+  float t[NR*32];
+  long i, j, p;
+
+  c00 = c01 = c10 = c11 = c20 = c21 = _mm512_setzero_ps();
+  c30 = c31 = c40 = c41 = c50 = c51 = _mm512_setzero_ps();
+  for (p=0; p<k; p++) {
+    a0 = _mm512_load_ps(a);
+    a1 = _mm512_load_ps(a+16);
+    bj = _mm512_set1_ps(b[0]);
+    c00 = _mm512_fmadd_ps(a0, bj, c00);
+    c01 = _mm512_fmadd_ps(a1, bj, c01);
+    bj = _mm512_set1_ps(b[1]);
+    c10 = _mm512_fmadd_ps(a0, bj, c10);
+    c11 = _mm512_fmadd_ps(a1, bj, c11);
+    bj = _mm512_set1_ps(b[2]);
+    c20 = _mm512_fmadd_ps(a0, bj, c20);
+    c21 = _mm512_fmadd_ps(a1, bj, c21);
+    bj = _mm512_set1_ps(b[3]);
+    c30 = _mm512_fmadd_ps(a0, bj, c30);
+    c31 = _mm512_fmadd_ps(a1, bj, c31);
+    bj = _mm512_set1_ps(b[4]);
+    c40 = _mm512_fmadd_ps(a0, bj, c40);
+    c41 = _mm512_fmadd_ps(a1, bj, c41);
+    bj = _mm512_set1_ps(b[5]);
+    c50 = _mm512_fmadd_ps(a0, bj, c50);
+    c51 = _mm512_fmadd_ps(a1, bj, c51);
+    a += 32;
+    b += NR;
+  }
+  if ((m == 32) && (n == NR)) {
+#define UPDATE_COLUMN(j, lo, hi) \
+    _mm512_storeu_ps(&c[(j)*ldc], _mm512_sub_ps(_mm512_loadu_ps(&c[(j)*ldc]), lo)); \
+    _mm512_storeu_ps(&c[(j)*ldc+16], _mm512_sub_ps(_mm512_loadu_ps(&c[(j)*ldc+16]), hi));
+    UPDATE_COLUMN(0, c00, c01)
+    UPDATE_COLUMN(1, c10, c11)
+    UPDATE_COLUMN(2, c20, c21)
+    UPDATE_COLUMN(3, c30, c31)
+    UPDATE_COLUMN(4, c40, c41)
+    UPDATE_COLUMN(5, c50, c51)
+#undef UPDATE_COLUMN
+    return;
+  }
+  _mm512_storeu_ps(&t[0], c00);
+  _mm512_storeu_ps(&t[16], c01);
+  _mm512_storeu_ps(&t[32], c10);
+  _mm512_storeu_ps(&t[48], c11);
+  _mm512_storeu_ps(&t[64], c20);
+  _mm512_storeu_ps(&t[80], c21);
+  _mm512_storeu_ps(&t[96], c30);
+  _mm512_storeu_ps(&t[112], c31);
+  _mm512_storeu_ps(&t[128], c40);
+  _mm512_storeu_ps(&t[144], c41);
+  _mm512_storeu_ps(&t[160], c50);
+  _mm512_storeu_ps(&t[176], c51);
+  for (j=0; j<n; j++) {
+    for (i=0; i<m; i++) {
+      c[i+j*ldc] -= t[i+j*32];
+    }
+  }
+}
+
+#endif
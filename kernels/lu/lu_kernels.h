@@ -0,0 +1,40 @@
+/*************************************************************************/
+/*                                                                       */
+/*  Dense block kernels of the LU engine in lu.c.  All matrices are      */
+/*  column-major with explicit leading dimensions (strides).             */
+/*                                                                       */
+/*************************************************************************/
+
+#ifndef LU_KERNELS_H
+#define LU_KERNELS_H
+
+#define LU_TRSM_BLOCK       8    /* panel width of the blocked solves */
+#define LU_RECURSE_MIN     16    /* widest block lu_getrf() factors directly */
+#define LU_TEAM_MIN        32    /* narrowest half lu_getrf_team() shares */
+
+void lu_kernel_init(void);
+const char *lu_kernel_name(void);
+void lu_gemm(long m, long n, long k, double *a, long lda, double *b,
+             long ldb, double *c, long ldc);
+void lu_trsm_right_upper(double *a, double *u, long lda, long ldu,
+                         long m, long n);
+void lu_trsm_left_lower(double *l, double *c, long ldl, long ldc,
+                        long m, long n);
+void lu_trsm_left_upper(double *u, double *c, long ldu, long ldc,
+                        long m, long n);
+void lu_getrf(double *a, long n, long lda);
+void lu_getrf_team(double *a, long n, long lda, long me, long team,
+                   void (*barrier)(void));
+
+/* Single-precision versions, for mixed-precision factorization */
+void lu_sgemm(long m, long n, long k, float *a, long lda, float *b,
+              long ldb, float *c, long ldc);
+void lu_strsm_right_upper(float *a, float *u, long lda, long ldu,
+                          long m, long n);
+void lu_strsm_left_lower(float *l, float *c, long ldl, long ldc,
+                         long m, long n);
+void lu_sgetrf(float *a, long n, long lda);
+void lu_sgetrf_team(float *a, long n, long lda, long me, long team,
+                    void (*barrier)(void));
+
+#endif
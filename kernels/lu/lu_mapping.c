@@ -0,0 +1,222 @@
+/*************************************************************************/
+/*                                                                       */
+/*  Block-to-processor mappings for the LU engine in lu.c (-m).          */
+/*                                                                       */
+/*  The owner of a block stores it and performs its updates.  The grid   */
+/*  mappings number processors row by row across a Pr x Pc grid, with    */
+/*  Pr the largest divisor of P not above sqrt(P), so that processors    */
+/*  with neighbouring numbers (usually on the same node) share block     */
+/*  rows.  The tiled mapping deals out T x T squares of blocks instead   */
+/*  of single blocks, keeping neighbouring blocks on one processor       */
+/*  while leaving enough tiles per processor for load balance.           */
+/*                                                                       */
+/*  lu_mapping_report() replays the schedule of one factorization and    */
+/*  counts, for every processor, the work it performs and the blocks it  */
+/*  touches that another processor owns.                                 */
+/*                                                                       */
+/*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lu_mapping.h"
+
+#define TILES_PER_PROC      8    /* tiles per grid row or column, at least */
+#define MAX_TILE            4    /* widest tile, in blocks */
+#define max(a,b) ((a) > (b) ? (a) : (b))
+#define min(a,b) ((a) < (b) ? (a) : (b))
+
+static long map = MAP_DIAGONAL;
+static long procs = 1;
+static long nb = 1;
+static long grid_rows = 1;
+static long grid_cols = 1;
+static long tile = 1;
+
+static const char *map_names[] = { "diagonal", "cyclic", "2d", "tiled" };
+
+/* Mapping number for name, or -1 */
+long lu_mapping_parse(const char *name)
+{
+  long i;
+
+  for (i=0; i<(long) (sizeof(map_names)/sizeof(map_names[0])); i++) {
+    if (strcmp(name, map_names[i]) == 0) {
+      return(i);
+    }
+  }
+  return(-1);
+}
+
+void lu_mapping_init(long mapping, long P, long nblocks)
+{
+  map = mapping;
+  procs = P;
+  nb = nblocks;
+
+  grid_rows = 1;
+  grid_cols = P;
+  if ((map == MAP_2D) || (map == MAP_TILED)) {
+    for (grid_rows=1; grid_rows*grid_rows<=P; grid_rows++)
+      ;
+    for (grid_rows--; P%grid_rows != 0; grid_rows--)
+      ;
+    grid_cols = P/grid_rows;
+  }
+
+  tile = 1;
+  if (map == MAP_TILED) {
+    tile = nblocks/(TILES_PER_PROC*max(grid_rows, grid_cols));
+    tile = max(1, min(tile, MAX_TILE));
+  }
+}
+
+void lu_mapping_describe(char *buf, long size)
+{
+  switch (map) {
+  case MAP_DIAGONAL:
+    snprintf(buf, size, "diagonal ((I+J) mod %ld)", procs);
+    break;
+  case MAP_CYCLIC:
+    snprintf(buf, size, "cyclic (J mod %ld)", procs);
+    break;
+  case MAP_2D:
+    snprintf(buf, size, "2d block-cyclic, %ld x %ld grid", grid_rows,
+             grid_cols);
+    break;
+  case MAP_TILED:
+    snprintf(buf, size, "tiled, %ld x %ld blocks per tile, %ld x %ld grid",
+             tile, tile, grid_rows, grid_cols);
+    break;
+  }
+}
+
+long lu_mapping_owner(long I, long J)
+{
+  switch (map) {
+  case MAP_CYCLIC:
+    return(J % procs);
+  case MAP_2D:
+    return((I % grid_rows)*grid_cols + (J % grid_cols));
+  case MAP_TILED:
+    return(((I/tile) % grid_rows)*grid_cols + ((J/tile) % grid_cols));
+  default:
+    return((I + J) % procs);
+  }
+}
+
+struct map_counts {
+  long blocks;
+  long ops;
+  double flops;
+  long remote;
+  double remote_bytes;
+};
+
+static void touch(struct map_counts *c, long p, long I, long J, long n, long bs)
+{
+  long dimi = min(bs, n - I*bs);
+  long dimj = min(bs, n - J*bs);
+
+  if (lu_mapping_owner(I, J) != p) {
+    c[p].remote++;
+    c[p].remote_bytes += (double) dimi*dimj*sizeof(double);
+  }
+}
+
+/*
+ * Count the work and remote block touches of each processor when block
+ * operations of step K are performed by factor(K,K), column(I,K),
+ * row(K,J) and update(I,J).
+ */
+void lu_mapping_report(long n, long bs, long (*factor)(long I, long J),
+                       long (*column)(long I, long J),
+                       long (*row)(long I, long J),
+                       long (*update)(long I, long J), long verbose)
+{
+  struct map_counts *c, tot, mx;
+  long I, J, K, p;
+  double di, dj, dk;
+  char desc[128];
+
+  c = (struct map_counts *) calloc(procs, sizeof(struct map_counts));
+  if (c == NULL) {
+    fprintf(stderr,"Could not malloc memory for mapping statistics.\n");
+    exit(-1);
+  }
+  for (I=0; I<nb; I++) {
+    for (J=0; J<nb; J++) {
+      c[lu_mapping_owner(I, J)].blocks++;
+    }
+  }
+  for (K=0; K<nb; K++) {
+    dk = min(bs, n - K*bs);
+    p = factor(K, K);
+    c[p].ops++;
+    c[p].flops += 2.0*dk*dk*dk/3.0;
+    touch(c, p, K, K, n, bs);
+    for (I=K+1; I<nb; I++) {
+      di = min(bs, n - I*bs);
+      p = column(I, K);
+      c[p].ops++;
+      c[p].flops += di*dk*dk;
+      touch(c, p, I, K, n, bs);
+      touch(c, p, K, K, n, bs);
+      p = row(K, I);
+      c[p].ops++;
+      c[p].flops += dk*dk*di;
+      touch(c, p, K, I, n, bs);
+      touch(c, p, K, K, n, bs);
+    }
+    for (J=K+1; J<nb; J++) {
+      dj = min(bs, n - J*bs);
+      for (I=K+1; I<nb; I++) {
+        di = min(bs, n - I*bs);
+        p = update(I, J);
+        c[p].ops++;
+        c[p].flops += 2.0*di*dj*dk;
+        touch(c, p, I, K, n, bs);
+        touch(c, p, K, J, n, bs);
+        touch(c, p, I, J, n, bs);
+      }
+    }
+  }
+
+  memset(&tot, 0, sizeof(tot));
+  memset(&mx, 0, sizeof(mx));
+  for (p=0; p<procs; p++) {
+    tot.blocks += c[p].blocks;
+    tot.ops += c[p].ops;
+    tot.flops += c[p].flops;
+    tot.remote += c[p].remote;
+    tot.remote_bytes += c[p].remote_bytes;
+    mx.blocks = max(mx.blocks, c[p].blocks);
+    mx.ops = max(mx.ops, c[p].ops);
+    mx.flops = max(mx.flops, c[p].flops);
+    mx.remote = max(mx.remote, c[p].remote);
+    mx.remote_bytes = max(mx.remote_bytes, c[p].remote_bytes);
+  }
+
+  lu_mapping_describe(desc, sizeof(desc));
+  printf("                            MAPPING STATISTICS\n");
+  printf("Mapping: %s\n", desc);
+  printf("                          Block                     Remote        Remote\n");
+  printf(" Proc       Blocks         Ops         Mflop        Touches         MB\n");
+  if (verbose) {
+    for (p=0; p<procs; p++) {
+      printf("  %3ld    %9ld   %9ld   %11.1f    %11ld   %10.1f\n", p,
+             c[p].blocks, c[p].ops, c[p].flops/1e6, c[p].remote,
+             c[p].remote_bytes/1e6);
+    }
+  }
+  printf("  Avg    %9.0f   %9.0f   %11.1f    %11.0f   %10.1f\n",
+         (double) tot.blocks/procs, (double) tot.ops/procs,
+         tot.flops/procs/1e6, (double) tot.remote/procs,
+         tot.remote_bytes/procs/1e6);
+  printf("  Max    %9ld   %9ld   %11.1f    %11ld   %10.1f\n",
+         mx.blocks, mx.ops, mx.flops/1e6, mx.remote, mx.remote_bytes/1e6);
+  printf("Work imbalance (max/avg Mflop)    : %16.3f\n",
+         mx.flops*procs/tot.flops);
+  printf("\n");
+  free(c);
+}
@@ -0,0 +1,26 @@
+/*************************************************************************/
+/*                                                                       */
+/*  Block-to-processor mappings for the LU engine in lu.c (-m).          */
+/*                                                                       */
+/*************************************************************************/
+
+#ifndef LU_MAPPING_H
+#define LU_MAPPING_H
+
+#define MAP_DIAGONAL        0    /* (I+J) mod P, the original mapping */
+#define MAP_CYCLIC          1    /* block columns dealt out cyclically */
+#define MAP_2D              2    /* 2D block-cyclic over a Pr x Pc grid */
+#define MAP_TILED           3    /* 2D cyclic over tiles of T x T blocks */
+
+#define DEFAULT_MAPPING     "diagonal"
+
+long lu_mapping_parse(const char *name);
+void lu_mapping_init(long mapping, long P, long nblocks);
+void lu_mapping_describe(char *buf, long size);
+long lu_mapping_owner(long I, long J);
+void lu_mapping_report(long n, long bs, long (*factor)(long I, long J),
+                       long (*column)(long I, long J),
+                       long (*row)(long I, long J),
+                       long (*update)(long I, long J), long verbose);
+
+#endif
@@ -0,0 +1,100 @@
+/*************************************************************************/
+/*                                                                       */
+/*  Parallel triangular solves with the LU factors, for the engine in    */
+/*  lu.c.                                                                */
+/*                                                                       */
+/*  lu_solve() overwrites the n x k right-hand sides X with the          */
+/*  solution of LU X = X, by block rows of X.  Forward, step K first     */
+/*  solves block row K with the diagonal block of L, its columns split   */
+/*  among all processors, and then subtracts L(I,K) X(K) from every      */
+/*  later block row; the backward solve mirrors this with U.  Each such  */
+/*  update is a matrix multiply over all k columns at once, done by the  */
+/*  processor that owns block I,K of the factors, so the factors are     */
+/*  read where the factorization left them.                              */
+/*                                                                       */
+/*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "lu_kernels.h"
+#include "lu_storage.h"
+#include "lu_solve.h"
+
+static long n;
+static long bs;
+static long nb;
+static long k;
+static long (*owner)(long I, long J);
+static double *x;               /* the right-hand sides, n x k, ld n */
+
+static long dim(long I)
+{
+  if (I == nb-1) {
+    return(n - I*bs);
+  }
+  return(bs);
+}
+
+/*
+ * lu_solve_init() allocates k right-hand sides for the n x n matrix in
+ * bs x bs blocks, owned as owner(I,J) says.  Fill them through
+ * lu_solve_rhs() before calling lu_solve().
+ */
+void lu_solve_init(long size, long block_size, long nrhs,
+                   long (*block_owner)(long I, long J))
+{
+  n = size;
+  bs = block_size;
+  nb = (n + bs - 1)/bs;
+  k = nrhs;
+  owner = block_owner;
+  x = (double *) malloc(n*k*sizeof(double));
+  if (x == NULL) {
+    fprintf(stderr,"Could not malloc memory for the right-hand sides.\n");
+    exit(-1);
+  }
+}
+
+/* The right-hand sides, column-major with leading dimension n */
+double *lu_solve_rhs()
+{
+  return(x);
+}
+
+/*
+ * lu_solve() is called by all P processors; barrier() must synchronize
+ * them.  It returns once the solution is complete.
+ */
+void lu_solve(long MyNum, long P, void (*barrier)(void))
+{
+  long I, K, lo, hi;
+
+  lo = MyNum*k/P;
+  hi = (MyNum+1)*k/P;
+
+  for (K=0; K<nb; K++) {
+    lu_trsm_left_lower(lu_block(K, K), &x[K*bs+lo*n], lu_block_ld(K), n,
+                       dim(K), hi-lo);
+    barrier();
+    for (I=K+1; I<nb; I++) {
+      if (owner(I, K) == MyNum) {
+        lu_gemm(dim(I), k, dim(K), lu_block(I, K), lu_block_ld(I),
+                &x[K*bs], n, &x[I*bs], n);
+      }
+    }
+    barrier();
+  }
+
+  for (K=nb-1; K>=0; K--) {
+    lu_trsm_left_upper(lu_block(K, K), &x[K*bs+lo*n], lu_block_ld(K), n,
+                       dim(K), hi-lo);
+    barrier();
+    for (I=0; I<K; I++) {
+      if (owner(I, K) == MyNum) {
+        lu_gemm(dim(I), k, dim(K), lu_block(I, K), lu_block_ld(I),
+                &x[K*bs], n, &x[I*bs], n);
+      }
+    }
+    barrier();
+  }
+}
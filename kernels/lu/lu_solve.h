@@ -0,0 +1,15 @@
+/*************************************************************************/
+/*                                                                       */
+/*  Parallel triangular solves with the LU factors, for the engine in    */
+/*  lu.c.                                                                */
+/*                                                                       */
+/*************************************************************************/
+
+#ifndef LU_SOLVE_H
+#define LU_SOLVE_H
+
+void lu_solve_init(long n, long bs, long k, long (*owner)(long I, long J));
+double *lu_solve_rhs(void);
+void lu_solve(long MyNum, long P, void (*barrier)(void));
+
+#endif
@@ -0,0 +1,222 @@
+/*************************************************************************/
+/*                                                                       */
+/*  Block storage layouts for the LU engine in lu.c.                     */
+/*                                                                       */
+/*  The engine reaches the matrix only through the start and leading     */
+/*  dimension of each block, so one binary can factor the same matrix    */
+/*  laid out three ways:                                                 */
+/*                                                                       */
+/*  column : one column-major n x n array, as non_contiguous_blocks      */
+/*           always stored it.  A block spans bs pages of a large        */
+/*           matrix, one per column.                                     */
+/*  tiles  : every block contiguous, and the blocks of each processor    */
+/*           together in page-aligned memory of their own, as            */
+/*           contiguous_blocks always stored them.                       */
+/*  morton : every block contiguous, all in one array in the Morton      */
+/*           (Z) order of their block coordinates, so that blocks near   */
+/*           each other in the matrix are near each other in memory.     */
+/*                                                                       */
+/*  A single-precision copy for mixed-precision factorization uses the   */
+/*  same layout.                                                         */
+/*                                                                       */
+/*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lu_storage.h"
+
+#define PAGE_SIZE        4096
+
+static long layout = LAYOUT_TILES;
+static long n = 1;
+static long bs = 1;
+static long nb = 1;
+static long procs = 1;
+static long (*owner)(long I, long J);
+static void **blocks;           /* start of block I,J at blocks[I+J*nb] */
+static void **sblocks;          /* same for the single-precision copy */
+
+static const char *layout_names[] = { "column", "tiles", "morton" };
+
+/* Layout number for name, or -1 */
+long lu_storage_parse(const char *name)
+{
+  long i;
+
+  for (i=0; i<(long) (sizeof(layout_names)/sizeof(layout_names[0])); i++) {
+    if (strcmp(name, layout_names[i]) == 0) {
+      return(i);
+    }
+  }
+  return(-1);
+}
+
+static long dim(long I)
+{
+  if (I == nb-1) {
+    return(n - I*bs);
+  }
+  return(bs);
+}
+
+static char *alloc_pages(long bytes)
+{
+  void *p;
+
+  if (posix_memalign(&p, PAGE_SIZE, bytes + 1) != 0) {
+    fprintf(stderr,"Could not malloc memory for the matrix.\n");
+    exit(-1);
+  }
+  return((char *) p);
+}
+
+/* Block row of Morton code z: the even bits of z */
+static long morton_row(unsigned long z)
+{
+  long r = 0, bit;
+
+  for (bit=0; z != 0; bit++, z >>= 2) {
+    r |= (long) (z & 1) << bit;
+  }
+  return(r);
+}
+
+/* Point table[I+J*nb] at block I,J of new storage of elem-byte elements */
+static void place(void **table, long elem)
+{
+  long I, J, p, side;
+  unsigned long z;
+  long *bytes;
+  char *base, **next;
+
+  switch (layout) {
+  case LAYOUT_COLUMN:
+    base = alloc_pages(n*n*elem);
+    for (J=0; J<nb; J++) {
+      for (I=0; I<nb; I++) {
+        table[I+J*nb] = base + (I*bs + J*bs*n)*elem;
+      }
+    }
+    break;
+
+  case LAYOUT_TILES:
+    /* POSSIBLE ENHANCEMENT:  Here is where one might place the memory
+       of each processor's blocks on the node that processor runs on. */
+    bytes = (long *) calloc(procs, sizeof(long));
+    next = (char **) malloc(procs*sizeof(char *));
+    if ((bytes == NULL) || (next == NULL)) {
+      fprintf(stderr,"Could not malloc memory for block placement.\n");
+      exit(-1);
+    }
+    for (I=0; I<nb; I++) {
+      for (J=0; J<nb; J++) {
+        bytes[owner(I, J)] += dim(I)*dim(J)*elem;
+      }
+    }
+    for (p=0; p<procs; p++) {
+      next[p] = alloc_pages(bytes[p]);
+    }
+    for (I=0; I<nb; I++) {
+      for (J=0; J<nb; J++) {
+        p = owner(I, J);
+        table[I+J*nb] = next[p];
+        next[p] += dim(I)*dim(J)*elem;
+      }
+    }
+    free(bytes);
+    free(next);
+    break;
+
+  case LAYOUT_MORTON:
+    base = alloc_pages(n*n*elem);
+    for (side=1; side<nb; side*=2)
+      ;
+    for (z=0; z<(unsigned long) (side*side); z++) {
+      I = morton_row(z);
+      J = morton_row(z >> 1);
+      if ((I < nb) && (J < nb)) {
+        table[I+J*nb] = base;
+        base += dim(I)*dim(J)*elem;
+      }
+    }
+    break;
+  }
+}
+
+/*
+ * lu_storage_init() allocates the n x n matrix in bs x bs blocks with
+ * the given layout; owner(I,J) says which of the P processors owns
+ * block I,J.
+ */
+void lu_storage_init(long lay, long size, long block_size, long P,
+                     long (*block_owner)(long I, long J))
+{
+  layout = lay;
+  n = size;
+  bs = block_size;
+  procs = P;
+  owner = block_owner;
+  nb = (n + bs - 1)/bs;
+
+  blocks = (void **) malloc(nb*nb*sizeof(void *));
+  if (blocks == NULL) {
+    fprintf(stderr,"Could not malloc memory for the block table.\n");
+    exit(-1);
+  }
+  place(blocks, sizeof(double));
+}
+
+/* Allocate the single-precision copy, in the same layout */
+void lu_storage_single()
+{
+  sblocks = (void **) malloc(nb*nb*sizeof(void *));
+  if (sblocks == NULL) {
+    fprintf(stderr,"Could not malloc memory for the block table.\n");
+    exit(-1);
+  }
+  place(sblocks, sizeof(float));
+}
+
+void lu_storage_describe(char *buf, long size)
+{
+  switch (layout) {
+  case LAYOUT_COLUMN:
+    snprintf(buf, size, "column-major");
+    break;
+  case LAYOUT_TILES:
+    snprintf(buf, size, "contiguous blocks by owner");
+    break;
+  case LAYOUT_MORTON:
+    snprintf(buf, size, "contiguous blocks in Morton order");
+    break;
+  }
+}
+
+double *lu_block(long I, long J)
+{
+  return((double *) blocks[I+J*nb]);
+}
+
+float *lu_sblock(long I, long J)
+{
+  return((float *) sblocks[I+J*nb]);
+}
+
+/* Leading dimension of the blocks in block row I */
+long lu_block_ld(long I)
+{
+  if (layout == LAYOUT_COLUMN) {
+    return(n);
+  }
+  return(dim(I));
+}
+
+/* Element i,j of the matrix */
+double *lu_elem(long i, long j)
+{
+  long I = i/bs;
+  long J = j/bs;
+
+  return(&lu_block(I, J)[(i - I*bs) + (j - J*bs)*lu_block_ld(I)]);
+}
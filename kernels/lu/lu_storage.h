@@ -0,0 +1,24 @@
+/*************************************************************************/
+/*                                                                       */
+/*  Block storage layouts for the LU engine in lu.c.                     */
+/*                                                                       */
+/*************************************************************************/
+
+#ifndef LU_STORAGE_H
+#define LU_STORAGE_H
+
+#define LAYOUT_COLUMN       0    /* one column-major n x n array */
+#define LAYOUT_TILES        1    /* contiguous blocks in their owner's pages */
+#define LAYOUT_MORTON       2    /* contiguous blocks in Morton (Z) order */
+
+long lu_storage_parse(const char *name);
+void lu_storage_init(long layout, long n, long bs, long P,
+                     long (*owner)(long I, long J));
+void lu_storage_single(void);
+void lu_storage_describe(char *buf, long size);
+double *lu_block(long I, long J);
+float *lu_sblock(long I, long J);
+long lu_block_ld(long I);
+double *lu_elem(long i, long j);
+
+#endif
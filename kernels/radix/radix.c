@@ -16,17 +16,35 @@
 
 /*************************************************************************/
 /*                                                                       */
-/*  Integer radix sort of non-negative integers.                         */
+/*  Integer radix sort of non-negative integers.  Floating-point and     */
+/*  composite keys are sorted through order-preserving transforms of     */
+/*  their bit patterns.                                                  */
 /*                                                                       */
 /*  Command line options:                                                */
 /*                                                                       */
 /*  -pP : P = number of processors.                                      */
-/*  -rR : R = radix for sorting.  Must be power of 2.                    */
+/*  -rR : R = radix for sorting.  Must be power of 2.  Radices whose     */
+/*        square is at most FUSE_RADIX are counted two digits per pass.  */
 /*  -nN : N = number of keys to sort.                                    */
 /*  -mM : M = maximum key value.  Integer keys k will be generated such  */
-/*        that 0 <= k <= M.                                              */
+/*        that 0 <= k <= M.  Float, double and pair keys (and each half  */
+/*        of a pair) are generated such that -M <= k < M.                */
+/*  -kK : K = key type: int, float, double or pair (int32,int32).        */
+/*  -DD : D = key distribution: uniform, zipf, sorted, reverse or few    */
+/*        (FEW_UNIQUE distinct values).                                  */
+/*  -eF : External mode: sort the binary key file F.  Keys are bucketed  */
+/*        by their top bits into run files in one parallel pass over     */
+/*        the mapped file, then each bucket is sorted in memory.  A      */
+/*        bucket larger than memory is bucketed again on its next bits,  */
+/*        and one holding a single key value is copied as it is.         */
+/*  -wF : Write the sorted keys to binary file F.                        */
+/*  -gF : Write the generated (unsorted) keys to binary file F.          */
+/*  -dD : D = directory for external mode bucket run files.              */
+/*  -bB : 2^B = number of external mode buckets.                         */
+/*  -MM : M = megabytes of memory for sorting external mode buckets.     */
 /*  -s  : Print individual processor timing statistics.                  */
-/*  -t  : Check to make sure all keys are sorted correctly.              */
+/*  -t  : Check to make sure all keys are sorted correctly, and that     */
+/*        the histogram of zipf and few keys is as it should be.         */
 /*  -o  : Print out sorted keys.                                         */
 /*  -h  : Print out command line options.                                */
 /*                                                                       */
@@ -40,19 +58,45 @@
 #include <math.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
 
 #define DEFAULT_P                    1
 #define DEFAULT_N               262144
 #define DEFAULT_R                 1024 
 #define DEFAULT_M               524288
 #define MAX_PROCESSORS              64    
-#define RADIX_S                8388608.0e0
 #define RADIX           70368744177664.0e0
-#define SEED                 314159265.0e0
-#define RATIO               1220703125.0e0
+#define SEED                 314159265ull
+#define RATIO               1220703125ull
+#define LCG_MASK       ((1ull << 46) - 1)   /* generator works mod 2^46 */
 #define PAGE_SIZE                 4096
 #define PAGE_MASK     (~(PAGE_SIZE-1))
 #define MAX_RADIX                 4096
+#define KEY_INT                      0
+#define KEY_FLOAT                    1
+#define KEY_DOUBLE                   2
+#define KEY_PAIR                     3
+#define XFORM_NONE                   0    /* key bits used as they are */
+#define XFORM_ENCODE                 1    /* raw key -> ordered unsigned */
+#define XFORM_DECODE                 2    /* ordered unsigned -> raw key */
+#define DEFAULT_B                    8
+#define DEFAULT_MEM               1024
+#define MAX_BUCKET_BITS             14
+#define EXT_BUFFER_BYTES         65536    /* per-bucket pwrite buffer */
+#define EXT_BUFFERS                  4    /* in, scratch, write, prefetch */
+#define HIST_WAYS                    4    /* replicated histogram counters */
+#define FUSE_RADIX                1024    /* largest radix made of two digits */
+#define GEN_LANES                    8    /* keys generated side by side */
+#define FEW_UNIQUE                  16    /* values in the few-unique set */
+#define DIST_UNIFORM                 0
+#define DIST_ZIPF                    1
+#define DIST_SORTED                  2
+#define DIST_REVERSE                 3
+#define DIST_FEW                     4
 
 
 
@@ -137,6 +181,7 @@ struct global_private {
 } gp[MAX_PROCESSORS];
 
 int32_t *key[2];            /* sort from one index into the other */
+uint64_t *key64[2];         /* same, for 64-bit key types */
 int32_t **rank_me;          /* individual processor ranks */
 int32_t *key_partition;     /* keys a processor works on */
 int32_t *rank_partition;    /* ranks a processor works on */
@@ -151,18 +196,91 @@ int32_t log2_keys;
 int32_t dostats = 0;
 int32_t test_result = 0;
 int32_t doprint = 0;
+int32_t key_type = KEY_INT;
+int32_t key_dist = DIST_UNIFORM;
+int32_t key_bits = 32;      /* width of the key type in bits */
+char *ext_file = NULL;      /* external mode input file */
+char *out_file = NULL;      /* sorted output file */
+char *gen_file = NULL;      /* generated key output file */
+char *run_dir = ".";        /* directory for bucket run files */
+int32_t bucket_bits = DEFAULT_B;
+int64_t ext_mem = DEFAULT_MEM;
+
+/* External mode state shared by the partitioning processors */
+struct ext_memory {
+   char *map;                  /* mapped input file */
+   int64_t total_keys;
+   int32_t num_buckets;
+   int32_t ext_shift;          /* bucket = ordered key >> ext_shift */
+   int32_t buf_keys;           /* keys per pwrite buffer */
+   int32_t *run_fd;            /* one run file per bucket */
+   int64_t *bucket_fill;       /* keys reserved in each run file */
+   int32_t bad_keys;           /* keys outside the bucket range */
+   int32_t splits;             /* run files too large to sort in memory */
+} ext;
+
+/* Work for the I/O thread that runs alongside each bucket sort */
+struct ext_io {
+   char *write_buf;            /* sorted bucket to write, or NULL */
+   int64_t write_keys;
+   int64_t write_offset;       /* in keys */
+   int32_t out_fd;
+   char *read_buf;             /* next bucket to read, or NULL */
+   int32_t read_bucket;
+};
+
+/* A composite key is ordered by major first, then by minor. */
+typedef struct {
+   int32_t major;
+   int32_t minor;
+} key_pair_t;
 
 void slave_sort(void);
-double product_mod_46(double t1, double t2);
-double ran_num_init(uint32_t k, double b, double t);
+uint64_t lcg_power(uint64_t a, uint64_t k);
 int32_t get_max_digits(int32_t max_key);
 int32_t get_log2_radix(int32_t rad);
 int32_t get_log2_keys(int32_t num_keys);
 int32_t log_2(int32_t number);
 void printerr(const char *s);
 void init(int32_t key_start, int32_t key_stop, int32_t from);
-void test_sort(int32_t final);
+void test_sort(void *keys, int64_t n);
+void test_dist(void *keys, int64_t n);
+double key_part(void *keys, int64_t i, int32_t minor);
+double gen_value(double t);
+int32_t dist_count(int64_t count, int64_t n, double p);
 void printout(void);
+uint32_t encode32(uint32_t u);
+uint32_t decode32(uint32_t u);
+uint64_t encode64(uint64_t u);
+uint64_t decode64(uint64_t u);
+void histogram32(uint32_t *key_from, int32_t key_start, int32_t key_stop,
+                 int32_t shiftnum, int32_t xform, int32_t *rank,
+                 int32_t *counts);
+void histogram64(uint64_t *key_from, int32_t key_start, int32_t key_stop,
+                 int32_t shiftnum, int32_t xform, int32_t *rank,
+                 int32_t *counts);
+void permute32(uint32_t *key_from, uint32_t *key_to, int32_t key_start,
+               int32_t key_stop, int32_t shiftnum, int32_t xform, int32_t *rank);
+void permute64(uint64_t *key_from, uint64_t *key_to, int32_t key_start,
+               int32_t key_stop, int32_t shiftnum, int32_t xform, int32_t *rank);
+double shape_uniform(double u, int64_t i);
+int32_t key_greater(void *keys, int64_t i, int64_t j);
+void print_key(FILE *fp, void *keys, int64_t i);
+void partition_keys(int32_t n);
+void run_processors(void (*proc)(void));
+double seconds(void);
+void read_all(int32_t fd, char *buf, int64_t bytes, int64_t offset);
+void write_all(int32_t fd, char *buf, int64_t bytes, int64_t offset);
+void write_keys(char *name, void *keys, int64_t n);
+void ext_sort(void);
+void ext_partition(void);
+void *ext_io_worker(void *arg);
+uint64_t ext_ordered(char *keys, int64_t i);
+char *ext_sort_keys(char *buf, char *scratch, int64_t n, int32_t shift);
+void ext_copy(int32_t fd, int64_t n, int32_t out_fd, int64_t out_offset,
+              char *buf, int64_t cap);
+void ext_split(int32_t fd, int64_t n, int32_t shift, int32_t out_fd,
+               int64_t out_offset, char *buf, char *scratch, int64_t cap);
 
 int main(int argc, char *argv[])
 {
@@ -196,7 +314,7 @@ int main(int argc, char *argv[])
 
 }
 
-   while ((c = getopt(argc, argv, "p:r:n:m:stoh")) != -1) {
+   while ((c = getopt(argc, argv, "p:r:n:m:k:D:e:w:g:d:b:M:stoh")) != -1) {
      switch(c) {
       case 'p': number_of_processors = atoi(optarg);
                 if (number_of_processors < 1) {
@@ -231,6 +349,54 @@ int main(int argc, char *argv[])
                   exit(-1);
                 }
                 break;
+      case 'k': if (strcmp(optarg, "int") == 0) {
+                  key_type = KEY_INT;
+                } else if (strcmp(optarg, "float") == 0) {
+                  key_type = KEY_FLOAT;
+                } else if (strcmp(optarg, "double") == 0) {
+                  key_type = KEY_DOUBLE;
+                } else if (strcmp(optarg, "pair") == 0) {
+                  key_type = KEY_PAIR;
+                } else {
+                  printerr("Key type must be int, float, double or pair\n");
+                  exit(-1);
+                }
+                break;
+      case 'D': if (strcmp(optarg, "uniform") == 0) {
+                  key_dist = DIST_UNIFORM;
+                } else if (strcmp(optarg, "zipf") == 0) {
+                  key_dist = DIST_ZIPF;
+                } else if (strcmp(optarg, "sorted") == 0) {
+                  key_dist = DIST_SORTED;
+                } else if (strcmp(optarg, "reverse") == 0) {
+                  key_dist = DIST_REVERSE;
+                } else if (strcmp(optarg, "few") == 0) {
+                  key_dist = DIST_FEW;
+                } else {
+                  printerr("Distribution must be uniform, zipf, sorted, reverse or few\n");
+                  exit(-1);
+                }
+                break;
+      case 'e': ext_file = optarg;
+                break;
+      case 'w': out_file = optarg;
+                break;
+      case 'g': gen_file = optarg;
+                break;
+      case 'd': run_dir = optarg;
+                break;
+      case 'b': bucket_bits = atoi(optarg);
+                if ((bucket_bits < 1) || (bucket_bits > MAX_BUCKET_BITS)) {
+                  printerr("Bucket bits must be between 1 and MAX_BUCKET_BITS\n");
+                  exit(-1);
+                }
+                break;
+      case 'M': ext_mem = atol(optarg);
+                if (ext_mem < 1) {
+                  printerr("Bucket sort memory must be >= 1 MB\n");
+                  exit(-1);
+                }
+                break;
       case 's': dostats = !dostats;
                 break;
       case 't': test_result = !test_result;
@@ -239,16 +405,28 @@ int main(int argc, char *argv[])
                 break;
       case 'h': printf("Usage: RADIX <options>\n\n");
                 printf("   -pP : P = number of processors.\n");
-                printf("   -rR : R = radix for sorting.  Must be power of 2.\n");
+                printf("   -rR : R = radix for sorting.  Must be power of 2.  Radices whose\n");
+                printf("         square is at most %d are counted two digits per pass.\n",FUSE_RADIX);
                 printf("   -nN : N = number of keys to sort.\n");
                 printf("   -mM : M = maximum key value.  Integer keys k will be generated such\n");
-                printf("         that 0 <= k <= M.\n");
+                printf("         that 0 <= k <= M.  Float, double and pair keys (and each\n");
+                printf("         half of a pair) are generated such that -M <= k < M.\n");
+                printf("   -kK : K = key type: int, float, double or pair (int32,int32).\n");
+                printf("   -DD : D = key distribution: uniform, zipf, sorted, reverse or few\n");
+                printf("         (%d distinct values).\n",FEW_UNIQUE);
+                printf("   -eF : External mode: sort the binary key file F.\n");
+                printf("   -wF : Write the sorted keys to binary file F.\n");
+                printf("   -gF : Write the generated (unsorted) keys to binary file F.\n");
+                printf("   -dD : D = directory for external mode bucket run files.\n");
+                printf("   -bB : 2^B = number of external mode buckets.\n");
+                printf("   -MM : M = megabytes of memory for sorting external mode buckets.\n");
                 printf("   -s  : Print individual processor timing statistics.\n");
-                printf("   -t  : Check to make sure all keys are sorted correctly.\n");
+                printf("   -t  : Check to make sure all keys are sorted correctly, and that\n");
+                printf("         the histogram of zipf and few keys is as it should be.\n");
                 printf("   -o  : Print out sorted keys.\n");
                 printf("   -h  : Print out command line options.\n\n");
-                printf("Default: RADIX -p%1d -n%1d -r%1d -m%1d\n",
-                        DEFAULT_P,DEFAULT_N,DEFAULT_R,DEFAULT_M);
+                printf("Default: RADIX -p%1d -n%1d -r%1d -m%1d -b%1d -M%1d\n",
+                        DEFAULT_P,DEFAULT_N,DEFAULT_R,DEFAULT_M,DEFAULT_B,DEFAULT_MEM);
 		exit(0);
      }
    }
@@ -257,13 +435,34 @@ int main(int argc, char *argv[])
 
    log2_radix = log_2(radix); 
    log2_keys = log_2(num_keys);
+
+   /* A small radix leaves the histograms mostly idle, so sort two of
+      its digits per pass; this halves the passes over the keys. */
+   if (radix * radix <= FUSE_RADIX) {
+     printf("Radix %d: counting two digits per pass (radix %d)\n",
+            radix, radix * radix);
+     radix = radix * radix;
+     log2_radix = 2 * log2_radix;
+   }
    global = (struct global_memory *) malloc(sizeof(struct global_memory));
    if (global == NULL) {
 	   fprintf(stderr,"ERROR: Cannot malloc enough memory for global\n");
 	   exit(-1);
    }
-   key[0] = (int32_t *) malloc(num_keys*sizeof(int32_t));
-   key[1] = (int32_t *) malloc(num_keys*sizeof(int32_t));
+   if ((key_type == KEY_DOUBLE) || (key_type == KEY_PAIR)) {
+     key_bits = 64;
+   }
+   if (ext_file != NULL) {
+     /* bucket buffers are allocated by ext_sort() */
+   } else if (key_bits == 64) {
+     key64[0] = (uint64_t *) malloc(num_keys*sizeof(uint64_t));
+     key64[1] = (uint64_t *) malloc(num_keys*sizeof(uint64_t));
+     key[0] = (int32_t *) key64[0];
+     key[1] = (int32_t *) key64[1];
+   } else {
+     key[0] = (int32_t *) malloc(num_keys*sizeof(int32_t));
+     key[1] = (int32_t *) malloc(num_keys*sizeof(int32_t));
+   }
    key_partition = (int32_t *) malloc((number_of_processors+1)*sizeof(int32_t));
    rank_partition = (int32_t *) malloc((number_of_processors+1)*sizeof(int32_t));
    global->ranktime = (double *) malloc(number_of_processors*sizeof(double));
@@ -271,7 +470,7 @@ int main(int argc, char *argv[])
    global->totaltime = (double *) malloc(number_of_processors*sizeof(double));
    size = number_of_processors*(radix*sizeof(int32_t)+sizeof(int32_t *));
    rank_me = (int32_t **) malloc(size);
-   if ((key[0] == NULL) || (key[1] == NULL) || (key_partition == NULL) || (rank_partition == NULL) || 
+   if ((((key[0] == NULL) || (key[1] == NULL)) && (ext_file == NULL)) || (key_partition == NULL) || (rank_partition == NULL) || 
        (global->ranktime == NULL) || (global->sorttime == NULL) || (global->totaltime == NULL) || (rank_me == NULL)) {
      fprintf(stderr,"ERROR: Cannot malloc enough memory\n");
      exit(-1); 
@@ -385,29 +584,28 @@ int main(int argc, char *argv[])
    }
 
    global->Index = 0;
-   max_num_digits = get_max_digits(max_key);
+   if (key_type == KEY_INT) {
+     max_num_digits = get_max_digits(max_key);
+   } else {
+     /* Transformed keys use every bit, so sort on all of them. */
+     max_num_digits = (key_bits + log2_radix - 1) / log2_radix;
+   }
    printf("\n");
    printf("Integer Radix Sort\n");
    printf("     %d Keys\n",num_keys);
+   printf("     Key type = %s\n",(key_type == KEY_INT) ? "int" :
+                                  (key_type == KEY_FLOAT) ? "float" :
+                                  (key_type == KEY_DOUBLE) ? "double" : "pair");
+   printf("     Distribution = %s\n",(key_dist == DIST_UNIFORM) ? "uniform" :
+                                      (key_dist == DIST_ZIPF) ? "zipf" :
+                                      (key_dist == DIST_SORTED) ? "sorted" :
+                                      (key_dist == DIST_REVERSE) ? "reverse" : "few");
    printf("     %d Processors\n",number_of_processors);
    printf("     Radix = %d\n",radix);
    printf("     Max key = %d\n",max_key);
    printf("\n");
 
-   quotient = num_keys / number_of_processors;
-   remainder = num_keys % number_of_processors;
-   sum_i = 0;
-   sum_f = 0;
-   p = 0;
-   while (sum_i < num_keys) {
-      key_partition[p] = sum_i;
-      p++;
-      sum_i = sum_i + quotient;
-      sum_f = sum_f + remainder;
-      sum_i = sum_i + sum_f / number_of_processors;
-      sum_f = sum_f % number_of_processors;
-   }
-   key_partition[p] = num_keys;
+   partition_keys(num_keys);
 
    quotient = radix / number_of_processors;
    remainder = radix % number_of_processors;
@@ -424,6 +622,11 @@ int main(int argc, char *argv[])
    }
    rank_partition[p] = radix;
 
+   if (ext_file != NULL) {
+     ext_sort();
+     exit(0);
+   }
+
 /* POSSIBLE ENHANCEMENT:  Here is where one might distribute the key,
    rank_me, rank, and gp data structures across physically 
    distributed memories as desired. 
@@ -459,38 +662,8 @@ int main(int argc, char *argv[])
    }  */
 
    /* Fill the random-number array. */
-   
-	for (i = 0; i < (number_of_processors) - 1; i++) {
-
-		Error = pthread_create(&PThreadTable[i], NULL, (void * (*)(void *))(slave_sort), NULL);
-
-		if (Error != 0) {
-
-			printf("Error in pthread_create().\n");
-
-			exit(-1);
-
-		}
-
-	}
-
-
-
-	slave_sort();
-
-	for (i = 0; i < (number_of_processors) - 1; i++) {
-
-		Error = pthread_join(PThreadTable[i], NULL);
-
-		if (Error != 0) {
-
-			printf("Error in pthread_join().\n");
 
-			exit(-1);
-
-		}
-
-	}
+   run_processors(slave_sort);
 
    printf("\n");
    printf("                 PROCESS STATISTICS\n");
@@ -559,7 +732,11 @@ int main(int argc, char *argv[])
      printout();
    }
    if (test_result) {
-     test_sort(global->final);  
+     test_sort(key[global->final], num_keys);
+     test_dist(key[global->final], num_keys);
+   }
+   if (out_file != NULL) {
+     write_keys(out_file, key[global->final], num_keys);
    }
   
    {exit(0);};
@@ -569,12 +746,10 @@ void slave_sort()
 {
    int32_t i;
    int32_t MyNum;
-   int32_t this_key;
-   int32_t tmp;
    int32_t loopnum;
    int32_t shiftnum;
-   int32_t bb;
-   int32_t my_key;
+   int32_t xform_in;
+   int32_t xform_out;
    int32_t key_start;
    int32_t key_stop;
    int32_t rank_start;
@@ -582,6 +757,7 @@ void slave_sort()
    int32_t from=0;
    int32_t to=1;
    int32_t *key_density;       /* individual processor key densities */
+   int32_t *hist_counts;       /* replicated histogram counters */
    uint32_t time1;
    uint32_t time2;
    uint32_t time3;
@@ -619,6 +795,7 @@ void slave_sort()
    processors to avoid migration */
 
    key_density = (int32_t *) malloc(radix*sizeof(int32_t));
+   hist_counts = (int32_t *) malloc(HIST_WAYS*radix*sizeof(int32_t));
 
    /* Fill the random-number array. */
 
@@ -635,7 +812,9 @@ void slave_sort()
      rank_stop--;
    }
 
-   init(key_start,key_stop,from);
+   if (ext_file == NULL) {
+     init(key_start,key_stop,from);
+   }
 
    {
 
@@ -693,6 +872,10 @@ void slave_sort()
 
 } 
 
+   if ((MyNum == 0) && (gen_file != NULL)) {
+     write_keys(gen_file, key[from], num_keys);
+   }
+
 /* POSSIBLE ENHANCEMENT:  Here is where one might reset the
    statistics that one is measuring about the parallel execution */
 
@@ -772,7 +955,20 @@ void slave_sort()
    rank_ff_mynum = gp[MyNum].rank_ff;
    for (loopnum=0;loopnum<max_num_digits;loopnum++) {
      shiftnum = (loopnum * log2_radix);
-     bb = (radix-1) << shiftnum;
+
+/* Non-integer keys are transformed while the first digit is counted and
+   moved, and transformed back while the last digit is moved. */
+
+     xform_in = XFORM_NONE;
+     xform_out = XFORM_NONE;
+     if (key_type != KEY_INT) {
+       if (loopnum == 0) {
+         xform_in = XFORM_ENCODE;
+       }
+       if (loopnum == max_num_digits-1) {
+         xform_out = XFORM_DECODE;
+       }
+     }
 
 /* generate histograms based on one digit */
 
@@ -795,10 +991,12 @@ void slave_sort()
      }  
      key_from = (int32_t *) key[from];
      key_to = (int32_t *) key[to];
-     for (i=key_start;i<key_stop;i++) {
-       my_key = key_from[i] & bb;
-       my_key = my_key >> shiftnum;  
-       rank_me_mynum[my_key]++;
+     if (key_bits == 64) {
+       histogram64(key64[from],key_start,key_stop,shiftnum,xform_in,
+                   rank_me_mynum,hist_counts);
+     } else {
+       histogram32((uint32_t *) key_from,key_start,key_stop,shiftnum,
+                   xform_in,rank_me_mynum,hist_counts);
      }
      key_density[0] = rank_me_mynum[0]; 
      for (i=1;i<radix;i++) {
@@ -1159,13 +1357,13 @@ void slave_sort()
 
      /* put it in order according to this digit */
 
-     for (i = key_start; i < key_stop; i++) {  
-       this_key = key_from[i] & bb;
-       this_key = this_key >> shiftnum;  
-       tmp = rank_ff_mynum[this_key];
-       key_to[tmp] = key_from[i];
-       rank_ff_mynum[this_key]++;
-     }   /*  i */  
+     if (key_bits == 64) {
+       permute64(key64[from],key64[to],key_start,key_stop,shiftnum,
+                 xform_in | xform_out,rank_ff_mynum);
+     } else {
+       permute32((uint32_t *) key_from,(uint32_t *) key_to,key_start,
+                 key_stop,shiftnum,xform_in | xform_out,rank_ff_mynum);
+     }
 
      if ((MyNum == 0) || (stats)) {
        {
@@ -1326,49 +1524,239 @@ void slave_sort()
    }
 
    free(key_density);
+   free(hist_counts);
+}
+
+/*
+ * lcg_power() returns a^k (mod 2^46).  The generator's kth number is
+ * SEED * RATIO^k (mod 2^46), so any thread can skip ahead to its keys.
+ */
+uint64_t lcg_power(uint64_t a, uint64_t k)
+{
+   uint64_t b = 1;
+
+   while (k != 0) {
+      if (k & 1) {
+         b = (b * a) & LCG_MASK;
+      }
+      a = (a * a) & LCG_MASK;
+      k >>= 1;
+   }
+
+   return b;
 }
 
 /*
- * product_mod_46() returns the product (mod 2^46) of t1 and t2.
+ * encode32() maps the bits of a float onto an unsigned integer with the
+ * same ordering: negative values have all bits flipped, non-negative
+ * values only the sign bit.  decode32() undoes the mapping.
  */
-double product_mod_46(double t1, double t2)
+uint32_t encode32(uint32_t u)
 {
-   double a1;
-   double b1;
-   double a2;
-   double b2;
-			
-   a1 = (double)((int32_t)(t1 / RADIX_S));    /* Decompose the arguments.  */
-   a2 = t1 - a1 * RADIX_S;
-   b1 = (double)((int32_t)(t2 / RADIX_S));
-   b2 = t2 - b1 * RADIX_S;
-   t1 = a1 * b2 + a2 * b1;      /* Multiply the arguments.  */
-   t2 = (double)((int32_t)(t1 / RADIX_S));
-   t2 = t1 - t2 * RADIX_S;
-   t1 = t2 * RADIX_S + a2 * b2;
-   t2 = (double)((int32_t)(t1 / RADIX));
-
-   return (t1 - t2 * RADIX);    /* Return the product.  */
+   return u ^ ((uint32_t) (-(int32_t) (u >> 31)) | 0x80000000u);
+}
+
+uint32_t decode32(uint32_t u)
+{
+   return u ^ (((u >> 31) - 1) | 0x80000000u);
 }
 
 /*
- * finds the (k)th random number, given the seed, b, and the ratio, t.
+ * encode64() does the same for doubles.  A pair is concatenated into
+ * major:minor with the sign bit of each half flipped, so unsigned order
+ * is lexicographic signed order.  decode64() undoes the mapping.
  */
-double ran_num_init(uint32_t k, double b, double t)
+uint64_t encode64(uint64_t u)
 {
-   uint32_t j;
+   key_pair_t pair;
 
-   while (k != 0) {             /* while() is executed m times
-				   such that 2^m > k.  */
-      j = k >> 1;
-      if ((j << 1) != k) {
-         b = product_mod_46(b, t);
-      }
-      t = product_mod_46(t, t);
-      k = j;
+   if (key_type == KEY_DOUBLE) {
+     return u ^ ((uint64_t) (-(int64_t) (u >> 63)) | 0x8000000000000000ull);
    }
+   memcpy(&pair, &u, sizeof(pair));
+   return ((uint64_t) ((uint32_t) pair.major ^ 0x80000000u) << 32) |
+          ((uint32_t) pair.minor ^ 0x80000000u);
+}
 
-   return b;
+uint64_t decode64(uint64_t u)
+{
+   key_pair_t pair;
+
+   if (key_type == KEY_DOUBLE) {
+     return u ^ (((u >> 63) - 1) | 0x8000000000000000ull);
+   }
+   pair.major = (int32_t) ((uint32_t) (u >> 32) ^ 0x80000000u);
+   pair.minor = (int32_t) ((uint32_t) u ^ 0x80000000u);
+   memcpy(&u, &pair, sizeof(pair));
+   return u;
+}
+
+/*
+ * histogram32() adds the count of the digit at shiftnum of keys
+ * key_start through key_stop-1 into rank.  With XFORM_ENCODE the keys
+ * are still raw and are transformed before the digit is taken.
+ *
+ * Keys are counted four at a time into HIST_WAYS interleaved copies of
+ * the histogram in counts, merged at the end, so that a run of equal
+ * digits does not serialize on one counter's store-to-load forwarding.
+ */
+void histogram32(uint32_t *key_from, int32_t key_start, int32_t key_stop,
+                 int32_t shiftnum, int32_t xform, int32_t *rank,
+                 int32_t *counts)
+{
+   int32_t i;
+   uint32_t mask = (uint32_t) (radix - 1);
+   uint32_t k0, k1, k2, k3;
+   int32_t *c0 = counts;
+   int32_t *c1 = counts + radix;
+   int32_t *c2 = counts + 2 * radix;
+   int32_t *c3 = counts + 3 * radix;
+
+   memset(counts, 0, HIST_WAYS * radix * sizeof(int32_t));
+   for (i = key_start; i + 3 < key_stop; i += 4) {
+     k0 = key_from[i];
+     k1 = key_from[i + 1];
+     k2 = key_from[i + 2];
+     k3 = key_from[i + 3];
+     if (xform & XFORM_ENCODE) {
+       k0 = encode32(k0);
+       k1 = encode32(k1);
+       k2 = encode32(k2);
+       k3 = encode32(k3);
+     }
+     c0[(k0 >> shiftnum) & mask]++;
+     c1[(k1 >> shiftnum) & mask]++;
+     c2[(k2 >> shiftnum) & mask]++;
+     c3[(k3 >> shiftnum) & mask]++;
+   }
+   for (; i < key_stop; i++) {
+     k0 = key_from[i];
+     if (xform & XFORM_ENCODE) {
+       k0 = encode32(k0);
+     }
+     c0[(k0 >> shiftnum) & mask]++;
+   }
+   for (i = 0; i < radix; i++) {
+     rank[i] += c0[i] + c1[i] + c2[i] + c3[i];
+   }
+}
+
+void histogram64(uint64_t *key_from, int32_t key_start, int32_t key_stop,
+                 int32_t shiftnum, int32_t xform, int32_t *rank,
+                 int32_t *counts)
+{
+   int32_t i;
+   uint64_t mask = (uint64_t) (radix - 1);
+   uint64_t k0, k1, k2, k3;
+   int32_t *c0 = counts;
+   int32_t *c1 = counts + radix;
+   int32_t *c2 = counts + 2 * radix;
+   int32_t *c3 = counts + 3 * radix;
+
+   memset(counts, 0, HIST_WAYS * radix * sizeof(int32_t));
+   for (i = key_start; i + 3 < key_stop; i += 4) {
+     k0 = key_from[i];
+     k1 = key_from[i + 1];
+     k2 = key_from[i + 2];
+     k3 = key_from[i + 3];
+     if (xform & XFORM_ENCODE) {
+       k0 = encode64(k0);
+       k1 = encode64(k1);
+       k2 = encode64(k2);
+       k3 = encode64(k3);
+     }
+     c0[(k0 >> shiftnum) & mask]++;
+     c1[(k1 >> shiftnum) & mask]++;
+     c2[(k2 >> shiftnum) & mask]++;
+     c3[(k3 >> shiftnum) & mask]++;
+   }
+   for (; i < key_stop; i++) {
+     k0 = key_from[i];
+     if (xform & XFORM_ENCODE) {
+       k0 = encode64(k0);
+     }
+     c0[(k0 >> shiftnum) & mask]++;
+   }
+   for (i = 0; i < radix; i++) {
+     rank[i] += c0[i] + c1[i] + c2[i] + c3[i];
+   }
+}
+
+/*
+ * permute32() moves keys key_start through key_stop-1 to the positions
+ * given by rank for the digit at shiftnum.  XFORM_ENCODE transforms raw
+ * keys on the way in, XFORM_DECODE restores them on the way out; with
+ * both set the digit comes from the transformed key and the raw key is
+ * stored.
+ */
+void permute32(uint32_t *key_from, uint32_t *key_to, int32_t key_start,
+               int32_t key_stop, int32_t shiftnum, int32_t xform, int32_t *rank)
+{
+   int32_t i;
+   uint32_t this_key;
+   uint32_t mask = (uint32_t) (radix - 1);
+
+   switch (xform) {
+     case XFORM_ENCODE:
+       for (i = key_start; i < key_stop; i++) {
+         this_key = encode32(key_from[i]);
+         key_to[rank[(this_key >> shiftnum) & mask]++] = this_key;
+       }
+       break;
+     case XFORM_DECODE:
+       for (i = key_start; i < key_stop; i++) {
+         this_key = key_from[i];
+         key_to[rank[(this_key >> shiftnum) & mask]++] = decode32(this_key);
+       }
+       break;
+     case XFORM_ENCODE | XFORM_DECODE:
+       for (i = key_start; i < key_stop; i++) {
+         this_key = encode32(key_from[i]);
+         key_to[rank[(this_key >> shiftnum) & mask]++] = key_from[i];
+       }
+       break;
+     default:
+       for (i = key_start; i < key_stop; i++) {
+         this_key = key_from[i];
+         key_to[rank[(this_key >> shiftnum) & mask]++] = this_key;
+       }
+       break;
+   }
+}
+
+void permute64(uint64_t *key_from, uint64_t *key_to, int32_t key_start,
+               int32_t key_stop, int32_t shiftnum, int32_t xform, int32_t *rank)
+{
+   int32_t i;
+   uint64_t this_key;
+   uint64_t mask = (uint64_t) (radix - 1);
+
+   switch (xform) {
+     case XFORM_ENCODE:
+       for (i = key_start; i < key_stop; i++) {
+         this_key = encode64(key_from[i]);
+         key_to[rank[(this_key >> shiftnum) & mask]++] = this_key;
+       }
+       break;
+     case XFORM_DECODE:
+       for (i = key_start; i < key_stop; i++) {
+         this_key = key_from[i];
+         key_to[rank[(this_key >> shiftnum) & mask]++] = decode64(this_key);
+       }
+       break;
+     case XFORM_ENCODE | XFORM_DECODE:
+       for (i = key_start; i < key_stop; i++) {
+         this_key = encode64(key_from[i]);
+         key_to[rank[(this_key >> shiftnum) & mask]++] = key_from[i];
+       }
+       break;
+     default:
+       for (i = key_start; i < key_stop; i++) {
+         this_key = key_from[i];
+         key_to[rank[(this_key >> shiftnum) & mask]++] = this_key;
+       }
+       break;
+   }
 }
 
 int32_t get_max_digits(int32_t max_key)
@@ -1411,67 +1799,343 @@ void printerr(const char *s)
   fprintf(stderr,"ERROR: %s\n",s);
 }
 
+/*
+ * shape_uniform() turns u, a uniform value in [0,1) drawn for key i,
+ * into a value in [0,1) following the selected distribution.
+ */
+double shape_uniform(double u, int64_t i)
+{
+   switch (key_dist) {
+     case DIST_ZIPF:
+       /* continuous Zipf (s = 1) over max_key+1 values */
+       return (pow((double) max_key + 1.0, u) - 1.0) / ((double) max_key + 1.0);
+     case DIST_SORTED:
+       return (double) i / num_keys;
+     case DIST_REVERSE:
+       return (double) (num_keys - 1 - i) / num_keys;
+     case DIST_FEW:
+       return floor(u * FEW_UNIQUE) / FEW_UNIQUE;
+     default:
+       return u;
+   }
+}
+
+/*
+ * init() generates keys key_start through key_stop-1.  Key i takes four
+ * consecutive numbers of the generator (two groups of four for a pair),
+ * starting from number 4*i+1, so the keys do not depend on the number
+ * of processors.  Uniform keys average the four, as they always have;
+ * the other distributions shape the first of them alone, since the
+ * average is not uniform.  GEN_LANES keys are generated side by side in
+ * exact integer arithmetic, each lane stepping over the numbers of the
+ * other lanes' keys.
+ */
 void init(int32_t key_start, int32_t key_stop, int32_t from)
 {
-   double ran_num;
-   double sum;
-   //int32_t tmp;
    int32_t i;
+   int32_t j;
+   int32_t n;
+   int32_t draws;
+   uint64_t a[8];
+   uint64_t stride;
+   uint64_t x[GEN_LANES];
+   double u[GEN_LANES];
+   double v[GEN_LANES];
    int32_t *key_from;
+   float *float_from;
+   double *double_from;
+   key_pair_t *pair_from;
+
+   draws = (key_type == KEY_PAIR) ? 8 : 4;
+   a[0] = 1;
+   for (j = 1; j < 8; j++) {
+     a[j] = (a[j - 1] * RATIO) & LCG_MASK;
+   }
+   stride = lcg_power(RATIO, (uint64_t) draws * GEN_LANES);
+   for (j = 0; j < GEN_LANES; j++) {
+     x[j] = (SEED * lcg_power(RATIO, (uint64_t) draws * (key_start + j) + 1)) & LCG_MASK;
+   }
 
-   ran_num = ran_num_init((key_start << 2) + 1, SEED, RATIO);
-   sum = ran_num / RADIX;
    key_from = (int32_t *) key[from];
-   for (i = key_start; i < key_stop; i++) {
-      ran_num = product_mod_46(ran_num, RATIO);
-      sum = sum + ran_num / RADIX;
-      ran_num = product_mod_46(ran_num, RATIO);
-      sum = sum + ran_num / RADIX;
-      ran_num = product_mod_46(ran_num, RATIO);
-      sum = sum + ran_num / RADIX;
-      key_from[i] = (int32_t) ((sum / 4.0) *  max_key);
-      //tmp = (int32_t) ((key_from[i])/100);
-      ran_num = product_mod_46(ran_num, RATIO);
-      sum = ran_num / RADIX;
+   float_from = (float *) key[from];
+   double_from = (double *) key64[from];
+   pair_from = (key_pair_t *) key64[from];
+   for (i = key_start; i < key_stop; i += GEN_LANES) {
+     n = key_stop - i;
+     if (n > GEN_LANES) {
+       n = GEN_LANES;
+     }
+     for (j = 0; j < GEN_LANES; j++) {
+       if (key_dist != DIST_UNIFORM) {
+         u[j] = shape_uniform((double) x[j] / RADIX, i + j);
+         v[j] = shape_uniform((double) ((x[j] * a[4]) & LCG_MASK) / RADIX, i + j);
+         x[j] = (x[j] * stride) & LCG_MASK;
+         continue;
+       }
+       u[j] = ((((double) x[j] / RADIX +
+                 (double) ((x[j] * a[1]) & LCG_MASK) / RADIX) +
+                 (double) ((x[j] * a[2]) & LCG_MASK) / RADIX) +
+                 (double) ((x[j] * a[3]) & LCG_MASK) / RADIX) / 4.0;
+       v[j] = ((((double) ((x[j] * a[4]) & LCG_MASK) / RADIX +
+                 (double) ((x[j] * a[5]) & LCG_MASK) / RADIX) +
+                 (double) ((x[j] * a[6]) & LCG_MASK) / RADIX) +
+                 (double) ((x[j] * a[7]) & LCG_MASK) / RADIX) / 4.0;
+       x[j] = (x[j] * stride) & LCG_MASK;
+     }
+     switch (key_type) {
+       case KEY_FLOAT:
+         for (j = 0; j < n; j++) {
+           float_from[i + j] = (float) ((2.0 * u[j] - 1.0) * max_key);
+         }
+         break;
+       case KEY_DOUBLE:
+         for (j = 0; j < n; j++) {
+           double_from[i + j] = (2.0 * u[j] - 1.0) * max_key;
+         }
+         break;
+       case KEY_PAIR:
+         for (j = 0; j < n; j++) {
+           pair_from[i + j].major = (int32_t) floor((2.0 * u[j] - 1.0) * max_key);
+           pair_from[i + j].minor = (int32_t) floor((2.0 * v[j] - 1.0) * max_key);
+         }
+         break;
+       default:
+         for (j = 0; j < n; j++) {
+           key_from[i + j] = (int32_t) (u[j] * max_key);
+         }
+         break;
+     }
    }
 }
 
-void test_sort(int32_t final)
+/*
+ * key_greater() compares keys i and j of the array keys in the order
+ * of the key type.
+ */
+int32_t key_greater(void *keys, int64_t i, int64_t j)
 {
-   int32_t i;
-   int32_t mistake = 0;
-   int32_t *key_final;
+   float *f;
+   double *d;
+   key_pair_t *p;
+   int32_t *k;
+
+   switch (key_type) {
+     case KEY_FLOAT:
+       f = (float *) keys;
+       return f[i] > f[j];
+     case KEY_DOUBLE:
+       d = (double *) keys;
+       return d[i] > d[j];
+     case KEY_PAIR:
+       p = (key_pair_t *) keys;
+       return (p[i].major > p[j].major) ||
+              ((p[i].major == p[j].major) && (p[i].minor > p[j].minor));
+     default:
+       k = (int32_t *) keys;
+       return k[i] > k[j];
+   }
+}
+
+void print_key(FILE *fp, void *keys, int64_t i)
+{
+   switch (key_type) {
+     case KEY_FLOAT:
+       fprintf(fp,"%12g ",((float *) keys)[i]);
+       break;
+     case KEY_DOUBLE:
+       fprintf(fp,"%12g ",((double *) keys)[i]);
+       break;
+     case KEY_PAIR:
+       fprintf(fp,"(%d,%d) ",((key_pair_t *) keys)[i].major,
+               ((key_pair_t *) keys)[i].minor);
+       break;
+     default:
+       fprintf(fp,"%8d ",((int32_t *) keys)[i]);
+       break;
+   }
+}
+
+void test_sort(void *keys, int64_t n)
+{
+   int64_t i;
+   int64_t mistake = 0;
 
    printf("\n");
    printf("                  TESTING RESULTS\n");
-   key_final = key[final];
-   for (i = 0; i < num_keys-1; i++) {
-     if (key_final[i] > key_final[i + 1]) {
-       fprintf(stderr,"error with key %d, value %d %d \n",
-        i,key_final[i],key_final[i + 1]);
+   for (i = 0; i < n-1; i++) {
+     if (key_greater(keys, i, i + 1)) {
+       fprintf(stderr,"error with key %ld, value ",(long) i);
+       print_key(stderr, keys, i);
+       print_key(stderr, keys, i + 1);
+       fprintf(stderr,"\n");
        mistake++;
      }
    }
 
    if (mistake) {
-      printf("FAILED: %d keys out of place.\n", mistake);
+      printf("FAILED: %ld keys out of place.\n", (long) mistake);
    } else {
       printf("PASSED: All keys in place.\n");
    }
    printf("\n");
 }
 
+/*
+ * key_part() is key i of keys as a double, or the minor half of a pair
+ * key if minor is set.  gen_value() is the value init() makes of the
+ * shaped value t.
+ */
+double key_part(void *keys, int64_t i, int32_t minor)
+{
+   switch (key_type) {
+     case KEY_FLOAT:
+       return ((float *) keys)[i];
+     case KEY_DOUBLE:
+       return ((double *) keys)[i];
+     case KEY_PAIR:
+       return minor ? ((key_pair_t *) keys)[i].minor :
+                      ((key_pair_t *) keys)[i].major;
+     default:
+       return ((int32_t *) keys)[i];
+   }
+}
+
+double gen_value(double t)
+{
+   switch (key_type) {
+     case KEY_FLOAT:
+       return (float) ((2.0 * t - 1.0) * max_key);
+     case KEY_DOUBLE:
+       return (2.0 * t - 1.0) * max_key;
+     case KEY_PAIR:
+       return (int32_t) floor((2.0 * t - 1.0) * max_key);
+     default:
+       return (int32_t) (t * max_key);
+   }
+}
+
+/*
+ * dist_count() checks that count of n keys is within five standard
+ * deviations (and a little rounding) of the expected fraction p.
+ */
+int32_t dist_count(int64_t count, int64_t n, double p)
+{
+   double sigma = sqrt(n * p * (1.0 - p));
+
+   if (fabs(count - n * p) <= 5.0 * sigma + 0.001 * n) {
+     return 0;
+   }
+   fprintf(stderr,"error in key histogram: %ld keys where %.1f were expected\n",
+           (long) count, n * p);
+   return 1;
+}
+
+/*
+ * test_dist() checks the histogram of the generated keys against the
+ * zipf and few distributions: the fraction below each of a few
+ * thresholds for zipf, and the count of each of the few values.  Both
+ * halves of a pair are checked.
+ */
+void test_dist(void *keys, int64_t n)
+{
+   int32_t c;
+   int32_t j;
+   int32_t half;
+   int32_t distinct;
+   int32_t mistake = 0;
+   int32_t mult[FEW_UNIQUE];
+   int64_t i;
+   int64_t below;
+   int64_t count[FEW_UNIQUE];
+   double value[FEW_UNIQUE];
+   double x;
+   double t;
+   double k;
+   double cut;
+
+   if ((key_dist != DIST_ZIPF) && (key_dist != DIST_FEW)) {
+     return;
+   }
+   for (half = 0; half < ((key_type == KEY_PAIR) ? 2 : 1); half++) {
+     if (key_dist == DIST_ZIPF) {
+       /* keys below K, where t = shape_uniform(j/8) falls */
+       for (j = 1; j < 8; j++) {
+         t = shape_uniform(j / 8.0, 0);
+         if (key_type == KEY_INT) {
+           k = ceil(t * max_key);
+           x = k / max_key;
+         } else {
+           /* a float key is below k if it was rounded from below cut */
+           k = (key_type == KEY_PAIR) ? ceil((2.0 * t - 1.0) * max_key) :
+                                        gen_value(t);
+           cut = (key_type == KEY_FLOAT) ? (k + nextafterf(k, -INFINITY)) / 2.0 : k;
+           x = (cut / max_key + 1.0) / 2.0;
+           if (x < 0.0) {
+             x = 0.0;
+           }
+         }
+         x = log(x * (max_key + 1.0) + 1.0) / log(max_key + 1.0);
+         if (x > 1.0) {
+           x = 1.0;
+         }
+         below = 0;
+         for (i = 0; i < n; i++) {
+           if (key_part(keys, i, half) < k) {
+             below++;
+           }
+         }
+         mistake += dist_count(below, n, x);
+       }
+     } else {
+       /* FEW_UNIQUE equally likely values, some equal if max_key is small */
+       distinct = 0;
+       for (c = 0; c < FEW_UNIQUE; c++) {
+         x = gen_value((double) c / FEW_UNIQUE);
+         for (j = 0; (j < distinct) && (value[j] != x); j++)
+           ;
+         if (j == distinct) {
+           value[distinct] = x;
+           mult[distinct] = 0;
+           count[distinct] = 0;
+           distinct++;
+         }
+         mult[j]++;
+       }
+       for (i = 0; i < n; i++) {
+         x = key_part(keys, i, half);
+         for (j = 0; (j < distinct) && (value[j] != x); j++)
+           ;
+         if (j == distinct) {
+           mistake++;
+         } else {
+           count[j]++;
+         }
+       }
+       for (j = 0; j < distinct; j++) {
+         mistake += dist_count(count[j], n, (double) mult[j] / FEW_UNIQUE);
+       }
+     }
+   }
+
+   if (mistake) {
+      printf("FAILED: Key histogram does not match the %s distribution.\n",
+             (key_dist == DIST_ZIPF) ? "zipf" : "few");
+   } else {
+      printf("PASSED: Key histogram matches the %s distribution.\n",
+             (key_dist == DIST_ZIPF) ? "zipf" : "few");
+   }
+   printf("\n");
+}
+
 void printout()
 {
    int32_t i;
-   int32_t *key_final;
 
-   key_final = (int32_t *) key[global->final];
    printf("\n");
    printf("                 SORTED KEY VALUES\n");
-   printf("%8d ",key_final[0]);
+   print_key(stdout, key[global->final], 0);
    for (i = 0; i < num_keys-1; i++) {
-     printf("%8d ",key_final[i+1]);
+     print_key(stdout, key[global->final], i+1);
      if ((i+2)%5 == 0) {
        printf("\n");
      }
@@ -1479,3 +2143,697 @@ void printout()
    printf("\n");
 }
 
+/*
+ * partition_keys() splits n keys as evenly as possible among the
+ * processors.
+ */
+void partition_keys(int32_t n)
+{
+   int32_t p;
+   int32_t quotient;
+   int32_t remainder;
+   int32_t sum_i;
+   int32_t sum_f;
+
+   quotient = n / number_of_processors;
+   remainder = n % number_of_processors;
+   sum_i = 0;
+   sum_f = 0;
+   p = 0;
+   while (sum_i < n) {
+      key_partition[p] = sum_i;
+      p++;
+      sum_i = sum_i + quotient;
+      sum_f = sum_f + remainder;
+      sum_i = sum_i + sum_f / number_of_processors;
+      sum_f = sum_f % number_of_processors;
+   }
+   while (p <= number_of_processors) {
+      key_partition[p] = n;
+      p++;
+   }
+}
+
+/*
+ * run_processors() runs proc on every processor, the caller acting as
+ * processor 0 once the others are created, and waits for all of them.
+ */
+void run_processors(void (*proc)(void))
+{
+	int32_t i;
+	int32_t Error;
+
+	global->Index = 0;
+	for (i = 0; i < (number_of_processors) - 1; i++) {
+
+		Error = pthread_create(&PThreadTable[i], NULL, (void * (*)(void *))(proc), NULL);
+
+		if (Error != 0) {
+
+			printf("Error in pthread_create().\n");
+
+			exit(-1);
+
+		}
+
+	}
+
+	proc();
+
+	for (i = 0; i < (number_of_processors) - 1; i++) {
+
+		Error = pthread_join(PThreadTable[i], NULL);
+
+		if (Error != 0) {
+
+			printf("Error in pthread_join().\n");
+
+			exit(-1);
+
+		}
+
+	}
+}
+
+double seconds()
+{
+   struct timeval FullTime;
+
+   gettimeofday(&FullTime, NULL);
+   return FullTime.tv_sec + FullTime.tv_usec * 1.0e-6;
+}
+
+/*
+ * read_all() and write_all() transfer bytes at offset, retrying short
+ * transfers.
+ */
+void read_all(int32_t fd, char *buf, int64_t bytes, int64_t offset)
+{
+   ssize_t done;
+
+   while (bytes > 0) {
+     done = pread(fd, buf, (size_t) bytes, (off_t) offset);
+     if (done <= 0) {
+       perror("ERROR: pread");
+       exit(-1);
+     }
+     buf += done;
+     bytes -= done;
+     offset += done;
+   }
+}
+
+void write_all(int32_t fd, char *buf, int64_t bytes, int64_t offset)
+{
+   ssize_t done;
+
+   while (bytes > 0) {
+     done = pwrite(fd, buf, (size_t) bytes, (off_t) offset);
+     if (done <= 0) {
+       perror("ERROR: pwrite");
+       exit(-1);
+     }
+     buf += done;
+     bytes -= done;
+     offset += done;
+   }
+}
+
+void write_keys(char *name, void *keys, int64_t n)
+{
+   int32_t fd;
+
+   fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+   if (fd < 0) {
+     perror(name);
+     exit(-1);
+   }
+   write_all(fd, (char *) keys, n * (key_bits / 8), 0);
+   close(fd);
+}
+
+/*
+ * ext_partition() is run by every processor over its share of the
+ * mapped input.  Each key goes to the bucket named by the top bits of
+ * its ordered form; keys are gathered in a per-bucket buffer that is
+ * flushed with pwrite at an offset reserved by fetch-and-add, so the
+ * bucket histogram falls out of the same pass.  Run files hold raw
+ * keys, and the bucket sort transforms them as usual.
+ */
+void ext_partition()
+{
+   int32_t MyNum;
+   int32_t b;
+   int32_t bad = 0;
+   int32_t key_size = key_bits / 8;
+   int64_t i;
+   int64_t key_start;
+   int64_t key_stop;
+   int64_t offset;
+   int32_t *fill;
+   char *buf;
+   uint32_t *src32;
+   uint64_t *src64;
+   uint32_t *dst32;
+   uint64_t *dst64;
+
+   {pthread_mutex_lock(&(global->lock_Index));}
+     MyNum = global->Index;
+     global->Index++;
+   {pthread_mutex_unlock(&(global->lock_Index));}
+
+   key_start = ext.total_keys * MyNum / number_of_processors;
+   key_stop = ext.total_keys * (MyNum + 1) / number_of_processors;
+   fill = (int32_t *) calloc(ext.num_buckets, sizeof(int32_t));
+   buf = (char *) malloc((size_t) ext.num_buckets * ext.buf_keys * key_size);
+   if ((fill == NULL) || (buf == NULL)) {
+     fprintf(stderr,"ERROR: Cannot malloc enough memory for bucket buffers\n");
+     exit(-1);
+   }
+
+   src32 = (uint32_t *) ext.map;
+   src64 = (uint64_t *) ext.map;
+   dst32 = (uint32_t *) buf;
+   dst64 = (uint64_t *) buf;
+   for (i = key_start; i < key_stop; i++) {
+     if (key_bits == 64) {
+       b = (int32_t) (encode64(src64[i]) >> ext.ext_shift);
+     } else if (key_type == KEY_FLOAT) {
+       b = (int32_t) (encode32(src32[i]) >> ext.ext_shift);
+     } else {
+       b = (int32_t) (src32[i] >> ext.ext_shift);
+     }
+     if ((b < 0) || (b >= ext.num_buckets)) {
+       bad++;
+       continue;
+     }
+     if (key_bits == 64) {
+       dst64[(int64_t) b * ext.buf_keys + fill[b]] = src64[i];
+     } else {
+       dst32[(int64_t) b * ext.buf_keys + fill[b]] = src32[i];
+     }
+     fill[b]++;
+     if (fill[b] == ext.buf_keys) {
+       offset = __sync_fetch_and_add(&ext.bucket_fill[b], (int64_t) fill[b]);
+       write_all(ext.run_fd[b], buf + (int64_t) b * ext.buf_keys * key_size,
+                 (int64_t) fill[b] * key_size, offset * key_size);
+       fill[b] = 0;
+     }
+   }
+   for (b = 0; b < ext.num_buckets; b++) {
+     if (fill[b] != 0) {
+       offset = __sync_fetch_and_add(&ext.bucket_fill[b], (int64_t) fill[b]);
+       write_all(ext.run_fd[b], buf + (int64_t) b * ext.buf_keys * key_size,
+                 (int64_t) fill[b] * key_size, offset * key_size);
+     }
+   }
+   if (bad != 0) {
+     __sync_fetch_and_add(&ext.bad_keys, bad);
+   }
+
+   free(buf);
+   free(fill);
+}
+
+/*
+ * ext_io_worker() writes the previously sorted bucket and reads the
+ * next one while the processors sort the current bucket.
+ */
+void *ext_io_worker(void *arg)
+{
+   struct ext_io *io = (struct ext_io *) arg;
+   int32_t key_size = key_bits / 8;
+
+   if (io->write_buf != NULL) {
+     write_all(io->out_fd, io->write_buf, io->write_keys * key_size,
+               io->write_offset * key_size);
+   }
+   if (io->read_buf != NULL) {
+     read_all(ext.run_fd[io->read_bucket], io->read_buf,
+              ext.bucket_fill[io->read_bucket] * key_size, 0);
+     close(ext.run_fd[io->read_bucket]);
+     ext.run_fd[io->read_bucket] = -1;
+   }
+
+   return NULL;
+}
+
+/*
+ * ext_ordered() is the ordered form of key i, whose top bits name its
+ * bucket.
+ */
+uint64_t ext_ordered(char *keys, int64_t i)
+{
+   if (key_bits == 64) {
+     return encode64(((uint64_t *) keys)[i]);
+   } else if (key_type == KEY_FLOAT) {
+     return encode32(((uint32_t *) keys)[i]);
+   } else {
+     return ((uint32_t *) keys)[i];
+   }
+}
+
+/*
+ * ext_sort_keys() sorts the n keys in buf, which agree on all but their
+ * low shift bits, with scratch as the second array, and returns the
+ * array that holds the result.
+ */
+char *ext_sort_keys(char *buf, char *scratch, int64_t n, int32_t shift)
+{
+   num_keys = (int32_t) n;
+   partition_keys(num_keys);
+   key[0] = (int32_t *) buf;
+   key[1] = (int32_t *) scratch;
+   key64[0] = (uint64_t *) buf;
+   key64[1] = (uint64_t *) scratch;
+   max_num_digits = (shift + log2_radix - 1) / log2_radix;
+   if (max_num_digits < 1) {
+     max_num_digits = 1;
+   }
+   run_processors(slave_sort);
+   return (global->final == 0) ? buf : scratch;
+}
+
+/*
+ * ext_copy() copies the n keys of run file fd to out_fd at key
+ * out_offset through buf, cap keys at a time, and closes fd.
+ */
+void ext_copy(int32_t fd, int64_t n, int32_t out_fd, int64_t out_offset,
+              char *buf, int64_t cap)
+{
+   int32_t key_size = key_bits / 8;
+   int64_t done;
+   int64_t len;
+
+   for (done = 0; done < n; done += len) {
+     len = (n - done < cap) ? n - done : cap;
+     read_all(fd, buf, len * key_size, done * key_size);
+     write_all(out_fd, buf, len * key_size, (out_offset + done) * key_size);
+   }
+   close(fd);
+}
+
+/*
+ * ext_split() sorts the n keys of run file fd, which are too many for
+ * the cap keys of buf, into out_fd at key out_offset, and closes fd.
+ * The keys agree on all but their low shift bits; they are bucketed
+ * again on the next bucket_bits of those into new run files.  A new
+ * bucket whose keys are all equal is copied to the output as it is,
+ * one that fits in buf is sorted there (with scratch) and one that
+ * still does not fit is split again, so one key value or a narrow
+ * range holding more keys than memory is never sorted in memory.
+ */
+void ext_split(int32_t fd, int64_t n, int32_t shift, int32_t out_fd,
+               int64_t out_offset, char *buf, char *scratch, int64_t cap)
+{
+   int32_t s;
+   int32_t sub_bits;
+   int32_t sub_shift;
+   int32_t num_sub;
+   int32_t buf_keys;
+   int32_t key_size = key_bits / 8;
+   int32_t *sub_fd;
+   int32_t *fill;
+   int32_t *same;
+   int64_t i;
+   int64_t done;
+   int64_t len;
+   int64_t offset;
+   int64_t *sub_keys;
+   uint64_t o;
+   uint64_t *first;
+   char *wbuf;
+   char *sorted;
+   char name[4096];
+
+   if (shift == 0) {
+     /* the keys of a bucket on every bit are all equal */
+     ext_copy(fd, n, out_fd, out_offset, buf, cap);
+     return;
+   }
+   ext.splits++;
+   sub_bits = (bucket_bits < shift) ? bucket_bits : shift;
+   sub_shift = shift - sub_bits;
+   num_sub = 1 << sub_bits;
+   buf_keys = EXT_BUFFER_BYTES / key_size;
+   if ((int64_t) num_sub * EXT_BUFFER_BYTES > (16 << 20)) {
+     buf_keys = (16 << 20) / num_sub / key_size;
+   }
+   sub_fd = (int32_t *) malloc(num_sub * sizeof(int32_t));
+   fill = (int32_t *) calloc(num_sub, sizeof(int32_t));
+   same = (int32_t *) malloc(num_sub * sizeof(int32_t));
+   sub_keys = (int64_t *) calloc(num_sub, sizeof(int64_t));
+   first = (uint64_t *) malloc(num_sub * sizeof(uint64_t));
+   wbuf = (char *) malloc((size_t) num_sub * buf_keys * key_size);
+   if ((sub_fd == NULL) || (fill == NULL) || (same == NULL) ||
+       (sub_keys == NULL) || (first == NULL) || (wbuf == NULL)) {
+     fprintf(stderr,"ERROR: Cannot malloc enough memory for bucket buffers\n");
+     exit(-1);
+   }
+   for (s = 0; s < num_sub; s++) {
+     snprintf(name, sizeof(name), "%s/radix.%d.split.%d.run", run_dir, (int) getpid(), s);
+     sub_fd[s] = open(name, O_RDWR | O_CREAT | O_TRUNC, 0600);
+     if (sub_fd[s] < 0) {
+       perror(name);
+       exit(-1);
+     }
+     unlink(name);    /* removed once closed */
+   }
+
+   /* Bucket the run file on the next bits, noting whether each new
+      bucket holds a single key value. */
+
+   for (done = 0; done < n; done += len) {
+     len = (n - done < cap) ? n - done : cap;
+     read_all(fd, buf, len * key_size, done * key_size);
+     for (i = 0; i < len; i++) {
+       o = ext_ordered(buf, i);
+       s = (int32_t) ((o >> sub_shift) & (num_sub - 1));
+       if (sub_keys[s] + fill[s] == 0) {
+         first[s] = o;
+         same[s] = 1;
+       } else if (o != first[s]) {
+         same[s] = 0;
+       }
+       memcpy(wbuf + ((int64_t) s * buf_keys + fill[s]) * key_size,
+              buf + i * key_size, key_size);
+       fill[s]++;
+       if (fill[s] == buf_keys) {
+         write_all(sub_fd[s], wbuf + (int64_t) s * buf_keys * key_size,
+                   (int64_t) fill[s] * key_size, sub_keys[s] * key_size);
+         sub_keys[s] += fill[s];
+         fill[s] = 0;
+       }
+     }
+   }
+   for (s = 0; s < num_sub; s++) {
+     if (fill[s] != 0) {
+       write_all(sub_fd[s], wbuf + (int64_t) s * buf_keys * key_size,
+                 (int64_t) fill[s] * key_size, sub_keys[s] * key_size);
+       sub_keys[s] += fill[s];
+     }
+   }
+   close(fd);
+   free(wbuf);
+
+   offset = out_offset;
+   for (s = 0; s < num_sub; s++) {
+     if (sub_keys[s] == 0) {
+       close(sub_fd[s]);
+     } else if (same[s]) {
+       ext_copy(sub_fd[s], sub_keys[s], out_fd, offset, buf, cap);
+     } else if (sub_keys[s] <= cap) {
+       read_all(sub_fd[s], buf, sub_keys[s] * key_size, 0);
+       close(sub_fd[s]);
+       sorted = ext_sort_keys(buf, scratch, sub_keys[s], sub_shift);
+       write_all(out_fd, sorted, sub_keys[s] * key_size, offset * key_size);
+     } else {
+       ext_split(sub_fd[s], sub_keys[s], sub_shift, out_fd, offset, buf,
+                 scratch, cap);
+     }
+     offset += sub_keys[s];
+   }
+
+   free(sub_fd);
+   free(fill);
+   free(same);
+   free(sub_keys);
+   free(first);
+}
+
+/*
+ * ext_sort() sorts the file ext_file into out_file.  Buckets are sorted
+ * in order by slave_sort() on the bits below the bucket bits, using
+ * EXT_BUFFERS buffers so that one bucket is read and the previous one
+ * written while the current one is sorted.  Buckets too large for a
+ * buffer are first split again by ext_split() straight into their place
+ * in the output.
+ */
+void ext_sort()
+{
+   int32_t i;
+   int32_t b;
+   int32_t fd;
+   int32_t out_fd;
+   int32_t Error;
+   int32_t sig_bits;
+   int32_t key_size = key_bits / 8;
+   int32_t cur;
+   int32_t scratch;
+   int32_t next;
+   int32_t prev;
+   int64_t buf_cap;
+   int64_t offset;
+   int64_t *start;
+   int64_t prev_keys;
+   int64_t prev_offset;
+   int64_t largest;
+   int64_t bytes;
+   char name[4096];
+   char *buffer[EXT_BUFFERS];
+   struct stat st;
+   struct rlimit rl;
+   struct ext_io io;
+   pthread_t io_thread;
+   double t0, t1, t2;
+   void *out_map;
+
+   fd = open(ext_file, O_RDONLY);
+   if ((fd < 0) || (fstat(fd, &st) != 0)) {
+     perror(ext_file);
+     exit(-1);
+   }
+   if ((st.st_size == 0) || (st.st_size % key_size != 0)) {
+     fprintf(stderr,"ERROR: %s is not a whole number of %d-byte keys\n",
+             ext_file, key_size);
+     exit(-1);
+   }
+   bytes = st.st_size;
+   ext.total_keys = bytes / key_size;
+   ext.map = (char *) mmap(NULL, (size_t) bytes, PROT_READ, MAP_SHARED, fd, 0);
+   if (ext.map == (char *) MAP_FAILED) {
+     perror("ERROR: mmap");
+     exit(-1);
+   }
+   madvise(ext.map, (size_t) bytes, MADV_SEQUENTIAL);
+   close(fd);
+
+   /* Integer keys only use the bits up to the maximum key. */
+   if (key_type == KEY_INT) {
+     sig_bits = 1;
+     while ((sig_bits < 31) && ((max_key >> sig_bits) != 0)) {
+       sig_bits++;
+     }
+   } else {
+     sig_bits = key_bits;
+   }
+   if (bucket_bits > sig_bits) {
+     bucket_bits = sig_bits;
+   }
+   ext.num_buckets = 1 << bucket_bits;
+   ext.ext_shift = sig_bits - bucket_bits;
+   ext.buf_keys = EXT_BUFFER_BYTES / key_size;
+   if ((int64_t) ext.num_buckets * EXT_BUFFER_BYTES > (16 << 20)) {
+     /* keep each processor's buffers near 16 MB */
+     ext.buf_keys = (16 << 20) / ext.num_buckets / key_size;
+   }
+   ext.bad_keys = 0;
+   ext.splits = 0;
+   ext.run_fd = (int32_t *) malloc(ext.num_buckets * sizeof(int32_t));
+   ext.bucket_fill = (int64_t *) calloc(ext.num_buckets, sizeof(int64_t));
+   if ((ext.run_fd == NULL) || (ext.bucket_fill == NULL)) {
+     fprintf(stderr,"ERROR: Cannot malloc enough memory for buckets\n");
+     exit(-1);
+   }
+   /* one descriptor per bucket, so lift the soft limit if it is low */
+   if ((getrlimit(RLIMIT_NOFILE, &rl) == 0) &&
+       (rl.rlim_cur < (rlim_t) ext.num_buckets + 64)) {
+     rl.rlim_cur = rl.rlim_max;
+     setrlimit(RLIMIT_NOFILE, &rl);
+   }
+   for (b = 0; b < ext.num_buckets; b++) {
+     snprintf(name, sizeof(name), "%s/radix.%d.%d.run", run_dir, (int) getpid(), b);
+     ext.run_fd[b] = open(name, O_RDWR | O_CREAT | O_TRUNC, 0600);
+     if (ext.run_fd[b] < 0) {
+       perror(name);
+       exit(-1);
+     }
+     unlink(name);    /* removed once closed */
+   }
+
+   if (out_file == NULL) {
+     snprintf(name, sizeof(name), "%s.sorted", ext_file);
+     out_file = strdup(name);
+   }
+   out_fd = open(out_file, O_RDWR | O_CREAT | O_TRUNC, 0644);
+   if ((out_fd < 0) || (ftruncate(out_fd, (off_t) bytes) != 0)) {
+     perror(out_file);
+     exit(-1);
+   }
+
+   printf("\n");
+   printf("Integer Radix Sort (external)\n");
+   printf("     %ld Keys in %s\n",(long) ext.total_keys,ext_file);
+   printf("     Key type = %s\n",(key_type == KEY_INT) ? "int" :
+                                  (key_type == KEY_FLOAT) ? "float" :
+                                  (key_type == KEY_DOUBLE) ? "double" : "pair");
+   printf("     %d Processors\n",number_of_processors);
+   printf("     Radix = %d\n",radix);
+   printf("     %d Buckets\n",ext.num_buckets);
+   printf("     Bucket memory = %ld MB\n",(long) ext_mem);
+   printf("\n");
+
+   /* Pass 1: bucket the mapped file into run files. */
+
+   t0 = seconds();
+   run_processors(ext_partition);
+   munmap(ext.map, (size_t) bytes);
+   if (ext.bad_keys != 0) {
+     fprintf(stderr,"ERROR: %d keys are negative or exceed the maximum key\n",
+             ext.bad_keys);
+     exit(-1);
+   }
+   t1 = seconds();
+
+   /* Pass 2: sort each bucket in memory on the remaining bits. */
+
+   buf_cap = (ext_mem << 20) / EXT_BUFFERS / key_size;
+   if (buf_cap > INT32_MAX) {
+     buf_cap = INT32_MAX;
+   }
+   largest = 0;
+   for (b = 0; b < ext.num_buckets; b++) {
+     if (ext.bucket_fill[b] > largest) {
+       largest = ext.bucket_fill[b];
+     }
+   }
+   if (buf_cap > largest) {
+     buf_cap = (largest > 0) ? largest : 1;
+   }
+   for (i = 0; i < EXT_BUFFERS; i++) {
+     buffer[i] = (char *) malloc((size_t) buf_cap * key_size);
+     if (buffer[i] == NULL) {
+       fprintf(stderr,"ERROR: Cannot malloc enough memory for bucket sort\n");
+       exit(-1);
+     }
+   }
+
+   /* Find where each bucket goes, and sort the empty and oversized ones
+      out of the way; the rest are left with an open run file. */
+
+   start = (int64_t *) malloc(ext.num_buckets * sizeof(int64_t));
+   if (start == NULL) {
+     fprintf(stderr,"ERROR: Cannot malloc enough memory for buckets\n");
+     exit(-1);
+   }
+   offset = 0;
+   for (b = 0; b < ext.num_buckets; b++) {
+     start[b] = offset;
+     offset += ext.bucket_fill[b];
+     if (ext.bucket_fill[b] == 0) {
+       close(ext.run_fd[b]);
+       ext.run_fd[b] = -1;
+     } else if (ext.bucket_fill[b] > buf_cap) {
+       ext_split(ext.run_fd[b], ext.bucket_fill[b], ext.ext_shift, out_fd,
+                 start[b], buffer[0], buffer[1], buf_cap);
+       ext.run_fd[b] = -1;
+     }
+   }
+
+   b = 0;
+   while ((b < ext.num_buckets) && (ext.run_fd[b] < 0)) {
+     b++;
+   }
+   cur = 0;
+   prev = -1;
+   prev_keys = 0;
+   prev_offset = 0;
+   if (b < ext.num_buckets) {
+     io.write_buf = NULL;
+     io.read_buf = buffer[cur];
+     io.read_bucket = b;
+     ext_io_worker(&io);
+   }
+   while (b < ext.num_buckets) {
+
+     /* cur holds bucket b and prev the last sorted bucket, which is
+        written while b is sorted; scratch and next are free. */
+
+     scratch = 0;
+     while ((scratch == cur) || (scratch == prev)) {
+       scratch++;
+     }
+     next = 0;
+     while ((next == cur) || (next == prev) || (next == scratch)) {
+       next++;
+     }
+     i = b + 1;
+     while ((i < ext.num_buckets) && (ext.run_fd[i] < 0)) {
+       i++;
+     }
+
+     io.out_fd = out_fd;
+     io.write_buf = (prev >= 0) ? buffer[prev] : NULL;
+     io.write_keys = prev_keys;
+     io.write_offset = prev_offset;
+     io.read_buf = (i < ext.num_buckets) ? buffer[next] : NULL;
+     io.read_bucket = i;
+     Error = pthread_create(&io_thread, NULL, ext_io_worker, &io);
+     if (Error != 0) {
+       printf("Error in pthread_create().\n");
+       exit(-1);
+     }
+
+     ext_sort_keys(buffer[cur], buffer[scratch], ext.bucket_fill[b],
+                   ext.ext_shift);
+
+     Error = pthread_join(io_thread, NULL);
+     if (Error != 0) {
+       printf("Error in pthread_join().\n");
+       exit(-1);
+     }
+
+     prev = (global->final == 0) ? cur : scratch;
+     prev_keys = ext.bucket_fill[b];
+     prev_offset = start[b];
+     cur = next;
+     b = i;
+   }
+   if (prev >= 0) {
+     io.write_buf = buffer[prev];
+     io.write_keys = prev_keys;
+     io.write_offset = prev_offset;
+     io.read_buf = NULL;
+     ext_io_worker(&io);
+   }
+   t2 = seconds();
+   close(out_fd);
+
+   printf("                 TIMING INFORMATION\n");
+   printf("Partition pass (s)                : %16.3f  (%.3f GB/s)\n",
+          t1 - t0, bytes / (t1 - t0) * 1.0e-9);
+   printf("Bucket sort pass (s)              : %16.3f  (%.3f GB/s)\n",
+          t2 - t1, bytes / (t2 - t1) * 1.0e-9);
+   printf("Total time (s)                    : %16.3f  (%.3f GB/s)\n",
+          t2 - t0, bytes / (t2 - t0) * 1.0e-9);
+   printf("Largest bucket                    : %16ld keys\n",(long) largest);
+   printf("Buckets split again               : %16d\n",ext.splits);
+   printf("\n");
+
+   if (test_result) {
+     fd = open(out_file, O_RDONLY);
+     out_map = mmap(NULL, (size_t) bytes, PROT_READ, MAP_SHARED, fd, 0);
+     if ((fd < 0) || (out_map == MAP_FAILED)) {
+       perror(out_file);
+       exit(-1);
+     }
+     test_sort(out_map, ext.total_keys);
+     munmap(out_map, (size_t) bytes);
+     close(fd);
+   }
+
+   for (i = 0; i < EXT_BUFFERS; i++) {
+     free(buffer[i]);
+   }
+   free(start);
+}